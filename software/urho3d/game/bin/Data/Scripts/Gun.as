@@ -20,6 +20,8 @@ class Gun : ScriptObject
                 controller.Play("Models/Gun_PewPew.ani", 0, false, 0.0f);
                 controller.SetSpeed("Models/Gun_PewPew.ani", 1);
                 controller.SetTime("Models/Gun_PewPew.ani", 0);
+
+                Fire();
             }
         }
 
@@ -30,10 +32,24 @@ class Gun : ScriptObject
         node.set_rotation(correctRotation_ * recoilRotation);
     }
 
+    void Fire()
+    {
+        // Projectiles are simulated natively so they follow the gravity field
+        ProjectileSystem@ projectiles = cast<ProjectileSystem>(scene.GetComponent("ProjectileSystem", true));
+        if(projectiles is null)
+            return;
+
+        Vector3 direction = node.worldRotation * Vector3(0, 0, 1);
+        projectiles.Fire(node.worldPosition + direction * muzzleOffset_, direction * muzzleSpeed_, projectileLifetime_);
+    }
+
     // Correct rotation of the gun so it is aligned properly
     private Quaternion correctRotation_ = Quaternion(0, Vector3(0, 1, 0));
     private float recoil_ = 0;
     private float targetRecoil_ = 0;
     private float counter_ = 0;
+    private float muzzleOffset_ = 0.5;     // m in front of the gun
+    private float muzzleSpeed_ = 80;       // m/s
+    private float projectileLifetime_ = 5; // s
 }
 
@@ -9,9 +9,16 @@ public:
     Urho3D::StringVector resourcePaths_;
     Urho3D::String sceneName_;
     Urho3D::String networkAddress_;
+    Urho3D::String recordGravityFile_;
+    Urho3D::String replayGravityFile_;
+    Urho3D::String recordInputFile_;
+    Urho3D::String replayInputFile_;
     unsigned short networkPort_;
+    unsigned loadTestBots_;
+    unsigned loadTestStep_;
     bool editor_;
     bool server_;
+    bool connect_;
     bool fullscreen_;
     bool vsync_;
     int multisample_;
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <Urho3D/Scene/Component.h>
+
+namespace Urho3D {
+    class Context;
+    class Node;
+}
+class MovementController;
+
+/*!
+ * @brief Spawns characters that are controlled by synthetic input instead of
+ * a player. Used to put load on a server, see BotLoadTest.
+ *
+ * Each bot is a MovementController fed one InputCommand per physics tick
+ * (MovementController::INPUT_REMOTE). Bots cycle through the behaviours in
+ * order of creation. Random decisions come from the driver's own generator,
+ * so the same seed and bot count always produce the same input.
+ */
+class BotDriver : public Urho3D::Component
+{
+    URHO3D_OBJECT(BotDriver, Urho3D::Component)
+
+public:
+    enum Behaviour
+    {
+        /// Walks forward and randomly changes direction and speed
+        WANDER,
+        /// Same as WANDER, but jumps about once per second
+        JUMP,
+        /// Same as WANDER, but randomly crouches and stands up again
+        CROUCH,
+        /// Runs straight ahead forever. Gravity bends the path around
+        /// whatever planet the bot is standing on.
+        ORBIT,
+
+        NUM_BEHAVIOURS
+    };
+
+    /*!
+     * @brief Constructs a new bot driver.
+     */
+    BotDriver(Urho3D::Context* context);
+
+    /*!
+     * @brief Destructs the bot driver and removes all bots.
+     */
+    virtual ~BotDriver();
+
+    /*!
+     * @brief Registers this class as an object factory.
+     */
+    static void RegisterObject(Urho3D::Context* context);
+
+    /*!
+     * @brief Spawns or removes bots until there are this many. New bots are
+     * placed on a grid around the spawn position.
+     */
+    void SetBotCount(unsigned count);
+
+    unsigned GetBotCount() const
+            { return bots_.Size(); }
+
+    void SetSpawnPosition(const Urho3D::Vector3& position)
+            { spawnPosition_ = position; }
+
+    /*!
+     * @brief If enabled, new bots also get a player model and a
+     * PlayerAnimationStatesController, like players do.
+     */
+    void SetAnimated(bool enable)
+            { isAnimated_ = enable; }
+
+    /// The generator gets stuck on 0, so 0 is replaced with 1
+    void SetSeed(unsigned seed)
+            { randomState_ = seed ? seed : 1; }
+
+protected:
+    virtual void OnSceneSet(Urho3D::Scene* scene) override;
+
+private:
+    struct Bot
+    {
+        Urho3D::SharedPtr<Urho3D::Node> node_;
+        Urho3D::WeakPtr<MovementController> controller_;
+        Behaviour behaviour_;
+        // Camera Y angle the bot walks towards
+        float heading_;
+        // Time until the next random decision
+        float timer_;
+        unsigned sequence_;
+        unsigned char buttons_;
+    };
+
+    void CreateBot();
+    void UpdateBot(Bot* bot, float timeStep);
+    // Returns a random number in [0, 1)
+    float NextRandom();
+
+    void HandlePhysicsPreStep(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+
+    Urho3D::Vector<Bot> bots_;
+    Urho3D::Vector3 spawnPosition_;
+    unsigned randomState_;
+    bool isAnimated_;
+};
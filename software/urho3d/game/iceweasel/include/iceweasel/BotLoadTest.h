@@ -0,0 +1,52 @@
+#pragma once
+
+#include "iceweasel/TickProfiler.h"
+
+#include <Urho3D/Core/Object.h>
+
+namespace Urho3D {
+    class Scene;
+}
+
+/*!
+ * @brief Finds how many characters a headless server can simulate at its
+ * fixed tick rate.
+ *
+ * Loads a scene, then ramps up the number of bots (see BotDriver) step by
+ * step. Every step is warmed up and then measured for a few seconds of
+ * simulated time, running ticks back to back. The test stops at the first
+ * step where the 95th percentile of the frame time exceeds the time budget
+ * of one tick (1 / physics FPS).
+ */
+class BotLoadTest : public Urho3D::Object
+{
+    URHO3D_OBJECT(BotLoadTest, Urho3D::Object)
+
+public:
+    BotLoadTest(Urho3D::Context* context);
+
+    /*!
+     * @brief Runs the test and prints a report to stdout.
+     * @param[in] maxBots The test stops after this many bots, even if the
+     * budget was never exceeded.
+     * @param[in] step Number of bots to add per step.
+     * @return Returns 0 if the test ran and 2 if the scene couldn't be loaded.
+     */
+    int Run(const Urho3D::String& sceneName, unsigned maxBots, unsigned step);
+
+    /// Simulated seconds per step before measuring
+    void SetWarmupTime(float seconds)
+            { warmupTime_ = seconds; }
+
+    /// Simulated seconds per step that are measured
+    void SetMeasureTime(float seconds)
+            { measureTime_ = seconds; }
+
+private:
+    void RunFrames(float seconds, float timeStep);
+
+    Urho3D::SharedPtr<Urho3D::Scene> scene_;
+    Urho3D::SharedPtr<TickProfiler> profiler_;
+    float warmupTime_;
+    float measureTime_;
+};
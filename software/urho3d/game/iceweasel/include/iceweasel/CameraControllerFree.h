@@ -6,6 +6,8 @@ namespace Urho3D {
     class Input;
 }
 
+class GravityManager;
+
 class CameraControllerFree : public Urho3D::LogicComponent
 {
     URHO3D_OBJECT(CameraControllerFree, Urho3D::LogicComponent)
@@ -14,11 +16,13 @@ public:
 
 private:
     virtual void Start() override;
+    virtual void Stop() override;
     virtual void Update(float timeStep) override;
 
     void HandleCameraAngleChanged(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
 
     Urho3D::SharedPtr<Urho3D::Input> input_;
+    Urho3D::SharedPtr<GravityManager> gravityManager_;
     Urho3D::Vector3 currentVelocity_;
     float cameraAngleY_;
 };
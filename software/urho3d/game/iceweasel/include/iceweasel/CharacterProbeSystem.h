@@ -0,0 +1,170 @@
+#pragma once
+
+#include "iceweasel/UpdateRateScheduler.h"
+
+#include <Urho3D/Scene/Component.h>
+
+namespace Urho3D {
+    class Context;
+    class Node;
+    class PhysicsWorld;
+    class RigidBody;
+}
+
+/*!
+ * @brief Input and output of the ground and ceiling probes of one character.
+ *
+ * The owner fills in the shape of its body and its inputs, and reads back the
+ * results after CharacterProbeSystem::UpdateProbes() ran.
+ */
+struct CharacterProbe
+{
+    CharacterProbe() :
+        body_(NULL),
+        node_(NULL),
+        height_(0.0f),
+        radius_(0.0f),
+        standHeight_(0.0f),
+        updateInterval_(1),
+        probeGround_(true),
+        isCrouching_(false),
+        index_(M_MAX_UNSIGNED),
+        substep_(0),
+        isUpdated_(false),
+        isOnGround_(false),
+        hasGroundPosition_(false),
+        hitsCeiling_(false),
+        canStandUp_(true)
+    {}
+
+    // Input. The body is excluded from its own probes.
+    Urho3D::RigidBody* body_;
+    Urho3D::Node* node_;
+    /// Current height of the body
+    float height_;
+    /// Current radius of the body
+    float radius_;
+    /// Height the body needs to stand up
+    float standHeight_;
+    /// Ticks between two ground probes, see UpdateRateScheduler
+    unsigned updateInterval_;
+    /// Set to false to skip the ground and ceiling probes in the batch
+    bool probeGround_;
+    /// Only crouching characters probe whether they can stand up
+    bool isCrouching_;
+
+    // Managed by CharacterProbeSystem
+    unsigned index_;
+    unsigned substep_;
+    UpdateRateTimer timer_;
+
+    // Output
+    /// Set if the ground and ceiling probes ran during this substep
+    bool isUpdated_;
+    bool isOnGround_;
+    /// Set if a ray straight down hit the ground. See groundPosition_
+    bool hasGroundPosition_;
+    bool hitsCeiling_;
+    bool canStandUp_;
+    Urho3D::Vector3 groundPosition_;
+    Urho3D::Vector3 groundNormal_;
+};
+
+/*!
+ * @brief Runs the ground and ceiling probes of all characters in one batch.
+ *
+ * Characters register a CharacterProbe. Once every character has filled in
+ * its probe inputs for a physics substep, MovementSystem calls UpdateProbes()
+ * to run the probes of every registered character. Casts go
+ * straight to Bullet and exclude each character's own body with a filter
+ * callback, so the body's collision mask is never touched (changing it
+ * re-adds the body to the broadphase).
+ *
+ * Ground probes follow each probe's update interval. The stand up probe of a
+ * crouching character runs every substep.
+ */
+class CharacterProbeSystem : public Urho3D::Component
+{
+    URHO3D_OBJECT(CharacterProbeSystem, Urho3D::Component)
+
+public:
+
+    /*!
+     * @brief Constructs a new character probe system.
+     */
+    CharacterProbeSystem(Urho3D::Context* context);
+
+    /*!
+     * @brief Destructs the character probe system.
+     */
+    virtual ~CharacterProbeSystem();
+
+    /*!
+     * @brief Registers this class as an object factory.
+     */
+    static void RegisterObject(Urho3D::Context* context);
+
+    /*!
+     * @brief Adds a probe to the batch. The probe must be removed again before
+     * it is destroyed.
+     */
+    void AddProbe(CharacterProbe* probe);
+
+    void RemoveProbe(CharacterProbe* probe);
+
+    unsigned GetProbeCount() const
+            { return probes_.Size(); }
+
+    /// Total time spent in UpdateProbes() so far, in nanoseconds
+    long long GetTotalProbeTime() const
+            { return totalProbeTime_; }
+
+    /*!
+     * @brief Runs all probes that haven't run yet during this substep.
+     */
+    void UpdateProbes();
+
+    /*!
+     * @brief Runs the ground and ceiling probes of a single character right
+     * away, regardless of its update interval. For characters that usually
+     * don't need them (see CharacterProbe::probeGround_).
+     */
+    void ProbeGround(CharacterProbe* probe);
+
+    /*!
+     * @brief Runs the ground and ceiling probes as if the character's node
+     * was at the given position and rotation. Only writes to the probe passed
+     * in, so it can be used with a copy of a probe to re-simulate past ticks.
+     */
+    void ProbeGround(CharacterProbe* probe, const Urho3D::Vector3& position, const Urho3D::Quaternion& rotation) const;
+
+    /*!
+     * @brief Checks whether a crouching character at the given position and
+     * rotation has room to stand up. Only writes to the probe passed in.
+     */
+    void ProbeStandUp(CharacterProbe* probe, const Urho3D::Vector3& position, const Urho3D::Quaternion& rotation) const;
+
+    /*!
+     * @brief Checks whether a character at the given position and rotation
+     * would run into anything when moved sideways by the given displacement.
+     * Movement along the character's up axis is left to the ground and
+     * ceiling probes.
+     */
+    bool ProbeMovement(const CharacterProbe* probe,
+                       const Urho3D::Vector3& position,
+                       const Urho3D::Quaternion& rotation,
+                       const Urho3D::Vector3& displacement) const;
+
+protected:
+    virtual void OnSceneSet(Urho3D::Scene* scene) override;
+
+private:
+    void RunProbe(CharacterProbe* probe);
+
+    void HandlePhysicsPostStep(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+
+    Urho3D::PODVector<CharacterProbe*> probes_;
+    Urho3D::WeakPtr<Urho3D::PhysicsWorld> physicsWorld_;
+    long long totalProbeTime_;
+    unsigned substep_;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Math/Vector3.h>
+
+/*!
+ * @brief Movement state of one character, shared between the components that
+ * make up the character.
+ *
+ * MovementController writes to it every physics tick, and the player and
+ * animation controllers of the same character read it every frame. This
+ * replaces broadcasting an event per character and tick, which reached the
+ * controllers of every other character as well.
+ */
+struct CharacterState : public Urho3D::RefCounted
+{
+    CharacterState() :
+        isCrouching_(false)
+    {}
+
+    /// Velocity in the plane the character is moving on. Y is the down velocity.
+    Urho3D::Vector3 localVelocity_;
+    bool isCrouching_;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Math/Color.h>
+#include <Urho3D/Math/Vector3.h>
+
+namespace Urho3D {
+    class CustomGeometry;
+    class Material;
+    class Node;
+}
+
+/*!
+ * @brief Persistent line geometry for debug drawing.
+ *
+ * DebugRenderer discards its lines every frame, so anything drawn with it
+ * has to be regenerated every frame. This class instead collects lines into
+ * a CustomGeometry, which uploads them to a vertex buffer once in Commit()
+ * and is then drawn every frame at no extra cost. The lines are kept until
+ * the next call to Clear().
+ *
+ * The geometry lives in a temporary, local child node of the specified
+ * parent, so it is neither saved nor replicated.
+ */
+class DebugLineCache : public Urho3D::RefCounted
+{
+public:
+    DebugLineCache(Urho3D::Node* parent);
+    ~DebugLineCache();
+
+    /// Removes all lines. They disappear on the next call to Commit()
+    void Clear();
+
+    void AddLine(const Urho3D::Vector3& start, const Urho3D::Vector3& end, const Urho3D::Color& color);
+
+    /// Uploads all lines added since the last call to Clear()
+    void Commit();
+
+    void SetVisible(bool visible);
+
+    bool IsVisible() const;
+
+    /// Whether lines are hidden by geometry in front of them. On by default
+    void SetDepthTest(bool enable);
+
+    bool GetDepthTest() const
+            { return depthTest_; }
+
+    unsigned GetLineCount() const
+            { return lineCount_; }
+
+private:
+    Urho3D::SharedPtr<Urho3D::Node> node_;
+    Urho3D::SharedPtr<Urho3D::CustomGeometry> geometry_;
+    Urho3D::SharedPtr<Urho3D::Material> depthTestMaterial_;
+    Urho3D::SharedPtr<Urho3D::Material> overlayMaterial_;
+    unsigned lineCount_;
+    bool depthTest_;
+};
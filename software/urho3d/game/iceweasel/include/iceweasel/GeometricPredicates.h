@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Urho3D/Math/Vector3.h>
+
+/*!
+ * @brief Robust orientation and in-sphere tests.
+ *
+ * Both predicates first evaluate the determinant in double precision and
+ * check the result against a forward error bound (Shewchuk, "Adaptive
+ * Precision Floating-Point Arithmetic and Fast Robust Geometric
+ * Predicates"). Only if the sign can't be trusted is the determinant
+ * re-evaluated exactly using floating-point expansions. The sign of the
+ * returned value is always correct; the magnitude is only an approximation.
+ */
+class GeometricPredicates
+{
+public:
+
+    /*!
+     * @brief Returns a positive value if d lies below the plane through a, b
+     * and c, where "below" is defined such that a, b and c appear in
+     * counter-clockwise order when viewed from above the plane. Returns a
+     * negative value if d lies above the plane, and zero if the four points
+     * are coplanar.
+     *
+     * The result is also six times the signed volume of the tetrahedron
+     * a, b, c, d (as long as the fast path was taken).
+     */
+    static double Orient3D(const Urho3D::Vector3& a,
+                           const Urho3D::Vector3& b,
+                           const Urho3D::Vector3& c,
+                           const Urho3D::Vector3& d);
+
+    /*!
+     * @brief Returns a positive value if e lies inside the sphere passing
+     * through a, b, c and d, a negative value if it lies outside, and zero if
+     * the five points are cospherical. The points a, b, c and d must be
+     * ordered such that Orient3D(a, b, c, d) is positive, otherwise the sign
+     * of the result is reversed.
+     */
+    static double InSphere(const Urho3D::Vector3& a,
+                           const Urho3D::Vector3& b,
+                           const Urho3D::Vector3& c,
+                           const Urho3D::Vector3& d,
+                           const Urho3D::Vector3& e);
+
+private:
+    static double Orient3DExact(const Urho3D::Vector3& a,
+                                const Urho3D::Vector3& b,
+                                const Urho3D::Vector3& c,
+                                const Urho3D::Vector3& d);
+
+    static double InSphereExact(const Urho3D::Vector3& a,
+                                const Urho3D::Vector3& b,
+                                const Urho3D::Vector3& c,
+                                const Urho3D::Vector3& d,
+                                const Urho3D::Vector3& e);
+};
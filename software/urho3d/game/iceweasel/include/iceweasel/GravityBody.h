@@ -0,0 +1,125 @@
+#pragma once
+
+#include "iceweasel/UpdateRateScheduler.h"
+
+#include <Urho3D/Scene/Component.h>
+
+namespace Urho3D {
+    class Context;
+    class RigidBody;
+}
+class GravityManager;
+
+/*!
+ * @brief Makes the rigid body on the same node follow the gravity field.
+ *
+ * Add this component next to a RigidBody to opt in. Instead of Bullet's
+ * uniform world gravity, the body is then accelerated by the gravity of the
+ * closest GravityManager at its current location.
+ *
+ * Bullet applies its own gravity as a force once per frame, and every substep
+ * of that frame integrates the same force. The gravity manager instead adds
+ * the field gravity to the velocity of all of its gravity bodies in one batch
+ * from Bullet's internal tick callback (E_PHYSICSPRESTEP), which runs before
+ * every substep. Bullet's own gravity is disabled on the body while it is
+ * tracked, and set back to what it was when the body stops being tracked.
+ */
+class GravityBody : public Urho3D::Component
+{
+    URHO3D_OBJECT(GravityBody, Urho3D::Component)
+
+public:
+
+    /*!
+     * @brief Constructs a new gravity body.
+     */
+    GravityBody(Urho3D::Context* context);
+
+    /*!
+     * @brief Destructs the gravity body.
+     */
+    virtual ~GravityBody();
+
+    /*!
+     * @brief Registers this class as an object factory.
+     */
+    static void RegisterObject(Urho3D::Context* context);
+
+    /*!
+     * @brief Returns the rigid body on this component's node, or NULL if the
+     * node has none.
+     */
+    Urho3D::RigidBody* GetRigidBody();
+
+    /*!
+     * @brief Accelerates the rigid body by the specified gravity for one
+     * physics substep.
+     */
+    void IntegrateGravity(const Urho3D::Vector3& gravity, float timeStep);
+
+    /*!
+     * @brief The gravity that was last passed to IntegrateGravity(). Used
+     * between updates when the body's update rate is lowered.
+     */
+    const Urho3D::Vector3& GetCachedGravity() const
+            { return cachedGravity_; }
+
+    /// Decides when the body's gravity has to be queried again
+    UpdateRateTimer& GetUpdateRateTimer()
+            { return updateRateTimer_; }
+
+    /*!
+     * @brief The tetrahedron of the gravity mesh the body was last found in.
+     * The next query starts searching from there, see
+     * TetrahedralMesh::Mesh::Locate().
+     */
+    void SetGravityHint(unsigned hint)
+            { gravityHint_ = hint; }
+
+    unsigned GetGravityHint() const
+            { return gravityHint_; }
+
+    /*!
+     * @brief Gives the rigid body back to the physics world's gravity, if it
+     * used it before this body was tracked.
+     */
+    void ResetGravity();
+
+    /*!
+     * @brief Sets the gravity manager this body is registered with. This is
+     * called by GravityManager when it starts tracking the body, and disables
+     * Bullet's gravity on the rigid body.
+     */
+    void SetGravityManager(GravityManager* gravityManager);
+
+    GravityManager* GetGravityManager() const
+            { return gravityManager_; }
+
+    /*!
+     * @brief The index of this body in the gravity manager's registry. This is
+     * maintained by GravityManager and allows it to find and remove bodies in
+     * constant time.
+     */
+    void SetGravityManagerIndex(unsigned index)
+            { gravityManagerIndex_ = index; }
+
+    unsigned GetGravityManagerIndex() const
+            { return gravityManagerIndex_; }
+
+protected:
+    /// Same as GravityVector::OnSceneSet()
+    virtual void OnSceneSet(Urho3D::Scene* scene) override;
+
+private:
+    // Remembers whether the rigid body used Bullet's gravity and disables it
+    void OverrideGravity();
+
+    Urho3D::WeakPtr<GravityManager> gravityManager_;
+    Urho3D::WeakPtr<Urho3D::RigidBody> rigidBody_;
+    Urho3D::Vector3 cachedGravity_;
+    UpdateRateTimer updateRateTimer_;
+    unsigned gravityHint_;
+    unsigned gravityManagerIndex_;
+    bool isGravityOverridden_;
+    bool originalUseGravity_;
+};
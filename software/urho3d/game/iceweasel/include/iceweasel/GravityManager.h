@@ -1,15 +1,27 @@
 #pragma once
 
+#include "iceweasel/GravityVectorSnapshot.h"
+#include "iceweasel/TetrahedralMeshBuilder.h"
+#include "iceweasel/TetrahedralMeshDecimator.h"
+#include "iceweasel/UpdateRateScheduler.h"
+
+#include <Urho3D/Container/HashSet.h>
 #include <Urho3D/Scene/Component.h>
 
 namespace Urho3D {
+    class BoundingBox;
     class Context;
     class DebugRenderer;
+    class File;
+    struct WorkItem;
 }
 namespace TetrahedralMesh {
     class Mesh;
     class Hull;
+    class Vertex;
 }
+class DebugLineCache;
+class GravityBody;
 class GravityVector;
 
 /*!
@@ -38,6 +50,17 @@ public:
         DISABLE
     };
 
+    /// How the result of a gravity query was calculated
+    enum QueryPath
+    {
+        PATH_DEFAULT,
+        PATH_SHORTEST_DISTANCE,
+        PATH_MESH,
+        PATH_HULL_FACE,
+        PATH_HULL_EDGE,
+        PATH_HULL_VERTEX
+    };
+
     /*!
      * @brief Creates a new gravity component.
      */
@@ -59,55 +82,409 @@ public:
      * @param[in] acceleration Gravitational constant, in m/s^2.
      */
     void SetGlobalGravity(float acceleration)
-            { gravity_ = acceleration; }
+            { gravity_ = acceleration; recordSnapshot_ = true; }
 
     float GetGlobalGravity() const
             { return gravity_; }
 
     void SetStrategy(Strategy strategy)
-            { strategy_ = strategy; }
+            { strategy_ = strategy; recordSnapshot_ = true; }
 
     Strategy GetStrategy() const
             { return strategy_; }
 
+    /*!
+     * @brief Rebuilding the gravity mesh is spread over multiple frames.
+     * Queries use the previous mesh until the new one is done. This sets how
+     * much time may be spent on the build per frame.
+     * @param[in] milliseconds Time budget per frame in milliseconds.
+     */
+    void SetBuildTimeBudget(float milliseconds)
+            { buildTimeBudget_ = milliseconds; }
+
+    float GetBuildTimeBudget() const
+            { return buildTimeBudget_; }
+
+    /*!
+     * @brief Sets the maximum number of gravity vectors that are inserted into
+     * the gravity mesh per frame while a build is in progress. At least one
+     * is inserted per frame, so the build always progresses.
+     */
+    void SetMaxInsertionsPerFrame(unsigned count)
+            { maxInsertionsPerFrame_ = count > 0 ? count : 1; }
+
+    unsigned GetMaxInsertionsPerFrame() const
+            { return maxInsertionsPerFrame_; }
+
+    /*!
+     * @brief Enables removing redundant gravity vectors from the gravity mesh.
+     * A gravity vector is redundant if its neighbours reproduce its direction
+     * and force factor within the errors set below. See
+     * TetrahedralMeshDecimator.
+     */
+    void SetDecimate(bool enable)
+            { decimate_ = enable; rebuildMesh_ = true; recordSnapshot_ = true; }
+
+    bool GetDecimate() const
+            { return decimate_; }
+
+    /// Maximum angle in degrees a decimated gravity vector's direction may be off by
+    void SetDecimationMaxAngle(float degrees)
+            { decimationMaxAngle_ = degrees; rebuildMesh_ = true; recordSnapshot_ = true; }
+
+    float GetDecimationMaxAngle() const
+            { return decimationMaxAngle_; }
+
+    /// Maximum amount a decimated gravity vector's force factor may be off by
+    void SetDecimationMaxForceFactorError(float error)
+            { decimationMaxForceFactorError_ = error; rebuildMesh_ = true; recordSnapshot_ = true; }
+
+    float GetDecimationMaxForceFactorError() const
+            { return decimationMaxForceFactorError_; }
+
+    /*!
+     * @brief Lowers how often gravity is queried and the ground is probed for
+     * entities that are far away from every player or at rest. Players
+     * register themselves as observers. Gravity bodies and movement
+     * controllers in this scene use this to schedule their updates.
+     */
+    UpdateRateScheduler& GetUpdateRateScheduler()
+            { return updateRateScheduler_; }
+
+    void SetLODNearDistance(float distance)
+            { updateRateScheduler_.SetNearDistance(distance); }
+
+    float GetLODNearDistance() const
+            { return updateRateScheduler_.GetNearDistance(); }
+
+    void SetLODFarDistance(float distance)
+            { updateRateScheduler_.SetFarDistance(distance); }
+
+    float GetLODFarDistance() const
+            { return updateRateScheduler_.GetFarDistance(); }
+
+    void SetLODMaxInterval(unsigned ticks)
+            { updateRateScheduler_.SetMaxInterval(ticks); }
+
+    unsigned GetLODMaxInterval() const
+            { return updateRateScheduler_.GetMaxInterval(); }
+
+    void SetLODRestSpeed(float speed)
+            { updateRateScheduler_.SetRestSpeed(speed); }
+
+    float GetLODRestSpeed() const
+            { return updateRateScheduler_.GetRestSpeed(); }
+
     /*!
      * @brief Queries all gravity probes and calculates the effective
      * gravitational force at the specified location in world space.
      * @param[in] worldLocation A 3D location in world space.
+     * @param[in,out] hint Optional. The tetrahedron the caller's previous
+     * query was found in, updated with the one found for this query. See
+     * TetrahedralMesh::Mesh::Locate(). Initialise it to M_MAX_UNSIGNED.
      * @return Returns the gravitational force at the specified location.
      */
-    Urho3D::Vector3 QueryGravity(Urho3D::Vector3 worldLocation);
+    Urho3D::Vector3 QueryGravity(Urho3D::Vector3 worldLocation, unsigned* hint=NULL);
+
+    /*!
+     * @brief Calculates the gravitational force at many locations at once.
+     * Pending gravity vector changes are only applied once for the whole
+     * batch.
+     * @param[out] gravity Resized to the number of locations and filled with
+     * the gravitational force at each location.
+     * @param[in] worldLocations 3D locations in world space.
+     * @param[in,out] hints Optional. One hint per location, see the single
+     * location version. Must have the same size as worldLocations. If NULL,
+     * each location starts searching where the previous one was found.
+     */
+    void QueryGravity(Urho3D::PODVector<Urho3D::Vector3>* gravity,
+                      const Urho3D::PODVector<Urho3D::Vector3>& worldLocations,
+                      Urho3D::PODVector<unsigned>* hints=NULL);
+
+    /*!
+     * @brief Applies pending changes so QueryGravityConcurrent() can be
+     * called. Must be called from the main thread.
+     */
+    void PrepareConcurrentQuery();
+
+    /*!
+     * @brief Same as the batched QueryGravity(), but only calculates the
+     * entries in the range [begin, end) and can be called from several worker
+     * threads at once, as long as the ranges don't overlap.
+     *
+     * Call PrepareConcurrentQuery() first. Nothing may modify the gravity
+     * manager or its gravity vectors until all threads are done. Concurrent
+     * queries aren't recorded and don't update the last query path.
+     * @param[out] gravity Must already have the same size as worldLocations.
+     * @param[in,out] hints Optional. Same as for the batched QueryGravity().
+     * Only the entries in the range are written.
+     */
+    void QueryGravityConcurrent(Urho3D::PODVector<Urho3D::Vector3>* gravity,
+                                const Urho3D::PODVector<Urho3D::Vector3>& worldLocations,
+                                unsigned begin,
+                                unsigned end,
+                                Urho3D::PODVector<unsigned>* hints=NULL) const;
+
+    /*!
+     * @brief Single location version of QueryGravityConcurrent(). Because it
+     * doesn't modify anything, it can also be used to re-simulate past ticks
+     * without affecting the queries of the current one.
+     * @param[out] path Optional. Same as GetLastQueryPath(), but for this
+     * query.
+     * @param[out] tetrahedronCount Optional. Same as
+     * GetLastQueryTetrahedronCount(), but for this query.
+     */
+    Urho3D::Vector3 QueryGravityConcurrent(const Urho3D::Vector3& worldLocation,
+                                           unsigned* hint=NULL,
+                                           QueryPath* path=NULL,
+                                           unsigned* tetrahedronCount=NULL) const;
+
+    /// Returns how the result of the last query was calculated
+    QueryPath GetLastQueryPath() const
+            { return lastQueryPath_; }
+
+    /// Returns how many tetrahedrons the last query tested
+    unsigned GetLastQueryTetrahedronCount() const
+            { return lastQueryTetrahedronCount_; }
+
+    /// Returns the bounding box of all gravity vectors
+    Urho3D::BoundingBox GetBoundingBox();
+
+    /*!
+     * @brief Starts writing every query to a binary log, which can be played
+     * back with --replay-gravity. See GravityQueryLog.h for the format. The
+     * state of all gravity vectors is written to the log whenever it changes.
+     * @return Returns false if the file could not be opened.
+     */
+    bool StartRecording(const Urho3D::String& fileName);
+
+    void StopRecording();
+
+    bool IsRecording() const;
 
     void DrawDebugGeometry(Urho3D::DebugRenderer* debug, bool depthTest, Urho3D::Vector3 pos);
 
+    /// Draws the gravity mesh when the component is selected in the editor
+    virtual void DrawDebugGeometry(Urho3D::DebugRenderer* debug, bool depthTest) override;
+
+    /*!
+     * @brief Called by gravity vectors when their node was moved or rotated,
+     * or when their force factor changed. The change is applied to the
+     * gravity mesh the next time it is needed.
+     */
+    void NotifyGravityVectorChanged(GravityVector* gravityVector);
+
+    /*!
+     * @brief Starts tracking a gravity vector. The gravity vector is given the
+     * next free dense index, which is also the index of its snapshot entry
+     * and the index of its mesh vertex. Adding a gravity vector that is
+     * already tracked has no effect.
+     *
+     * This is called by gravity vectors beneath this manager's node when they
+     * enter the scene. A gravity vector tracked by a different manager is
+     * removed from it first.
+     */
+    void AddGravityVector(GravityVector* gravityVector);
+
+    /*!
+     * @brief Stops tracking a gravity vector in constant time. The last
+     * gravity vector is moved into the freed index, which invalidates the
+     * current mesh.
+     *
+     * This is called by gravity vectors when they leave the scene.
+     */
+    void RemoveGravityVector(GravityVector* gravityVector);
+
+    /*!
+     * @brief Starts applying the gravity field to a rigid body in every
+     * physics substep. Adding a body that is already tracked has no effect.
+     *
+     * This is called by gravity bodies beneath this manager's node when they
+     * enter the scene. A body tracked by a different manager is removed from
+     * it first.
+     */
+    void AddGravityBody(GravityBody* gravityBody);
+
+    /*!
+     * @brief Stops applying the gravity field to a rigid body and gives it
+     * back to the physics world's gravity.
+     *
+     * This is called by gravity bodies when they leave the scene.
+     */
+    void RemoveGravityBody(GravityBody* gravityBody);
+
+    /*!
+     * @brief Finds the gravity manager that gravity vectors and bodies on the
+     * specified node belong to, which is the closest one on the node or above
+     * it. Returns NULL if there is none.
+     */
+    static GravityManager* FindClosest(Urho3D::Node* node);
+
 private:
-    void RebuildTetrahedralMesh();
+    /*!
+     * @brief Calculates the gravitational force at a location without
+     * applying pending changes first.
+     */
+    Urho3D::Vector3 EvaluateGravity(const Urho3D::Vector3& worldLocation, unsigned* hint);
+
+    /*!
+     * @brief Does the work of EvaluateGravity().
+     * @param[in] hull If the location is outside of the mesh, it is projected
+     * onto this hull, which also fills in the hull's direction map and last
+     * intersection. If NULL, the const hull query is used instead, and this
+     * function is safe to call from several threads at once.
+     * @param[in,out] hint Optional. See QueryGravity().
+     */
+    Urho3D::Vector3 InterpolateGravity(const Urho3D::Vector3& worldLocation,
+                                       QueryPath* path,
+                                       unsigned* tetrahedronCount,
+                                       TetrahedralMesh::Hull* hull,
+                                       unsigned* hint) const;
+
+    /*!
+     * @brief Applies changed gravity vectors before querying the gravity mesh.
+     * While a new mesh is being built, the previous one is queried instead.
+     */
+    void PrepareQuery();
+
+    /// Integrates the gravity field into all awake gravity bodies for one substep
+    void HandlePhysicsPreStep(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
 
-    /// Triggers a new search for all gravity probe nodes and rebuilds the tetrahedral mesh
-    virtual void OnSceneSet(Urho3D::Scene* scene);
+    /// Evaluates a query and writes it to the log along with its latency
+    Urho3D::Vector3 EvaluateAndRecordGravity(const Urho3D::Vector3& worldLocation, unsigned* hint);
+
+    /// Writes the current gravity vectors and settings to the log
+    void RecordSnapshot();
+
+    /*!
+     * @brief Regenerates the cached debug lines of the probes, the mesh and
+     * the hull if anything changed since they were last generated.
+     */
+    void UpdateDebugLines();
+
+    /*!
+     * @brief Starts building a new gravity mesh from the current state of all
+     * gravity vectors. The previous mesh is used until the new one is
+     * finished. If decimation is enabled, it runs on the WorkQueue first and
+     * the builder starts once it's done.
+     */
+    void BeginBuild();
+
+    /// Decimates a copy of the snapshot on a worker thread, see BeginBuild()
+    static void DecimateWork(const Urho3D::WorkItem* item, unsigned threadIndex);
+
+    /*!
+     * @brief Starts the builder from the finished decimation, or decimates
+     * again if gravity vectors were added or removed in the meantime.
+     */
+    void EndDecimation();
+
+    /// Continues the build in progress within the configured time budget
+    void ContinueBuild();
+
+    /// Synchronously completes the build in progress
+    void FinishBuild();
+
+    /// Replaces the current gravity mesh with the finished build
+    void ApplyBuild();
 
     /*!
-     * @brief Searches for all gravity probe nodes that are located beneath the
-     * specified node and caches them. The specified node is not checked.
+     * @brief Writes the snapshot entries at the specified indices into the
+     * mesh vertices and updates the affected tetrahedrons. Starts a new build
+     * if this is not possible.
      */
-    void AddGravityVectorsRecursively(Urho3D::Node* node);
+    void ApplyVertexChanges(const Urho3D::PODVector<unsigned>& indices);
+
+    /// Subscribes to E_UPDATE for as long as there is pending work
+    void SubscribeToUpdate();
+    void HandleUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
 
     /*!
-     * @brief Searches for all gravity probe nodes that are located on and
-     * beneath the specified node.
+     * @brief Applies all pending gravity vector changes to the gravity mesh.
+     *
+     * Direction and force factor changes are written directly into the mesh
+     * vertices. Position changes update the affected tetrahedrons in place,
+     * and only if a tetrahedron is inverted by the move is the mesh rebuilt.
      */
-    void RemoveGravityVectorsRecursively(Urho3D::Node* node);
+    void UpdateChangedGravityVectors();
+
+    /*!
+     * @brief Reads the current position, direction and force factor of all
+     * changed gravity vectors into the snapshot.
+     * @param[out] changedIndices If not NULL, the snapshot indices that were
+     * refreshed are appended to this list.
+     */
+    void UpdateSnapshot(Urho3D::PODVector<unsigned>* changedIndices);
+
+    /// Stops tracking all gravity vectors
+    void ClearGravityVectors();
+
+    /// Stops tracking all gravity bodies
+    void ClearGravityBodies();
 
-    void HandleComponentAdded(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
-    void HandleComponentRemoved(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    /// Triggers a new search for all gravity probe nodes
+    virtual void OnSceneSet(Urho3D::Scene* scene) override;
+
+    /*!
+     * @brief Starts tracking the gravity vectors and bodies on and beneath the
+     * specified node that belong to this manager, and stops tracking those
+     * that no longer do. Subtrees with a gravity manager of their own belong
+     * to that manager.
+     * @param[in] closest The gravity manager on or above the specified node's
+     * parent.
+     */
+    void UpdateTrackedRecursively(Urho3D::Node* node, GravityManager* closest);
+
+    /// Gravity vectors and bodies moved to a different parent in the scene
     void HandleNodeAdded(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
-    void HandleNodeRemoved(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
 
+    /// Dense registry. Each gravity vector knows its own index into this list
     Urho3D::PODVector<GravityVector*> gravityVectors_;
+    /// Same order as gravityVectors_
+    GravityVectorSnapshot snapshot_;
+    Urho3D::Vector<Urho3D::SharedPtr<TetrahedralMesh::Vertex> > gravityVertices_;
+    Urho3D::HashSet<GravityVector*> changedGravityVectors_;
+    /// Dense registry. Each gravity body knows its own index into this list
+    Urho3D::PODVector<GravityBody*> gravityBodies_;
+    /// Scratch buffers for the batched query, kept to avoid allocations
+    Urho3D::PODVector<GravityBody*> dueBodies_;
+    Urho3D::PODVector<Urho3D::Vector3> bodyPositions_;
+    Urho3D::PODVector<unsigned> bodyHints_;
+    Urho3D::PODVector<Urho3D::Vector3> bodyGravity_;
     Urho3D::SharedPtr<TetrahedralMesh::Mesh> gravityMesh_;
     Urho3D::SharedPtr<TetrahedralMesh::Hull> gravityHull_;
+    TetrahedralMeshBuilder builder_;
+    /// Only touched by the worker thread while decimationItem_ is set
+    TetrahedralMeshDecimator decimator_;
+    GravityVectorSnapshot decimationSnapshot_;
+    Urho3D::PODVector<bool> decimationExcluded_;
+    Urho3D::SharedPtr<Urho3D::WorkItem> decimationItem_;
+    UpdateRateScheduler updateRateScheduler_;
+    Urho3D::SharedPtr<Urho3D::File> recordFile_;
+    Urho3D::SharedPtr<DebugLineCache> debugLines_;
 
     float gravity_;
 
     Strategy strategy_;
+    QueryPath lastQueryPath_;
+    unsigned lastQueryTetrahedronCount_;
+    /// Tetrahedron the debug highlight was found in last frame
+    unsigned debugHighlightHint_;
+
+    float buildTimeBudget_;
+    unsigned maxInsertionsPerFrame_;
+    float decimationMaxAngle_;
+    float decimationMaxForceFactorError_;
+    bool decimate_;
+
+    /// Set when gravity vectors were added or removed since the last build
+    bool rebuildMesh_;
+    /// Set while builder_ holds a build in progress
+    bool isBuilding_;
+    /// Set when the state written by RecordSnapshot() changed
+    bool recordSnapshot_;
+    /// Set when the cached debug lines no longer match the mesh or probes
+    bool debugLinesDirty_;
+    /// Set when the debug lines were drawn since the last update
+    bool debugLinesDrawn_;
 };
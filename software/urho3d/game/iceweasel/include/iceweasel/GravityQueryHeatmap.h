@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/BoundingBox.h>
+
+namespace Urho3D {
+    class Context;
+    class DebugRenderer;
+}
+class GravityManager;
+
+/*!
+ * @brief Samples the cost of gravity queries on a regular grid.
+ *
+ * For every cell, the query at the cell's centre is timed and the number of
+ * tetrahedrons it tested and the path it took (mesh, hull face, edge or
+ * vertex) are stored. The grid can be drawn as a coloured 3D heatmap and
+ * exported as CSV to find places where the gravity mesh or the probe
+ * placement perform badly.
+ */
+class GravityQueryHeatmap : public Urho3D::RefCounted
+{
+public:
+    /// Which value determines the colour of a cell
+    enum Metric
+    {
+        METRIC_NANOSECONDS,
+        METRIC_TETRAHEDRONS,
+        METRIC_PATH,
+        NUM_METRICS
+    };
+
+    struct Cell
+    {
+        Urho3D::Vector3 position_;
+        unsigned nanoseconds_;
+        unsigned tetrahedrons_;
+        unsigned char path_;
+    };
+
+    GravityQueryHeatmap();
+
+    /*!
+     * @brief Replaces all cells by sampling the specified region.
+     * @param[in] resolution Number of cells along the longest side of the
+     * region. The other sides use the same cell size.
+     */
+    void Sample(GravityManager* gravityManager, const Urho3D::BoundingBox& region, unsigned resolution);
+
+    void SetMetric(Metric metric)
+            { metric_ = metric; }
+
+    Metric GetMetric() const
+            { return metric_; }
+
+    const Urho3D::PODVector<Cell>& GetCells() const
+            { return cells_; }
+
+    /*!
+     * @brief Writes one line per cell with its grid coordinates, its world
+     * position and all sampled values.
+     */
+    bool ExportCSV(Urho3D::Context* context, const Urho3D::String& fileName) const;
+
+    void DrawDebugGeometry(Urho3D::DebugRenderer* debug, bool depthTest) const;
+
+private:
+    Urho3D::PODVector<Cell> cells_;
+    Urho3D::BoundingBox region_;
+    float cellSize_;
+    unsigned size_[3];
+    unsigned maxNanoseconds_;
+    unsigned maxTetrahedrons_;
+    Metric metric_;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+/*!
+ * @brief Binary log of gravity queries, written by
+ * GravityManager::StartRecording().
+ *
+ * The file starts with the ID "GQLG" followed by the format version as an
+ * unsigned int. The rest of the file is a sequence of chunks, each starting
+ * with a one byte chunk type:
+ *
+ *   CHUNK_SNAPSHOT
+ *     unsigned char  strategy
+ *     float          global gravity
+ *     bool           decimate
+ *     float          decimation max angle
+ *     float          decimation max force factor error
+ *     unsigned int   gravity vector count
+ *     per gravity vector: Vector3 position, Vector3 direction, float force factor
+ *
+ *   CHUNK_QUERY
+ *     Vector3        query position
+ *     Vector3        result
+ *     unsigned char  GravityManager::QueryPath
+ *     unsigned int   latency in nanoseconds
+ *
+ * A snapshot chunk is written before the first query and before any query
+ * that follows a change to the gravity vectors or the settings.
+ */
+namespace GravityQueryLog
+{
+    static const unsigned VERSION = 1;
+
+    enum ChunkType
+    {
+        CHUNK_SNAPSHOT = 1,
+        CHUNK_QUERY = 2
+    };
+}
+
+/*!
+ * @brief Plays back a gravity query log against the current build and
+ * reports throughput and any results that differ from the recording.
+ */
+class GravityQueryReplay : public Urho3D::Object
+{
+    URHO3D_OBJECT(GravityQueryReplay, Urho3D::Object)
+
+public:
+    GravityQueryReplay(Urho3D::Context* context);
+
+    /*!
+     * @brief Runs all queries in the log and prints a report to stdout.
+     * @return Returns 0 if all results match, 1 if any differ and 2 if the
+     * log could not be read.
+     */
+    int Run(const Urho3D::String& fileName);
+
+    /// Results further apart than this are reported as different
+    void SetTolerance(float tolerance)
+            { tolerance_ = tolerance; }
+
+private:
+    float tolerance_;
+};
@@ -6,6 +6,8 @@
 namespace Urho3D {
     class Context;
 }
+class DebugLineCache;
+class GravityManager;
 
 class GravityVector : public Urho3D::Component
 {
@@ -58,8 +60,7 @@ public:
      * value is 1.0.
      * @param[in] factor Multiplication factor to apply to this probe.
      */
-    void SetForceFactor(float factor)
-            { forceFactor_ = factor; }
+    void SetForceFactor(float factor);
 
     /*!
      * @brief Gets the probe's force factor. This is multiplied with the global
@@ -71,6 +72,51 @@ public:
 
     virtual void DrawDebugGeometry(Urho3D::DebugRenderer* debug, bool depthTest);
 
+    /// Same arrow as DrawDebugGeometry(), written to a persistent cache
+    void AddDebugLines(DebugLineCache* lines) const;
+
+    /*!
+     * @brief Sets the gravity manager that should be notified whenever this
+     * probe moves, rotates or has its force factor changed. This is called by
+     * GravityManager when it starts tracking the probe.
+     */
+    void SetGravityManager(GravityManager* gravityManager);
+
+    GravityManager* GetGravityManager() const
+            { return gravityManager_; }
+
+    /*!
+     * @brief The index of this probe in the gravity manager's registry. This
+     * is maintained by GravityManager and allows it to find and remove
+     * probes in constant time.
+     */
+    void SetGravityManagerIndex(unsigned index)
+            { gravityManagerIndex_ = index; }
+
+    unsigned GetGravityManagerIndex() const
+            { return gravityManagerIndex_; }
+
+protected:
+    /*!
+     * @brief Registers this component as a transform listener on the node,
+     * and removes it from the node it was previously attached to.
+     */
+    virtual void OnNodeSet(Urho3D::Node* node) override;
+
+    /*!
+     * @brief Registers this probe with its GravityManager (see
+     * GravityManager::FindClosest()) when entering the scene, and unregisters
+     * it when leaving.
+     */
+    virtual void OnSceneSet(Urho3D::Scene* scene) override;
+
+    /// Called by the node whenever its world transform becomes dirty
+    virtual void OnMarkedDirty(Urho3D::Node* node) override;
+
 private:
+    Urho3D::WeakPtr<GravityManager> gravityManager_;
+    /// node_ is already NULL when OnNodeSet() is told we were removed
+    Urho3D::WeakPtr<Urho3D::Node> listenedNode_;
     float forceFactor_;
+    unsigned gravityManagerIndex_;
 };
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Vector3.h>
+
+/*!
+ * @brief Packed copy of the attributes of all gravity vectors in a scene.
+ *
+ * Reading a gravity vector's position or direction walks its node's world
+ * transform. The gravity manager instead keeps a copy of these values in
+ * flat arrays and only refreshes an entry when the gravity vector's node is
+ * marked dirty. All entries at the same index belong to the same gravity
+ * vector.
+ */
+struct GravityVectorSnapshot
+{
+    unsigned Size() const
+            { return positions_.Size(); }
+
+    bool Empty() const
+            { return positions_.Empty(); }
+
+    void Clear()
+    {
+        positions_.Clear();
+        directions_.Clear();
+        forceFactors_.Clear();
+    }
+
+    void Push(const Urho3D::Vector3& position, const Urho3D::Vector3& direction, float forceFactor)
+    {
+        positions_.Push(position);
+        directions_.Push(direction);
+        forceFactors_.Push(forceFactor);
+    }
+
+    void Set(unsigned index, const Urho3D::Vector3& position, const Urho3D::Vector3& direction, float forceFactor)
+    {
+        positions_[index] = position;
+        directions_[index] = direction;
+        forceFactors_[index] = forceFactor;
+    }
+
+    /// Removes an entry by moving the last entry into its place
+    void EraseSwap(unsigned index)
+    {
+        positions_[index] = positions_.Back();
+        directions_[index] = directions_.Back();
+        forceFactors_[index] = forceFactors_.Back();
+        positions_.Pop();
+        directions_.Pop();
+        forceFactors_.Pop();
+    }
+
+    Urho3D::PODVector<Urho3D::Vector3> positions_;
+    Urho3D::PODVector<Urho3D::Vector3> directions_;
+    Urho3D::PODVector<float> forceFactors_;
+};
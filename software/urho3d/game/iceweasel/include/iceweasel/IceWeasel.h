@@ -1,8 +1,10 @@
 #pragma once
 
+#include <Urho3D/Container/HashMap.h>
 #include <Urho3D/Engine/Application.h>
 
 namespace Urho3D {
+    class Connection;
     class Node;
     class Scene;
     class Text;
@@ -10,6 +12,7 @@ namespace Urho3D {
 }
 
 class Args;
+class GravityQueryHeatmap;
 class MainMenu;
 
 /// Defines the category under which iceweasel specific components can be found in the editor.
@@ -51,12 +54,14 @@ private:
     void RegisterComponents();
     void StartNetworking();
     void StopNetworking();
+    void CreateRemotePlayer(Urho3D::Connection* connection);
     void CreateCamera();
     void CreateScene();
     void CreateDebugHud();
 
     void SwitchCameraToFreeCam();
     void SwitchCameraToFPSCam();
+    void SampleGravityHeatmap();
 
     void HandleKeyDown(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
     void HandlePostRenderUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
@@ -74,12 +79,16 @@ private:
     Urho3D::SharedPtr<Urho3D::Node> cameraOffsetNode_;
     Urho3D::SharedPtr<Urho3D::Node> cameraRotateNode_;
     Urho3D::SharedPtr<Urho3D::DebugHud> debugHud_;
+    Urho3D::SharedPtr<GravityQueryHeatmap> gravityHeatmap_;
+    // Server: the player controlled by each client
+    Urho3D::HashMap<Urho3D::Connection*, Urho3D::SharedPtr<Urho3D::Node> > remotePlayers_;
 
     enum DebugDrawMode
     {
         DRAW_NONE,
         DRAW_PHYSICS,
-        DRAW_GRAVITY
+        DRAW_GRAVITY,
+        DRAW_GRAVITY_HEATMAP
     };
 
     DebugDrawMode debugDrawMode_;
@@ -53,6 +53,10 @@ public:
                 float speed;
                 float transitionSpeed;
             } animations[PlayerAnimation::NUM_ANIMATIONS];
+            struct Ground {
+                bool useContacts;
+                float maxSlope;
+            } ground;
         };
         Urho3D::Vector<PlayerClass> playerClassContainer;
         const PlayerClass& playerClass(unsigned index) const;
@@ -71,6 +75,31 @@ public:
         } freeCam;
     };
 
+    /*!
+     * @brief Copy of everything a player of one class needs every frame.
+     *
+     * Blocks are built when the config is loaded and never change afterwards.
+     * Reloading the config builds new blocks, so components can cache a
+     * pointer to their block and only need to fetch it again when
+     * E_CONFIGRELOADED is sent. The camera parameters are included because
+     * the player's camera is updated every frame as well.
+     */
+    struct PlayerClassParameters : public Urho3D::RefCounted
+    {
+        PlayerClassParameters(const Data::PlayerClass& playerClass,
+                              const Data::Camera& camera,
+                              unsigned version) :
+            playerClass(playerClass),
+            camera(camera),
+            version(version)
+        {}
+
+        const Data::PlayerClass playerClass;
+        const Data::Camera camera;
+        /// Version of the config this block was built from
+        const unsigned version;
+    };
+
     IceWeaselConfig(Urho3D::Context* context);
 
     void Load(Urho3D::String fileName);
@@ -79,9 +108,29 @@ public:
 
     const Data& GetConfig() const;
 
+    /// The XML file the config was last loaded from. May be NULL.
+    Urho3D::XMLFile* GetXMLFile() const
+            { return xml_; }
+
+    /*!
+     * @brief Returns the parameter block of a player class. If the class
+     * doesn't exist, an error is logged and a block with default parameters
+     * is returned. Never returns NULL.
+     */
+    PlayerClassParameters* GetPlayerClassParameters(unsigned index) const;
+
+    /// Incremented every time the config is reloaded
+    unsigned GetVersion() const
+            { return version_; }
+
 private:
+    void BuildParameterBlocks();
+
     void HandleFileChanged(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
 
     Urho3D::SharedPtr<Urho3D::XMLFile> xml_;
     Data data_;
+    Urho3D::Vector<Urho3D::SharedPtr<PlayerClassParameters> > playerClassParameters_;
+    Urho3D::SharedPtr<PlayerClassParameters> defaultPlayerClassParameters_;
+    unsigned version_;
 };
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Vector2.h>
+
+namespace Urho3D {
+    class Deserializer;
+    class Input;
+    class Serializer;
+}
+
+/*!
+ * @brief The movement input of one render frame.
+ *
+ * Held buttons are sampled once per frame. Buttons pressed during the frame
+ * are recorded separately, so a tap shorter than a physics tick isn't lost.
+ */
+struct InputCommand
+{
+    enum Button
+    {
+        FORWARD = 0x01,
+        BACK    = 0x02,
+        LEFT    = 0x04,
+        RIGHT   = 0x08,
+        RUN     = 0x10,
+        CROUCH  = 0x20,
+        JUMP    = 0x40
+    };
+
+    InputCommand() :
+        sequence_(0),
+        frame_(0),
+        time_(0.0f),
+        timeStep_(0.0f),
+        buttons_(0),
+        pressed_(0)
+    {}
+
+    /*!
+     * @brief Samples the current state of the keyboard.
+     * @param[in] time See time_.
+     * @param[in] cameraAngle The camera's X and Y angle. WASD moves relative
+     * to the camera.
+     */
+    static InputCommand Sample(Urho3D::Input* input,
+                               unsigned frame,
+                               float time,
+                               float timeStep,
+                               const Urho3D::Vector2& cameraAngle);
+
+    bool IsDown(Button button) const
+            { return (buttons_ & button) != 0; }
+
+    /// Returns true if the button went down since the previous command
+    bool IsPressed(Button button) const
+            { return (pressed_ & button) != 0; }
+
+    void Write(Urho3D::Serializer& dest) const;
+    bool Read(Urho3D::Deserializer& source);
+
+    /// Number of the physics tick that consumed the command, see InputCommandBuffer::Consume()
+    unsigned sequence_;
+    /// Frame number the command was sampled on
+    unsigned frame_;
+    /// Start of the frame the command was sampled on, in seconds. Ticks
+    /// ending after this use the command.
+    float time_;
+    /// Length of the frame the command was sampled on
+    float timeStep_;
+    Urho3D::Vector2 cameraAngle_;
+    unsigned char buttons_;
+    unsigned char pressed_;
+};
+
+/*!
+ * @brief Ring buffer of input commands, filled once per render frame and
+ * consumed once per physics tick.
+ *
+ * There may be several frames between two ticks (high frame rate) or several
+ * ticks between two frames (low frame rate). Consume() handles both by
+ * handing each tick the commands that were sampled before it ended.
+ */
+class InputCommandBuffer
+{
+public:
+    InputCommandBuffer(unsigned capacity=64);
+
+    /*!
+     * @brief Appends a command. If the buffer is full, the oldest command is
+     * dropped, but its pressed buttons are carried over to the next one.
+     */
+    void Push(const InputCommand& command);
+
+    /*!
+     * @brief Removes the oldest command. Returns false if the buffer is empty.
+     */
+    bool Pop(InputCommand* command);
+
+    /*!
+     * @brief Consumes the queued commands that were sampled before the end of
+     * a physics tick, in order, and returns the input to use for that tick.
+     * Commands sampled later stay queued for the following ticks.
+     *
+     * Held buttons and the camera angle come from the newest consumed
+     * command, pressed buttons are merged from all of them. If nothing was
+     * due, the previous input is repeated without any presses. Each call
+     * stamps the result with the next sequence number.
+     *
+     * @param[in] tickEndTime The time the tick ends at, on the same clock as
+     * InputCommand::time_.
+     */
+    const InputCommand& Consume(float tickEndTime);
+
+    /*!
+     * @brief Consumes only the oldest queued command and returns it. Used when
+     * every command already stands for one tick, e.g. commands received from
+     * a client. If nothing is queued, the previous input is repeated without
+     * any presses and with the same sequence number, see GetRepeatCount().
+     */
+    const InputCommand& ConsumeNext();
+
+    /// Drops all queued commands and releases all buttons
+    void Clear();
+
+    unsigned GetSize() const
+            { return size_; }
+
+    bool IsEmpty() const
+            { return size_ == 0; }
+
+    /// Returns the result of the last call to Consume()
+    const InputCommand& GetCurrent() const
+            { return current_; }
+
+    /// Number of ticks ConsumeNext() repeated the current command for because nothing was queued
+    unsigned GetRepeatCount() const
+            { return repeatCount_; }
+
+private:
+    Urho3D::PODVector<InputCommand> commands_;
+    InputCommand current_;
+    unsigned head_;
+    unsigned size_;
+    unsigned nextSequence_;
+    unsigned repeatCount_;
+};
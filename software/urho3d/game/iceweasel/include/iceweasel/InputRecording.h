@@ -0,0 +1,157 @@
+#pragma once
+
+#include "iceweasel/InputCommand.h"
+#include "iceweasel/MovementSystem.h"
+#include "iceweasel/TickProfiler.h"
+
+#include <Urho3D/Scene/Component.h>
+
+namespace Urho3D {
+    class File;
+    class Node;
+    class Scene;
+}
+class MovementController;
+
+/*!
+ * @brief Binary recording of the input of all players, written by
+ * InputRecorder and played back by InputReplay.
+ *
+ * The file starts with the ID "IRLG" followed by the format version as an
+ * unsigned int and a header:
+ *
+ *   String         scene resource name
+ *   String         IceWeaselConfig XML
+ *   int            physics FPS
+ *
+ * The rest of the file is a sequence of chunks, each starting with a one
+ * byte chunk type:
+ *
+ *   CHUNK_FRAME
+ *     float          time step passed to Scene::Update()
+ *
+ *   CHUNK_PLAYERS
+ *     unsigned int   player count
+ *     per player: MovementSnapshot, in MovementSystem slot order
+ *
+ *   CHUNK_TICK
+ *     float          physics time step
+ *     unsigned int   player count
+ *     per player: InputCommand consumed during the tick
+ *     unsigned int   MovementSystem::GetStateHash() after the tick
+ *
+ * A players chunk follows the frame chunk of the first frame and of every
+ * frame in which players were added or removed. Tick chunks follow the frame
+ * chunk they were simulated in.
+ */
+namespace InputRecording
+{
+    static const unsigned VERSION = 1;
+
+    enum ChunkType
+    {
+        CHUNK_FRAME = 1,
+        CHUNK_PLAYERS = 2,
+        CHUNK_TICK = 3
+    };
+}
+
+/*!
+ * @brief Records the input of all players in the scene, see InputRecording.
+ */
+class InputRecorder : public Urho3D::Component
+{
+    URHO3D_OBJECT(InputRecorder, Urho3D::Component)
+
+public:
+    InputRecorder(Urho3D::Context* context);
+    virtual ~InputRecorder();
+
+    /*!
+     * @brief Registers this class as an object factory.
+     */
+    static void RegisterObject(Urho3D::Context* context);
+
+    /*!
+     * @brief Starts writing to the file. Any previous recording is stopped.
+     * @param[in] sceneName Resource name of the scene, so the replay can load
+     * it again.
+     */
+    bool StartRecording(const Urho3D::String& fileName, const Urho3D::String& sceneName);
+    void StopRecording();
+    bool IsRecording() const;
+
+protected:
+    virtual void OnSceneSet(Urho3D::Scene* scene) override;
+
+private:
+    MovementSystem* GetMovementSystem();
+    void RecordPlayersIfChanged();
+
+    void HandleSceneUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandlePhysicsPostStep(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+
+    Urho3D::SharedPtr<Urho3D::File> recordFile_;
+    Urho3D::WeakPtr<MovementSystem> movementSystem_;
+    // Players in slot order at the time of the last players chunk
+    Urho3D::PODVector<MovementController*> players_;
+    bool recordPlayers_;
+};
+
+/*!
+ * @brief Plays back an input recording headless and as fast as possible.
+ * Reports how long each part of a tick took and whether the state after each
+ * tick matches the recording.
+ */
+class InputReplay : public Urho3D::Object
+{
+    URHO3D_OBJECT(InputReplay, Urho3D::Object)
+
+public:
+    InputReplay(Urho3D::Context* context);
+
+    /*!
+     * @brief Runs the recording and prints a report to stdout.
+     * @return Returns 0 if all state hashes match, 1 if any differ and 2 if
+     * the recording could not be read.
+     */
+    int Run(const Urho3D::String& fileName);
+
+private:
+    struct Tick
+    {
+        float timeStep_;
+        Urho3D::PODVector<InputCommand> commands_;
+        unsigned hash_;
+    };
+
+    struct Frame
+    {
+        float timeStep_;
+        bool hasPlayers_;
+        Urho3D::PODVector<MovementSnapshot> players_;
+        // Range in ticks_
+        unsigned firstTick_;
+        unsigned tickCount_;
+    };
+
+    bool ReadRecording(Urho3D::File* file);
+    bool CreateScene(const Urho3D::String& sceneName, int fps);
+    void CreatePlayers(const Urho3D::PODVector<MovementSnapshot>& players);
+
+    void HandlePhysicsPostStep(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+
+    Urho3D::SharedPtr<Urho3D::Scene> scene_;
+    Urho3D::SharedPtr<TickProfiler> profiler_;
+    Urho3D::WeakPtr<MovementSystem> movementSystem_;
+    Urho3D::Vector<Urho3D::SharedPtr<Urho3D::Node> > players_;
+    Urho3D::Vector<Frame> frames_;
+    Urho3D::Vector<Tick> ticks_;
+
+    // Next tick in ticks_ to compare against, and the end of the current frame
+    unsigned nextTick_;
+    unsigned frameEnd_;
+    unsigned hashMismatches_;
+    unsigned firstMismatch_;
+    unsigned lastHash_;
+};
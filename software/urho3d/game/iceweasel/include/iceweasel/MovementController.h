@@ -1,69 +1,235 @@
 #pragma once
 
-#include "iceweasel/Curves.h"
+#include "iceweasel/CharacterProbeSystem.h"
+#include "iceweasel/CharacterState.h"
+#include "iceweasel/IceWeaselConfig.h"
+#include "iceweasel/InputCommand.h"
+#include "iceweasel/UpdateRateScheduler.h"
 #include <Urho3D/Scene/LogicComponent.h>
 
 namespace Urho3D {
     class Input;
+    class Time;
     class PhysicsWorld;
     class RigidBody;
     class CollisionShape;
 }
 
 class GravityManager;
+class MovementSystem;
+struct MovementSnapshot;
 
 class MovementController : public Urho3D::LogicComponent
 {
     URHO3D_OBJECT(MovementController, Urho3D::LogicComponent)
 
 public:
-    MovementController(Urho3D::Context* context, Urho3D::Node* moveNode, Urho3D::Node* offsetNode);
+    enum InputSource
+    {
+        /// Input is sampled from the local keyboard every frame
+        INPUT_KEYBOARD,
+        /// Input commands are pushed by someone else, one per tick (e.g. from
+        /// the network). See GetInputCommands().
+        INPUT_REMOTE
+    };
+
+    /*!
+     * @param[in] state The movement results are written to this every tick.
+     * If NULL, the controller creates its own.
+     */
+    MovementController(Urho3D::Context* context, Urho3D::Node* moveNode, Urho3D::Node* offsetNode, CharacterState* state);
+
+    CharacterState* GetCharacterState() const
+            { return state_; }
 
     void setRespawnDistance(float distance);
 
+    /// Normal of the ground the player last stood on, pointing away from it
+    const Urho3D::Vector3& GetGroundNormal() const
+            { return groundNormal_; }
+
+    /*!
+     * @brief Consumes the input for this substep, crouches or stands up
+     * accordingly and fills in the inputs of the ground and ceiling probes.
+     * Called by MovementSystem on the main thread at the start of every
+     * physics substep, before the probes of all characters are run.
+     * @param[in] tickEndTime Elapsed time (see Time::GetElapsedTime()) at
+     * the end of the substep. Keyboard input sampled after that is left for
+     * the following substeps.
+     */
+    void PrepareProbes(float tickEndTime);
+
+    /*!
+     * @brief Gathers the input, contacts and probe results into this
+     * controller's slot of the movement state arrays. Called by
+     * MovementSystem on the main thread once the probes have run.
+     */
+    void PrepareMovement(float timeStep);
+
+    /*!
+     * @brief Applies the integrated velocity and rotation to the body. Called
+     * by MovementSystem on the main thread after all characters were
+     * integrated.
+     */
+    void ApplyMovement();
+
+    /*!
+     * @brief Input commands waiting for the next physics tick. Commands can be
+     * serialised with InputCommand::Write().
+     */
+    InputCommandBuffer& GetInputCommands()
+            { return commands_; }
+
+    void SetInputSource(InputSource source)
+            { inputSource_ = source; }
+
+    InputSource GetInputSource() const
+            { return inputSource_; }
+
+    /*!
+     * @brief Makes this character an observer of the update rate scheduler,
+     * so entities near it are updated at full rate. Only characters a player
+     * controls should be observers. Bots aren't, otherwise every character is
+     * always near an observer and nothing is ever updated at a lower rate.
+     */
+    void SetIsObserver(bool enable);
+
+    bool IsObserver() const
+            { return isObserver_; }
+
+    /*!
+     * @brief Returns the movement state after the last physics tick.
+     */
+    MovementSnapshot CaptureSnapshot() const;
+
+    /*!
+     * @brief Moves the character to a previously captured state, e.g. a
+     * correction received from the server.
+     */
+    void RestoreSnapshot(const MovementSnapshot& snapshot);
+
+    /*!
+     * @brief Advances a snapshot by one tick using the given input, without
+     * touching the scene or this controller's state. Used to re-simulate the
+     * ticks the server hasn't acknowledged yet after a correction.
+     *
+     * Probes and gravity are queried at the snapshot's position. The ground
+     * is detected the same way as in a regular tick, with the probes standing
+     * in for contacts. Collisions with other bodies can't be re-simulated.
+     * @return False if the character would run into something during this
+     * tick. The snapshot must be discarded in that case.
+     */
+    bool Resimulate(MovementSnapshot* snapshot, const InputCommand& command, float timeStep) const;
+
+    /*!
+     * @brief Sets the node that is drawn in place of the body. It must be a
+     * child of the move node. Its transform is interpolated between the last
+     * two physics ticks, see InterpolateVisual(). If NULL (the default),
+     * nothing is interpolated, which is fine for characters nobody looks at.
+     */
+    void SetVisualNode(Urho3D::Node* node);
+
+    /*!
+     * @brief Remembers the body's transform after a physics tick. Called by
+     * MovementSystem after every substep.
+     */
+    void RecordPhysicsTransform();
+
+    /*!
+     * @brief Places the visual node between the transforms of the last two
+     * physics ticks. Called by MovementSystem once per frame.
+     * @param[in] alpha 0 is the second to last tick, 1 is the last tick.
+     */
+    void InterpolateVisual(float alpha);
+
+    /*!
+     * @brief Snaps the visual node to the body after the next tick instead of
+     * sliding it there. Use after teleporting.
+     */
+    void ResetInterpolation();
+
+    unsigned GetMovementSystemIndex() const
+            { return movementSystemIndex_; }
+
+    void SetMovementSystemIndex(unsigned index)
+            { movementSystemIndex_ = index; }
+
 protected:
     virtual void Start() override;
     virtual void Stop() override;
     virtual void Update(float timeStep) override;
-    virtual void FixedUpdate(float timeStep) override;
 
     void CreateComponents();
     void DestroyComponents();
-    bool CanStandUp() const;
+    bool CanStandUp();
     bool IsCrouching() const;
 
 private:
-    void FixedUpdate_Ground(float timeStep);
-    void FixedUpdate_Water(float timeStep);
+    void PrepareProbes_Ground(const InputCommand& command);
+    void PrepareMovement_Ground(const InputCommand& command, float timeStep);
+    void PrepareMovement_Water(const InputCommand& command, float timeStep);
+    // Acceleration the input asks for, in the plane we're walking on
+    Urho3D::Vector3 GetTargetAcceleration(const InputCommand& command, bool isCrouching) const;
+    // Swaps the collision shapes and probe dimensions
+    void SetCrouching(bool enable);
     void Update_Ground(float timeStep);
     void Update_Water(float timeStep);
     // Returns true if the player is on the ground
     bool ResetDownVelocityIfOnGround();
+    // Copies the current body dimensions into the ground/ceiling probe
+    void UpdateProbeShape();
+    // Same as ResetDownVelocityIfOnGround(), but uses the contacts gathered
+    // since the last tick and only probes if those are ambiguous
+    bool ResetDownVelocityIfTouchingGround();
+    void ClearContacts();
+    // Ticks between two ground probes and gravity queries, see UpdateRateScheduler
+    unsigned GetUpdateInterval() const;
     void UpdatePhysicsSettings();
     void SetInitialPhysicsParameters();
 
     void HandleCameraAngleChanged(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
     void HandleConfigReloaded(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
-
-    void NotifyLocalMovementVelocityChange(const Urho3D::Vector3& localPlaneVelocity);
-    void NotifyCrouchStateChange(bool isCrouching);
+    void HandleNodeCollision(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
 
     Urho3D::SharedPtr<Urho3D::Input> input_;
+    Urho3D::SharedPtr<Urho3D::Time> time_;
+    Urho3D::SharedPtr<IceWeaselConfig::PlayerClassParameters> parameters_;
     Urho3D::SharedPtr<Urho3D::PhysicsWorld> physicsWorld_;
     Urho3D::SharedPtr<GravityManager> gravityManager_;
+    Urho3D::SharedPtr<CharacterProbeSystem> probeSystem_;
+    Urho3D::SharedPtr<MovementSystem> movementSystem_;
     Urho3D::SharedPtr<Urho3D::RigidBody> body_;
     Urho3D::SharedPtr<Urho3D::CollisionShape> collisionShapeUpright_;
     Urho3D::SharedPtr<Urho3D::CollisionShape> collisionShapeCrouch_;
     Urho3D::SharedPtr<Urho3D::Node> moveNode_;
     Urho3D::SharedPtr<Urho3D::Node> offsetNode_;
+    Urho3D::SharedPtr<Urho3D::Node> visualNode_;
+    Urho3D::SharedPtr<CharacterState> state_;
 
-    ExponentialCurve<Urho3D::Vector3> localPlaneAcceleration_;
+    UpdateRateTimer gravityTimer_;
+    CharacterProbe probe_;
+    // Sampled every frame in Update(), consumed every physics tick
+    InputCommandBuffer commands_;
+    Urho3D::Vector3 groundNormal_;
 
+    // Body transforms of the last two physics ticks, see InterpolateVisual()
+    Urho3D::Vector3 previousPosition_;
+    Urho3D::Vector3 currentPosition_;
+    Urho3D::Quaternion previousRotation_;
     Urho3D::Quaternion currentRotation_;
+    bool hasPhysicsTransform_;
+
+    // Contacts reported by the physics world since the last tick
+    Urho3D::Vector3 contactGroundNormal_;
+    unsigned groundContactCount_;
+    unsigned steepContactCount_;
+    bool hasCeilingContact_;
+
     Urho3D::Vector2 cameraAngle_;
-    float downVelocity_;
     float respawnDistance_;
-    bool jumpKeyPressed_;
-    bool crouchKeyPressed_;
+    // Our slot in the MovementSystem's state arrays
+    unsigned movementSystemIndex_;
+    InputSource inputSource_;
+    bool isObserver_;
     bool isSwimming_;
 };
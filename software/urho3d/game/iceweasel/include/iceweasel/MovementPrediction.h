@@ -0,0 +1,118 @@
+#pragma once
+
+#include "iceweasel/InputCommand.h"
+#include "iceweasel/MovementSystem.h"
+
+#include <Urho3D/Scene/Component.h>
+
+namespace Urho3D {
+    class Connection;
+    class Context;
+    class MemoryBuffer;
+}
+class MovementController;
+
+/// Client -> server. A count followed by that many InputCommands.
+static const int MSG_MOVEMENTINPUT = 0x200;
+/// Server -> client. The sequence number of the last consumed command, the
+/// number of ticks the server simulated since (see
+/// InputCommandBuffer::GetRepeatCount()), followed by the MovementSnapshot
+/// after those ticks.
+static const int MSG_MOVEMENTSTATE = 0x201;
+
+/*!
+ * @brief Keeps the movement of a character in sync between the server and the
+ * client controlling it. Must be on the same node as the character's
+ * MovementController.
+ *
+ * In PREDICT mode (client), the controller runs on local input as usual. The
+ * input and resulting state of every tick is kept in a history and the input
+ * is sent to the server until it is acknowledged. When the server's state for
+ * a tick differs from the predicted one, the client starts from the server's
+ * state and re-simulates all ticks that the server hasn't seen yet.
+ *
+ * In AUTHORITY mode (server), the commands received from the connection are
+ * fed to the controller one per tick (MovementController::INPUT_REMOTE) and
+ * the resulting state is sent back. If the client's commands don't arrive in
+ * time, the server keeps simulating with the last one. The client only
+ * compares states that belong exactly to one of its ticks.
+ */
+class MovementPrediction : public Urho3D::Component
+{
+    URHO3D_OBJECT(MovementPrediction, Urho3D::Component)
+
+public:
+    enum Mode
+    {
+        PREDICT,
+        AUTHORITY
+    };
+
+    /*!
+     * @brief Constructs a new movement prediction component.
+     */
+    MovementPrediction(Urho3D::Context* context);
+
+    /*!
+     * @brief Registers this class as an object factory.
+     */
+    static void RegisterObject(Urho3D::Context* context);
+
+    void SetMode(Mode mode);
+
+    Mode GetMode() const
+            { return mode_; }
+
+    /*!
+     * @brief Sets the client connection whose input drives this character.
+     * Only used in AUTHORITY mode. In PREDICT mode, the server connection is
+     * used.
+     */
+    void SetConnection(Urho3D::Connection* connection);
+
+    /// Predicted positions further than this from the server's are corrected
+    void SetCorrectionTolerance(float tolerance)
+            { correctionTolerance_ = tolerance; }
+
+    /// Number of times the prediction had to be corrected
+    unsigned GetCorrectionCount() const
+            { return correctionCount_; }
+
+    /// Number of ticks that were predicted but not acknowledged yet
+    unsigned GetPendingCount() const
+            { return history_.Size(); }
+
+protected:
+    virtual void OnSceneSet(Urho3D::Scene* scene) override;
+
+private:
+    struct HistoryEntry
+    {
+        InputCommand command_;
+        float timeStep_;
+        /// State after the command was applied
+        MovementSnapshot snapshot_;
+    };
+
+    MovementController* GetMovementController();
+    Urho3D::Connection* GetConnection() const;
+    void SendInput();
+    void SendState();
+    void ReceiveInput(Urho3D::MemoryBuffer& message);
+    void ReceiveState(Urho3D::MemoryBuffer& message);
+
+    void HandlePhysicsPostStep(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandleNetworkUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandleNetworkMessage(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+
+    Urho3D::WeakPtr<MovementController> movementController_;
+    Urho3D::WeakPtr<Urho3D::Connection> connection_;
+    Urho3D::Vector<HistoryEntry> history_;
+    Mode mode_;
+    float correctionTolerance_;
+    // Client: newest command the server has applied
+    unsigned lastAcknowledged_;
+    // Server: newest command received from the client
+    unsigned lastReceived_;
+    unsigned correctionCount_;
+};
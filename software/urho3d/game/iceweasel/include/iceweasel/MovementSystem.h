@@ -0,0 +1,238 @@
+#pragma once
+
+#include <Urho3D/Math/Quaternion.h>
+#include <Urho3D/Scene/Component.h>
+
+namespace Urho3D {
+    class Context;
+    class Deserializer;
+    class Serializer;
+    class Time;
+    struct WorkItem;
+}
+class CharacterProbeSystem;
+class GravityManager;
+class MovementController;
+
+/*!
+ * @brief Movement state of all characters. All entries at the same index
+ * belong to the same character.
+ */
+struct MovementStates
+{
+    unsigned Size() const
+            { return positions_.Size(); }
+
+    void Push();
+
+    /// Removes an entry by moving the last entry into its place
+    void EraseSwap(unsigned index);
+
+    // Input, gathered on the main thread every tick
+    Urho3D::PODVector<Urho3D::Vector3> positions_;
+    Urho3D::PODVector<Urho3D::Vector3> bodyVelocities_;
+    /// Target acceleration in the plane we're walking on
+    Urho3D::PODVector<Urho3D::Vector3> targetAccelerations_;
+    Urho3D::PODVector<float> jounceSpeeds_;
+    Urho3D::PODVector<float> accelerateSpeeds_;
+    Urho3D::PODVector<float> jumpForces_;
+    Urho3D::PODVector<float> bunnyHopBoosts_;
+    /// Set if the character jumps off the ground during this tick
+    Urho3D::PODVector<bool> jumps_;
+    Urho3D::PODVector<bool> isOnGround_;
+
+    // Carried over from tick to tick
+    Urho3D::PODVector<Urho3D::Vector3> accelerations_;
+    Urho3D::PODVector<Urho3D::Vector3> gravity_;
+    Urho3D::PODVector<Urho3D::Quaternion> rotations_;
+    /// A down velocity of 0.0f means we're on the ground
+    Urho3D::PODVector<float> downVelocities_;
+    /// Tetrahedron of the gravity mesh the character was last found in
+    Urho3D::PODVector<unsigned> gravityHints_;
+
+    // Output, applied on the main thread
+    Urho3D::PODVector<Urho3D::Vector3> linearVelocities_;
+    Urho3D::PODVector<Urho3D::Vector3> localVelocities_;
+};
+
+/*!
+ * @brief Complete movement state of one character after a physics tick. Used
+ * to exchange states between the server and clients and to re-simulate past
+ * ticks, see MovementController::Resimulate().
+ */
+struct MovementSnapshot
+{
+    MovementSnapshot() :
+        rotation_(Urho3D::Quaternion::IDENTITY),
+        downVelocity_(0.0f),
+        isOnGround_(false),
+        isCrouching_(false)
+    {}
+
+    void Write(Urho3D::Serializer& dest) const;
+    bool Read(Urho3D::Deserializer& source);
+
+    Urho3D::Vector3 position_;
+    Urho3D::Vector3 velocity_;
+    Urho3D::Vector3 acceleration_;
+    Urho3D::Vector3 gravity_;
+    /// See MovementStates::rotations_
+    Urho3D::Quaternion rotation_;
+    float downVelocity_;
+    bool isOnGround_;
+    bool isCrouching_;
+};
+
+/*!
+ * @brief Updates the movement of all characters in one pass per physics
+ * substep.
+ *
+ * Each MovementController registers a slot in the movement state arrays.
+ * Every substep (E_PHYSICSPRESTEP) the system:
+ *   1) Lets each controller consume its input, crouch or stand up and fill
+ *      in its probe inputs (MovementController::PrepareProbes()), then runs
+ *      the probes of all characters at once and lets each controller gather
+ *      its input, ground contacts and probe results
+ *      (MovementController::PrepareMovement()). All of this happens on the
+ *      main thread.
+ *   2) Queries gravity for all characters that are due, split across the
+ *      WorkQueue's threads.
+ *   3) Integrates acceleration and velocity of all characters, split across
+ *      the WorkQueue's threads. This stage only reads and writes the arrays.
+ *   4) Applies the velocities and rotations to the bodies on the main thread
+ *      in slot order (MovementController::ApplyMovement()), so the result
+ *      doesn't depend on how the work was split.
+ *
+ * Small batches are run on the main thread only.
+ *
+ * After every substep (E_PHYSICSPOSTSTEP) each controller records the
+ * transform of its body. After the scene update (E_SCENEPOSTUPDATE) the
+ * visual nodes are placed between the last two recorded transforms,
+ * according to how much time is left over until the next substep. See
+ * MovementController::InterpolateVisual().
+ */
+class MovementSystem : public Urho3D::Component
+{
+    URHO3D_OBJECT(MovementSystem, Urho3D::Component)
+
+public:
+    /// Time spent in each stage during the last substep, in nanoseconds
+    struct StageTimes
+    {
+        StageTimes() :
+            prepare_(0),
+            gravity_(0),
+            integrate_(0),
+            apply_(0)
+        {}
+
+        long long prepare_;
+        long long gravity_;
+        long long integrate_;
+        long long apply_;
+    };
+
+    /*!
+     * @brief Constructs a new movement system.
+     */
+    MovementSystem(Urho3D::Context* context);
+
+    /*!
+     * @brief Destructs the movement system.
+     */
+    virtual ~MovementSystem();
+
+    /*!
+     * @brief Registers this class as an object factory.
+     */
+    static void RegisterObject(Urho3D::Context* context);
+
+    /*!
+     * @brief Gives the controller a slot in the movement state arrays. This is
+     * called by movement controllers when they start. Controllers can't be
+     * added or removed while a substep is being processed.
+     */
+    void AddMovementController(MovementController* controller);
+
+    /*!
+     * @brief Removes the controller's slot. The last slot is moved into the
+     * freed one, which would invalidate the slot indices a substep is
+     * working with, so this mustn't be called while one is being processed.
+     */
+    void RemoveMovementController(MovementController* controller);
+
+    unsigned GetMovementControllerCount() const
+            { return controllers_.Size(); }
+
+    MovementController* GetMovementController(unsigned index) const
+            { return controllers_[index]; }
+
+    MovementStates& GetStates()
+            { return states_; }
+
+    const StageTimes& GetStageTimes() const
+            { return stageTimes_; }
+
+    /*!
+     * @brief Hashes the position, velocity and rotation of every character in
+     * slot order. Two runs with the same input must produce the same hash
+     * after every tick, see InputReplay.
+     */
+    unsigned GetStateHash() const;
+
+    /*!
+     * @brief Requests the gravity of a character to be queried during this
+     * substep. Otherwise the gravity of the last query is used.
+     */
+    void QueueGravityQuery(unsigned index)
+            { gravityQueries_.Push(index); }
+
+    /*!
+     * @brief Advances the movement of one character by one substep. Only
+     * reads and writes the character's entries in the state arrays, so it can
+     * be called for different characters at the same time.
+     */
+    static void IntegrateMovement(MovementStates* states, unsigned index, float timeStep);
+
+protected:
+    virtual void OnSceneSet(Urho3D::Scene* scene) override;
+
+private:
+    typedef void (MovementSystem::*Stage)(unsigned begin, unsigned end);
+
+    /// Runs a stage over [0, count), split across the WorkQueue's threads
+    void RunStage(Stage stage, unsigned count);
+    static void RunStageWork(const Urho3D::WorkItem* item, unsigned threadIndex);
+
+    void QueryGravityStage(unsigned begin, unsigned end);
+    void IntegrateMovementStage(unsigned begin, unsigned end);
+
+    GravityManager* GetGravityManager();
+    CharacterProbeSystem* GetProbeSystem();
+
+    void HandleSceneUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandlePhysicsPreStep(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandlePhysicsPostStep(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandleScenePostUpdate(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+
+    MovementStates states_;
+    Urho3D::PODVector<MovementController*> controllers_;
+
+    // Scratch space reused every substep
+    Urho3D::PODVector<unsigned> gravityQueries_;
+    Urho3D::PODVector<Urho3D::Vector3> queryPositions_;
+    Urho3D::PODVector<Urho3D::Vector3> queryGravity_;
+    Urho3D::PODVector<unsigned> queryHints_;
+    Urho3D::PODVector<unsigned> stageBounds_;
+
+    Urho3D::WeakPtr<GravityManager> gravityManager_;
+    Urho3D::WeakPtr<CharacterProbeSystem> probeSystem_;
+    Urho3D::SharedPtr<Urho3D::Time> time_;
+    StageTimes stageTimes_;
+    Stage currentStage_;
+    float timeStep_;
+    // Time the physics world hasn't simulated yet, like Bullet's accumulator
+    float timeSinceTick_;
+    // Set while HandlePhysicsPreStep() works with slot indices
+    bool isStepping_;
+};
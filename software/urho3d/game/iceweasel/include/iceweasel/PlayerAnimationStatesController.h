@@ -1,6 +1,8 @@
 #pragma once
 
+#include "iceweasel/CharacterState.h"
 #include "iceweasel/Curves.h"
+#include "iceweasel/IceWeaselConfig.h"
 #include "iceweasel/PlayerAnimation.h"
 #include <Urho3D/Scene/LogicComponent.h>
 
@@ -28,7 +30,10 @@ public:
         SWIMMING
     };
 
-    PlayerAnimationStatesController(Urho3D::Context* context);
+    /*!
+     * @param[in] state Movement state of the character this model belongs to.
+     */
+    PlayerAnimationStatesController(Urho3D::Context* context, CharacterState* state);
 
 protected:
     virtual void Start() override;
@@ -39,15 +44,14 @@ private:
     void HandleCrouchWeights(float velocitySquared);
     void HandleAirWeights();
 
-    void HandleLocalMovementVelocityChanged(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
-    void HandleCrouchStateChanged(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandleConfigReloaded(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
     void HandleDownVelocityChange(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
 
     Urho3D::SharedPtr<Urho3D::AnimationState> animation_[PlayerAnimation::NUM_ANIMATIONS];
     ExponentialCurve<float> animationWeight_[PlayerAnimation::NUM_ANIMATIONS];
+    Urho3D::SharedPtr<IceWeaselConfig::PlayerClassParameters> parameters_;
 
     State state_;
 
-    Urho3D::Vector3 currentLocalVelocity_;
-    bool isCrouching_;
+    Urho3D::SharedPtr<CharacterState> characterState_;
 };
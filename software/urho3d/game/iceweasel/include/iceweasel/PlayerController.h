@@ -1,6 +1,8 @@
 #pragma once
 
+#include "iceweasel/CharacterState.h"
 #include "iceweasel/Curves.h"
+#include "iceweasel/IceWeaselConfig.h"
 #include <Urho3D/Scene/LogicComponent.h>
 
 namespace Urho3D {
@@ -36,7 +38,7 @@ protected:
     virtual void Update(float timeStep) override;
 
 private:
-    void HandleLocalMovementVelocityChanged(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandleConfigReloaded(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
 
     void CreateComponents();
     void DestroyComponents();
@@ -44,9 +46,13 @@ private:
     Urho3D::SharedPtr<Urho3D::Node> moveNode_;
     Urho3D::SharedPtr<Urho3D::Node> offsetNode_;
     Urho3D::SharedPtr<Urho3D::Node> rotateNode_;
+    // Interpolated between physics ticks, parent of the offset and model nodes
+    Urho3D::SharedPtr<Urho3D::Node> visualNode_;
     Urho3D::SharedPtr<Urho3D::Node> modelNode_;
+    Urho3D::SharedPtr<IceWeaselConfig::PlayerClassParameters> parameters_;
+    // Written by our MovementController, read by us and our animation controller
+    Urho3D::SharedPtr<CharacterState> state_;
 
-    Urho3D::Vector3 currentLocalVelocity_;
     Urho3D::Vector3 oldLocalVelocity_;
 
     float currentYAngle_;
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <Urho3D/Scene/Component.h>
+
+namespace Urho3D {
+    class Context;
+    class DebugRenderer;
+    class Node;
+}
+class GravityManager;
+
+/*!
+ * @brief Simulates ballistic projectiles under the gravity field.
+ *
+ * Projectiles aren't nodes or rigid bodies. Their state is kept in flat
+ * arrays in a pool of fixed size, and all of them are advanced together once
+ * per physics substep (E_PHYSICSPRESTEP): the gravity of all projectiles is
+ * looked up with a single batched GravityManager query, then each projectile
+ * is integrated and the segment it travelled is raycast against the physics
+ * world. Projectiles that hit something are removed and an E_PROJECTILEHIT
+ * event is sent from this component.
+ *
+ * Add one of these to the scene. It uses the first GravityManager found in the
+ * scene, or the physics world's gravity if there is none.
+ */
+class ProjectileSystem : public Urho3D::Component
+{
+    URHO3D_OBJECT(ProjectileSystem, Urho3D::Component)
+
+public:
+
+    /*!
+     * @brief Constructs a new projectile system.
+     */
+    ProjectileSystem(Urho3D::Context* context);
+
+    /*!
+     * @brief Destructs the projectile system.
+     */
+    virtual ~ProjectileSystem();
+
+    /*!
+     * @brief Registers this class as an object factory.
+     */
+    static void RegisterObject(Urho3D::Context* context);
+
+    /*!
+     * @brief Spawns a new projectile.
+     * @param[in] position World position to spawn the projectile at.
+     * @param[in] velocity Initial velocity in m/s.
+     * @param[in] lifetime Time in seconds after which the projectile is
+     * removed if it didn't hit anything.
+     * @return Returns false if the pool is full.
+     */
+    bool Fire(const Urho3D::Vector3& position, const Urho3D::Vector3& velocity, float lifetime);
+
+    /// Removes all projectiles
+    void Clear();
+
+    /*!
+     * @brief Sets the maximum number of projectiles that can exist at the same
+     * time. Reducing the capacity removes the newest projectiles.
+     */
+    void SetCapacity(unsigned capacity);
+
+    unsigned GetCapacity() const
+            { return capacity_; }
+
+    /// Number of projectiles currently in flight
+    unsigned GetCount() const
+            { return positions_.Size(); }
+
+    /// Collision mask used when raycasting projectiles against the physics world
+    void SetCollisionMask(unsigned mask)
+            { collisionMask_ = mask; }
+
+    unsigned GetCollisionMask() const
+            { return collisionMask_; }
+
+    const Urho3D::PODVector<Urho3D::Vector3>& GetPositions() const
+            { return positions_; }
+
+    const Urho3D::PODVector<Urho3D::Vector3>& GetVelocities() const
+            { return velocities_; }
+
+    virtual void DrawDebugGeometry(Urho3D::DebugRenderer* debug, bool depthTest) override;
+
+protected:
+    virtual void OnSceneSet(Urho3D::Scene* scene) override;
+
+private:
+    /// Removes a projectile by moving the last projectile into its place
+    void EraseSwap(unsigned index);
+
+    GravityManager* GetGravityManager();
+
+    void HandlePhysicsPreStep(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+
+    // All arrays are indexed by projectile
+    Urho3D::PODVector<Urho3D::Vector3> positions_;
+    Urho3D::PODVector<Urho3D::Vector3> velocities_;
+    Urho3D::PODVector<float> lifetimes_;
+    /// Tetrahedron of the gravity mesh each projectile was last found in
+    Urho3D::PODVector<unsigned> gravityHints_;
+
+    // Scratch space reused every substep
+    Urho3D::PODVector<Urho3D::Vector3> gravity_;
+    Urho3D::PODVector<Urho3D::Vector3> previousPositions_;
+    Urho3D::PODVector<Urho3D::Vector3> hitPositions_;
+    Urho3D::PODVector<Urho3D::Vector3> hitNormals_;
+    Urho3D::PODVector<Urho3D::Vector3> hitVelocities_;
+    Urho3D::Vector<Urho3D::WeakPtr<Urho3D::Node> > hitNodes_;
+
+    Urho3D::WeakPtr<GravityManager> gravityManager_;
+
+    unsigned capacity_;
+    unsigned collisionMask_;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+namespace Urho3D {
+    class Context;
+}
+
+/*!
+ * @brief Exposes ProjectileSystem to AngelScript and Lua.
+ *
+ * Must be called after the Script and LuaScript subsystems were registered.
+ * Either one is skipped if it doesn't exist. From AngelScript the component
+ * is retrieved with
+ *
+ *     ProjectileSystem@ p = cast<ProjectileSystem>(scene.GetComponent("ProjectileSystem", true));
+ *
+ * and from Lua with
+ *
+ *     local p = tolua.cast(scene:GetComponent("ProjectileSystem", true), "ProjectileSystem")
+ */
+void RegisterProjectileSystemAPI(Urho3D::Context* context);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+/// Sent from the ProjectileSystem when one of its projectiles hits something
+URHO3D_EVENT(E_PROJECTILEHIT, ProjectileHit)
+{
+    URHO3D_PARAM(P_POSITION, Position);            // Vector3
+    URHO3D_PARAM(P_NORMAL, Normal);                // Vector3
+    URHO3D_PARAM(P_VELOCITY, Velocity);            // Vector3
+    URHO3D_PARAM(P_NODE, Node);                    // Node pointer
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "iceweasel/GravityVectorSnapshot.h"
 #include "iceweasel/TetrahedralMesh_Vertex.h"
 #include "iceweasel/TetrahedralMesh_Polyhedron.h"
 
@@ -7,7 +8,9 @@
 #include <Urho3D/Container/Vector.h>
 #include <Urho3D/Math/Vector3.h>
 
-class GravityVector;
+namespace Urho3D {
+    class DebugRenderer;
+}
 
 struct TetrahedralMeshBuilder
 {
@@ -18,20 +21,67 @@ struct TetrahedralMeshBuilder
     class CircumscribedTetrahedron : public Urho3D::RefCounted
     {
     public:
-        CircumscribedTetrahedron() {}
         CircumscribedTetrahedron(TetrahedralMesh::Vertex* v1, TetrahedralMesh::Vertex* v2,
                                  TetrahedralMesh::Vertex* v3, TetrahedralMesh::Vertex* v4);
 
         Urho3D::SharedPtr<TetrahedralMesh::Vertex> v_[4];
-        Urho3D::Vector3 circumscibedSphereCenter_;
+        /// Tetrahedron on the other side of the face opposite to vertex i, or
+        /// NULL if the face is on the hull
+        CircumscribedTetrahedron* neighbours_[4];
+        /// Sign of GeometricPredicates::Orient3D() for the four vertices
+        int orientation_;
     };
 
     typedef Urho3D::Vector<Urho3D::SharedPtr<CircumscribedTetrahedron> > CircumscribedTetrahedralMesh;
 
+    TetrahedralMeshBuilder();
+
+    /*!
+     * @brief Takes a snapshot of all gravity vector components and creates a
+     * triangulated mesh.
+     * @param[in] gravityVectors Snapshot of all gravity vectors.
+     * @param[in] excluded Optional. Entries set to true are not inserted into
+     * the mesh (see TetrahedralMeshDecimator). A vertex is still created for
+     * them so GetVertices() stays in the same order as the snapshot.
+     */
+    void Build(const GravityVectorSnapshot& gravityVectors,
+               const Urho3D::PODVector<bool>* excluded=NULL);
+
+    /*!
+     * @brief Starts a resumable build. The snapshot is copied, so it can
+     * safely change while the build is in progress. Call Step() until it
+     * returns true.
+     */
+    void Begin(const GravityVectorSnapshot& gravityVectors,
+               const Urho3D::PODVector<bool>* excluded=NULL);
+
+    /*!
+     * @brief Continues a build started with Begin().
+     * @param[in] maxInsertions The maximum number of gravity vectors to insert
+     * into the triangulation during this call. Once all gravity vectors are
+     * inserted, the next call finalises the mesh and the hull.
+     * @return Returns true if the build is finished and the results can be
+     * retrieved.
+     */
+    bool Step(unsigned maxInsertions);
+
+    bool IsFinished() const
+            { return isFinished_; }
+
     /*!
-     * @brief Takes a list of gravity vector components and creates a triangulated mesh.
+     * @brief Number of gravity vectors that could not be connected to the
+     * mesh during the last build, e.g. because they share their position with
+     * another gravity vector. They still have a vertex in GetVertices(), but
+     * no tetrahedrons.
      */
-    void Build(const Urho3D::PODVector<GravityVector*>& gravityVectors);
+    unsigned GetSkippedCount() const
+            { return skippedCount_; }
+
+    /*!
+     * @brief Draws the tetrahedrons of a build that is still in progress,
+     * excluding those still connected to the super tetrahedron.
+     */
+    void DrawDebugGeometry(Urho3D::DebugRenderer* debug, bool depthTest) const;
 
     /*!
      * @brief After building, the resulting mesh can be retrieved with this.
@@ -40,6 +90,13 @@ struct TetrahedralMeshBuilder
 
     TetrahedralMesh::Polyhedron* GetHullMesh() const;
 
+    /*!
+     * @brief Gets the vertices that were created for each gravity vector. The
+     * list is in the same order as the snapshot entries passed to Build().
+     * Changing the attributes of these vertices directly affects the mesh.
+     */
+    const Urho3D::Vector<Urho3D::SharedPtr<TetrahedralMesh::Vertex> >& GetVertices() const;
+
 private:
 
     /*!
@@ -50,6 +107,22 @@ private:
      */
     void FindBadTetrahedrons(CircumscribedTetrahedralMesh* badTetrahedrons, Urho3D::Vector3 point) const;
 
+    /*!
+     * @brief Makes sure the point can see every face on the boundary of the
+     * bad tetrahedrons.
+     *
+     * If the point is cospherical with a tetrahedron (which is common with
+     * grid-aligned probes) it can end up coplanar with a boundary face of the
+     * cavity, and connecting the point to that face would create a flat
+     * tetrahedron. In that case the neighbouring tetrahedron on the other
+     * side of the face is added to the cavity. It is guaranteed to have the
+     * point on or inside its circumsphere, so the result stays Delaunay.
+     * @return Returns false if a face the point can't see is on the hull of
+     * the triangulation, so there is no neighbour to add. The point can't be
+     * inserted without creating a flat tetrahedron.
+     */
+    bool ExpandCavity(CircumscribedTetrahedralMesh* badTetrahedrons, Urho3D::Vector3 point) const;
+
     /*!
      * @brief Creates a list of triangles are the hull of the specified list of
      * tetrahedrons.
@@ -68,21 +141,31 @@ private:
     void RemoveTetrahedronsFromTriangulation(const CircumscribedTetrahedralMesh& tetrahedrons);
 
     /*!
-     * @brief Creates tetrahedrons by connecting each triangle of a polyhedron
-     * to that of the specified gravity vector.
-     * @param[in] polyhedron The hull, or polyhedron.
-     * @param[in] gravityVector The position, direction and force factor of the
-     * gravity vector component is used to create the new vertex to which
-     * the faces are connected.
+     * @brief Creates tetrahedrons by connecting each face on the boundary of
+     * the cavity to the new vertex, and links them to their neighbours.
+     * @param[in] cavity The tetrahedrons that were removed from the
+     * triangulation. Their neighbour links are used to find the boundary.
+     * @param[in] connectToVertex The vertex to which the faces are connected.
      */
-    void ReTriangulateGap(const TetrahedralMesh::Polyhedron& polyhedron, const GravityVector& gravityVector);
+    void ReTriangulateGap(const CircumscribedTetrahedralMesh& cavity,
+                          TetrahedralMesh::Vertex* connectToVertex);
 
     /*!
      * @brief Cleans up the triangulation result such that no more connections
-     * exist to the original super tetrahedron.
+     * exist to the original super tetrahedron. Faces that were shared with
+     * removed tetrahedrons are on the hull afterwards.
      */
     void CleanUp(const CircumscribedTetrahedron* superTetrahedron);
 
+    bool IsConnectedToSuperTetrahedron(const CircumscribedTetrahedron* tetrahedron) const;
+
+    GravityVectorSnapshot gravityVectors_;
+    Urho3D::PODVector<bool> excluded_;
     CircumscribedTetrahedralMesh triangulationResult_;
-    TetrahedralMesh::Polyhedron* hull_;
+    Urho3D::Vector<Urho3D::SharedPtr<TetrahedralMesh::Vertex> > vertices_;
+    Urho3D::SharedPtr<CircumscribedTetrahedron> superTetrahedron_;
+    Urho3D::SharedPtr<TetrahedralMesh::Polyhedron> hull_;
+    unsigned nextInsertion_;
+    unsigned skippedCount_;
+    bool isFinished_;
 };
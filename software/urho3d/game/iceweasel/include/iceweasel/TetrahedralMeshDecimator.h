@@ -0,0 +1,62 @@
+#pragma once
+
+#include "iceweasel/GravityVectorSnapshot.h"
+
+#include <Urho3D/Container/Vector.h>
+
+/*!
+ * @brief Finds gravity vectors that don't contribute to the gravity mesh.
+ *
+ * A gravity vector is redundant if the mesh built from its neighbours
+ * already interpolates its direction and force factor within the configured
+ * error. Redundant gravity vectors are removed in passes. Within a pass, no
+ * two removed gravity vectors are neighbours, so every prediction is made
+ * from gravity vectors that are kept. After each pass, all removed gravity
+ * vectors are checked against the mesh built from the remaining ones, and
+ * any that are no longer within the error are put back. Gravity vectors on
+ * the hull are never removed, so the shape of the mesh doesn't change.
+ */
+struct TetrahedralMeshDecimator
+{
+    TetrahedralMeshDecimator();
+
+    /// Maximum angle in degrees between a gravity vector's direction and the interpolated direction
+    void SetMaxAngularError(float degrees)
+            { maxAngularError_ = degrees; }
+
+    /// Maximum absolute difference between a gravity vector's force factor and the interpolated force factor
+    void SetMaxForceFactorError(float error)
+            { maxForceFactorError_ = error; }
+
+    /*!
+     * @brief Decides which gravity vectors can be left out of the gravity
+     * mesh.
+     * @param[out] excluded Resized to the number of snapshot entries. Entries
+     * that can be left out are set to true. This can be passed directly to
+     * TetrahedralMeshBuilder::Build().
+     * @param[in] gravityVectors Snapshot of all gravity vectors.
+     */
+    void Decimate(Urho3D::PODVector<bool>* excluded, const GravityVectorSnapshot& gravityVectors);
+
+    unsigned GetRemovedCount() const
+            { return removedCount_; }
+
+    /// Number of tetrahedrons of the mesh built from all gravity vectors
+    unsigned GetTetrahedronCountBefore() const
+            { return tetrahedronCountBefore_; }
+
+    /// Number of tetrahedrons of the mesh built from the remaining gravity vectors
+    unsigned GetTetrahedronCountAfter() const
+            { return tetrahedronCountAfter_; }
+
+private:
+    bool IsWithinError(const Urho3D::Vector3& predicted,
+                       const Urho3D::Vector3& direction,
+                       float forceFactor) const;
+
+    float maxAngularError_;
+    float maxForceFactorError_;
+    unsigned removedCount_;
+    unsigned tetrahedronCountBefore_;
+    unsigned tetrahedronCountAfter_;
+};
@@ -10,6 +10,7 @@ namespace Urho3D {
     class Color;
     class DebugRenderer;
 }
+class DebugLineCache;
 
 namespace TetrahedralMesh {
 class Vertex;
@@ -28,6 +29,12 @@ public:
          const Urho3D::Vector3& boundaryNormal0,
          const Urho3D::Vector3& boundaryNormal1);
 
+    /*!
+     * @param vertexID The ID (0 or 1) of the vertex to get.
+     * @return Returns the specified vertex.
+     */
+    Vertex* GetVertex(unsigned char vertexID);
+
     void FlipBoundaryCheck();
 
     /*!
@@ -55,6 +62,9 @@ public:
     void DrawDebugGeometry(Urho3D::DebugRenderer* debug, bool depthTest,
                            const Urho3D::Color& color) const;
 
+    /// Same lines as DrawDebugGeometry(), written to a persistent cache
+    void AddDebugLines(DebugLineCache* lines, const Urho3D::Color& color) const;
+
 private:
     Urho3D::Matrix4 CalculateEdgeProjectionMatrix() const;
     Urho3D::Matrix4 CalculateBarycentricTransformationMatrix() const;
@@ -10,6 +10,7 @@ namespace Urho3D {
     class Color;
     class DebugRenderer;
 }
+class DebugLineCache;
 
 namespace TetrahedralMesh {
 class Vertex;
@@ -70,6 +71,9 @@ public:
 
     void DrawDebugGeometry(Urho3D::DebugRenderer* debug, bool depthTest, const Urho3D::Color& color) const;
 
+    /// Same lines as DrawDebugGeometry(), written to a persistent cache
+    void AddDebugLines(DebugLineCache* lines, const Urho3D::Color& color) const;
+
 private:
     Urho3D::Matrix4 CalculateSurfaceProjectionMatrix() const;
     Urho3D::Matrix4 CalculateBarycentricTransformationMatrix() const;
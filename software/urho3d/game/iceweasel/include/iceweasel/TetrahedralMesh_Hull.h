@@ -9,6 +9,8 @@
 namespace Urho3D {
     class DebugRenderer;
 }
+class DebugLineCache;
+
 namespace TetrahedralMesh {
 class Polyhedron;
 class Vertex;
@@ -18,23 +20,132 @@ class Face;
 class Hull : public Urho3D::RefCounted
 {
 public:
+    /// Which part of the hull a query was projected onto
+    enum Feature
+    {
+        FEATURE_NONE,
+        FEATURE_FACE,
+        FEATURE_EDGE,
+        FEATURE_VERTEX
+    };
+
     Hull();
 
     Hull(Polyhedron* polyhedron);
 
     void SetMesh(Polyhedron* polyhedron);
 
+    /*!
+     * @brief Recalculates the faces and edges connected to any of the
+     * specified vertices. Call this after vertex positions were changed in
+     * place. The hull's topology must not have changed and it must still be
+     * convex, otherwise call SetMesh() instead. Mesh::UpdateVertices() checks
+     * both.
+     *
+     * Only direction map cells listing one of the recalculated features are
+     * cleared. The centre of the hull is kept so the remaining cells still
+     * cover the same space.
+     */
+    void UpdateVertices(const Urho3D::PODVector<Vertex*>& movedVertices);
+
+    /*!
+     * @brief Projects a position outside of the mesh onto the hull and
+     * interpolates the gravity at the projected point.
+     *
+     * Only the faces, edges and vertices listed in the direction map cell
+     * containing the position are tested. The lists are sampled and may be
+     * missing the feature the position projects onto, so if no face or edge
+     * matches and the closest listed vertex isn't the closest point on the
+     * hull, all features are searched.
+     */
     bool Query(Urho3D::Vector3* gravity, const Urho3D::Vector3& position);
 
+    /*!
+     * @brief Same as Query(), but doesn't modify the hull and can be called
+     * from several threads at once. Cells of the direction map that haven't
+     * been sampled yet fall back to searching all features.
+     * @param[out] feature The feature the position was projected onto.
+     * @param[out] intersection The projected position.
+     */
+    bool Query(Urho3D::Vector3* gravity,
+               const Urho3D::Vector3& position,
+               Feature* feature,
+               Urho3D::Vector3* intersection) const;
+
+    /// Returns the feature the last call to Query() projected onto
+    Feature GetLastFeature() const
+            { return lastFeature_; }
+
     void DrawDebugGeometry(Urho3D::DebugRenderer* debug, bool depthTest, Urho3D::Vector3 pos) const;
 
+    /*!
+     * @brief Writes the faces and edges to a persistent line cache. Only the
+     * last intersection still has to be drawn every frame.
+     */
+    void AddDebugLines(DebugLineCache* lines) const;
+
+    /// Draws the last intersection
+    void DrawLastIntersection(Urho3D::DebugRenderer* debug, bool depthTest) const;
+
 private:
+    bool TestFace(unsigned index, const Urho3D::Vector3& position) const;
+    bool TestEdge(unsigned index, const Urho3D::Vector3& position) const;
+    /// Returns true if the vertex is the closest point on the hull to the position
+    bool TestVertex(unsigned index, const Urho3D::Vector3& position) const;
+
+    /*!
+     * @brief Searches all features for the one the position projects onto.
+     * @return Faces are numbered first, followed by edges and then vertices.
+     * Returns M_MAX_UNSIGNED if the hull is empty.
+     */
+    unsigned FindFeature(const Urho3D::Vector3& position) const;
+    /*!
+     * @brief Same as FindFeature(), but only searches the listed features.
+     * @return Returns M_MAX_UNSIGNED if none of the listed features match.
+     */
+    unsigned FindCandidateFeature(const Urho3D::PODVector<unsigned>& candidates,
+                                  const Urho3D::Vector3& position) const;
+    bool EvaluateFeature(Urho3D::Vector3* gravity,
+                         unsigned feature,
+                         const Urho3D::Vector3& position,
+                         Feature* type,
+                         Urho3D::Vector3* intersection) const;
+
+    /// Clears all sampled cells listing one of the features (must be sorted)
+    void InvalidateDirectionMap(const Urho3D::PODVector<unsigned>& features);
+
+    unsigned GetDirectionMapCell(const Urho3D::Vector3& position) const;
+    /// Fills in the cell containing the position if it wasn't sampled yet
+    void SampleDirectionMap(const Urho3D::Vector3& position);
+    void SampleDirectionMapCell(unsigned cell);
+
+    static const unsigned DIRECTION_MAP_RESOLUTION = 16;
+    static const unsigned DIRECTION_MAP_BANDS = 8;
+
     Urho3D::Vector3 centre_;
     Urho3D::Vector<Edge> edges_;
     Urho3D::Vector<Face> faces_;
+    Urho3D::PODVector<Vertex*> vertices_;
+    /// Same order as vertices_. Lists the vertices sharing a face with each vertex
+    Urho3D::Vector<Urho3D::PODVector<unsigned> > vertexNeighbours_;
+    /// Same order as vertices_. Lists the faces using each vertex
+    Urho3D::Vector<Urho3D::PODVector<unsigned> > vertexFaces_;
+    /// Same order as faces_. Lists the edges bordering each face
+    Urho3D::Vector<Urho3D::PODVector<unsigned> > faceEdges_;
+    /// Two entries per edge, the faces its boundary normals were taken from
+    Urho3D::PODVector<unsigned> edgeFaces_;
+    /// Indexed by Vertex::index_. Position of the vertex in vertices_, or M_MAX_UNSIGNED
+    Urho3D::PODVector<unsigned> hullVertexIndices_;
     Urho3D::SharedPtr<Polyhedron> hullMesh_;
 
+    Urho3D::Vector<Urho3D::PODVector<unsigned> > directionMap_;
+    Urho3D::PODVector<bool> directionMapValid_;
+    /// Cells that were sampled, so they can be cleared without visiting every cell
+    Urho3D::PODVector<unsigned> sampledCells_;
+    float bandWidth_;
+
     Urho3D::Vector3 lastIntersection_;
+    Feature lastFeature_;
 };
 
 }
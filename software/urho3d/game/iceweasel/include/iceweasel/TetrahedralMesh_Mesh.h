@@ -10,6 +10,8 @@ class GravityVector;
 namespace Urho3D {
     class DebugRenderer;
 }
+class DebugLineCache;
+
 namespace TetrahedralMesh {
 class Tetrahedron;
 
@@ -35,8 +37,17 @@ public:
      * returned. If no tetrahedron was found (e.g. the point exists outside of)
      * the mesh's hull), then NULL is returned.
      * @param[in] position The position to query.
+     * @param[in,out] hint Optional. The tetrahedron to start searching from,
+     * see Locate(). If the point is inside the mesh, the tetrahedron
+     * containing it is written back. Callers querying roughly the same
+     * location every tick should keep one hint each.
+     * @param[out] visited If this is not NULL, the number of tetrahedrons
+     * that were tested is written to this parameter.
      */
-    bool Query(Urho3D::Vector3* gravity, const Urho3D::Vector3& position) const;
+    bool Query(Urho3D::Vector3* gravity,
+               const Urho3D::Vector3& position,
+               unsigned* hint=NULL,
+               unsigned* visited=NULL) const;
 
     /*!
      * @brief Replaces the existing gravity mesh (if any) with a shared vertex
@@ -46,11 +57,97 @@ public:
      */
     void SetMesh(const TetrahedralMeshBuilder::CircumscribedTetrahedralMesh& sharedVertexMesh);
 
+    /*!
+     * @brief Updates all tetrahedrons connected to the specified vertices
+     * after their positions were changed in place.
+     *
+     * The connectivity of the mesh is kept. This is valid for as long as none
+     * of the affected tetrahedrons are inverted by the move and the hull
+     * stays convex.
+     * @return Returns false if at least one tetrahedron was inverted or
+     * flattened, or if the hull was convex and no longer is. In this case the
+     * mesh (and the Hull built along with it) must be re-triangulated.
+     */
+    bool UpdateVertices(const Urho3D::PODVector<Vertex*>& movedVertices);
+
+    /*!
+     * @brief Returns true if the vertex is part of at least one tetrahedron.
+     * This is not the case for vertices that were left out of the mesh.
+     */
+    bool ContainsVertex(const Vertex* vertex) const;
+
+    unsigned GetTetrahedronCount() const
+            { return tetrahedrons_.Size(); }
+
+    /*!
+     * @brief Returns true if no vertex lies outside of the plane of any face
+     * on the hull. Only then does a walk that leaves the mesh prove that the
+     * point is outside, see Locate().
+     */
+    bool IsConvex() const
+            { return isConvex_; }
+
     void DrawDebugGeometry(Urho3D::DebugRenderer* debug, bool depthTest, Urho3D::Vector3 pos);
 
+    /*!
+     * @brief Finds the tetrahedron containing a point by walking from
+     * tetrahedron to tetrahedron towards the point.
+     *
+     * If the mesh is convex and the walk leaves it through a face on the
+     * hull, the point is outside. If the mesh isn't convex (e.g. vertices on
+     * the hull were moved inwards), or the walk doesn't arrive (rounding
+     * errors can make it cycle near degenerate tetrahedrons), all
+     * tetrahedrons are tested.
+     * @param[in] hint Index of the tetrahedron to start walking from. Passing
+     * the result of the previous call for a nearby point makes the walk
+     * short. Out of range values are allowed.
+     * @param[out] visited If this is not NULL, the number of tetrahedrons
+     * that were tested is written to this parameter.
+     * @return The index of the tetrahedron, or M_MAX_UNSIGNED if the point
+     * lies outside of the mesh.
+     */
+    unsigned Locate(const Urho3D::Vector3& position, unsigned hint=0, unsigned* visited=NULL) const;
+
+    /// Writes every edge of the mesh to a persistent line cache once
+    void AddDebugLines(DebugLineCache* lines, const Urho3D::Color& color) const;
+
+    /// Draws a single tetrahedron, e.g. the one returned by Locate()
+    void DrawTetrahedron(Urho3D::DebugRenderer* debug, bool depthTest, unsigned index, const Urho3D::Color& color);
+
 private:
+    /// Finds the tetrahedrons sharing a face with each tetrahedron
+    void FindNeighbours();
+
+    /// Collects the faces and vertices on the hull. Requires the neighbours
+    void FindHull();
+
+    bool IsHullVertex(const Vertex* vertex) const;
+
+    /// Tests every vertex on the hull against every face on the hull
+    bool IsHullConvex() const;
+
+    /// Returns false if the position lies strictly outside of the hull face
+    bool LiesBehindHullFace(unsigned face, const Urho3D::Vector3& position) const;
+
     typedef Urho3D::Vector<Tetrahedron> ContainerType;
     ContainerType tetrahedrons_;
+
+    /// Indexed by Vertex::index_. Lists the tetrahedrons each vertex is a part of
+    Urho3D::Vector<Urho3D::PODVector<unsigned> > vertexTetrahedrons_;
+
+    /*!
+     * Four entries per tetrahedron. Entry i is the tetrahedron on the other
+     * side of the face opposite of vertex i, or M_MAX_UNSIGNED if that face
+     * is on the hull.
+     */
+    Urho3D::PODVector<unsigned> neighbours_;
+
+    /// Faces on the hull, encoded as tetrahedron * 4 + opposite vertex
+    Urho3D::PODVector<unsigned> hullFaces_;
+    Urho3D::PODVector<Vertex*> hullVertices_;
+    /// Indexed by Vertex::index_
+    Urho3D::PODVector<bool> isHullVertex_;
+    bool isConvex_;
 };
 
 }
@@ -17,7 +17,7 @@ class Tetrahedron
 {
 public:
 
-    Tetrahedron() {} // Required for Vector<GravityTetrahedron>
+    Tetrahedron() : positiveOrientation_(true) {} // Required for Vector<GravityTetrahedron>
 
     /*!
      * @brief Constructs a tetrahedron from 4 vertex locations in cartesian
@@ -47,15 +47,35 @@ public:
 
     Urho3D::Vector3 GetVertexPosition(unsigned char vertexID) const;
 
+    Vertex* GetVertex(unsigned char vertexID) const
+            { return vertex_[vertexID]; }
+
     Urho3D::Vector3 InterpolateGravity(const Urho3D::Vector4& barycentric) const;
 
+    /*!
+     * @brief Returns true if the specified vertex is one of the four vertices
+     * of this tetrahedron.
+     */
+    bool ContainsVertex(const Vertex* vertex) const;
+
+    /*!
+     * @brief Recalculates the barycentric transformation matrix after one or
+     * more of the vertices were moved.
+     * @return Returns false if the tetrahedron was inverted or flattened by
+     * the move (i.e. its orientation changed). The mesh is no longer valid in
+     * this case and needs to be re-triangulated.
+     */
+    bool UpdateTransform();
+
     void DrawDebugGeometry(Urho3D::DebugRenderer* debug, bool depthTest, const Urho3D::Color& color);
 
 private:
     Urho3D::Matrix4 CalculateBarycentricTransformationMatrix() const;
+    float CalculateSignedVolume() const;
 
     Urho3D::SharedPtr<Vertex> vertex_[4];
     Urho3D::Matrix4 transform_;
+    bool positiveOrientation_;
 };
 
 }
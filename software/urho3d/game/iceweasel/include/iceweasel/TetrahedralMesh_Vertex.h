@@ -13,14 +13,17 @@ namespace TetrahedralMesh {
 class Vertex : public Urho3D::RefCounted
 {
 public:
-    Vertex() : forceFactor_(0) {}
+    Vertex() : forceFactor_(0), index_(Urho3D::M_MAX_UNSIGNED) {}
     Vertex(const Urho3D::Vector3& position,
            const Urho3D::Vector3& direction,
-           float forceFactor=1.0f);
+           float forceFactor=1.0f,
+           unsigned index=Urho3D::M_MAX_UNSIGNED);
 
     Urho3D::Vector3 position_;
     Urho3D::Vector3 direction_;
     float forceFactor_;
+    /// Dense index of the gravity vector this vertex was created from, or M_MAX_UNSIGNED
+    unsigned index_;
 };
 
 }
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+#include <chrono>
+
+namespace Urho3D {
+    class Scene;
+}
+class CharacterProbeSystem;
+class MovementSystem;
+
+/*!
+ * @brief Measures how long each part of a frame and of each physics tick
+ * takes when a scene is updated manually, e.g. by InputReplay.
+ *
+ * Wrap each call to Scene::Update() in BeginFrame() and EndFrame(). Physics
+ * ticks are timed from E_PHYSICSPRESTEP to E_PHYSICSPOSTSTEP. The movement
+ * system's stages and the probes are taken out of that. The rest is counted
+ * as "other": the Bullet step itself, but also the tick handlers of every
+ * other system (GravityManager, ProjectileSystem, CharacterProbeSystem, ...).
+ * Whatever the frame spends outside of physics ticks is counted as the logic
+ * update (animation, LogicComponent updates).
+ */
+class TickProfiler : public Urho3D::Object
+{
+    URHO3D_OBJECT(TickProfiler, Urho3D::Object)
+
+public:
+    enum Sample
+    {
+        // Per frame
+        FRAME,
+        LOGIC,
+        // Per tick
+        TICK,
+        OTHER,
+        PROBES,
+        MOVEMENT_PREPARE,
+        GRAVITY,
+        INTEGRATE,
+        APPLY,
+
+        NUM_SAMPLES
+    };
+
+    TickProfiler(Urho3D::Context* context);
+
+    /// Subscribes to the physics world of the scene
+    void SetScene(Urho3D::Scene* scene);
+
+    void BeginFrame();
+    void EndFrame();
+
+    /// Number of ticks the physics world ran during the last frame
+    unsigned GetFrameTickCount() const
+            { return frameTickCount_; }
+
+    /// All samples of one kind recorded since the last Clear(), in nanoseconds
+    const Urho3D::PODVector<long long>& GetSamples(Sample sample) const
+            { return samples_[sample]; }
+
+    /// Mean of all samples of one kind, in nanoseconds
+    double GetMean(Sample sample) const;
+
+    /// Returns the given percentile (0-100) of all samples of one kind, in nanoseconds
+    long long GetPercentile(Sample sample, unsigned percentile) const;
+
+    void Clear();
+
+    /*!
+     * @brief Prints mean, p50, p95, p99 and max of every kind of sample to
+     * stdout, in microseconds.
+     */
+    void PrintReport() const;
+
+private:
+    void HandlePhysicsPreStep(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+    void HandlePhysicsPostStep(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData);
+
+    Urho3D::WeakPtr<Urho3D::Scene> scene_;
+    Urho3D::PODVector<long long> samples_[NUM_SAMPLES];
+
+    std::chrono::high_resolution_clock::time_point frameStart_;
+    std::chrono::high_resolution_clock::time_point tickStart_;
+    long long probeTimeAtTickStart_;
+    long long frameTickTime_;
+    unsigned frameTickCount_;
+};
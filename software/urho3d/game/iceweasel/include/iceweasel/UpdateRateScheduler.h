@@ -0,0 +1,115 @@
+#pragma once
+
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Vector3.h>
+
+namespace Urho3D {
+    class Node;
+}
+
+/*!
+ * @brief Decides when an entity has to refresh a cached per-tick result.
+ *
+ * Each entity owns one timer per cached result (e.g. its gravity or whether
+ * it is standing on the ground). Call Tick() once per physics tick with the
+ * interval returned by UpdateRateScheduler::GetInterval(). The first call
+ * always returns true.
+ */
+struct UpdateRateTimer
+{
+    UpdateRateTimer() :
+        countdown_(0),
+        phase_(0),
+        isValid_(false)
+    {}
+
+    /*!
+     * @brief Returns true if the cached result has to be refreshed during
+     * this tick.
+     */
+    bool Tick(unsigned interval);
+
+    /// Forces the next call to Tick() to return true
+    void Invalidate()
+            { isValid_ = false; }
+
+    unsigned countdown_;
+    unsigned phase_;
+    bool isValid_;
+};
+
+/*!
+ * @brief Lowers the update rate of entities that are far away from every
+ * observer or at rest.
+ *
+ * Observers are the nodes of player controlled characters and free cameras,
+ * never bots, so the cost of GetInterval() only grows with the number of
+ * players. Entities within the near distance of an observer are updated
+ * every tick. Beyond that, the interval grows linearly up to the maximum
+ * interval at the far distance. Outside of the near distance, entities
+ * moving slower than the rest speed are updated at the maximum interval.
+ *
+ * Each timer is given a different phase, so entities with the same interval
+ * are spread evenly across ticks instead of all updating on the same tick.
+ */
+class UpdateRateScheduler
+{
+public:
+    UpdateRateScheduler();
+
+    void SetNearDistance(float distance)
+            { nearDistance_ = distance; }
+
+    float GetNearDistance() const
+            { return nearDistance_; }
+
+    void SetFarDistance(float distance)
+            { farDistance_ = distance; }
+
+    float GetFarDistance() const
+            { return farDistance_; }
+
+    /// Maximum number of ticks between two updates. 1 disables the scheduler
+    void SetMaxInterval(unsigned ticks)
+            { maxInterval_ = ticks; }
+
+    unsigned GetMaxInterval() const
+            { return maxInterval_; }
+
+    /// Entities moving slower than this (in m/s) are considered at rest
+    void SetRestSpeed(float speed)
+            { restSpeed_ = speed; }
+
+    float GetRestSpeed() const
+            { return restSpeed_; }
+
+    /*!
+     * @brief Adds a node that entities close to are updated at full rate.
+     * Adding the same node twice has no effect.
+     */
+    void AddObserver(Urho3D::Node* node);
+    void RemoveObserver(Urho3D::Node* node);
+
+    /*!
+     * @brief Gives the timer the next phase, so it doesn't refresh on the
+     * same ticks as previously scheduled timers.
+     */
+    void Schedule(UpdateRateTimer* timer);
+
+    /*!
+     * @brief Calculates how many ticks may pass between two updates of an
+     * entity.
+     * @param[in] position World position of the entity.
+     * @param[in] velocity Linear velocity of the entity.
+     */
+    unsigned GetInterval(const Urho3D::Vector3& position, const Urho3D::Vector3& velocity) const;
+
+private:
+    Urho3D::Vector<Urho3D::WeakPtr<Urho3D::Node> > observers_;
+    float nearDistance_;
+    float farDistance_;
+    float restSpeed_;
+    unsigned maxInterval_;
+    unsigned nextPhase_;
+};
@@ -4,8 +4,11 @@
 Args::Args() :
     networkAddress_("127.0.0.1"),
     networkPort_(1834),
+    loadTestBots_(0),
+    loadTestStep_(0),
     editor_(false),
     server_(false),
+    connect_(false),
     fullscreen_(false),
     vsync_(false),
     multisample_(2)
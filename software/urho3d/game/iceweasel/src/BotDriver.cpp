@@ -0,0 +1,175 @@
+#include "iceweasel/BotDriver.h"
+#include "iceweasel/CharacterState.h"
+#include "iceweasel/IceWeasel.h"
+#include "iceweasel/InputCommand.h"
+#include "iceweasel/MovementController.h"
+#include "iceweasel/PlayerAnimationStatesController.h"
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
+#include <Urho3D/Scene/Node.h>
+#include <Urho3D/Scene/Scene.h>
+
+using namespace Urho3D;
+
+// Bots are spawned on a grid with this many bots per row
+static const unsigned SPAWN_ROW_LENGTH = 16;
+static const float SPAWN_SPACING = 2.0f;
+
+// ----------------------------------------------------------------------------
+BotDriver::BotDriver(Context* context) :
+    Component(context),
+    spawnPosition_(Vector3::ZERO),
+    randomState_(1),
+    isAnimated_(true)
+{
+}
+
+// ----------------------------------------------------------------------------
+BotDriver::~BotDriver()
+{
+    SetBotCount(0);
+}
+
+// ----------------------------------------------------------------------------
+void BotDriver::RegisterObject(Context* context)
+{
+    context->RegisterFactory<BotDriver>(ICEWEASEL_CATEGORY);
+}
+
+// ----------------------------------------------------------------------------
+void BotDriver::SetBotCount(unsigned count)
+{
+    while(bots_.Size() > count)
+    {
+        if(bots_.Back().node_)
+            bots_.Back().node_->Remove();
+        bots_.Pop();
+    }
+
+    if(GetScene() == NULL)
+        return;
+
+    while(bots_.Size() < count)
+        CreateBot();
+}
+
+// ----------------------------------------------------------------------------
+void BotDriver::CreateBot()
+{
+    unsigned index = bots_.Size();
+    Vector3 offset(
+        ((float)(index % SPAWN_ROW_LENGTH) - SPAWN_ROW_LENGTH / 2) * SPAWN_SPACING,
+        0.0f,
+        (float)(index / SPAWN_ROW_LENGTH) * SPAWN_SPACING
+    );
+
+    Node* moveNode = GetScene()->CreateChild("Bot", LOCAL);
+    Node* offsetNode = moveNode->CreateChild("Bot Offset", LOCAL);
+    moveNode->SetWorldPosition(spawnPosition_ + offset);
+
+    // Same components as a player, minus the camera
+    SharedPtr<CharacterState> state(new CharacterState);
+    MovementController* controller = new MovementController(context_, moveNode, offsetNode, state);
+    controller->SetInputSource(MovementController::INPUT_REMOTE);
+    moveNode->AddComponent(controller, 0, LOCAL);
+
+    if(isAnimated_)
+    {
+        XMLFile* modelNodeXML = GetSubsystem<ResourceCache>()->GetResource<XMLFile>("Models/Binky.xml");
+        if(modelNodeXML)
+        {
+            Node* visualNode = moveNode->CreateChild("Bot Visual", LOCAL);
+            controller->SetVisualNode(visualNode);
+
+            Node* modelNode = visualNode->CreateChild("Bot Model", LOCAL);
+            modelNode->LoadXML(modelNodeXML->GetRoot());
+            modelNode->AddComponent(new PlayerAnimationStatesController(context_, state), 0, LOCAL);
+        }
+    }
+
+    Bot bot;
+    bot.node_ = moveNode;
+    bot.controller_ = controller;
+    bot.behaviour_ = (Behaviour)(index % NUM_BEHAVIOURS);
+    bot.heading_ = NextRandom() * 360.0f;
+    bot.timer_ = 0.0f;
+    bot.sequence_ = 0;
+    bot.buttons_ = InputCommand::FORWARD;
+    if(bot.behaviour_ == ORBIT)
+        bot.buttons_ |= InputCommand::RUN;
+    bots_.Push(bot);
+}
+
+// ----------------------------------------------------------------------------
+void BotDriver::UpdateBot(Bot* bot, float timeStep)
+{
+    InputCommand command;
+    command.sequence_ = ++bot->sequence_;
+    command.timeStep_ = timeStep;
+
+    if(bot->behaviour_ != ORBIT)
+    {
+        // Random walk: every few seconds, pick a new direction and speed
+        bot->timer_ -= timeStep;
+        if(bot->timer_ <= 0.0f)
+        {
+            bot->timer_ = 0.5f + NextRandom() * 2.5f;
+            bot->heading_ += (NextRandom() - 0.5f) * 180.0f;
+            bot->buttons_ = InputCommand::FORWARD;
+            if(NextRandom() < 0.3f)
+                bot->buttons_ |= InputCommand::RUN;
+            if(bot->behaviour_ == CROUCH && NextRandom() < 0.5f)
+                bot->buttons_ |= InputCommand::CROUCH;
+        }
+
+        if(bot->behaviour_ == JUMP && NextRandom() < timeStep)
+            command.pressed_ |= InputCommand::JUMP;
+    }
+
+    command.buttons_ = bot->buttons_;
+    command.cameraAngle_ = Vector2(0.0f, bot->heading_);
+
+    bot->controller_->GetInputCommands().Push(command);
+}
+
+// ----------------------------------------------------------------------------
+float BotDriver::NextRandom()
+{
+    // xorshift32, independent of Urho3D's global Rand()
+    randomState_ ^= randomState_ << 13;
+    randomState_ ^= randomState_ >> 17;
+    randomState_ ^= randomState_ << 5;
+    return (randomState_ >> 8) * (1.0f / 16777216.0f);
+}
+
+// ----------------------------------------------------------------------------
+void BotDriver::OnSceneSet(Scene* scene)
+{
+    UnsubscribeFromAllEvents();
+
+    if(scene == NULL)
+    {
+        SetBotCount(0);
+        return;
+    }
+
+    // Specific to the world, so the commands are pushed before
+    // MovementSystem consumes them during the same substep
+    SubscribeToEvent(scene->GetOrCreateComponent<PhysicsWorld>(), E_PHYSICSPRESTEP, URHO3D_HANDLER(BotDriver, HandlePhysicsPreStep));
+}
+
+// ----------------------------------------------------------------------------
+void BotDriver::HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData)
+{
+    using namespace PhysicsPreStep;
+    (void)eventType;
+
+    float timeStep = eventData[P_TIMESTEP].GetFloat();
+    for(unsigned i = 0; i != bots_.Size(); ++i)
+        if(bots_[i].controller_)
+            UpdateBot(&bots_[i], timeStep);
+}
@@ -0,0 +1,103 @@
+#include "iceweasel/BotLoadTest.h"
+#include "iceweasel/BotDriver.h"
+
+#include <Urho3D/Graphics/Octree.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include <stdio.h>
+
+using namespace Urho3D;
+
+// ----------------------------------------------------------------------------
+BotLoadTest::BotLoadTest(Context* context) :
+    Object(context),
+    profiler_(new TickProfiler(context)),
+    warmupTime_(1.0f),
+    measureTime_(5.0f)
+{
+}
+
+// ----------------------------------------------------------------------------
+int BotLoadTest::Run(const String& sceneName, unsigned maxBots, unsigned step)
+{
+    // Same setup as IceWeasel::CreateScene(), minus everything that renders
+    scene_ = new Scene(context_);
+    scene_->CreateComponent<Octree>(LOCAL);
+    scene_->CreateComponent<PhysicsWorld>(LOCAL);
+
+    XMLFile* xml = GetSubsystem<ResourceCache>()->GetResource<XMLFile>(sceneName);
+    if(xml == NULL || scene_->LoadXML(xml->GetRoot()) == false)
+    {
+        printf("Failed to load scene \"%s\"\n", sceneName.CString());
+        return 2;
+    }
+
+    BotDriver* driver = scene_->CreateComponent<BotDriver>(LOCAL);
+    profiler_->SetScene(scene_);
+
+    // One tick per frame, as a server running at its fixed rate would
+    int fps = scene_->GetComponent<PhysicsWorld>()->GetFps();
+    float timeStep = 1.0f / fps;
+    double budget = 1e9 / fps;
+
+    printf("Load test on \"%s\" at %d ticks/s, budget %.2f ms per tick\n", sceneName.CString(), fps, budget * 1e-6);
+    printf("  Mean time per tick in ms. Movement includes the probes, other is the Bullet step plus\n");
+    printf("  the tick handlers of all other systems, animation is the logic update.\n");
+    printf("  %6s %8s %8s %8s %8s %9s %10s\n", "bots", "mean", "p95", "gravity", "other", "movement", "animation");
+
+    if(step == 0)
+        step = 1;
+
+    unsigned exceededAt = 0;
+    for(unsigned count = step; count <= maxBots; count += step)
+    {
+        driver->SetBotCount(count);
+        RunFrames(warmupTime_, timeStep);
+        profiler_->Clear();
+        RunFrames(measureTime_, timeStep);
+
+        long long p95 = profiler_->GetPercentile(TickProfiler::FRAME, 95);
+        double movement = profiler_->GetMean(TickProfiler::PROBES) +
+                          profiler_->GetMean(TickProfiler::MOVEMENT_PREPARE) +
+                          profiler_->GetMean(TickProfiler::INTEGRATE) +
+                          profiler_->GetMean(TickProfiler::APPLY);
+        printf("  %6d %8.3f %8.3f %8.3f %8.3f %9.3f %10.3f\n",
+               count,
+               profiler_->GetMean(TickProfiler::FRAME) * 1e-6,
+               p95 * 1e-6,
+               profiler_->GetMean(TickProfiler::GRAVITY) * 1e-6,
+               profiler_->GetMean(TickProfiler::OTHER) * 1e-6,
+               movement * 1e-6,
+               profiler_->GetMean(TickProfiler::LOGIC) * 1e-6);
+        fflush(stdout);
+
+        if(p95 > budget)
+        {
+            exceededAt = count;
+            break;
+        }
+    }
+
+    if(exceededAt != 0)
+        printf("Tick budget exceeded at %d bots\n", exceededAt);
+    else
+        printf("Tick budget not exceeded with up to %d bots\n", maxBots);
+
+    driver->SetBotCount(0);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+void BotLoadTest::RunFrames(float seconds, float timeStep)
+{
+    unsigned frames = (unsigned)(seconds / timeStep + 0.5f);
+    for(unsigned i = 0; i != frames; ++i)
+    {
+        profiler_->BeginFrame();
+        scene_->Update(timeStep);
+        profiler_->EndFrame();
+    }
+}
@@ -1,9 +1,11 @@
 #include "iceweasel/CameraControllerFree.h"
 #include "iceweasel/IceWeaselConfig.h"
 #include "iceweasel/CameraControllerEvents.h"
+#include "iceweasel/GravityManager.h"
 
 #include <Urho3D/Input/Input.h>
 #include <Urho3D/Scene/Node.h>
+#include <Urho3D/Scene/Scene.h>
 
 using namespace Urho3D;
 
@@ -20,10 +22,22 @@ void CameraControllerFree::Start()
 
     node_->SetRotation(Quaternion::IDENTITY);
 
+    // Entities near the camera are updated at full rate
+    gravityManager_ = GetScene()->GetComponent<GravityManager>();
+    if(gravityManager_)
+        gravityManager_->GetUpdateRateScheduler().AddObserver(node_);
+
     // WASD depends on the current camera Y angle
     SubscribeToEvent(E_CAMERAANGLECHANGED, URHO3D_HANDLER(CameraControllerFree, HandleCameraAngleChanged));
 }
 
+// ----------------------------------------------------------------------------
+void CameraControllerFree::Stop()
+{
+    if(gravityManager_)
+        gravityManager_->GetUpdateRateScheduler().RemoveObserver(node_);
+}
+
 // ----------------------------------------------------------------------------
 void CameraControllerFree::Update(float timeStep)
 {
@@ -0,0 +1,290 @@
+#include "iceweasel/CharacterProbeSystem.h"
+#include "iceweasel/IceWeasel.h"
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsUtils.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Node.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include <Bullet/BulletCollision/CollisionShapes/btSphereShape.h>
+#include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+
+#include <chrono>
+
+using namespace Urho3D;
+
+// ----------------------------------------------------------------------------
+/*
+ * Bullet's closest hit callbacks, except that the object being probed for is
+ * ignored by the broadphase filter.
+ */
+struct ExcludingRayCallback : public btCollisionWorld::ClosestRayResultCallback
+{
+    ExcludingRayCallback(const btVector3& from, const btVector3& to, const btCollisionObject* exclude) :
+        btCollisionWorld::ClosestRayResultCallback(from, to),
+        exclude_(exclude)
+    {
+        // Same filter as PhysicsWorld's casts
+        m_collisionFilterGroup = (short)0xffff;
+        m_collisionFilterMask = (short)0xffff;
+    }
+
+    virtual bool needsCollision(btBroadphaseProxy* proxy) const override
+    {
+        if(proxy->m_clientObject == exclude_)
+            return false;
+        return btCollisionWorld::ClosestRayResultCallback::needsCollision(proxy);
+    }
+
+    const btCollisionObject* exclude_;
+};
+
+struct ExcludingConvexCallback : public btCollisionWorld::ClosestConvexResultCallback
+{
+    ExcludingConvexCallback(const btVector3& from, const btVector3& to, const btCollisionObject* exclude) :
+        btCollisionWorld::ClosestConvexResultCallback(from, to),
+        exclude_(exclude)
+    {
+        // Same filter as PhysicsWorld's casts
+        m_collisionFilterGroup = (short)0xffff;
+        m_collisionFilterMask = (short)0xffff;
+    }
+
+    virtual bool needsCollision(btBroadphaseProxy* proxy) const override
+    {
+        if(proxy->m_clientObject == exclude_)
+            return false;
+        return btCollisionWorld::ClosestConvexResultCallback::needsCollision(proxy);
+    }
+
+    const btCollisionObject* exclude_;
+};
+
+// ----------------------------------------------------------------------------
+static bool CastRay(btCollisionWorld* world,
+                    const btCollisionObject* exclude,
+                    const Vector3& origin,
+                    const Vector3& direction,
+                    float length,
+                    Vector3* hitPosition=NULL,
+                    Vector3* hitNormal=NULL)
+{
+    btVector3 from = ToBtVector3(origin);
+    btVector3 to = ToBtVector3(origin + direction * length);
+    ExcludingRayCallback callback(from, to, exclude);
+    world->rayTest(from, to, callback);
+    if(callback.hasHit() == false)
+        return false;
+
+    if(hitPosition)
+        *hitPosition = ToVector3(callback.m_hitPointWorld);
+    if(hitNormal)
+        *hitNormal = ToVector3(callback.m_hitNormalWorld);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+static bool CastSphere(btCollisionWorld* world,
+                       const btCollisionObject* exclude,
+                       const Vector3& origin,
+                       const Vector3& direction,
+                       float radius,
+                       float length)
+{
+    btSphereShape shape(radius);
+    btTransform from(btQuaternion::getIdentity(), ToBtVector3(origin));
+    btTransform to(btQuaternion::getIdentity(), ToBtVector3(origin + direction * length));
+    ExcludingConvexCallback callback(from.getOrigin(), to.getOrigin(), exclude);
+    world->convexSweepTest(&shape, from, to, callback);
+    if(callback.hasHit() == false)
+        return false;
+
+    // Same as PhysicsWorld::SphereCast(), the distance is measured to the hit
+    // point and not to the center of the sphere
+    return (ToVector3(callback.m_hitPointWorld) - origin).Length() < length;
+}
+
+// ----------------------------------------------------------------------------
+CharacterProbeSystem::CharacterProbeSystem(Context* context) :
+    Component(context),
+    totalProbeTime_(0),
+    substep_(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+CharacterProbeSystem::~CharacterProbeSystem()
+{
+}
+
+// ----------------------------------------------------------------------------
+void CharacterProbeSystem::RegisterObject(Context* context)
+{
+    context->RegisterFactory<CharacterProbeSystem>(ICEWEASEL_CATEGORY);
+}
+
+// ----------------------------------------------------------------------------
+void CharacterProbeSystem::AddProbe(CharacterProbe* probe)
+{
+    if(probe->index_ < probes_.Size() && probes_[probe->index_] == probe)
+        return;
+
+    probe->index_ = probes_.Size();
+    probe->substep_ = substep_ - 1;
+    probe->timer_.Invalidate();
+    probes_.Push(probe);
+}
+
+// ----------------------------------------------------------------------------
+void CharacterProbeSystem::RemoveProbe(CharacterProbe* probe)
+{
+    unsigned index = probe->index_;
+    if(index >= probes_.Size() || probes_[index] != probe)
+        return;
+
+    // Move the last probe into the freed slot
+    CharacterProbe* last = probes_.Back();
+    last->index_ = index;
+    probes_[index] = last;
+    probes_.Pop();
+
+    probe->index_ = M_MAX_UNSIGNED;
+}
+
+// ----------------------------------------------------------------------------
+void CharacterProbeSystem::UpdateProbes()
+{
+    if(!physicsWorld_ || physicsWorld_->GetWorld() == NULL)
+        return;
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    for(PODVector<CharacterProbe*>::ConstIterator it = probes_.Begin(); it != probes_.End(); ++it)
+    {
+        if((*it)->substep_ == substep_)
+            continue;
+        (*it)->substep_ = substep_;
+        RunProbe(*it);
+    }
+    totalProbeTime_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// ----------------------------------------------------------------------------
+void CharacterProbeSystem::RunProbe(CharacterProbe* probe)
+{
+    ProbeStandUp(probe, probe->node_->GetWorldPosition(), probe->node_->GetRotation());
+
+    probe->isUpdated_ = probe->probeGround_ && probe->timer_.Tick(probe->updateInterval_);
+    if(probe->isUpdated_)
+        ProbeGround(probe);
+}
+
+// ----------------------------------------------------------------------------
+void CharacterProbeSystem::ProbeGround(CharacterProbe* probe)
+{
+    if(!physicsWorld_ || physicsWorld_->GetWorld() == NULL)
+        return;
+
+    ProbeGround(probe, probe->node_->GetWorldPosition(), probe->node_->GetRotation());
+    probe->isUpdated_ = true;
+}
+
+// ----------------------------------------------------------------------------
+void CharacterProbeSystem::ProbeGround(CharacterProbe* probe, const Vector3& position, const Quaternion& rotation) const
+{
+    if(!physicsWorld_ || physicsWorld_->GetWorld() == NULL)
+        return;
+
+    btCollisionWorld* world = physicsWorld_->GetWorld();
+    const btCollisionObject* self = probe->body_ ? probe->body_->GetBody() : NULL;
+
+    Vector3 downDirection = rotation * Vector3::DOWN;
+
+    // Radius slightly less than body width/2
+    float castRadius = probe->radius_ / 1.1f;
+
+    // Because we're sphere casting, and the ray length goes to the center of
+    // the sphere and not to the edge, subtract cast width from the length.
+    // Cast slightly beyond.
+    const float extendFactor = 1.1f;
+    float castLength = (probe->height_ - castRadius) * extendFactor;
+
+    // Cast from the top of the capsule down and check if we're on the ground.
+    // The ray straight down gives the position to snap to the ground with.
+    Vector3 top = position - downDirection * probe->height_;
+    probe->isOnGround_ = CastSphere(world, self, top, downDirection, castRadius, castLength);
+    probe->hasGroundPosition_ = probe->isOnGround_ &&
+        CastRay(world, self, top, downDirection, probe->height_ * extendFactor,
+                &probe->groundPosition_, &probe->groundNormal_);
+
+    // Cast a ray up and check if we're hitting anything with our head
+    probe->hitsCeiling_ = CastRay(world, self, position, -downDirection, castLength);
+}
+
+// ----------------------------------------------------------------------------
+void CharacterProbeSystem::ProbeStandUp(CharacterProbe* probe, const Vector3& position, const Quaternion& rotation) const
+{
+    // A crouching character can only stand up again if there are no
+    // obstacles above it
+    probe->canStandUp_ = true;
+    if(probe->isCrouching_ == false || !physicsWorld_ || physicsWorld_->GetWorld() == NULL)
+        return;
+
+    btCollisionWorld* world = physicsWorld_->GetWorld();
+    const btCollisionObject* self = probe->body_ ? probe->body_->GetBody() : NULL;
+    Vector3 upDirection = rotation * Vector3::UP;
+    probe->canStandUp_ = !CastRay(world, self, position, upDirection, probe->standHeight_);
+}
+
+// ----------------------------------------------------------------------------
+bool CharacterProbeSystem::ProbeMovement(const CharacterProbe* probe,
+                                         const Vector3& position,
+                                         const Quaternion& rotation,
+                                         const Vector3& displacement) const
+{
+    if(!physicsWorld_ || physicsWorld_->GetWorld() == NULL)
+        return false;
+
+    btCollisionWorld* world = physicsWorld_->GetWorld();
+    const btCollisionObject* self = probe->body_ ? probe->body_->GetBody() : NULL;
+
+    // Remove the vertical part, the ground and ceiling probes deal with that
+    Vector3 upDirection = rotation * Vector3::UP;
+    Vector3 sideways = displacement - upDirection * upDirection.DotProduct(displacement);
+    float length = sideways.Length();
+    if(length < M_EPSILON)
+        return false;
+
+    // Cast from the middle of the body, with the same radius as the ground
+    // probe so the ground itself isn't hit
+    float castRadius = probe->radius_ / 1.1f;
+    Vector3 centre = position + upDirection * (probe->height_ / 2);
+    return CastSphere(world, self, centre, sideways / length, castRadius, length + castRadius);
+}
+
+// ----------------------------------------------------------------------------
+void CharacterProbeSystem::OnSceneSet(Scene* scene)
+{
+    if(physicsWorld_)
+        UnsubscribeFromEvent(physicsWorld_, E_PHYSICSPOSTSTEP);
+    physicsWorld_.Reset();
+
+    if(scene == NULL)
+        return;
+
+    physicsWorld_ = scene->GetOrCreateComponent<PhysicsWorld>();
+    SubscribeToEvent(physicsWorld_, E_PHYSICSPOSTSTEP, URHO3D_HANDLER(CharacterProbeSystem, HandlePhysicsPostStep));
+}
+
+// ----------------------------------------------------------------------------
+void CharacterProbeSystem::HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData)
+{
+    (void)eventType;
+    (void)eventData;
+
+    // Sent after every substep. Probes run again during the next one.
+    ++substep_;
+}
@@ -0,0 +1,97 @@
+#include "iceweasel/DebugLineCache.h"
+
+#include <Urho3D/Graphics/CustomGeometry.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Technique.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Scene/Node.h>
+
+using namespace Urho3D;
+
+// ----------------------------------------------------------------------------
+DebugLineCache::DebugLineCache(Node* parent) :
+    lineCount_(0),
+    depthTest_(true)
+{
+    node_ = parent->CreateChild("Debug Lines", LOCAL);
+    node_->SetTemporary(true);
+
+    geometry_ = node_->CreateComponent<CustomGeometry>(LOCAL);
+    geometry_->SetNumGeometries(1);
+
+    // Lines are coloured per vertex and shouldn't be lit
+    Context* context = parent->GetContext();
+    ResourceCache* cache = context->GetSubsystem<ResourceCache>();
+    Technique* technique = cache ? cache->GetResource<Technique>("Techniques/NoTextureUnlitVCol.xml") : NULL;
+    if(technique)
+    {
+        depthTestMaterial_ = new Material(context);
+        depthTestMaterial_->SetTechnique(0, technique);
+        geometry_->SetMaterial(depthTestMaterial_);
+
+        // Techniques are shared resources, so disable depth testing on a copy
+        SharedPtr<Technique> overlay = technique->Clone();
+        PODVector<Pass*> passes = overlay->GetPasses();
+        for(PODVector<Pass*>::Iterator it = passes.Begin(); it != passes.End(); ++it)
+        {
+            (*it)->SetDepthTestMode(CMP_ALWAYS);
+            (*it)->SetDepthWrite(false);
+        }
+        overlayMaterial_ = new Material(context);
+        overlayMaterial_->SetTechnique(0, overlay);
+    }
+
+    Clear();
+}
+
+// ----------------------------------------------------------------------------
+DebugLineCache::~DebugLineCache()
+{
+    node_->Remove();
+}
+
+// ----------------------------------------------------------------------------
+void DebugLineCache::Clear()
+{
+    geometry_->BeginGeometry(0, LINE_LIST);
+    lineCount_ = 0;
+}
+
+// ----------------------------------------------------------------------------
+void DebugLineCache::AddLine(const Vector3& start, const Vector3& end, const Color& color)
+{
+    geometry_->DefineVertex(start);
+    geometry_->DefineColor(color);
+    geometry_->DefineVertex(end);
+    geometry_->DefineColor(color);
+    ++lineCount_;
+}
+
+// ----------------------------------------------------------------------------
+void DebugLineCache::Commit()
+{
+    geometry_->Commit();
+}
+
+// ----------------------------------------------------------------------------
+void DebugLineCache::SetVisible(bool visible)
+{
+    node_->SetEnabled(visible);
+}
+
+// ----------------------------------------------------------------------------
+bool DebugLineCache::IsVisible() const
+{
+    return node_->IsEnabled();
+}
+
+// ----------------------------------------------------------------------------
+void DebugLineCache::SetDepthTest(bool enable)
+{
+    if(depthTest_ == enable)
+        return;
+
+    depthTest_ = enable;
+    if(depthTestMaterial_)
+        geometry_->SetMaterial(enable ? depthTestMaterial_ : overlayMaterial_);
+}
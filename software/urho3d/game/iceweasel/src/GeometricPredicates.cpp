@@ -0,0 +1,324 @@
+#include "iceweasel/GeometricPredicates.h"
+
+#include <Urho3D/Container/Vector.h>
+
+#include <cmath>
+#include <limits>
+
+using namespace Urho3D;
+
+/*
+ * An expansion is a sum of doubles, ordered by increasing magnitude, where no
+ * two components overlap. This allows sums and products of doubles to be
+ * represented exactly. Zero components are always eliminated, so an empty
+ * expansion represents zero.
+ */
+typedef PODVector<double> Expansion;
+
+// Machine epsilon as defined by Shewchuk (half of std::numeric_limits<double>::epsilon())
+static const double epsilon = std::numeric_limits<double>::epsilon() * 0.5;
+static const double orient3dErrorBound = (7.0 + 56.0 * epsilon) * epsilon;
+static const double inSphereErrorBound = (16.0 + 224.0 * epsilon) * epsilon;
+
+// ----------------------------------------------------------------------------
+static inline void TwoSum(double a, double b, double* x, double* y)
+{
+    *x = a + b;
+    double bVirtual = *x - a;
+    double aVirtual = *x - bVirtual;
+    double bRoundoff = b - bVirtual;
+    double aRoundoff = a - aVirtual;
+    *y = aRoundoff + bRoundoff;
+}
+
+// ----------------------------------------------------------------------------
+static inline void FastTwoSum(double a, double b, double* x, double* y)
+{
+    // Requires |a| >= |b|
+    *x = a + b;
+    *y = b - (*x - a);
+}
+
+// ----------------------------------------------------------------------------
+static inline void TwoProduct(double a, double b, double* x, double* y)
+{
+    *x = a * b;
+    *y = std::fma(a, b, -*x);
+}
+
+// ----------------------------------------------------------------------------
+static void Difference(Expansion* h, double a, double b)
+{
+    double x, y;
+    TwoSum(a, -b, &x, &y);
+    h->Clear();
+    if(y != 0.0) h->Push(y);
+    if(x != 0.0) h->Push(x);
+}
+
+// ----------------------------------------------------------------------------
+static void GrowExpansion(Expansion* h, const Expansion& e, double b)
+{
+    double q = b;
+    h->Clear();
+    for(unsigned i = 0; i != e.Size(); ++i)
+    {
+        double sum, error;
+        TwoSum(q, e[i], &sum, &error);
+        q = sum;
+        if(error != 0.0)
+            h->Push(error);
+    }
+    if(q != 0.0)
+        h->Push(q);
+}
+
+// ----------------------------------------------------------------------------
+static void ScaleExpansion(Expansion* h, const Expansion& e, double b)
+{
+    h->Clear();
+    if(e.Empty() || b == 0.0)
+        return;
+
+    double q, error;
+    TwoProduct(e[0], b, &q, &error);
+    if(error != 0.0)
+        h->Push(error);
+
+    for(unsigned i = 1; i != e.Size(); ++i)
+    {
+        double product1, product0, sum;
+        TwoProduct(e[i], b, &product1, &product0);
+        TwoSum(q, product0, &sum, &error);
+        if(error != 0.0)
+            h->Push(error);
+        FastTwoSum(product1, sum, &q, &error);
+        if(error != 0.0)
+            h->Push(error);
+    }
+    if(q != 0.0)
+        h->Push(q);
+}
+
+// ----------------------------------------------------------------------------
+static void Add(Expansion* h, const Expansion& e, const Expansion& f)
+{
+    Expansion result(e);
+    Expansion temp;
+    for(unsigned i = 0; i != f.Size(); ++i)
+    {
+        GrowExpansion(&temp, result, f[i]);
+        result.Swap(temp);
+    }
+    h->Swap(result);
+}
+
+// ----------------------------------------------------------------------------
+static void Subtract(Expansion* h, const Expansion& e, const Expansion& f)
+{
+    Expansion negated(f);
+    for(unsigned i = 0; i != negated.Size(); ++i)
+        negated[i] = -negated[i];
+    Add(h, e, negated);
+}
+
+// ----------------------------------------------------------------------------
+static void Multiply(Expansion* h, const Expansion& e, const Expansion& f)
+{
+    Expansion result;
+    Expansion scaled;
+    for(unsigned i = 0; i != f.Size(); ++i)
+    {
+        ScaleExpansion(&scaled, e, f[i]);
+        Add(&result, result, scaled);
+    }
+    h->Swap(result);
+}
+
+// ----------------------------------------------------------------------------
+static double Estimate(const Expansion& e)
+{
+    double sum = 0.0;
+    for(unsigned i = 0; i != e.Size(); ++i)
+        sum += e[i];
+    return sum;
+}
+
+// ----------------------------------------------------------------------------
+double GeometricPredicates::Orient3D(const Vector3& a, const Vector3& b, const Vector3& c, const Vector3& d)
+{
+    double adx = (double)a.x_ - d.x_, ady = (double)a.y_ - d.y_, adz = (double)a.z_ - d.z_;
+    double bdx = (double)b.x_ - d.x_, bdy = (double)b.y_ - d.y_, bdz = (double)b.z_ - d.z_;
+    double cdx = (double)c.x_ - d.x_, cdy = (double)c.y_ - d.y_, cdz = (double)c.z_ - d.z_;
+
+    double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+    double cdxady = cdx * ady, adxcdy = adx * cdy;
+    double adxbdy = adx * bdy, bdxady = bdx * ady;
+
+    double det = adz * (bdxcdy - cdxbdy)
+               + bdz * (cdxady - adxcdy)
+               + cdz * (adxbdy - bdxady);
+
+    double permanent = (std::abs(bdxcdy) + std::abs(cdxbdy)) * std::abs(adz)
+                     + (std::abs(cdxady) + std::abs(adxcdy)) * std::abs(bdz)
+                     + (std::abs(adxbdy) + std::abs(bdxady)) * std::abs(cdz);
+
+    double errorBound = orient3dErrorBound * permanent;
+    if(det > errorBound || -det > errorBound)
+        return det;
+
+    return Orient3DExact(a, b, c, d);
+}
+
+// ----------------------------------------------------------------------------
+double GeometricPredicates::InSphere(const Vector3& a, const Vector3& b, const Vector3& c, const Vector3& d, const Vector3& e)
+{
+    double aex = (double)a.x_ - e.x_, aey = (double)a.y_ - e.y_, aez = (double)a.z_ - e.z_;
+    double bex = (double)b.x_ - e.x_, bey = (double)b.y_ - e.y_, bez = (double)b.z_ - e.z_;
+    double cex = (double)c.x_ - e.x_, cey = (double)c.y_ - e.y_, cez = (double)c.z_ - e.z_;
+    double dex = (double)d.x_ - e.x_, dey = (double)d.y_ - e.y_, dez = (double)d.z_ - e.z_;
+
+    double aexbey = aex * bey, bexaey = bex * aey;
+    double bexcey = bex * cey, cexbey = cex * bey;
+    double cexdey = cex * dey, dexcey = dex * cey;
+    double dexaey = dex * aey, aexdey = aex * dey;
+    double aexcey = aex * cey, cexaey = cex * aey;
+    double bexdey = bex * dey, dexbey = dex * bey;
+
+    double ab = aexbey - bexaey;
+    double bc = bexcey - cexbey;
+    double cd = cexdey - dexcey;
+    double da = dexaey - aexdey;
+    double ac = aexcey - cexaey;
+    double bd = bexdey - dexbey;
+
+    double abc = aez * bc - bez * ac + cez * ab;
+    double bcd = bez * cd - cez * bd + dez * bc;
+    double cda = cez * da + dez * ac + aez * cd;
+    double dab = dez * ab + aez * bd + bez * da;
+
+    double alift = aex * aex + aey * aey + aez * aez;
+    double blift = bex * bex + bey * bey + bez * bez;
+    double clift = cex * cex + cey * cey + cez * cez;
+    double dlift = dex * dex + dey * dey + dez * dez;
+
+    double det = (dlift * abc - clift * dab) + (blift * cda - alift * bcd);
+
+    aez = std::abs(aez); bez = std::abs(bez); cez = std::abs(cez); dez = std::abs(dez);
+    aexbey = std::abs(aexbey); bexaey = std::abs(bexaey);
+    bexcey = std::abs(bexcey); cexbey = std::abs(cexbey);
+    cexdey = std::abs(cexdey); dexcey = std::abs(dexcey);
+    dexaey = std::abs(dexaey); aexdey = std::abs(aexdey);
+    aexcey = std::abs(aexcey); cexaey = std::abs(cexaey);
+    bexdey = std::abs(bexdey); dexbey = std::abs(dexbey);
+
+    double permanent = ((cexdey + dexcey) * bez
+                     + (dexbey + bexdey) * cez
+                     + (bexcey + cexbey) * dez) * alift
+                     + ((dexaey + aexdey) * cez
+                     + (aexcey + cexaey) * dez
+                     + (cexdey + dexcey) * aez) * blift
+                     + ((aexbey + bexaey) * dez
+                     + (bexdey + dexbey) * aez
+                     + (dexaey + aexdey) * bez) * clift
+                     + ((bexcey + cexbey) * aez
+                     + (cexaey + aexcey) * bez
+                     + (aexbey + bexaey) * cez) * dlift;
+
+    double errorBound = inSphereErrorBound * permanent;
+    if(det > errorBound || -det > errorBound)
+        return det;
+
+    return InSphereExact(a, b, c, d, e);
+}
+
+// ----------------------------------------------------------------------------
+/*
+ * The exact versions evaluate the same determinants as above, except every
+ * intermediate value is an expansion. This is slow, but it is only reached
+ * for nearly degenerate inputs such as coplanar or cospherical probes.
+ */
+
+// ----------------------------------------------------------------------------
+static void Minor2x2(Expansion* h, const Expansion& a, const Expansion& b, const Expansion& c, const Expansion& d)
+{
+    // a*b - c*d
+    Expansion ab, cd;
+    Multiply(&ab, a, b);
+    Multiply(&cd, c, d);
+    Subtract(h, ab, cd);
+}
+
+// ----------------------------------------------------------------------------
+double GeometricPredicates::Orient3DExact(const Vector3& a, const Vector3& b, const Vector3& c, const Vector3& d)
+{
+    Expansion adx, ady, adz, bdx, bdy, bdz, cdx, cdy, cdz;
+    Difference(&adx, a.x_, d.x_); Difference(&ady, a.y_, d.y_); Difference(&adz, a.z_, d.z_);
+    Difference(&bdx, b.x_, d.x_); Difference(&bdy, b.y_, d.y_); Difference(&bdz, b.z_, d.z_);
+    Difference(&cdx, c.x_, d.x_); Difference(&cdy, c.y_, d.y_); Difference(&cdz, c.z_, d.z_);
+
+    Expansion minor, term, det;
+    Minor2x2(&minor, bdx, cdy, cdx, bdy);
+    Multiply(&term, adz, minor);
+    Add(&det, det, term);
+
+    Minor2x2(&minor, cdx, ady, adx, cdy);
+    Multiply(&term, bdz, minor);
+    Add(&det, det, term);
+
+    Minor2x2(&minor, adx, bdy, bdx, ady);
+    Multiply(&term, cdz, minor);
+    Add(&det, det, term);
+
+    return Estimate(det);
+}
+
+// ----------------------------------------------------------------------------
+double GeometricPredicates::InSphereExact(const Vector3& a, const Vector3& b, const Vector3& c, const Vector3& d, const Vector3& e)
+{
+    Expansion aex, aey, aez, bex, bey, bez, cex, cey, cez, dex, dey, dez;
+    Difference(&aex, a.x_, e.x_); Difference(&aey, a.y_, e.y_); Difference(&aez, a.z_, e.z_);
+    Difference(&bex, b.x_, e.x_); Difference(&bey, b.y_, e.y_); Difference(&bez, b.z_, e.z_);
+    Difference(&cex, c.x_, e.x_); Difference(&cey, c.y_, e.y_); Difference(&cez, c.z_, e.z_);
+    Difference(&dex, d.x_, e.x_); Difference(&dey, d.y_, e.y_); Difference(&dez, d.z_, e.z_);
+
+    Expansion ab, bc, cd, da, ac, bd;
+    Minor2x2(&ab, aex, bey, bex, aey);
+    Minor2x2(&bc, bex, cey, cex, bey);
+    Minor2x2(&cd, cex, dey, dex, cey);
+    Minor2x2(&da, dex, aey, aex, dey);
+    Minor2x2(&ac, aex, cey, cex, aey);
+    Minor2x2(&bd, bex, dey, dex, bey);
+
+    // abc = aez*bc - bez*ac + cez*ab, etc.
+    Expansion t0, t1, t2, abc, bcd, cda, dab;
+    Multiply(&t0, aez, bc); Multiply(&t1, bez, ac); Multiply(&t2, cez, ab);
+    Subtract(&abc, t0, t1); Add(&abc, abc, t2);
+    Multiply(&t0, bez, cd); Multiply(&t1, cez, bd); Multiply(&t2, dez, bc);
+    Subtract(&bcd, t0, t1); Add(&bcd, bcd, t2);
+    Multiply(&t0, cez, da); Multiply(&t1, dez, ac); Multiply(&t2, aez, cd);
+    Add(&cda, t0, t1); Add(&cda, cda, t2);
+    Multiply(&t0, dez, ab); Multiply(&t1, aez, bd); Multiply(&t2, bez, da);
+    Add(&dab, t0, t1); Add(&dab, dab, t2);
+
+    // lift = x^2 + y^2 + z^2
+    Expansion alift, blift, clift, dlift;
+    Multiply(&t0, aex, aex); Multiply(&t1, aey, aey); Multiply(&t2, aez, aez);
+    Add(&alift, t0, t1); Add(&alift, alift, t2);
+    Multiply(&t0, bex, bex); Multiply(&t1, bey, bey); Multiply(&t2, bez, bez);
+    Add(&blift, t0, t1); Add(&blift, blift, t2);
+    Multiply(&t0, cex, cex); Multiply(&t1, cey, cey); Multiply(&t2, cez, cez);
+    Add(&clift, t0, t1); Add(&clift, clift, t2);
+    Multiply(&t0, dex, dex); Multiply(&t1, dey, dey); Multiply(&t2, dez, dez);
+    Add(&dlift, t0, t1); Add(&dlift, dlift, t2);
+
+    // det = (dlift*abc - clift*dab) + (blift*cda - alift*bcd)
+    Expansion det;
+    Multiply(&t0, dlift, abc); Multiply(&t1, clift, dab);
+    Subtract(&det, t0, t1);
+    Multiply(&t0, blift, cda); Multiply(&t1, alift, bcd);
+    Subtract(&t2, t0, t1);
+    Add(&det, det, t2);
+
+    return Estimate(det);
+}
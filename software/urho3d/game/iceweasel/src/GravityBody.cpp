@@ -0,0 +1,105 @@
+#include "iceweasel/GravityBody.h"
+#include "iceweasel/GravityManager.h"
+#include "iceweasel/IceWeasel.h"
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Node.h>
+
+using namespace Urho3D;
+
+// ----------------------------------------------------------------------------
+GravityBody::GravityBody(Context* context) :
+    Component(context),
+    gravityHint_(M_MAX_UNSIGNED),
+    gravityManagerIndex_(M_MAX_UNSIGNED),
+    isGravityOverridden_(false),
+    originalUseGravity_(true)
+{
+}
+
+// ----------------------------------------------------------------------------
+GravityBody::~GravityBody()
+{
+}
+
+// ----------------------------------------------------------------------------
+void GravityBody::RegisterObject(Context* context)
+{
+    context->RegisterFactory<GravityBody>(ICEWEASEL_CATEGORY);
+}
+
+// ----------------------------------------------------------------------------
+RigidBody* GravityBody::GetRigidBody()
+{
+    // The rigid body may be created after this component
+    if(!rigidBody_ && node_)
+    {
+        rigidBody_ = node_->GetComponent<RigidBody>();
+        isGravityOverridden_ = false;
+    }
+    return rigidBody_;
+}
+
+// ----------------------------------------------------------------------------
+void GravityBody::IntegrateGravity(const Vector3& gravity, float timeStep)
+{
+    RigidBody* body = GetRigidBody();
+    if(body == NULL)
+        return;
+
+    cachedGravity_ = gravity;
+
+    // The rigid body was created after we were tracked
+    if(isGravityOverridden_ == false)
+        OverrideGravity();
+
+    body->SetLinearVelocity(body->GetLinearVelocity() + gravity * timeStep);
+}
+
+// ----------------------------------------------------------------------------
+void GravityBody::ResetGravity()
+{
+    RigidBody* body = GetRigidBody();
+    if(body == NULL || isGravityOverridden_ == false)
+        return;
+
+    body->SetUseGravity(originalUseGravity_);
+    isGravityOverridden_ = false;
+}
+
+// ----------------------------------------------------------------------------
+void GravityBody::SetGravityManager(GravityManager* gravityManager)
+{
+    gravityManager_ = gravityManager;
+    if(gravityManager_)
+        OverrideGravity();
+}
+
+// ----------------------------------------------------------------------------
+void GravityBody::OverrideGravity()
+{
+    RigidBody* body = GetRigidBody();
+    if(body == NULL || isGravityOverridden_)
+        return;
+
+    // Bullet's gravity would be applied on top of ours
+    originalUseGravity_ = body->GetUseGravity();
+    body->SetUseGravity(false);
+    isGravityOverridden_ = true;
+}
+
+// ----------------------------------------------------------------------------
+void GravityBody::OnSceneSet(Scene* scene)
+{
+    if(scene == NULL)
+    {
+        if(gravityManager_)
+            gravityManager_->RemoveGravityBody(this);
+        return;
+    }
+
+    GravityManager* gravityManager = GravityManager::FindClosest(node_);
+    if(gravityManager)
+        gravityManager->AddGravityBody(this);
+}
@@ -1,13 +1,31 @@
 #include "iceweasel/GravityManager.h"
+#include "iceweasel/DebugLineCache.h"
+#include "iceweasel/GravityBody.h"
+#include "iceweasel/GravityQueryLog.h"
 #include "iceweasel/GravityVector.h"
 #include "iceweasel/IceWeasel.h"
 #include "iceweasel/TetrahedralMesh_Mesh.h"
 #include "iceweasel/TetrahedralMesh_Hull.h"
+#include "iceweasel/TetrahedralMesh_Vertex.h"
 #include "iceweasel/TetrahedralMeshBuilder.h"
+#include "iceweasel/TetrahedralMeshDecimator.h"
 
 #include <Urho3D/Core/Context.h>
-#include <Urho3D/Scene/SceneEvents.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/DebugRenderer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Math/BoundingBox.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Physics/RigidBody.h>
 #include <Urho3D/Scene/Node.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include <chrono>
 
 using namespace Urho3D;
 
@@ -21,17 +39,31 @@ GravityManager::GravityManager(Context* context) :
     gravityMesh_(new TetrahedralMesh::Mesh),
     gravityHull_(new TetrahedralMesh::Hull),
     gravity_(9.81f),
-    strategy_(SHORTEST_DISTANCE)
+    strategy_(SHORTEST_DISTANCE),
+    lastQueryPath_(PATH_DEFAULT),
+    lastQueryTetrahedronCount_(0),
+    debugHighlightHint_(0),
+    buildTimeBudget_(2.0f),
+    maxInsertionsPerFrame_(64),
+    decimationMaxAngle_(5.0f),
+    decimationMaxForceFactorError_(0.05f),
+    decimate_(false),
+    rebuildMesh_(false),
+    isBuilding_(false),
+    recordSnapshot_(true),
+    debugLinesDirty_(true),
+    debugLinesDrawn_(false)
 {
-    SubscribeToEvent(E_COMPONENTADDED, URHO3D_HANDLER(GravityManager, HandleComponentAdded));
-    SubscribeToEvent(E_COMPONENTREMOVED, URHO3D_HANDLER(GravityManager, HandleComponentRemoved));
-    SubscribeToEvent(E_NODEADDED, URHO3D_HANDLER(GravityManager, HandleNodeAdded));
-    SubscribeToEvent(E_NODEREMOVED, URHO3D_HANDLER(GravityManager, HandleNodeRemoved));
 }
 
 // ----------------------------------------------------------------------------
 GravityManager::~GravityManager()
 {
+    // The decimation refers to our members
+    if(decimationItem_)
+        GetSubsystem<WorkQueue>()->Complete(0);
+
+    StopRecording();
 }
 
 // ----------------------------------------------------------------------------
@@ -47,32 +79,136 @@ void GravityManager::RegisterObject(Context* context)
 
     URHO3D_ACCESSOR_ATTRIBUTE("Global Gravity", GetGlobalGravity, SetGlobalGravity, float, 9.81, AM_DEFAULT);
     URHO3D_ENUM_ACCESSOR_ATTRIBUTE("Strategy", GetStrategy, SetStrategy, Strategy, strategyNames, SHORTEST_DISTANCE, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Build Time Budget", GetBuildTimeBudget, SetBuildTimeBudget, float, 2.0f, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Max Insertions Per Frame", GetMaxInsertionsPerFrame, SetMaxInsertionsPerFrame, unsigned, 64, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Decimate Probes", GetDecimate, SetDecimate, bool, false, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Decimation Max Angle", GetDecimationMaxAngle, SetDecimationMaxAngle, float, 5.0f, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Decimation Max Force Error", GetDecimationMaxForceFactorError, SetDecimationMaxForceFactorError, float, 0.05f, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("LOD Near Distance", GetLODNearDistance, SetLODNearDistance, float, 20.0f, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("LOD Far Distance", GetLODFarDistance, SetLODFarDistance, float, 100.0f, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("LOD Max Interval", GetLODMaxInterval, SetLODMaxInterval, unsigned, 8, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("LOD Rest Speed", GetLODRestSpeed, SetLODRestSpeed, float, 0.1f, AM_DEFAULT);
+}
+
+// ----------------------------------------------------------------------------
+Vector3 GravityManager::QueryGravity(Vector3 worldLocation, unsigned* hint)
+{
+    PrepareQuery();
+
+    if(recordFile_)
+        return EvaluateAndRecordGravity(worldLocation, hint);
+    return EvaluateGravity(worldLocation, hint);
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::QueryGravity(PODVector<Vector3>* gravity,
+                                  const PODVector<Vector3>& worldLocations,
+                                  PODVector<unsigned>* hints)
+{
+    PrepareQuery();
+
+    assert(hints == NULL || hints->Size() == worldLocations.Size());
+    gravity->Resize(worldLocations.Size());
+    unsigned sharedHint = M_MAX_UNSIGNED;
+    for(unsigned i = 0; i != worldLocations.Size(); ++i)
+    {
+        unsigned* hint = hints != NULL ? &(*hints)[i] : &sharedHint;
+        if(recordFile_)
+            (*gravity)[i] = EvaluateAndRecordGravity(worldLocations[i], hint);
+        else
+            (*gravity)[i] = EvaluateGravity(worldLocations[i], hint);
+    }
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::PrepareQuery()
+{
+    UpdateChangedGravityVectors();
+
+    // Queries keep using the previous mesh while a new one is being built.
+    // HandleUpdate() continues the build and ApplyBuild() swaps it in. Only
+    // the very first build has no previous mesh to fall back on.
+    if(isBuilding_ && gravityVertices_.Empty())
+        FinishBuild();
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::PrepareConcurrentQuery()
+{
+    PrepareQuery();
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::QueryGravityConcurrent(PODVector<Vector3>* gravity,
+                                            const PODVector<Vector3>& worldLocations,
+                                            unsigned begin,
+                                            unsigned end,
+                                            PODVector<unsigned>* hints) const
+{
+    QueryPath path;
+    unsigned tetrahedronCount;
+    unsigned sharedHint = M_MAX_UNSIGNED;
+    for(unsigned i = begin; i < end; ++i)
+    {
+        unsigned* hint = hints != NULL ? &(*hints)[i] : &sharedHint;
+        (*gravity)[i] = InterpolateGravity(worldLocations[i], &path, &tetrahedronCount, NULL, hint);
+    }
+}
+
+// ----------------------------------------------------------------------------
+Vector3 GravityManager::QueryGravityConcurrent(const Vector3& worldLocation,
+                                               unsigned* hint,
+                                               QueryPath* path,
+                                               unsigned* tetrahedronCount) const
+{
+    QueryPath ignoredPath;
+    unsigned ignoredTetrahedronCount;
+    return InterpolateGravity(worldLocation,
+                              path != NULL ? path : &ignoredPath,
+                              tetrahedronCount != NULL ? tetrahedronCount : &ignoredTetrahedronCount,
+                              NULL,
+                              hint);
+}
+
+// ----------------------------------------------------------------------------
+Vector3 GravityManager::EvaluateGravity(const Vector3& worldLocation, unsigned* hint)
+{
+    // Passing the hull lets it fill in its direction map, which concurrent
+    // queries can't do
+    return InterpolateGravity(worldLocation, &lastQueryPath_, &lastQueryTetrahedronCount_, gravityHull_, hint);
 }
 
 // ----------------------------------------------------------------------------
-Vector3 GravityManager::QueryGravity(Vector3 worldLocation)
+Vector3 GravityManager::InterpolateGravity(const Vector3& worldLocation,
+                                           QueryPath* path,
+                                           unsigned* tetrahedronCount,
+                                           TetrahedralMesh::Hull* hull,
+                                           unsigned* hint) const
 {
+    *path = PATH_DEFAULT;
+    *tetrahedronCount = 0;
+
     if(strategy_ == SHORTEST_DISTANCE)
     {
         // TODO Really shitty method of finding closest node
-        float distance = std::numeric_limits<float>::max();
-        PODVector<GravityVector*>::ConstIterator it = gravityVectors_.Begin();
-        GravityVector* foundGravityVector = NULL;
-        for(; it != gravityVectors_.End(); ++it)
+        float distanceSquared = std::numeric_limits<float>::max();
+        unsigned foundIndex = M_MAX_UNSIGNED;
+        for(unsigned i = 0; i != snapshot_.Size(); ++i)
         {
-            float newDistance = (worldLocation - (*it)->GetPosition()).Length();
-            if(newDistance < distance)
+            float newDistanceSquared = (worldLocation - snapshot_.positions_[i]).LengthSquared();
+            if(newDistanceSquared < distanceSquared)
             {
-                foundGravityVector = *it;
-                distance = newDistance;
+                foundIndex = i;
+                distanceSquared = newDistanceSquared;
             }
         }
 
         // No node was found? No gravity nodes exist. Provide default vector
-        if(foundGravityVector == NULL)
+        if(foundIndex == M_MAX_UNSIGNED)
             return Vector3::DOWN * gravity_;
 
-        return foundGravityVector->GetDirection() * foundGravityVector->GetForceFactor() * gravity_;
+        *path = PATH_SHORTEST_DISTANCE;
+        return snapshot_.directions_[foundIndex] * snapshot_.forceFactors_[foundIndex] * gravity_;
     }
     else if(strategy_ == TETRAHEDRAL_MESH)
     {
@@ -83,14 +219,36 @@ Vector3 GravityManager::QueryGravity(Vector3 worldLocation)
 
         // Query gravity mesh. This will fail if the point is outside of the hull.
         Vector3 gravityVector;
-        if(gravityMesh_->Query(&gravityVector, worldLocation))
+        if(gravityMesh_->Query(&gravityVector, worldLocation, hint, tetrahedronCount))
         {
+            *path = PATH_MESH;
             return gravityVector * gravity_;
         }
 
         // Project our location onto the the hull.
-        if(gravityHull_->Query(&gravityVector, worldLocation))
+        bool projected;
+        TetrahedralMesh::Hull::Feature feature;
+        if(hull)
+        {
+            projected = hull->Query(&gravityVector, worldLocation);
+            feature = hull->GetLastFeature();
+        }
+        else
+        {
+            const TetrahedralMesh::Hull* constHull = gravityHull_;
+            Vector3 intersection;
+            projected = constHull->Query(&gravityVector, worldLocation, &feature, &intersection);
+        }
+
+        if(projected)
         {
+            switch(feature)
+            {
+                case TetrahedralMesh::Hull::FEATURE_FACE   : *path = PATH_HULL_FACE;   break;
+                case TetrahedralMesh::Hull::FEATURE_EDGE   : *path = PATH_HULL_EDGE;   break;
+                case TetrahedralMesh::Hull::FEATURE_VERTEX : *path = PATH_HULL_VERTEX; break;
+                default : break;
+            }
             return gravityVector * gravity_;
         }
     }
@@ -98,154 +256,739 @@ Vector3 GravityManager::QueryGravity(Vector3 worldLocation)
     return Vector3::DOWN * gravity_;
 }
 
+// ----------------------------------------------------------------------------
+BoundingBox GravityManager::GetBoundingBox()
+{
+    UpdateChangedGravityVectors();
+
+    BoundingBox box;
+    for(unsigned i = 0; i != snapshot_.Size(); ++i)
+        box.Merge(snapshot_.positions_[i]);
+    return box;
+}
+
+// ----------------------------------------------------------------------------
+bool GravityManager::StartRecording(const String& fileName)
+{
+    StopRecording();
+
+    SharedPtr<File> file(new File(context_, fileName, FILE_WRITE));
+    if(file->IsOpen() == false)
+    {
+        URHO3D_LOGERRORF("[GravityManager] Failed to open \"%s\" for recording", fileName.CString());
+        return false;
+    }
+
+    file->WriteFileID("GQLG");
+    file->WriteUInt(GravityQueryLog::VERSION);
+
+    recordFile_ = file;
+    recordSnapshot_ = true;
+    URHO3D_LOGINFOF("[GravityManager] Recording gravity queries to \"%s\"", fileName.CString());
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::StopRecording()
+{
+    if(recordFile_)
+        recordFile_->Close();
+    recordFile_.Reset();
+}
+
+// ----------------------------------------------------------------------------
+bool GravityManager::IsRecording() const
+{
+    return recordFile_.NotNull();
+}
+
+// ----------------------------------------------------------------------------
+Vector3 GravityManager::EvaluateAndRecordGravity(const Vector3& worldLocation, unsigned* hint)
+{
+    if(recordSnapshot_)
+        RecordSnapshot();
+
+    // HiresTimer only has microsecond resolution, which is longer than most
+    // queries take
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    Vector3 result = EvaluateGravity(worldLocation, hint);
+    long long latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now() - start).count();
+
+    recordFile_->WriteUByte(GravityQueryLog::CHUNK_QUERY);
+    recordFile_->WriteVector3(worldLocation);
+    recordFile_->WriteVector3(result);
+    recordFile_->WriteUByte((unsigned char)lastQueryPath_);
+    recordFile_->WriteUInt((unsigned)Min(latency, (long long)M_MAX_UNSIGNED));
+
+    return result;
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::RecordSnapshot()
+{
+    recordFile_->WriteUByte(GravityQueryLog::CHUNK_SNAPSHOT);
+    recordFile_->WriteUByte((unsigned char)strategy_);
+    recordFile_->WriteFloat(gravity_);
+    recordFile_->WriteBool(decimate_);
+    recordFile_->WriteFloat(decimationMaxAngle_);
+    recordFile_->WriteFloat(decimationMaxForceFactorError_);
+    recordFile_->WriteUInt(snapshot_.Size());
+    for(unsigned i = 0; i != snapshot_.Size(); ++i)
+    {
+        recordFile_->WriteVector3(snapshot_.positions_[i]);
+        recordFile_->WriteVector3(snapshot_.directions_[i]);
+        recordFile_->WriteFloat(snapshot_.forceFactors_[i]);
+    }
+
+    recordSnapshot_ = false;
+}
+
 // ----------------------------------------------------------------------------
 void GravityManager::DrawDebugGeometry(DebugRenderer* debug, bool depthTest, Vector3 pos)
 {
+    UpdateChangedGravityVectors();
+
+    // Show the partial triangulation while a build is in progress, so the
+    // preview refines progressively.
+    if(isBuilding_)
+    {
+        if(debugLines_)
+            debugLines_->SetVisible(false);
+
+        PODVector<GravityVector*>::ConstIterator it = gravityVectors_.Begin();
+        for(; it != gravityVectors_.End(); ++it)
+            (*it)->DrawDebugGeometry(debug, depthTest);
+        if(decimationItem_ == NULL)
+            builder_.DrawDebugGeometry(debug, depthTest);
+        return;
+    }
+
+    // The probes, mesh and hull only change when the mesh does, so their
+    // lines are cached. HandleUpdate() hides them again once we stop being
+    // called.
+    UpdateDebugLines();
+    if(debugLines_)
+    {
+        debugLines_->SetDepthTest(depthTest);
+        debugLines_->SetVisible(true);
+        debugLinesDrawn_ = true;
+        SubscribeToUpdate();
+    }
+
+    // Highlight the tetrahedron the position is in. Starting the walk from
+    // last frame's tetrahedron usually finds it in a few steps.
+    unsigned found = gravityMesh_->Locate(pos, debugHighlightHint_);
+    if(found != M_MAX_UNSIGNED)
+    {
+        debugHighlightHint_ = found;
+        gravityMesh_->DrawTetrahedron(debug, false, found, Color::RED);
+    }
+    gravityHull_->DrawLastIntersection(debug, depthTest);
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::UpdateDebugLines()
+{
+    if(GetScene() == NULL)
+        return;
+
+    if(!debugLines_)
+    {
+        debugLines_ = new DebugLineCache(GetScene());
+        debugLinesDirty_ = true;
+    }
+
+    if(debugLinesDirty_ == false)
+        return;
+
+    debugLines_->Clear();
     PODVector<GravityVector*>::ConstIterator it = gravityVectors_.Begin();
     for(; it != gravityVectors_.End(); ++it)
-        (*it)->DrawDebugGeometry(debug, depthTest);
-    gravityMesh_->DrawDebugGeometry(debug, depthTest, pos);
-    gravityHull_->DrawDebugGeometry(debug, depthTest, pos);
+        (*it)->AddDebugLines(debugLines_);
+    gravityMesh_->AddDebugLines(debugLines_, Color::GRAY);
+    gravityHull_->AddDebugLines(debugLines_);
+    debugLines_->Commit();
+
+    debugLinesDirty_ = false;
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::DrawDebugGeometry(DebugRenderer* debug, bool depthTest)
+{
+    // Called by the editor. Highlight the tetrahedron the camera is in.
+    DrawDebugGeometry(debug, depthTest, debug->GetView().Inverse().Translation());
 }
 
 // ----------------------------------------------------------------------------
-void GravityManager::RebuildTetrahedralMesh()
+void GravityManager::BeginBuild()
 {
-    TetrahedralMeshBuilder builder;
-    builder.Build(gravityVectors_);
+    // The snapshot being decimated can't be replaced until the decimation is
+    // done. EndDecimation() starts over.
+    if(decimationItem_)
+    {
+        rebuildMesh_ = true;
+        return;
+    }
+
+    // The new mesh is built from the current state of all gravity vectors
+    UpdateSnapshot(NULL);
+
+    rebuildMesh_ = false;
+    isBuilding_ = true;
+    SubscribeToUpdate();
+
+    if(decimate_ == false)
+    {
+        builder_.Begin(snapshot_);
+        return;
+    }
 
-    gravityMesh_->SetMesh(builder.GetTetrahedralMesh());
-    gravityHull_->SetMesh(builder.GetHullMesh());
+    // Decimation builds several meshes of its own and can't be split into
+    // steps, so it runs on a worker thread on a copy of the snapshot
+    decimationSnapshot_ = snapshot_;
+    decimator_.SetMaxAngularError(decimationMaxAngle_);
+    decimator_.SetMaxForceFactorError(decimationMaxForceFactorError_);
+
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    if(queue == NULL)
+    {
+        decimator_.Decimate(&decimationExcluded_, decimationSnapshot_);
+        EndDecimation();
+        return;
+    }
+
+    // Lower priority than the movement stages, so waiting for those every
+    // substep doesn't wait for the decimation as well
+    decimationItem_ = new WorkItem;
+    decimationItem_->priority_ = 0;
+    decimationItem_->workFunction_ = DecimateWork;
+    decimationItem_->aux_ = this;
+    queue->AddWorkItem(decimationItem_);
 }
 
 // ----------------------------------------------------------------------------
-/*
- * This section maintains a list of nodes that have gravity probes
- * attached to them. Whenever nodes are deleted or added to the scene, or
- * whenever components are added or removed from nodes, we must check to see
- * which of those nodes have/had a gravity probe attached to it and update
- * our internal list accordingly.
- *
- * Unfortunately, E_COMPONENTREMOVED and E_COMPONENTADDED do not fire when a
- * parent node is removed/added containing gravity probe nodes, so we must
- * also monitor E_NODEREMOVED AND E_NODEADDED.
- */
+void GravityManager::DecimateWork(const WorkItem* item, unsigned threadIndex)
+{
+    (void)threadIndex;
+
+    GravityManager* gravityManager = static_cast<GravityManager*>(item->aux_);
+    gravityManager->decimator_.Decimate(&gravityManager->decimationExcluded_,
+                                        gravityManager->decimationSnapshot_);
+}
 
 // ----------------------------------------------------------------------------
-void GravityManager::OnSceneSet(Scene* scene)
+void GravityManager::EndDecimation()
 {
-    (void)scene;
+    decimationItem_.Reset();
 
-    // do a full search for gravityProbe nodes
-    gravityVectors_.Clear();
-    AddGravityVectorsRecursively(node_);
-    RebuildTetrahedralMesh();
+    URHO3D_LOGINFOF("[GravityManager] Decimation removed %d of %d gravity probes, tetrahedrons %d -> %d",
+                    decimator_.GetRemovedCount(),
+                    decimationSnapshot_.Size(),
+                    decimator_.GetTetrahedronCountBefore(),
+                    decimator_.GetTetrahedronCountAfter());
+
+    // Gravity vectors were added or removed while decimating
+    if(rebuildMesh_)
+    {
+        BeginBuild();
+        return;
+    }
+
+    // Moved gravity vectors are synchronised once the build is applied
+    builder_.Begin(decimationSnapshot_, &decimationExcluded_);
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::ContinueBuild()
+{
+    // Nothing can be inserted until the decimation is done
+    if(decimationItem_)
+    {
+        if(decimationItem_->completed_ == false)
+            return;
+        EndDecimation();
+        if(decimationItem_)
+            return;
+    }
+
+    // Insert gravity vectors one at a time until we run out of time or hit
+    // the insertion limit for this frame.
+    HiresTimer timer;
+    long long budget = (long long)(buildTimeBudget_ * 1000.0f);
+    bool isFinished = false;
+    for(unsigned i = 0; i != maxInsertionsPerFrame_ && !isFinished; ++i)
+    {
+        isFinished = builder_.Step(1);
+        if(timer.GetUSec(false) >= budget)
+            break;
+    }
+
+    if(isFinished)
+        ApplyBuild();
 }
 
 // ----------------------------------------------------------------------------
-void GravityManager::AddGravityVectorsRecursively(Node* node)
+void GravityManager::FinishBuild()
 {
-    // Recursively retrieve all nodes that have a gravity probe component and
-    // add them to our internal list of gravity probe nodes. Note that it
-    // should not be possible for there to be duplicates; scene graphs can't
-    // have loops.
-    PODVector<Node*> gravityVectorNodesToAdd;
-    node->GetChildrenWithComponent<GravityVector>(gravityVectorNodesToAdd, true);
-    // Don't forget to check this node's components as well
-    if(node->GetComponent<GravityVector>())
-        gravityVectorNodesToAdd.Push(node);
+    // Restarting the decimation clears rebuildMesh_, so this waits at most
+    // twice
+    while(decimationItem_)
+    {
+        GetSubsystem<WorkQueue>()->Complete(0);
+        EndDecimation();
+    }
+
+    builder_.Step(M_MAX_UNSIGNED);
+    builder_.Step(0);
+    ApplyBuild();
+}
 
-    PODVector<Node*>::Iterator it = gravityVectorNodesToAdd.Begin();
-    for(; it != gravityVectorNodesToAdd.End(); ++it)
-        gravityVectors_.Push((*it)->GetComponent<GravityVector>());
+// ----------------------------------------------------------------------------
+void GravityManager::ApplyBuild()
+{
+    // Until now, queries were still using the previous mesh
+    gravityMesh_->SetMesh(builder_.GetTetrahedralMesh());
+    gravityHull_->SetMesh(builder_.GetHullMesh());
+    gravityVertices_ = builder_.GetVertices();
+    isBuilding_ = false;
+    debugLinesDirty_ = true;
+
+    if(builder_.GetSkippedCount() > 0)
+        URHO3D_LOGWARNINGF("[GravityManager] %d of %d gravity probes could not be added to the mesh (duplicate positions?)",
+                           builder_.GetSkippedCount(),
+                           builder_.GetVertices().Size());
+
+    // Gravity vectors may have changed while the mesh was being built.
+    // Synchronise all vertices with the snapshot.
+    PODVector<unsigned> indices;
+    for(unsigned i = 0; i != gravityVertices_.Size(); ++i)
+        indices.Push(i);
+    ApplyVertexChanges(indices);
 }
 
 // ----------------------------------------------------------------------------
-void GravityManager::RemoveGravityVectorsRecursively(Node* node)
+void GravityManager::NotifyGravityVectorChanged(GravityVector* gravityVector)
 {
-    // Recursively retrieve all nodes that have a gravity probe component
-    PODVector<Node*> gravityVectorNodesToRemove;
-    node->GetChildrenWithComponent<GravityVector>(gravityVectorNodesToRemove, true);
-    // Don't forget to check this node's components as well
-    if(node->GetComponent<GravityVector>())
-        gravityVectorNodesToRemove.Push(node);
+    changedGravityVectors_.Insert(gravityVector);
+    SubscribeToUpdate();
+}
 
-    // search for found components and remove them from our internal list
-    PODVector<Node*>::ConstIterator it = gravityVectorNodesToRemove.Begin();
-    for(; it != gravityVectorNodesToRemove.End(); ++it)
+// ----------------------------------------------------------------------------
+void GravityManager::UpdateChangedGravityVectors()
+{
+    // Gravity vectors were added or removed since the last build
+    if(rebuildMesh_)
     {
-        PODVector<GravityVector*>::Iterator gravityNode = gravityVectors_.Find((*it)->GetComponent<GravityVector>());
-        if(gravityNode != gravityVectors_.End())
-            gravityVectors_.Erase(gravityNode);
+        BeginBuild();
+        return;
     }
+
+    if(changedGravityVectors_.Empty())
+        return;
+
+    PODVector<unsigned> changedIndices;
+    UpdateSnapshot(&changedIndices);
+
+    // The mesh being built is synchronised with the snapshot once it's done
+    if(isBuilding_)
+        return;
+
+    ApplyVertexChanges(changedIndices);
 }
 
 // ----------------------------------------------------------------------------
-void GravityManager::HandleComponentAdded(StringHash eventType, VariantMap& eventData)
+void GravityManager::ApplyVertexChanges(const PODVector<unsigned>& indices)
 {
-    using namespace ComponentAdded;
-    (void)eventType;
+    // The mesh vertices are stored in the same order as the snapshot they
+    // were created from
+    if(gravityVertices_.Size() != snapshot_.Size())
+    {
+        BeginBuild();
+        return;
+    }
+
+    PODVector<TetrahedralMesh::Vertex*> movedVertices;
+    for(PODVector<unsigned>::ConstIterator it = indices.Begin();
+        it != indices.End();
+        ++it)
+    {
+        TetrahedralMesh::Vertex* vertex = gravityVertices_[*it];
 
-    // We only care about nodes that are descendants of us
-    if(!node_->IsAncestorOf(static_cast<Node*>(eventData[P_NODE].GetPtr())))
+        // Vertices that were left out of the mesh (e.g. by decimation) have
+        // to be re-evaluated by a new build when they change.
+        if(gravityMesh_->ContainsVertex(vertex) == false)
+        {
+            if(vertex->position_.Equals(snapshot_.positions_[*it]) &&
+               vertex->direction_.Equals(snapshot_.directions_[*it]) &&
+               Equals(vertex->forceFactor_, snapshot_.forceFactors_[*it]))
+                continue;
+
+            BeginBuild();
+            return;
+        }
+
+        // Direction and force factor only affect interpolation, so they can
+        // be written directly into the vertex.
+        vertex->direction_ = snapshot_.directions_[*it];
+        vertex->forceFactor_ = snapshot_.forceFactors_[*it];
+
+        const Vector3& position = snapshot_.positions_[*it];
+        if(position.Equals(vertex->position_))
+            continue;
+
+        vertex->position_ = position;
+        movedVertices.Push(vertex);
+    }
+
+    if(movedVertices.Empty())
         return;
 
-    // Check if the component that was added is a gravity vector. If not, then
-    // it does not concern us.
-    Component* component = static_cast<Component*>(eventData[P_COMPONENT].GetPtr());
-    if(component->GetType() != GravityVector::GetTypeStatic())
+    // Try to keep the existing triangulation and only update the
+    // tetrahedrons that are connected to the moved vertices. If the move
+    // inverted any of them then the connectivity is no longer valid and the
+    // mesh has to be rebuilt.
+    if(gravityMesh_->UpdateVertices(movedVertices) == false)
+    {
+        BeginBuild();
         return;
+    }
+    gravityHull_->UpdateVertices(movedVertices);
+}
 
-    gravityVectors_.Push(static_cast<GravityVector*>(component));
-    RebuildTetrahedralMesh();
+// ----------------------------------------------------------------------------
+void GravityManager::SubscribeToUpdate()
+{
+    if(!HasSubscribedToEvent(E_UPDATE))
+        SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(GravityManager, HandleUpdate));
 }
 
 // ----------------------------------------------------------------------------
-void GravityManager::HandleComponentRemoved(StringHash eventType, VariantMap& eventData)
+void GravityManager::HandleUpdate(StringHash eventType, VariantMap& eventData)
 {
-    using namespace ComponentRemoved;
     (void)eventType;
+    (void)eventData;
+
+    // Hide the cached debug lines if they weren't drawn since the last
+    // update
+    bool showDebugLines = debugLines_ && debugLines_->IsVisible();
+    if(showDebugLines && debugLinesDrawn_ == false)
+    {
+        debugLines_->SetVisible(false);
+        showDebugLines = false;
+    }
+    debugLinesDrawn_ = false;
+
+    // Nobody may be querying gravity (e.g. in the editor), so pending
+    // changes are also applied here.
+    UpdateChangedGravityVectors();
+
+    if(isBuilding_)
+        ContinueBuild();
+    else if(changedGravityVectors_.Empty() && showDebugLines == false)
+        UnsubscribeFromEvent(E_UPDATE);
+}
 
-    // We only care about nodes that are descendants of us
-    if(!node_->IsAncestorOf(static_cast<Node*>(eventData[P_NODE].GetPtr())))
+// ----------------------------------------------------------------------------
+void GravityManager::UpdateSnapshot(PODVector<unsigned>* changedIndices)
+{
+    for(HashSet<GravityVector*>::ConstIterator it = changedGravityVectors_.Begin();
+        it != changedGravityVectors_.End();
+        ++it)
+    {
+        GravityVector* gravityVector = *it;
+        unsigned index = gravityVector->GetGravityManagerIndex();
+        if(index >= gravityVectors_.Size() || gravityVectors_[index] != gravityVector)
+            continue;
+
+        // This is the only place where the node's world transform is read
+        snapshot_.Set(index,
+                      gravityVector->GetPosition(),
+                      gravityVector->GetDirection(),
+                      gravityVector->GetForceFactor());
+
+        if(changedIndices)
+            changedIndices->Push(index);
+        recordSnapshot_ = true;
+        debugLinesDirty_ = true;
+    }
+    changedGravityVectors_.Clear();
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::AddGravityVector(GravityVector* gravityVector)
+{
+    // Both the gravity vector and this manager try to register the gravity
+    // vector when they enter the scene, whichever comes last.
+    unsigned index = gravityVector->GetGravityManagerIndex();
+    if(index < gravityVectors_.Size() && gravityVectors_[index] == gravityVector)
         return;
 
-    // Check if the component that was removed was a gravity vector. If not,
-    // then it does not concern us.
-    Component* component = static_cast<Component*>(eventData[P_COMPONENT].GetPtr());
-    if(component->GetType() != GravityVector::GetTypeStatic())
+    // Moved from beneath a different gravity manager
+    if(gravityVector->GetGravityManager())
+        gravityVector->GetGravityManager()->RemoveGravityVector(gravityVector);
+
+    gravityVector->SetGravityManager(this);
+    gravityVector->SetGravityManagerIndex(gravityVectors_.Size());
+    gravityVectors_.Push(gravityVector);
+    snapshot_.Push(gravityVector->GetPosition(),
+                   gravityVector->GetDirection(),
+                   gravityVector->GetForceFactor());
+
+    // Vertex indices no longer match the registry
+    gravityVertices_.Clear();
+    rebuildMesh_ = true;
+    recordSnapshot_ = true;
+    debugLinesDirty_ = true;
+    SubscribeToUpdate();
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::RemoveGravityVector(GravityVector* gravityVector)
+{
+    unsigned index = gravityVector->GetGravityManagerIndex();
+    if(index >= gravityVectors_.Size() || gravityVectors_[index] != gravityVector)
         return;
 
-    gravityVectors_.Remove(static_cast<GravityVector*>(component));
-    RebuildTetrahedralMesh();
+    changedGravityVectors_.Erase(gravityVector);
+
+    // Move the last gravity vector into the freed slot
+    GravityVector* last = gravityVectors_.Back();
+    last->SetGravityManagerIndex(index);
+    gravityVectors_[index] = last;
+    gravityVectors_.Pop();
+    snapshot_.EraseSwap(index);
+
+    gravityVector->SetGravityManager(NULL);
+    gravityVector->SetGravityManagerIndex(M_MAX_UNSIGNED);
+
+    // Vertex indices no longer match the registry
+    gravityVertices_.Clear();
+    rebuildMesh_ = true;
+    recordSnapshot_ = true;
+    debugLinesDirty_ = true;
+    SubscribeToUpdate();
 }
 
 // ----------------------------------------------------------------------------
-void GravityManager::HandleNodeAdded(StringHash eventType, VariantMap& eventData)
+void GravityManager::AddGravityBody(GravityBody* gravityBody)
 {
-    using namespace NodeAdded;
-    (void)eventType;
+    unsigned index = gravityBody->GetGravityManagerIndex();
+    if(index < gravityBodies_.Size() && gravityBodies_[index] == gravityBody)
+        return;
+
+    if(gravityBody->GetGravityManager())
+        gravityBody->GetGravityManager()->RemoveGravityBody(gravityBody);
 
-    // We only care about nodes that are descendants of us
-    Node* addedNode = static_cast<Node*>(eventData[P_NODE].GetPtr());
-    if(!node_->IsAncestorOf(addedNode))
+    gravityBody->SetGravityManager(this);
+    gravityBody->SetGravityManagerIndex(gravityBodies_.Size());
+    gravityBodies_.Push(gravityBody);
+    updateRateScheduler_.Schedule(&gravityBody->GetUpdateRateTimer());
+
+    if(!HasSubscribedToEvent(E_PHYSICSPRESTEP))
+        SubscribeToEvent(E_PHYSICSPRESTEP, URHO3D_HANDLER(GravityManager, HandlePhysicsPreStep));
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::RemoveGravityBody(GravityBody* gravityBody)
+{
+    unsigned index = gravityBody->GetGravityManagerIndex();
+    if(index >= gravityBodies_.Size() || gravityBodies_[index] != gravityBody)
         return;
 
-    AddGravityVectorsRecursively(addedNode);
-    RebuildTetrahedralMesh();
+    // Move the last gravity body into the freed slot
+    GravityBody* last = gravityBodies_.Back();
+    last->SetGravityManagerIndex(index);
+    gravityBodies_[index] = last;
+    gravityBodies_.Pop();
+
+    gravityBody->SetGravityManager(NULL);
+    gravityBody->SetGravityManagerIndex(M_MAX_UNSIGNED);
+    gravityBody->ResetGravity();
+
+    if(gravityBodies_.Empty())
+        UnsubscribeFromEvent(E_PHYSICSPRESTEP);
 }
 
 // ----------------------------------------------------------------------------
-void GravityManager::HandleNodeRemoved(StringHash eventType, VariantMap& eventData)
+void GravityManager::ClearGravityBodies()
 {
-    using namespace NodeRemoved;
+    for(PODVector<GravityBody*>::Iterator it = gravityBodies_.Begin(); it != gravityBodies_.End(); ++it)
+    {
+        (*it)->SetGravityManager(NULL);
+        (*it)->SetGravityManagerIndex(M_MAX_UNSIGNED);
+        (*it)->ResetGravity();
+    }
+
+    gravityBodies_.Clear();
+    UnsubscribeFromEvent(E_PHYSICSPRESTEP);
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData)
+{
+    using namespace PhysicsPreStep;
     (void)eventType;
 
-    // We only care about nodes that are descendants of us
-    Node* removedNode = static_cast<Node*>(eventData[P_NODE].GetPtr());
-    if(!node_->IsAncestorOf(removedNode))
+    // Other scenes have their own physics world
+    PhysicsWorld* world = static_cast<PhysicsWorld*>(eventData[P_WORLD].GetPtr());
+    if(world == NULL || world->GetScene() != GetScene())
+        return;
+
+    // This is sent from Bullet's internal tick callback, once per substep.
+    // Sleeping bodies aren't integrated by Bullet, so skip those too.
+    // Bodies whose update rate is lowered keep using their last gravity.
+    float timeStep = eventData[P_TIMESTEP].GetFloat();
+    dueBodies_.Clear();
+    bodyPositions_.Clear();
+    bodyHints_.Clear();
+    for(PODVector<GravityBody*>::ConstIterator it = gravityBodies_.Begin(); it != gravityBodies_.End(); ++it)
+    {
+        RigidBody* body = (*it)->GetRigidBody();
+        if(body == NULL || body->IsActive() == false)
+            continue;
+
+        Vector3 position = body->GetPosition();
+        unsigned interval = updateRateScheduler_.GetInterval(position, body->GetLinearVelocity());
+        if((*it)->GetUpdateRateTimer().Tick(interval) == false)
+        {
+            (*it)->IntegrateGravity((*it)->GetCachedGravity(), timeStep);
+            continue;
+        }
+
+        dueBodies_.Push(*it);
+        bodyPositions_.Push(position);
+        bodyHints_.Push((*it)->GetGravityHint());
+    }
+
+    if(dueBodies_.Empty())
+        return;
+
+    QueryGravity(&bodyGravity_, bodyPositions_, &bodyHints_);
+    for(unsigned i = 0; i != dueBodies_.Size(); ++i)
+    {
+        dueBodies_[i]->SetGravityHint(bodyHints_[i]);
+        dueBodies_[i]->IntegrateGravity(bodyGravity_[i], timeStep);
+    }
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::ClearGravityVectors()
+{
+    for(PODVector<GravityVector*>::Iterator it = gravityVectors_.Begin(); it != gravityVectors_.End(); ++it)
+    {
+        (*it)->SetGravityManager(NULL);
+        (*it)->SetGravityManagerIndex(M_MAX_UNSIGNED);
+    }
+
+    gravityVectors_.Clear();
+    snapshot_.Clear();
+    changedGravityVectors_.Clear();
+    gravityVertices_.Clear();
+    rebuildMesh_ = true;
+    recordSnapshot_ = true;
+    debugLinesDirty_ = true;
+    SubscribeToUpdate();
+}
+
+// ----------------------------------------------------------------------------
+/*
+ * This section maintains a list of gravity probes beneath our node. Rather
+ * than listening to every component change in the scene, gravity probes
+ * register themselves with the closest GravityManager on or above them when
+ * they enter the scene and unregister when they leave it (see
+ * GravityVector::OnSceneSet). Gravity bodies are tracked the same way (see
+ * GravityBody::OnSceneSet).
+ *
+ * A node moved to a different parent within the same scene never leaves it,
+ * and a node added with Node::AddChild() enters the scene before its parent
+ * is set. Both are followed by E_NODEADDED, after which the subtree is
+ * checked again. A full search also happens when this manager itself
+ * enters the scene, to pick up gravity probes that entered before we did.
+ *
+ * The mesh is not rebuilt immediately. Instead, it is rebuilt the next time
+ * it is needed, so loading a scene with many gravity probes only causes a
+ * single rebuild.
+ */
+
+// ----------------------------------------------------------------------------
+GravityManager* GravityManager::FindClosest(Node* node)
+{
+    for(; node != NULL; node = node->GetParent())
+    {
+        GravityManager* gravityManager = node->GetComponent<GravityManager>();
+        if(gravityManager)
+            return gravityManager;
+    }
+
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::OnSceneSet(Scene* scene)
+{
+    // The debug lines live in the scene we're leaving
+    debugLines_.Reset();
+
+    ClearGravityVectors();
+    ClearGravityBodies();
+    UnsubscribeFromEvent(E_NODEADDED);
+
+    // Clearing asked for an update to rebuild the mesh, which is pointless
+    // outside of a scene
+    if(scene == NULL)
+    {
+        UnsubscribeFromEvent(E_UPDATE);
         return;
+    }
+
+    // do a full search for gravityProbe nodes
+    UpdateTrackedRecursively(node_, this);
+
+    SubscribeToEvent(scene, E_NODEADDED, URHO3D_HANDLER(GravityManager, HandleNodeAdded));
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::UpdateTrackedRecursively(Node* node, GravityManager* closest)
+{
+    // Nested gravity managers take over everything beneath them
+    GravityManager* gravityManager = node->GetComponent<GravityManager>();
+    if(gravityManager)
+        closest = gravityManager;
+
+    GravityVector* gravityVector = node->GetComponent<GravityVector>();
+    if(gravityVector)
+    {
+        if(closest == this)
+            AddGravityVector(gravityVector);
+        else if(gravityVector->GetGravityManager() == this)
+            RemoveGravityVector(gravityVector);
+    }
+
+    GravityBody* gravityBody = node->GetComponent<GravityBody>();
+    if(gravityBody)
+    {
+        if(closest == this)
+            AddGravityBody(gravityBody);
+        else if(gravityBody->GetGravityManager() == this)
+            RemoveGravityBody(gravityBody);
+    }
+
+    // Scene graphs can't have loops, so nothing is visited twice
+    const Vector<SharedPtr<Node> >& children = node->GetChildren();
+    for(Vector<SharedPtr<Node> >::ConstIterator it = children.Begin(); it != children.End(); ++it)
+        UpdateTrackedRecursively(*it, closest);
+}
+
+// ----------------------------------------------------------------------------
+void GravityManager::HandleNodeAdded(StringHash eventType, VariantMap& eventData)
+{
+    using namespace NodeAdded;
+    (void)eventType;
 
-    RemoveGravityVectorsRecursively(removedNode);
-    RebuildTetrahedralMesh();
+    // Every gravity manager in the scene checks the subtree, so gravity
+    // vectors and bodies moved away from beneath us are removed as well
+    Node* node = static_cast<Node*>(eventData[P_NODE].GetPtr());
+    Node* parent = static_cast<Node*>(eventData[P_PARENT].GetPtr());
+    UpdateTrackedRecursively(node, FindClosest(parent));
 }
@@ -0,0 +1,157 @@
+#include "iceweasel/GravityQueryHeatmap.h"
+#include "iceweasel/GravityManager.h"
+
+#include <Urho3D/Graphics/DebugRenderer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Math/Color.h>
+
+#include <chrono>
+
+using namespace Urho3D;
+
+// Timing a single query is noisy, the fastest of several runs is kept
+static const unsigned TIMING_REPEATS = 4;
+
+// ----------------------------------------------------------------------------
+static Color Heat(float value)
+{
+    // blue -> green -> red
+    value = Clamp(value, 0.0f, 1.0f);
+    if(value < 0.5f)
+        return Color::BLUE.Lerp(Color::GREEN, value * 2.0f);
+    return Color::GREEN.Lerp(Color::RED, value * 2.0f - 1.0f);
+}
+
+// ----------------------------------------------------------------------------
+static Color PathColor(unsigned char path)
+{
+    switch(path)
+    {
+        case GravityManager::PATH_SHORTEST_DISTANCE : return Color::CYAN;
+        case GravityManager::PATH_MESH              : return Color::GREEN;
+        case GravityManager::PATH_HULL_FACE         : return Color::YELLOW;
+        case GravityManager::PATH_HULL_EDGE         : return Color(1.0f, 0.5f, 0.0f);
+        case GravityManager::PATH_HULL_VERTEX       : return Color::RED;
+        default                                     : return Color::GRAY;
+    }
+}
+
+// ----------------------------------------------------------------------------
+GravityQueryHeatmap::GravityQueryHeatmap() :
+    cellSize_(1.0f),
+    maxNanoseconds_(0),
+    maxTetrahedrons_(0),
+    metric_(METRIC_NANOSECONDS)
+{
+    size_[0] = size_[1] = size_[2] = 0;
+}
+
+// ----------------------------------------------------------------------------
+void GravityQueryHeatmap::Sample(GravityManager* gravityManager, const BoundingBox& region, unsigned resolution)
+{
+    cells_.Clear();
+    maxNanoseconds_ = 0;
+    maxTetrahedrons_ = 0;
+    region_ = region;
+
+    Vector3 regionSize = region.Size();
+    float longestSide = Max(Max(regionSize.x_, regionSize.y_), regionSize.z_);
+    if(resolution == 0 || longestSide <= 0.0f)
+        return;
+
+    cellSize_ = longestSide / resolution;
+    for(unsigned i = 0; i != 3; ++i)
+        size_[i] = Max(1, (int)Ceil(regionSize.Data()[i] / cellSize_));
+
+    // Make sure building the mesh isn't included in the first sample. The
+    // concurrent queries don't end up in an active gravity query recording
+    // (see GravityManager::StartRecording()), and they take the same path
+    // as the queries of MovementSystem.
+    gravityManager->PrepareConcurrentQuery();
+
+    // Each cell starts searching the mesh where the previous cell was found,
+    // like a character moving through the region would
+    unsigned hint = M_MAX_UNSIGNED;
+
+    cells_.Reserve(size_[0] * size_[1] * size_[2]);
+    for(unsigned x = 0; x != size_[0]; ++x)
+        for(unsigned y = 0; y != size_[1]; ++y)
+            for(unsigned z = 0; z != size_[2]; ++z)
+            {
+                Cell cell;
+                cell.position_ = region.min_ + Vector3(x + 0.5f, y + 0.5f, z + 0.5f) * cellSize_;
+                cell.nanoseconds_ = M_MAX_UNSIGNED;
+                GravityManager::QueryPath path = GravityManager::PATH_DEFAULT;
+                unsigned previousHint = hint;
+                for(unsigned r = 0; r != TIMING_REPEATS; ++r)
+                {
+                    hint = previousHint;
+                    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+                    gravityManager->QueryGravityConcurrent(cell.position_, &hint, &path, &cell.tetrahedrons_);
+                    long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::high_resolution_clock::now() - start).count();
+                    cell.nanoseconds_ = Min(cell.nanoseconds_, (unsigned)Min(ns, (long long)M_MAX_UNSIGNED));
+                }
+                cell.path_ = (unsigned char)path;
+
+                maxNanoseconds_ = Max(maxNanoseconds_, cell.nanoseconds_);
+                maxTetrahedrons_ = Max(maxTetrahedrons_, cell.tetrahedrons_);
+                cells_.Push(cell);
+            }
+}
+
+// ----------------------------------------------------------------------------
+bool GravityQueryHeatmap::ExportCSV(Context* context, const String& fileName) const
+{
+    SharedPtr<File> file(new File(context, fileName, FILE_WRITE));
+    if(file->IsOpen() == false)
+    {
+        URHO3D_LOGERRORF("[GravityQueryHeatmap] Failed to open \"%s\" for writing", fileName.CString());
+        return false;
+    }
+
+    file->WriteLine("# size " + String(size_[0]) + " " + String(size_[1]) + " " + String(size_[2]) +
+                    ", cell size " + String(cellSize_));
+    file->WriteLine("i,j,k,x,y,z,nanoseconds,tetrahedrons,path");
+
+    unsigned index = 0;
+    for(unsigned x = 0; x != size_[0]; ++x)
+        for(unsigned y = 0; y != size_[1]; ++y)
+            for(unsigned z = 0; z != size_[2]; ++z, ++index)
+            {
+                const Cell& cell = cells_[index];
+                file->WriteLine(
+                    String(x) + "," + String(y) + "," + String(z) + "," +
+                    String(cell.position_.x_) + "," + String(cell.position_.y_) + "," + String(cell.position_.z_) + "," +
+                    String(cell.nanoseconds_) + "," + String(cell.tetrahedrons_) + "," + String((unsigned)cell.path_)
+                );
+            }
+
+    URHO3D_LOGINFOF("[GravityQueryHeatmap] Exported %d cells to \"%s\"", cells_.Size(), fileName.CString());
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+void GravityQueryHeatmap::DrawDebugGeometry(DebugRenderer* debug, bool depthTest) const
+{
+    Vector3 halfExtent = Vector3::ONE * cellSize_ * 0.2f;
+    for(PODVector<Cell>::ConstIterator it = cells_.Begin(); it != cells_.End(); ++it)
+    {
+        Color color;
+        switch(metric_)
+        {
+            case METRIC_NANOSECONDS :
+                color = Heat(maxNanoseconds_ ? (float)it->nanoseconds_ / maxNanoseconds_ : 0.0f);
+                break;
+            case METRIC_TETRAHEDRONS :
+                color = Heat(maxTetrahedrons_ ? (float)it->tetrahedrons_ / maxTetrahedrons_ : 0.0f);
+                break;
+            default :
+                color = PathColor(it->path_);
+                break;
+        }
+
+        debug->AddBoundingBox(BoundingBox(it->position_ - halfExtent, it->position_ + halfExtent), color, depthTest);
+    }
+}
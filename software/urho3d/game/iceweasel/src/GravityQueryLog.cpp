@@ -0,0 +1,152 @@
+#include "iceweasel/GravityQueryLog.h"
+#include "iceweasel/GravityManager.h"
+#include "iceweasel/GravityVector.h"
+
+#include <Urho3D/IO/File.h>
+#include <Urho3D/Scene/Node.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include <chrono>
+#include <stdio.h>
+
+using namespace Urho3D;
+
+static const char* pathNames[] = {
+    "default",
+    "shortest distance",
+    "mesh",
+    "hull face",
+    "hull edge",
+    "hull vertex"
+};
+static const unsigned NUM_PATHS = sizeof(pathNames) / sizeof(*pathNames);
+
+// ----------------------------------------------------------------------------
+GravityQueryReplay::GravityQueryReplay(Context* context) :
+    Object(context),
+    tolerance_(0.001f)
+{
+}
+
+// ----------------------------------------------------------------------------
+int GravityQueryReplay::Run(const String& fileName)
+{
+    SharedPtr<File> file(new File(context_, fileName, FILE_READ));
+    if(file->IsOpen() == false)
+    {
+        printf("Failed to open \"%s\"\n", fileName.CString());
+        return 2;
+    }
+    if(file->ReadFileID() != "GQLG")
+    {
+        printf("\"%s\" is not a gravity query log\n", fileName.CString());
+        return 2;
+    }
+    unsigned version = file->ReadUInt();
+    if(version != GravityQueryLog::VERSION)
+    {
+        printf("Unsupported gravity query log version %d (expected %d)\n", version, GravityQueryLog::VERSION);
+        return 2;
+    }
+
+    SharedPtr<Scene> scene(new Scene(context_));
+    GravityManager* gravityManager = scene->CreateComponent<GravityManager>();
+    Node* probes = scene->CreateChild("Gravity Probes");
+
+    unsigned queryCount = 0;
+    unsigned snapshotCount = 0;
+    unsigned resultMismatches = 0;
+    unsigned pathMismatches = 0;
+    float maxError = 0.0f;
+    unsigned pathCounts[NUM_PATHS] = {0};
+    unsigned long long recordedTime = 0;
+    unsigned long long replayTime = 0;
+
+    // The log doesn't say which caller made a query, so every query starts
+    // searching the mesh where the previous one was found
+    unsigned hint = M_MAX_UNSIGNED;
+
+    while(file->IsEof() == false)
+    {
+        unsigned char chunk = file->ReadUByte();
+        if(chunk == GravityQueryLog::CHUNK_SNAPSHOT)
+        {
+            gravityManager->SetStrategy((GravityManager::Strategy)file->ReadUByte());
+            gravityManager->SetGlobalGravity(file->ReadFloat());
+            gravityManager->SetDecimate(file->ReadBool());
+            gravityManager->SetDecimationMaxAngle(file->ReadFloat());
+            gravityManager->SetDecimationMaxForceFactorError(file->ReadFloat());
+
+            probes->RemoveAllChildren();
+            unsigned count = file->ReadUInt();
+            for(unsigned i = 0; i != count; ++i)
+            {
+                Node* node = probes->CreateChild();
+                node->SetWorldPosition(file->ReadVector3());
+                node->SetWorldDirection(file->ReadVector3());
+                node->CreateComponent<GravityVector>()->SetForceFactor(file->ReadFloat());
+            }
+
+            // Rebuilding the mesh is not part of the query workload
+            gravityManager->QueryGravity(Vector3::ZERO);
+            ++snapshotCount;
+        }
+        else if(chunk == GravityQueryLog::CHUNK_QUERY)
+        {
+            Vector3 position = file->ReadVector3();
+            Vector3 recordedResult = file->ReadVector3();
+            unsigned char recordedPath = file->ReadUByte();
+            recordedTime += file->ReadUInt();
+
+            std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+            Vector3 result = gravityManager->QueryGravity(position, &hint);
+            replayTime += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::high_resolution_clock::now() - start).count();
+
+            unsigned char path = (unsigned char)gravityManager->GetLastQueryPath();
+            if(path < NUM_PATHS)
+                ++pathCounts[path];
+            if(path != recordedPath)
+                ++pathMismatches;
+
+            float error = (result - recordedResult).Length();
+            maxError = Max(maxError, error);
+            if(error > tolerance_)
+            {
+                if(resultMismatches < 10)
+                    printf("  Mismatch at (%f, %f, %f): recorded (%f, %f, %f) via %s, got (%f, %f, %f) via %s\n",
+                           position.x_, position.y_, position.z_,
+                           recordedResult.x_, recordedResult.y_, recordedResult.z_,
+                           recordedPath < NUM_PATHS ? pathNames[recordedPath] : "?",
+                           result.x_, result.y_, result.z_,
+                           path < NUM_PATHS ? pathNames[path] : "?");
+                ++resultMismatches;
+            }
+
+            ++queryCount;
+        }
+        else
+        {
+            printf("Unknown chunk type %d, log is corrupt\n", chunk);
+            return 2;
+        }
+    }
+
+    printf("Replayed %d queries (%d snapshots) from \"%s\"\n", queryCount, snapshotCount, fileName.CString());
+    if(queryCount != 0)
+    {
+        printf("  Recorded: %.1f ns/query, %.0f queries/s\n",
+               (double)recordedTime / queryCount,
+               recordedTime ? queryCount * 1e9 / recordedTime : 0.0);
+        printf("  Replayed: %.1f ns/query, %.0f queries/s\n",
+               (double)replayTime / queryCount,
+               replayTime ? queryCount * 1e9 / replayTime : 0.0);
+    }
+    for(unsigned i = 0; i != NUM_PATHS; ++i)
+        if(pathCounts[i] != 0)
+            printf("  %-18s %d\n", pathNames[i], pathCounts[i]);
+    printf("  Result mismatches: %d (max error %f)\n", resultMismatches, maxError);
+    printf("  Path mismatches:   %d\n", pathMismatches);
+
+    return resultMismatches == 0 && pathMismatches == 0 ? 0 : 1;
+}
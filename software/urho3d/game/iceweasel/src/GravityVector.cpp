@@ -21,6 +21,8 @@
 //
 
 #include "iceweasel/GravityVector.h"
+#include "iceweasel/DebugLineCache.h"
+#include "iceweasel/GravityManager.h"
 #include "iceweasel/IceWeasel.h"
 
 #include <Urho3D/Core/Context.h>
@@ -32,7 +34,8 @@ using namespace Urho3D;
 // ----------------------------------------------------------------------------
 GravityVector::GravityVector(Context* context) :
     Component(context),
-    forceFactor_(1.0f)
+    forceFactor_(1.0f),
+    gravityManagerIndex_(M_MAX_UNSIGNED)
 {
 }
 
@@ -71,6 +74,65 @@ Vector3 GravityVector::GetDirection() const
     return node_->GetWorldDirection();
 }
 
+// ----------------------------------------------------------------------------
+void GravityVector::SetForceFactor(float factor)
+{
+    forceFactor_ = factor;
+
+    if(gravityManager_)
+        gravityManager_->NotifyGravityVectorChanged(this);
+}
+
+// ----------------------------------------------------------------------------
+void GravityVector::SetGravityManager(GravityManager* gravityManager)
+{
+    gravityManager_ = gravityManager;
+}
+
+// ----------------------------------------------------------------------------
+void GravityVector::OnNodeSet(Node* node)
+{
+    // A removed component would otherwise keep being notified by its old
+    // node
+    if(listenedNode_)
+        listenedNode_->RemoveListener(this);
+    listenedNode_ = node;
+
+    // We want to know when the node (or any of its parents) is moved or
+    // rotated, so the gravity mesh can be updated.
+    if(node)
+        node->AddListener(this);
+}
+
+// ----------------------------------------------------------------------------
+void GravityVector::OnSceneSet(Scene* scene)
+{
+    if(scene == NULL)
+    {
+        if(gravityManager_)
+            gravityManager_->RemoveGravityVector(this);
+        return;
+    }
+
+    // If our node is being added to a parent, the parent isn't set yet. The
+    // gravity managers check again once it is, see
+    // GravityManager::HandleNodeAdded().
+    GravityManager* gravityManager = GravityManager::FindClosest(node_);
+    if(gravityManager)
+        gravityManager->AddGravityVector(this);
+}
+
+// ----------------------------------------------------------------------------
+void GravityVector::OnMarkedDirty(Node* node)
+{
+    (void)node;
+
+    // Only flag the change here. Reading the world transform is deferred
+    // until the gravity manager actually needs the new values.
+    if(gravityManager_)
+        gravityManager_->NotifyGravityVectorChanged(this);
+}
+
 // ----------------------------------------------------------------------------
 void GravityVector::DrawDebugGeometry(DebugRenderer* debug, bool depthTest)
 {
@@ -93,3 +155,26 @@ void GravityVector::DrawDebugGeometry(DebugRenderer* debug, bool depthTest)
     startPosition = transform * Vector3(scale*.2, 0, -scale*.2) + direction;
     debug->AddLine(startPosition, endPosition, Color::BLUE, depthTest);
 }
+
+// ----------------------------------------------------------------------------
+void GravityVector::AddDebugLines(DebugLineCache* lines) const
+{
+    float scale = forceFactor_ * 3.0f;
+    Vector3 direction = GetDirection() * scale;
+    Matrix3x4 transform = node_->GetWorldTransform();
+    Vector3 startPosition = node_->GetWorldPosition();
+
+    // Base of arrow, with a small cross instead of the sphere
+    Vector3 endPosition = startPosition + direction;
+    lines->AddLine(startPosition, endPosition, Color::BLUE);
+    float crossSize = scale * .08f;
+    lines->AddLine(startPosition - Vector3(crossSize, 0, 0), startPosition + Vector3(crossSize, 0, 0), Color::CYAN);
+    lines->AddLine(startPosition - Vector3(0, crossSize, 0), startPosition + Vector3(0, crossSize, 0), Color::CYAN);
+    lines->AddLine(startPosition - Vector3(0, 0, crossSize), startPosition + Vector3(0, 0, crossSize), Color::CYAN);
+
+    // Two lines at tip
+    startPosition = transform * Vector3(-scale*.2, 0, -scale*.2) + direction;
+    lines->AddLine(startPosition, endPosition, Color::BLUE);
+    startPosition = transform * Vector3(scale*.2, 0, -scale*.2) + direction;
+    lines->AddLine(startPosition, endPosition, Color::BLUE);
+}
@@ -3,15 +3,27 @@
 
 #include "iceweasel/Args.h"
 #include "iceweasel/PlayerController.h"
+#include "iceweasel/BotDriver.h"
+#include "iceweasel/BotLoadTest.h"
 #include "iceweasel/CameraControllerFree.h"
+#include "iceweasel/CharacterProbeSystem.h"
 #include "iceweasel/DebugTextScroll.h"
+#include "iceweasel/GravityBody.h"
 #include "iceweasel/GravityManager.h"
+#include "iceweasel/GravityQueryHeatmap.h"
 #include "iceweasel/GravityVector.h"
+#include "iceweasel/InputRecording.h"
 #include "iceweasel/MainMenu.h"
+#include "iceweasel/MovementController.h"
+#include "iceweasel/MovementPrediction.h"
+#include "iceweasel/MovementSystem.h"
+#include "iceweasel/ProjectileSystem.h"
+#include "iceweasel/ProjectileSystemAPI.h"
 
 #include <Urho3D/AngelScript/Script.h>
 #include <Urho3D/Core/CoreEvents.h>
 #include <Urho3D/Engine/DebugHud.h>
+#include <Urho3D/Engine/Engine.h>
 #include <Urho3D/Graphics/Camera.h>
 #include <Urho3D/Graphics/DebugRenderer.h>
 #include <Urho3D/Graphics/Octree.h>
@@ -22,7 +34,6 @@
 #include <Urho3D/Input/Input.h>
 #include <Urho3D/IO/Log.h>
 #include <Urho3D/LuaScript/LuaScript.h>
-#include <Urho3D/Math/Random.h>
 #include <Urho3D/Network/Network.h>
 #include <Urho3D/Network/NetworkEvents.h>
 #include <Urho3D/Physics/PhysicsWorld.h>
@@ -45,8 +56,15 @@ const char* ICEWEASEL_CATEGORY = "IceWeasel Mods";
 // ----------------------------------------------------------------------------
 void RegisterIceWeaselMods(Urho3D::Context* context)
 {
+    BotDriver::RegisterObject(context);
+    CharacterProbeSystem::RegisterObject(context);
+    GravityBody::RegisterObject(context);
     GravityManager::RegisterObject(context);
     GravityVector::RegisterObject(context);
+    InputRecorder::RegisterObject(context);
+    MovementPrediction::RegisterObject(context);
+    MovementSystem::RegisterObject(context);
+    ProjectileSystem::RegisterObject(context);
 }
 
 // ----------------------------------------------------------------------------
@@ -117,6 +135,10 @@ void IceWeasel::StartState_Game()
 void IceWeasel::CleanupState_Game()
 {
     StopNetworking();
+
+    for(HashMap<Connection*, SharedPtr<Node> >::Iterator it = remotePlayers_.Begin(); it != remotePlayers_.End(); ++it)
+        it->second_->Remove();
+    remotePlayers_.Clear();
 }
 
 // ----------------------------------------------------------------------------
@@ -126,7 +148,9 @@ void IceWeasel::Setup()
 
     engineParameters_["WindowTitle"] = "IceWeasel";
     engineParameters_["FullScreen"]  = args_->fullscreen_;
-    engineParameters_["Headless"]    = args_->server_;
+    engineParameters_["Headless"]    = args_->server_ ||
+                                       args_->replayInputFile_.Length() != 0 ||
+                                       args_->loadTestBots_ != 0;
     engineParameters_["Multisample"] = args_->multisample_;
     engineParameters_["VSync"] = args_->vsync_;
 
@@ -149,6 +173,24 @@ void IceWeasel::Start()
 
     GetSubsystem<IceWeaselConfig>()->Load("Config/IceWeaselConfig.xml");
 
+    // The replay brings its own scene and config
+    if(args_->replayInputFile_.Length() != 0)
+    {
+        SharedPtr<InputReplay> replay(new InputReplay(context_));
+        exitCode_ = replay->Run(args_->replayInputFile_);
+        engine_->Exit();
+        return;
+    }
+    if(args_->loadTestBots_ != 0)
+    {
+        String sceneName = args_->sceneName_.Length() ? args_->sceneName_ : String("Scenes/TestMap.xml");
+        unsigned step = args_->loadTestStep_ ? args_->loadTestStep_ : Max(args_->loadTestBots_ / 16, 1u);
+        SharedPtr<BotLoadTest> loadTest(new BotLoadTest(context_));
+        exitCode_ = loadTest->Run(sceneName, args_->loadTestBots_, step);
+        engine_->Exit();
+        return;
+    }
+
     SwitchState(GAME);
 
     if(args_->server_)
@@ -159,6 +201,9 @@ void IceWeasel::Start()
     {
         SubscribeToEvent(E_KEYDOWN, URHO3D_HANDLER(IceWeasel, HandleKeyDown));
         SubscribeToEvent(E_POSTRENDERUPDATE, URHO3D_HANDLER(IceWeasel, HandlePostRenderUpdate));
+
+        if(args_->connect_)
+            StartNetworking();
     }
 
     SubscribeToEvent(E_FILECHANGED, URHO3D_HANDLER(IceWeasel, HandleFileChanged));
@@ -182,6 +227,7 @@ void IceWeasel::RegisterSubsystems()
 {
     context_->RegisterSubsystem(new Script(context_));
     context_->RegisterSubsystem(new LuaScript(context_));
+    RegisterProjectileSystemAPI(context_);
     context_->RegisterSubsystem(new IceWeaselConfig(context_));
     context_->RegisterSubsystem(new DebugTextScroll(context_));
 
@@ -215,6 +261,29 @@ void IceWeasel::StopNetworking()
         network->Disconnect();
 }
 
+// ----------------------------------------------------------------------------
+void IceWeasel::CreateRemotePlayer(Connection* connection)
+{
+    /*
+     * The server simulates the player of every client from the input commands
+     * the client sends, and sends back the resulting state so the client can
+     * correct its prediction. See MovementPrediction.
+     */
+    Node* moveNode = scene_->CreateChild("Remote Player", LOCAL);
+    Node* offsetNode = moveNode->CreateChild("Remote Player Offset", LOCAL);
+
+    MovementController* controller = new MovementController(context_, moveNode, offsetNode, NULL);
+    controller->SetInputSource(MovementController::INPUT_REMOTE);
+    controller->SetIsObserver(true);
+    moveNode->AddComponent(controller, 0, LOCAL);
+
+    MovementPrediction* prediction = moveNode->CreateComponent<MovementPrediction>(LOCAL);
+    prediction->SetMode(MovementPrediction::AUTHORITY);
+    prediction->SetConnection(connection);
+
+    remotePlayers_[connection] = moveNode;
+}
+
 // ----------------------------------------------------------------------------
 void IceWeasel::CreateCamera()
 {
@@ -287,17 +356,14 @@ void IceWeasel::CreateScene()
     else
         ErrorExit("Failed to load scene \"" + mapName + "\" - did you spell it correctly?");
 
-    /*
-    // HACK Add a small random offset to all gravity vectors so the
-    // triangulation can avoid degenerate tetrahedrons.
-    PODVector<Node*> gravityVectorNodes;
-    scene_->GetChildrenWithComponent<GravityVector>(gravityVectorNodes, true);
-    // Don't forget to check this node's components as well
-    if(scene_->GetComponent<GravityVector>())
-        gravityVectorNodes.Push(scene_);
-    PODVector<Node*>::Iterator it = gravityVectorNodes.Begin();
-    for(; it != gravityVectorNodes.End(); ++it)
-        (*it)->SetPosition((*it)->GetPosition() + Vector3(Random()*2-1, Random()*2-1, Random()*2-1));*/
+    // Weapon scripts expect a projectile system in the scene
+    if(scene_->GetComponent<ProjectileSystem>(true) == NULL)
+        scene_->CreateComponent<ProjectileSystem>(LOCAL);
+
+    if(args_->recordGravityFile_.Length() != 0)
+        scene_->GetOrCreateComponent<GravityManager>()->StartRecording(args_->recordGravityFile_);
+    if(args_->recordInputFile_.Length() != 0)
+        scene_->CreateComponent<InputRecorder>(LOCAL)->StartRecording(args_->recordInputFile_, mapName);
 }
 
 // ----------------------------------------------------------------------------
@@ -326,6 +392,27 @@ void IceWeasel::SwitchCameraToFPSCam()
 
 }
 
+// ----------------------------------------------------------------------------
+void IceWeasel::SampleGravityHeatmap()
+{
+    GravityManager* gravity = scene_->GetComponent<GravityManager>();
+    if(gravity == NULL)
+        return;
+
+    // Sample a bit beyond the probes to include the hull projections
+    BoundingBox region = gravity->GetBoundingBox();
+    if(region.Defined() == false)
+        return;
+    Vector3 margin = region.HalfSize() * 0.25f + Vector3::ONE;
+    region = BoundingBox(region.min_ - margin, region.max_ + margin);
+
+    if(!gravityHeatmap_)
+        gravityHeatmap_ = new GravityQueryHeatmap;
+    gravityHeatmap_->Sample(gravity, region, 24);
+    gravityHeatmap_->ExportCSV(context_, "GravityHeatmap.csv");
+    LOG_SCROLL("Gravity heatmap exported to GravityHeatmap.csv, press H to change metric");
+}
+
 // ----------------------------------------------------------------------------
 void IceWeasel::HandleKeyDown(StringHash eventType, VariantMap& eventData)
 {
@@ -350,7 +437,28 @@ void IceWeasel::HandleKeyDown(StringHash eventType, VariantMap& eventData)
         {
             case DRAW_NONE    : debugDrawMode_ = DRAW_PHYSICS; break;
             case DRAW_PHYSICS : debugDrawMode_ = DRAW_GRAVITY; break;
-            case DRAW_GRAVITY : debugDrawMode_ = DRAW_NONE;    break;
+            case DRAW_GRAVITY : debugDrawMode_ = DRAW_GRAVITY_HEATMAP; SampleGravityHeatmap(); break;
+            case DRAW_GRAVITY_HEATMAP : debugDrawMode_ = DRAW_NONE; break;
+        }
+    }
+
+    // Cycle through what the gravity heatmap shows
+    if(key == KEY_H && debugDrawMode_ == DRAW_GRAVITY_HEATMAP && gravityHeatmap_)
+    {
+        switch(gravityHeatmap_->GetMetric())
+        {
+            case GravityQueryHeatmap::METRIC_NANOSECONDS :
+                gravityHeatmap_->SetMetric(GravityQueryHeatmap::METRIC_TETRAHEDRONS);
+                LOG_SCROLL("Gravity heatmap: tetrahedrons visited");
+                break;
+            case GravityQueryHeatmap::METRIC_TETRAHEDRONS :
+                gravityHeatmap_->SetMetric(GravityQueryHeatmap::METRIC_PATH);
+                LOG_SCROLL("Gravity heatmap: query path");
+                break;
+            default :
+                gravityHeatmap_->SetMetric(GravityQueryHeatmap::METRIC_NANOSECONDS);
+                LOG_SCROLL("Gravity heatmap: nanoseconds");
+                break;
         }
     }
 
@@ -441,6 +549,13 @@ void IceWeasel::HandlePostRenderUpdate(StringHash eventType, VariantMap& eventDa
                 gravity->DrawDebugGeometry(debugRenderer, depthTest, cameraMoveNode_->GetWorldPosition());
             break;
         }
+
+        case DRAW_GRAVITY_HEATMAP:
+        {
+            if(gravityHeatmap_)
+                gravityHeatmap_->DrawDebugGeometry(debugRenderer, depthTest);
+            break;
+        }
     }
 }
 
@@ -467,15 +582,35 @@ void IceWeasel::HandleClientConnected(StringHash eventType, VariantMap& eventDat
     // When a client connects, assign to scene to begin scene replication
     Connection* newConnection = static_cast<Connection*>(eventData[P_CONNECTION].GetPtr());
     newConnection->SetScene(scene_);
+
+    CreateRemotePlayer(newConnection);
 }
 
 // ----------------------------------------------------------------------------
 void IceWeasel::HandleClientDisconnected(StringHash eventType, VariantMap& eventData)
 {
-    using namespace ClientConnected;
+    using namespace ClientDisconnected;
+
+    Connection* connection = static_cast<Connection*>(eventData[P_CONNECTION].GetPtr());
+    HashMap<Connection*, SharedPtr<Node> >::Iterator it = remotePlayers_.Find(connection);
+    if(it == remotePlayers_.End())
+        return;
+
+    it->second_->Remove();
+    remotePlayers_.Erase(it);
 }
 
 // ----------------------------------------------------------------------------
 void IceWeasel::HandleConnectionStatus(StringHash eventType, VariantMap& eventData)
 {
+    (void)eventData;
+
+    if(!cameraMoveNode_)
+        return;
+
+    // Our own player is predicted locally and corrected by the server
+    if(eventType == E_SERVERCONNECTED)
+        cameraMoveNode_->GetOrCreateComponent<MovementPrediction>(LOCAL)->SetMode(MovementPrediction::PREDICT);
+    else
+        cameraMoveNode_->RemoveComponent<MovementPrediction>();
 }
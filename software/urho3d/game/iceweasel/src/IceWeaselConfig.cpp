@@ -10,18 +10,24 @@ using namespace Urho3D;
 
 
 // ----------------------------------------------------------------------------
-const IceWeaselConfig::Data::PlayerClass& IceWeaselConfig::Data::playerClass(unsigned int index) const
+static const IceWeaselConfig::Data::PlayerClass& GetDefaultPlayerClass()
 {
-    static const Data::PlayerClass defaultPlayerClass = {
+    static const IceWeaselConfig::Data::PlayerClass defaultPlayerClass = {
         "",
         {1, 1, 1, 1, 1},
         {1, 1},
         {1, 1, 1, 1}
     };
+    return defaultPlayerClass;
+}
+
+// ----------------------------------------------------------------------------
+const IceWeaselConfig::Data::PlayerClass& IceWeaselConfig::Data::playerClass(unsigned int index) const
+{
     if(playerClassContainer.Size() <= index)
     {
         URHO3D_LOGERRORF("[IceWeaselConfig] Failed to read player class info \"%d\" from settings", index);
-        return defaultPlayerClass;
+        return GetDefaultPlayerClass();
     }
     return playerClassContainer.At(index);
 }
@@ -29,8 +35,12 @@ const IceWeaselConfig::Data::PlayerClass& IceWeaselConfig::Data::playerClass(uns
 
 // ----------------------------------------------------------------------------
 IceWeaselConfig::IceWeaselConfig(Context* context) :
-    Object(context)
+    Object(context),
+    data_(),
+    version_(0)
 {
+    BuildParameterBlocks();
+
     SubscribeToEvent(E_FILECHANGED, URHO3D_HANDLER(IceWeaselConfig, HandleFileChanged));
 }
 
@@ -113,6 +123,14 @@ void IceWeaselConfig::Reload()
                 playerClass.animations[i].transitionSpeed = animations.GetFloat("DefaultTransitionSpeed");
         }
 
+        // Ground detection either uses the contacts reported by the physics
+        // world, or casts rays every tick
+        XMLElement ground = player.GetChild("Ground");
+        playerClass.ground.useContacts = (ground.GetAttribute("Detection") == "Contacts");
+        playerClass.ground.maxSlope    = ground.GetFloat("MaxSlope");
+        if(playerClass.ground.maxSlope == 0.0f)
+            playerClass.ground.maxSlope = 45.0f;
+
         data_.playerClassContainer.Push(playerClass);
     }
 
@@ -133,6 +151,9 @@ void IceWeaselConfig::Reload()
         data_.freeCam.speed.smoothness = speed.GetFloat("Smoothness");
     }
 
+    ++version_;
+    BuildParameterBlocks();
+
     SendEvent(E_CONFIGRELOADED, GetEventDataMap());
 }
 
@@ -142,6 +163,30 @@ const IceWeaselConfig::Data& IceWeaselConfig::GetConfig() const
     return data_;
 }
 
+// ----------------------------------------------------------------------------
+IceWeaselConfig::PlayerClassParameters* IceWeaselConfig::GetPlayerClassParameters(unsigned index) const
+{
+    if(playerClassParameters_.Size() <= index)
+    {
+        URHO3D_LOGERRORF("[IceWeaselConfig] Failed to read player class info \"%d\" from settings", index);
+        return defaultPlayerClassParameters_;
+    }
+    return playerClassParameters_[index];
+}
+
+// ----------------------------------------------------------------------------
+void IceWeaselConfig::BuildParameterBlocks()
+{
+    // Components may still hold on to the old blocks until they receive
+    // E_CONFIGRELOADED, so build new ones instead of modifying them
+    playerClassParameters_.Clear();
+    for(unsigned i = 0; i != data_.playerClassContainer.Size(); ++i)
+        playerClassParameters_.Push(SharedPtr<PlayerClassParameters>(
+            new PlayerClassParameters(data_.playerClassContainer[i], data_.camera, version_)));
+
+    defaultPlayerClassParameters_ = new PlayerClassParameters(GetDefaultPlayerClass(), data_.camera, version_);
+}
+
 // ----------------------------------------------------------------------------
 void IceWeaselConfig::HandleFileChanged(StringHash eventType, VariantMap& eventData)
 {
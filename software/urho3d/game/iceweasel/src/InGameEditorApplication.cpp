@@ -1,6 +1,7 @@
 #include "iceweasel/InGameEditorApplication.h"
 #include "iceweasel/IceWeasel.h"
 #include "iceweasel/Args.h"
+#include "iceweasel/ProjectileSystemAPI.h"
 
 #include <Urho3D/AngelScript/Script.h>
 #include <Urho3D/LuaScript/LuaScript.h>
@@ -60,6 +61,7 @@ void InGameEditorApplication::RegisterSubsystems()
 {
     context_->RegisterSubsystem(new Script(context_));
     context_->RegisterSubsystem(new LuaScript(context_));
+    RegisterProjectileSystemAPI(context_);
 }
 
 // ----------------------------------------------------------------------------
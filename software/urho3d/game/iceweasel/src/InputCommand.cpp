@@ -0,0 +1,155 @@
+#include "iceweasel/InputCommand.h"
+
+#include <Urho3D/Input/Input.h>
+#include <Urho3D/IO/Deserializer.h>
+#include <Urho3D/IO/Serializer.h>
+
+using namespace Urho3D;
+
+// ----------------------------------------------------------------------------
+InputCommand InputCommand::Sample(Input* input,
+                                  unsigned frame,
+                                  float time,
+                                  float timeStep,
+                                  const Vector2& cameraAngle)
+{
+    static const struct { int key; Button button; } mapping[] = {
+        {KEY_W,     FORWARD},
+        {KEY_S,     BACK},
+        {KEY_A,     LEFT},
+        {KEY_D,     RIGHT},
+        {KEY_SHIFT, RUN},
+        {KEY_CTRL,  CROUCH},
+        {KEY_SPACE, JUMP}
+    };
+
+    InputCommand command;
+    command.frame_ = frame;
+    command.time_ = time;
+    command.timeStep_ = timeStep;
+    command.cameraAngle_ = cameraAngle;
+
+    for(unsigned i = 0; i != sizeof(mapping) / sizeof(*mapping); ++i)
+    {
+        if(input->GetKeyDown(mapping[i].key))
+            command.buttons_ |= mapping[i].button;
+        // Also catches keys that were pressed and released within the frame
+        if(input->GetKeyPress(mapping[i].key))
+            command.pressed_ |= mapping[i].button;
+    }
+
+    return command;
+}
+
+// ----------------------------------------------------------------------------
+void InputCommand::Write(Serializer& dest) const
+{
+    dest.WriteUInt(sequence_);
+    dest.WriteUInt(frame_);
+    dest.WriteFloat(time_);
+    dest.WriteFloat(timeStep_);
+    dest.WriteVector2(cameraAngle_);
+    dest.WriteUByte(buttons_);
+    dest.WriteUByte(pressed_);
+}
+
+// ----------------------------------------------------------------------------
+bool InputCommand::Read(Deserializer& source)
+{
+    if(source.IsEof())
+        return false;
+
+    sequence_    = source.ReadUInt();
+    frame_       = source.ReadUInt();
+    time_        = source.ReadFloat();
+    timeStep_    = source.ReadFloat();
+    cameraAngle_ = source.ReadVector2();
+    buttons_     = source.ReadUByte();
+    pressed_     = source.ReadUByte();
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+InputCommandBuffer::InputCommandBuffer(unsigned capacity) :
+    head_(0),
+    size_(0),
+    nextSequence_(1),
+    repeatCount_(0)
+{
+    commands_.Resize(capacity > 0 ? capacity : 1);
+}
+
+// ----------------------------------------------------------------------------
+void InputCommandBuffer::Push(const InputCommand& command)
+{
+    unsigned char carry = 0;
+    if(size_ == commands_.Size())
+    {
+        // Don't lose taps when the physics falls behind
+        InputCommand dropped;
+        Pop(&dropped);
+        if(size_ > 0)
+            commands_[head_].pressed_ |= dropped.pressed_;
+        else
+            carry = dropped.pressed_;
+    }
+
+    InputCommand& slot = commands_[(head_ + size_) % commands_.Size()];
+    slot = command;
+    slot.pressed_ |= carry;
+    ++size_;
+}
+
+// ----------------------------------------------------------------------------
+bool InputCommandBuffer::Pop(InputCommand* command)
+{
+    if(size_ == 0)
+        return false;
+
+    *command = commands_[head_];
+    head_ = (head_ + 1) % commands_.Size();
+    --size_;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+const InputCommand& InputCommandBuffer::Consume(float tickEndTime)
+{
+    // Presses only apply to the first tick that sees them
+    unsigned char pressed = 0;
+    InputCommand command;
+    while(size_ > 0 && commands_[head_].time_ <= tickEndTime)
+    {
+        Pop(&command);
+        pressed |= command.pressed_;
+        current_ = command;
+    }
+    current_.pressed_ = pressed;
+    current_.sequence_ = nextSequence_++;
+    repeatCount_ = 0;
+
+    return current_;
+}
+
+// ----------------------------------------------------------------------------
+const InputCommand& InputCommandBuffer::ConsumeNext()
+{
+    if(Pop(&current_))
+        repeatCount_ = 0;
+    else
+    {
+        current_.pressed_ = 0;
+        ++repeatCount_;
+    }
+
+    return current_;
+}
+
+// ----------------------------------------------------------------------------
+void InputCommandBuffer::Clear()
+{
+    head_ = 0;
+    size_ = 0;
+    repeatCount_ = 0;
+    current_ = InputCommand();
+}
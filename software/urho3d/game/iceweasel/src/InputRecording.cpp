@@ -0,0 +1,394 @@
+#include "iceweasel/InputRecording.h"
+#include "iceweasel/IceWeasel.h"
+#include "iceweasel/IceWeaselConfig.h"
+#include "iceweasel/MovementController.h"
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/Octree.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
+#include <Urho3D/Scene/Node.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include <chrono>
+#include <stdio.h>
+
+using namespace Urho3D;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// ----------------------------------------------------------------------------
+InputRecorder::InputRecorder(Context* context) :
+    Component(context),
+    recordPlayers_(false)
+{
+}
+
+// ----------------------------------------------------------------------------
+InputRecorder::~InputRecorder()
+{
+    StopRecording();
+}
+
+// ----------------------------------------------------------------------------
+void InputRecorder::RegisterObject(Context* context)
+{
+    context->RegisterFactory<InputRecorder>(ICEWEASEL_CATEGORY);
+}
+
+// ----------------------------------------------------------------------------
+bool InputRecorder::StartRecording(const String& fileName, const String& sceneName)
+{
+    StopRecording();
+
+    if(GetScene() == NULL)
+    {
+        URHO3D_LOGERROR("[InputRecorder] Must be added to a scene before recording");
+        return false;
+    }
+
+    SharedPtr<File> file(new File(context_, fileName, FILE_WRITE));
+    if(file->IsOpen() == false)
+    {
+        URHO3D_LOGERRORF("[InputRecorder] Failed to open \"%s\" for recording", fileName.CString());
+        return false;
+    }
+
+    // The replay needs the same scene, player parameters and tick rate
+    XMLFile* config = GetSubsystem<IceWeaselConfig>()->GetXMLFile();
+    file->WriteFileID("IRLG");
+    file->WriteUInt(InputRecording::VERSION);
+    file->WriteString(sceneName);
+    file->WriteString(config ? config->ToString() : String::EMPTY);
+    file->WriteInt(GetScene()->GetOrCreateComponent<PhysicsWorld>()->GetFps());
+
+    recordFile_ = file;
+    recordPlayers_ = true;
+    URHO3D_LOGINFOF("[InputRecorder] Recording input to \"%s\"", fileName.CString());
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+void InputRecorder::StopRecording()
+{
+    if(recordFile_)
+        recordFile_->Close();
+    recordFile_.Reset();
+    players_.Clear();
+}
+
+// ----------------------------------------------------------------------------
+bool InputRecorder::IsRecording() const
+{
+    return recordFile_.NotNull();
+}
+
+// ----------------------------------------------------------------------------
+MovementSystem* InputRecorder::GetMovementSystem()
+{
+    // Created by the first movement controller
+    if(!movementSystem_ && GetScene())
+        movementSystem_ = GetScene()->GetComponent<MovementSystem>();
+    return movementSystem_;
+}
+
+// ----------------------------------------------------------------------------
+void InputRecorder::RecordPlayersIfChanged()
+{
+    MovementSystem* movementSystem = GetMovementSystem();
+    unsigned count = movementSystem ? movementSystem->GetMovementControllerCount() : 0;
+
+    bool changed = recordPlayers_ || count != players_.Size();
+    for(unsigned i = 0; i != count && changed == false; ++i)
+        if(players_[i] != movementSystem->GetMovementController(i))
+            changed = true;
+    if(changed == false)
+        return;
+
+    recordFile_->WriteUByte(InputRecording::CHUNK_PLAYERS);
+    recordFile_->WriteUInt(count);
+    players_.Resize(count);
+    for(unsigned i = 0; i != count; ++i)
+    {
+        players_[i] = movementSystem->GetMovementController(i);
+        players_[i]->CaptureSnapshot().Write(*recordFile_);
+    }
+
+    recordPlayers_ = false;
+}
+
+// ----------------------------------------------------------------------------
+void InputRecorder::OnSceneSet(Scene* scene)
+{
+    UnsubscribeFromAllEvents();
+    movementSystem_.Reset();
+
+    if(scene == NULL)
+    {
+        StopRecording();
+        return;
+    }
+
+    SubscribeToEvent(scene, E_SCENEUPDATE, URHO3D_HANDLER(InputRecorder, HandleSceneUpdate));
+    SubscribeToEvent(scene->GetOrCreateComponent<PhysicsWorld>(), E_PHYSICSPOSTSTEP, URHO3D_HANDLER(InputRecorder, HandlePhysicsPostStep));
+}
+
+// ----------------------------------------------------------------------------
+void InputRecorder::HandleSceneUpdate(StringHash eventType, VariantMap& eventData)
+{
+    using namespace SceneUpdate;
+    (void)eventType;
+
+    if(!recordFile_)
+        return;
+
+    recordFile_->WriteUByte(InputRecording::CHUNK_FRAME);
+    recordFile_->WriteFloat(eventData[P_TIMESTEP].GetFloat());
+
+    RecordPlayersIfChanged();
+}
+
+// ----------------------------------------------------------------------------
+void InputRecorder::HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData)
+{
+    using namespace PhysicsPostStep;
+    (void)eventType;
+
+    if(!recordFile_)
+        return;
+
+    MovementSystem* movementSystem = GetMovementSystem();
+    unsigned count = movementSystem ? movementSystem->GetMovementControllerCount() : 0;
+
+    recordFile_->WriteUByte(InputRecording::CHUNK_TICK);
+    recordFile_->WriteFloat(eventData[P_TIMESTEP].GetFloat());
+    recordFile_->WriteUInt(count);
+    for(unsigned i = 0; i != count; ++i)
+        movementSystem->GetMovementController(i)->GetInputCommands().GetCurrent().Write(*recordFile_);
+    recordFile_->WriteUInt(movementSystem ? movementSystem->GetStateHash() : 0);
+}
+
+// ----------------------------------------------------------------------------
+InputReplay::InputReplay(Context* context) :
+    Object(context),
+    profiler_(new TickProfiler(context)),
+    nextTick_(0),
+    frameEnd_(0),
+    hashMismatches_(0),
+    firstMismatch_(M_MAX_UNSIGNED),
+    lastHash_(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+int InputReplay::Run(const String& fileName)
+{
+    SharedPtr<File> file(new File(context_, fileName, FILE_READ));
+    if(file->IsOpen() == false)
+    {
+        printf("Failed to open \"%s\"\n", fileName.CString());
+        return 2;
+    }
+    if(file->ReadFileID() != "IRLG")
+    {
+        printf("\"%s\" is not an input recording\n", fileName.CString());
+        return 2;
+    }
+    unsigned version = file->ReadUInt();
+    if(version != InputRecording::VERSION)
+    {
+        printf("Unsupported input recording version %d (expected %d)\n", version, InputRecording::VERSION);
+        return 2;
+    }
+
+    String sceneName = file->ReadString();
+    String config = file->ReadString();
+    int fps = file->ReadInt();
+
+    // Player parameters have to match the recording
+    if(config.Length() != 0)
+    {
+        SharedPtr<XMLFile> xml(new XMLFile(context_));
+        if(xml->FromString(config) == false)
+        {
+            printf("Failed to parse the config stored in the recording\n");
+            return 2;
+        }
+        GetSubsystem<IceWeaselConfig>()->LoadXML(xml);
+    }
+
+    if(ReadRecording(file) == false || CreateScene(sceneName, fps) == false)
+        return 2;
+
+    // Only the simulation is timed, not loading
+    profiler_->SetScene(scene_);
+    SubscribeToEvent(scene_->GetComponent<PhysicsWorld>(), E_PHYSICSPOSTSTEP, URHO3D_HANDLER(InputReplay, HandlePhysicsPostStep));
+
+    unsigned tickCountMismatches = 0;
+    Clock::time_point start = Clock::now();
+    for(unsigned f = 0; f != frames_.Size(); ++f)
+    {
+        const Frame& frame = frames_[f];
+        if(frame.hasPlayers_)
+            CreatePlayers(frame.players_);
+
+        // Remote input is consumed one command per tick, in order
+        for(unsigned t = frame.firstTick_; t != frame.firstTick_ + frame.tickCount_; ++t)
+        {
+            const Tick& tick = ticks_[t];
+            for(unsigned p = 0; p != tick.commands_.Size() && p != players_.Size(); ++p)
+                players_[p]->GetComponent<MovementController>()->GetInputCommands().Push(tick.commands_[p]);
+        }
+
+        nextTick_ = frame.firstTick_;
+        frameEnd_ = frame.firstTick_ + frame.tickCount_;
+
+        profiler_->BeginFrame();
+        scene_->Update(frame.timeStep_);
+        profiler_->EndFrame();
+
+        // The physics world ran a different number of substeps than recorded
+        if(profiler_->GetFrameTickCount() != frame.tickCount_)
+        {
+            if(tickCountMismatches < 10)
+                printf("  Frame %d: recorded %d ticks, replayed %d\n",
+                       f, frame.tickCount_, profiler_->GetFrameTickCount());
+            ++tickCountMismatches;
+        }
+    }
+    double totalTime = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() * 1e-9;
+
+    printf("Replayed %d frames and %d ticks of \"%s\" from \"%s\" in %.3f s\n",
+           frames_.Size(), ticks_.Size(), sceneName.CString(), fileName.CString(), totalTime);
+    printf("Time per frame or tick in microseconds:\n");
+    profiler_->PrintReport();
+    printf("  State hash mismatches: %d", hashMismatches_);
+    if(hashMismatches_ != 0)
+        printf(" (first at tick %d)", firstMismatch_);
+    printf("\n");
+    printf("  Tick count mismatches: %d\n", tickCountMismatches);
+    printf("  Final state hash:      %08x\n", lastHash_);
+
+    return hashMismatches_ == 0 && tickCountMismatches == 0 ? 0 : 1;
+}
+
+// ----------------------------------------------------------------------------
+bool InputReplay::ReadRecording(File* file)
+{
+    while(file->IsEof() == false)
+    {
+        unsigned char chunk = file->ReadUByte();
+        if(chunk == InputRecording::CHUNK_FRAME)
+        {
+            Frame frame;
+            frame.timeStep_ = file->ReadFloat();
+            frame.hasPlayers_ = false;
+            frame.firstTick_ = ticks_.Size();
+            frame.tickCount_ = 0;
+            frames_.Push(frame);
+        }
+        else if(chunk == InputRecording::CHUNK_PLAYERS && frames_.Size())
+        {
+            Frame& frame = frames_.Back();
+            frame.hasPlayers_ = true;
+            frame.players_.Resize(file->ReadUInt());
+            for(unsigned i = 0; i != frame.players_.Size(); ++i)
+                frame.players_[i].Read(*file);
+        }
+        else if(chunk == InputRecording::CHUNK_TICK && frames_.Size())
+        {
+            Tick tick;
+            tick.timeStep_ = file->ReadFloat();
+            tick.commands_.Resize(file->ReadUInt());
+            for(unsigned i = 0; i != tick.commands_.Size(); ++i)
+                tick.commands_[i].Read(*file);
+            tick.hash_ = file->ReadUInt();
+            ticks_.Push(tick);
+            ++frames_.Back().tickCount_;
+        }
+        else
+        {
+            printf("Unexpected chunk type %d, recording is corrupt\n", chunk);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+bool InputReplay::CreateScene(const String& sceneName, int fps)
+{
+    // Same setup as IceWeasel::CreateScene(), minus everything that renders
+    scene_ = new Scene(context_);
+    scene_->CreateComponent<Octree>(LOCAL);
+    scene_->CreateComponent<PhysicsWorld>(LOCAL);
+
+    XMLFile* xml = GetSubsystem<ResourceCache>()->GetResource<XMLFile>(sceneName);
+    if(xml == NULL || scene_->LoadXML(xml->GetRoot()) == false)
+    {
+        printf("Failed to load scene \"%s\"\n", sceneName.CString());
+        return false;
+    }
+
+    PhysicsWorld* physicsWorld = scene_->GetOrCreateComponent<PhysicsWorld>();
+    if(fps > 0)
+        physicsWorld->SetFps(fps);
+
+    movementSystem_ = scene_->GetOrCreateComponent<MovementSystem>();
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+void InputReplay::CreatePlayers(const PODVector<MovementSnapshot>& players)
+{
+    /*
+     * Players are created in slot order, so the slots match the recording.
+     * Starting over also resets anything a snapshot doesn't hold (update
+     * rate timers, contacts), which only matters if players joined or left
+     * during the recording.
+     */
+    for(unsigned i = 0; i != players_.Size(); ++i)
+        players_[i]->Remove();
+    players_.Clear();
+
+    for(unsigned i = 0; i != players.Size(); ++i)
+    {
+        Node* moveNode = scene_->CreateChild("Replay Player", LOCAL);
+        Node* offsetNode = moveNode->CreateChild("Replay Player Offset", LOCAL);
+
+        MovementController* controller = new MovementController(context_, moveNode, offsetNode, NULL);
+        controller->SetInputSource(MovementController::INPUT_REMOTE);
+        moveNode->AddComponent(controller, 0, LOCAL);
+        controller->RestoreSnapshot(players[i]);
+
+        players_.Push(SharedPtr<Node>(moveNode));
+    }
+}
+
+// ----------------------------------------------------------------------------
+void InputReplay::HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData)
+{
+    (void)eventType;
+    (void)eventData;
+
+    // Compare against the recording. Extra ticks can't be compared.
+    lastHash_ = movementSystem_ ? movementSystem_->GetStateHash() : 0;
+    if(nextTick_ == frameEnd_)
+        return;
+
+    if(lastHash_ != ticks_[nextTick_].hash_)
+    {
+        if(hashMismatches_ < 10)
+            printf("  Tick %d: recorded state hash %08x, got %08x\n", nextTick_, ticks_[nextTick_].hash_, lastHash_);
+        if(hashMismatches_ == 0)
+            firstMismatch_ = nextTick_;
+        ++hashMismatches_;
+    }
+    ++nextTick_;
+}
@@ -5,10 +5,12 @@
 #include "iceweasel/IceWeaselConfig.h"
 #include "iceweasel/IceWeaselConfigEvents.h"
 #include "iceweasel/GravityManager.h"
+#include "iceweasel/MovementSystem.h"
 
+#include <Urho3D/Core/Timer.h>
 #include <Urho3D/Input/Input.h>
+#include <Urho3D/IO/MemoryBuffer.h>
 #include <Urho3D/IO/Log.h>
-#include <Urho3D/Math/Ray.h>
 #include <Urho3D/Physics/CollisionShape.h>
 #include <Urho3D/Physics/RigidBody.h>
 #include <Urho3D/Physics/PhysicsWorld.h>
@@ -20,15 +22,29 @@
 using namespace Urho3D;
 
 // ----------------------------------------------------------------------------
-MovementController::MovementController(Context* context, Node* moveNode, Node* offsetNode) :
+MovementController::MovementController(Context* context, Node* moveNode, Node* offsetNode, CharacterState* state) :
     LogicComponent(context),
     moveNode_(moveNode),
     offsetNode_(offsetNode),
+    state_(state ? state : new CharacterState),
+    groundNormal_(Vector3::UP),
+    previousPosition_(Vector3::ZERO),
+    currentPosition_(Vector3::ZERO),
+    previousRotation_(Quaternion::IDENTITY),
+    currentRotation_(Quaternion::IDENTITY),
+    hasPhysicsTransform_(false),
+    contactGroundNormal_(Vector3::ZERO),
+    groundContactCount_(0),
+    steepContactCount_(0),
+    hasCeilingContact_(false),
     respawnDistance_(100.0f),
-    jumpKeyPressed_(false),
-    crouchKeyPressed_(false),
+    movementSystemIndex_(M_MAX_UNSIGNED),
+    inputSource_(INPUT_KEYBOARD),
+    isObserver_(false),
     isSwimming_(false)
 {
+    // Fixed updates are driven by MovementSystem
+    SetUpdateEventMask(USE_UPDATE);
 }
 
 // ----------------------------------------------------------------------------
@@ -37,17 +53,53 @@ void MovementController::setRespawnDistance(float distance)
     respawnDistance_ = distance;
 }
 
+// ----------------------------------------------------------------------------
+void MovementController::SetIsObserver(bool enable)
+{
+    isObserver_ = enable;
+
+    // Not started yet, Start() registers us
+    if(gravityManager_ == NULL)
+        return;
+
+    UpdateRateScheduler& scheduler = gravityManager_->GetUpdateRateScheduler();
+    if(isObserver_)
+        scheduler.AddObserver(moveNode_);
+    else
+        scheduler.RemoveObserver(moveNode_);
+}
+
 // ----------------------------------------------------------------------------
 void MovementController::Start()
 {
     // Cache frequently used subsystems/scene components
     input_ = GetSubsystem<Input>();
+    time_ = GetSubsystem<Time>();
+    parameters_ = GetSubsystem<IceWeaselConfig>()->GetPlayerClassParameters(0);
     gravityManager_ = GetScene()->GetOrCreateComponent<GravityManager>();
     physicsWorld_ = GetScene()->GetOrCreateComponent<PhysicsWorld>();
+    probeSystem_ = GetScene()->GetOrCreateComponent<CharacterProbeSystem>();
+    movementSystem_ = GetScene()->GetOrCreateComponent<MovementSystem>();
+
+    // Entities near players are updated at full rate
+    UpdateRateScheduler& scheduler = gravityManager_->GetUpdateRateScheduler();
+    if(isObserver_)
+        scheduler.AddObserver(moveNode_);
+    scheduler.Schedule(&gravityTimer_);
+    scheduler.Schedule(&probe_.timer_);
+
+    // Movement state lives in the system's arrays. This has to happen before
+    // the physics parameters are initialised.
+    movementSystem_->AddMovementController(this);
 
     // Set up things
     CreateComponents();
 
+    // Ground and ceiling probes are batched with all other characters
+    probe_.body_ = body_;
+    probe_.node_ = moveNode_;
+    probeSystem_->AddProbe(&probe_);
+
     // Initial physics parameters
     moveNode_->SetRotation(Quaternion::IDENTITY);
 
@@ -55,26 +107,136 @@ void MovementController::Start()
     SubscribeToEvent(E_CAMERAANGLECHANGED, URHO3D_HANDLER(MovementController, HandleCameraAngleChanged));
     // Update physics collision shapes and rigid body parameters
     SubscribeToEvent(E_CONFIGRELOADED, URHO3D_HANDLER(MovementController, HandleConfigReloaded));
+    // Contacts of our body, used to detect the ground
+    SubscribeToEvent(moveNode_, E_NODECOLLISION, URHO3D_HANDLER(MovementController, HandleNodeCollision));
 }
 
 // ----------------------------------------------------------------------------
 void MovementController::Stop()
 {
+    if(gravityManager_)
+        gravityManager_->GetUpdateRateScheduler().RemoveObserver(moveNode_);
+    if(probeSystem_)
+        probeSystem_->RemoveProbe(&probe_);
+    if(movementSystem_)
+        movementSystem_->RemoveMovementController(this);
+
     DestroyComponents();
 }
 
 // ----------------------------------------------------------------------------
 void MovementController::Update(float timeStep)
 {
+    /*
+     * Record this frame's input. The physics ticks that follow consume it,
+     * see PrepareProbes(). This runs before the physics world is stepped
+     * for this frame.
+     *
+     * The elapsed time already includes this frame, and the last tick of the
+     * frame ends up to one step before it. The command is stamped with the
+     * start of the frame instead, so the first tick of this frame consumes it.
+     */
+    if(inputSource_ == INPUT_KEYBOARD)
+        commands_.Push(InputCommand::Sample(
+            input_, time_->GetFrameNumber(), time_->GetElapsedTime() - timeStep, timeStep, cameraAngle_));
+
     Update_Ground(timeStep);
     //Update_Water(timeStep);
 }
 
 // ----------------------------------------------------------------------------
-void MovementController::FixedUpdate(float timeStep)
+void MovementController::PrepareProbes(float tickEndTime)
+{
+    // Remote commands were already split into ticks by the client
+    const InputCommand& command = (inputSource_ == INPUT_REMOTE ?
+        commands_.ConsumeNext() : commands_.Consume(tickEndTime));
+
+    PrepareProbes_Ground(command);
+}
+
+// ----------------------------------------------------------------------------
+void MovementController::PrepareMovement(float timeStep)
+{
+    const InputCommand& command = commands_.GetCurrent();
+
+    PrepareMovement_Ground(command, timeStep);
+    //PrepareMovement_Water(command, timeStep);
+}
+
+// ----------------------------------------------------------------------------
+void MovementController::ApplyMovement()
+{
+    const MovementStates& states = movementSystem_->GetStates();
+    unsigned i = movementSystemIndex_;
+
+    state_->localVelocity_ = states.localVelocities_[i];
+
+    body_->SetLinearVelocity(states.linearVelocities_[i]);
+    moveNode_->SetRotation(-states.rotations_[i]);
+}
+
+// ----------------------------------------------------------------------------
+void MovementController::SetVisualNode(Node* node)
+{
+    if(visualNode_)
+    {
+        visualNode_->SetPosition(Vector3::ZERO);
+        visualNode_->SetRotation(Quaternion::IDENTITY);
+    }
+
+    visualNode_ = node;
+}
+
+// ----------------------------------------------------------------------------
+void MovementController::RecordPhysicsTransform()
+{
+    /*
+     * Read the transform from the body and not from the node. With physics
+     * interpolation enabled, Bullet writes an extrapolated transform to the
+     * node, which would have us interpolate towards a guess.
+     */
+    previousPosition_ = currentPosition_;
+    previousRotation_ = currentRotation_;
+    currentPosition_ = body_->GetPosition();
+    currentRotation_ = body_->GetRotation();
+    if(hasPhysicsTransform_)
+        return;
+
+    // First tick since spawning or teleporting, nothing to come from
+    previousPosition_ = currentPosition_;
+    previousRotation_ = currentRotation_;
+    hasPhysicsTransform_ = true;
+}
+
+// ----------------------------------------------------------------------------
+void MovementController::InterpolateVisual(float alpha)
+{
+    if(!visualNode_ || hasPhysicsTransform_ == false)
+        return;
+
+    /*
+     * Everything drawn is one tick behind the simulation. In exchange, the
+     * character moves smoothly no matter how the frame rate relates to the
+     * physics rate. This includes the rotation towards gravity, which only
+     * changes once per tick (see MovementSystem).
+     *
+     * The move node is wherever Bullet put it, so cancel that out.
+     */
+    Vector3 position = previousPosition_.Lerp(currentPosition_, alpha);
+    Quaternion rotation = previousRotation_.Nlerp(currentRotation_, alpha, true);
+    visualNode_->SetPosition(moveNode_->WorldToLocal(position));
+    visualNode_->SetRotation(moveNode_->GetWorldRotation().Inverse() * rotation);
+}
+
+// ----------------------------------------------------------------------------
+void MovementController::ResetInterpolation()
 {
-    FixedUpdate_Ground(timeStep);
-    //FixedUpdate_Water(timeStep);
+    hasPhysicsTransform_ = false;
+    if(visualNode_)
+    {
+        visualNode_->SetPosition(Vector3::ZERO);
+        visualNode_->SetRotation(Quaternion::IDENTITY);
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -104,41 +266,16 @@ void MovementController::DestroyComponents()
 }
 
 // ----------------------------------------------------------------------------
-bool MovementController::CanStandUp() const
+bool MovementController::CanStandUp()
 {
     /*
      * This is called when the player is crouching, but the user has let go of
      * the crouch button. The player should only be able to stand up again if
-     * there are no obstacles in the way.
+     * there are no obstacles in the way. The probe system casts a ray upwards
+     * that is as long as the player's standing height.
      */
-
-    bool canStandUp = true;
-
-    const IceWeaselConfig::Data& config = GetSubsystem<IceWeaselConfig>()->GetConfig();
-    const IceWeaselConfig::Data::PlayerClass& playerClass = config.playerClass(0);
-
-    /*
-     * Temporarily disable collision checks for the player's rigid body, so
-     * raycasts don't collide with ourselves.
-     */
-    unsigned storeCollisionMask = body_->GetCollisionMask();
-    body_->SetCollisionMask(0);
-
-        // Cast a ray that is as long as the player's standing height
-        float rayCastLength = playerClass.body.height;
-        Vector3 upDirection = moveNode_->GetRotation() * Vector3::UP;
-        Vector3 rayOrigin = moveNode_->GetWorldPosition();
-
-        // Cast upwards. If it hits anything then we can't stand up.
-        PhysicsRaycastResult result;
-        Ray ray(rayOrigin, upDirection);
-        physicsWorld_->RaycastSingle(result, ray, rayCastLength);
-        if(result.distance_ < rayCastLength)
-            canStandUp = false;
-
-    body_->SetCollisionMask(storeCollisionMask);
-
-    return canStandUp;
+    probeSystem_->ProbeStandUp(&probe_, moveNode_->GetWorldPosition(), moveNode_->GetRotation());
+    return probe_.canStandUp_;
 }
 
 // ----------------------------------------------------------------------------
@@ -152,16 +289,16 @@ void MovementController::Update_Ground(float timeStep)
 {
     (void)timeStep;
 
-    const IceWeaselConfig::Data& config = GetSubsystem<IceWeaselConfig>()->GetConfig();
+    const IceWeaselConfig::Data::PlayerClass& playerClass = parameters_->playerClass;
 
     // Change height offset if crouching
-    float targetHeight = config.playerClass(0).body.height;
+    float targetHeight = playerClass.body.height;
     if(IsCrouching())
-        targetHeight = config.playerClass(0).body.crouchHeight;
+        targetHeight = playerClass.body.crouchHeight;
 
     float currentHeight = offsetNode_->GetPosition().y_;
     currentHeight += (targetHeight - currentHeight) *
-            Min(1.0f, config.playerClass(0).speed.crouchTransitionSpeed * timeStep);
+            Min(1.0f, playerClass.speed.crouchTransitionSpeed * timeStep);
     offsetNode_->SetPosition(Vector3(0, currentHeight, 0));
 
     // Respawn player if he goes too far away
@@ -169,67 +306,87 @@ void MovementController::Update_Ground(float timeStep)
     {
         SetInitialPhysicsParameters();
         moveNode_->SetPosition(Vector3::ZERO);
+        ResetInterpolation();
     }
 }
 
 // ----------------------------------------------------------------------------
-void MovementController::FixedUpdate_Ground(float timeStep)
+void MovementController::PrepareProbes_Ground(const InputCommand& command)
 {
-    const IceWeaselConfig::Data& config = GetSubsystem<IceWeaselConfig>()->GetConfig();
-    const IceWeaselConfig::Data::PlayerClass& playerClass = config.playerClass(0);
-
-    /*
-     * Some notes on the following code.
-     *  + Through experimenting I have found the best method of controlling a
-     *    physics body is to modify its current linear velocity. There are
-     *    other implementations that act on its acceleration instead, but those
-     *    seem to be less stable and harder to control.
-     *
-     *  + The directional input (e.g. WASD) is assumed to be jerk/jounce (i.e.
-     *    the fourth derivative of location). This is integrated once using a
-     *    negative exponential function to get acceleration, which in turn is
-     *    integrated a second time and added to the current linear velocity of
-     *    the physics body. The reasons for this double-integration approach
-     *    are:
-     *      - The X/Z rotation code for tilting the player in the direction of
-     *        acceleration is a lot smoother this way.
-     *      - It's a little more realistic.
-     */
+    const IceWeaselConfig::Data::PlayerClass& playerClass = parameters_->playerClass;
 
     // Change collision shape depending on whether the player is crouching
-    // This needs to happen in FixedUpdate().
-    if(input_->GetKeyDown(KEY_CTRL))
-    {
-        if(crouchKeyPressed_ == false)
-        {
-            crouchKeyPressed_ = true;
-            collisionShapeCrouch_->SetEnabled(true);
-            collisionShapeUpright_->SetEnabled(false);
-
-            NotifyCrouchStateChange(true);
-        }
-    }
-    else
-        crouchKeyPressed_ = false;
+    // This needs to happen in a fixed update. A tap shorter than a tick still
+    // crouches for one tick. The probes use the new shape.
+    bool wantsToCrouch = command.IsDown(InputCommand::CROUCH) || command.IsPressed(InputCommand::CROUCH);
+    if(wantsToCrouch && IsCrouching() == false)
+        SetCrouching(true);
+    else if(wantsToCrouch == false && IsCrouching() && CanStandUp())
+        SetCrouching(false);
+
+    // MovementSystem runs the ground and ceiling probes of all characters
+    // once everyone has filled in theirs. While the player is at rest, the
+    // ground probe is only refreshed on some ticks.
+    probe_.updateInterval_ = GetUpdateInterval();
+    probe_.probeGround_ = (playerClass.ground.useContacts == false);
+}
 
-    if(IsCrouching() && crouchKeyPressed_ == false)
-    {
-        if(CanStandUp())
-        {
-            collisionShapeCrouch_->SetEnabled(false);
-            collisionShapeUpright_->SetEnabled(true);
+// ----------------------------------------------------------------------------
+void MovementController::PrepareMovement_Ground(const InputCommand& command, float timeStep)
+{
+    (void)timeStep;
 
-            NotifyCrouchStateChange(false);
-        }
-    }
+    const IceWeaselConfig::Data::PlayerClass& playerClass = parameters_->playerClass;
+    MovementStates& states = movementSystem_->GetStates();
+    unsigned i = movementSystemIndex_;
 
     /*
-     * Do some raycasts to figure out if we are on the ground (or hitting our
+     * Use the probes to figure out if we are on the ground (or hitting our
      * head on something). If so, reset the down velocity to 0.0f.
      *
      * A down velocity of 0.0f means we are on the ground.
+     *
+     * If the probe wasn't refreshed this tick, the previous result is reused.
+     * When using contacts, the probes only run if the contacts are ambiguous.
      */
-    bool isOnGround = ResetDownVelocityIfOnGround();
+    if(playerClass.ground.useContacts)
+        states.isOnGround_[i] = ResetDownVelocityIfTouchingGround();
+    else if(probe_.isUpdated_)
+        states.isOnGround_[i] = ResetDownVelocityIfOnGround();
+    ClearContacts();
+
+    // Acceleration approaches this, see MovementSystem::IntegrateMovement()
+    states.targetAccelerations_[i] = GetTargetAcceleration(command, IsCrouching());
+    states.jounceSpeeds_[i] = playerClass.speed.jounceSpeed;
+    states.accelerateSpeeds_[i] = playerClass.speed.accelerateSpeed;
+    states.jumpForces_[i] = playerClass.jump.force;
+    states.bunnyHopBoosts_[i] = playerClass.jump.bunnyHopBoost;
+    states.positions_[i] = moveNode_->GetWorldPosition();
+    states.bodyVelocities_[i] = body_->GetLinearVelocity();
+
+    // Gravity is queried for all characters at once. Until then, the result
+    // of the last query is used.
+    if(gravityTimer_.Tick(probe_.updateInterval_))
+        movementSystem_->QueueGravityQuery(i);
+
+    /*
+     * Allow the player to jump by pressing space while on the ground. The
+     * press is recorded by the frame it happened on, so it isn't missed if
+     * space is released again before the next tick.
+     */
+    states.jumps_[i] = command.IsPressed(InputCommand::JUMP) && states.isOnGround_[i];
+
+    // TODO limit velocity on slopes?
+
+    // TODO Take upwards velocity into account when bunny hopping (e.g. on ramps)
+
+    // TODO Add a "lifter" collision sphere to handle steps or other sharp edges.
+}
+
+// ----------------------------------------------------------------------------
+Vector3 MovementController::GetTargetAcceleration(const InputCommand& command, bool isCrouching) const
+{
+    const IceWeaselConfig::Data::PlayerClass& playerClass = parameters_->playerClass;
 
     /*
      * Get input direction vector from WASD on keyboard and store in x and z
@@ -241,106 +398,165 @@ void MovementController::FixedUpdate_Ground(float timeStep)
      */
     float speed = playerClass.speed.walk;
     Vector3 jounce(Vector3::ZERO);
-    if(input_->GetKeyDown(KEY_SHIFT))
+    if(command.IsDown(InputCommand::RUN))
         speed = playerClass.speed.run;
-    if(input_->GetKeyDown(KEY_CTRL) || IsCrouching())
+    if(command.IsDown(InputCommand::CROUCH) || isCrouching)
         speed = playerClass.speed.crouch;
-    if(input_->GetKeyDown(KEY_W))     jounce.z_ += 1;
-    if(input_->GetKeyDown(KEY_S))     jounce.z_ -= 1;
-    if(input_->GetKeyDown(KEY_A))     jounce.x_ += 1;
-    if(input_->GetKeyDown(KEY_D))     jounce.x_ -= 1;
+    if(command.IsDown(InputCommand::FORWARD)) jounce.z_ += 1;
+    if(command.IsDown(InputCommand::BACK))    jounce.z_ -= 1;
+    if(command.IsDown(InputCommand::LEFT))    jounce.x_ += 1;
+    if(command.IsDown(InputCommand::RIGHT))   jounce.x_ -= 1;
     if(jounce.x_ != 0 || jounce.z_ != 0)
         jounce = jounce.Normalized();
 
     // Rotate input direction by camera angle using a 3D rotation matrix
     jounce = Matrix3(
-        -Cos(cameraAngle_.y_), 0, Sin(cameraAngle_.y_),
+        -Cos(command.cameraAngle_.y_), 0, Sin(command.cameraAngle_.y_),
         0, 1, 0,
-        Sin(cameraAngle_.y_), 0, Cos(cameraAngle_.y_)
+        Sin(command.cameraAngle_.y_), 0, Cos(command.cameraAngle_.y_)
     ) * jounce;
 
-    // Approach acceleration smoothly using the input vector.
-    localPlaneAcceleration_.SetTarget(jounce * speed);
-    localPlaneAcceleration_.Advance(timeStep * playerClass.speed.jounceSpeed);
+    return jounce * speed;
+}
 
-    /*
-     * Query gravity at player's 3D location and calculate the rotation matrix
-     * that would transform our local coordinate system into the gravity's
-     * coordinate system (such that "down" correlates with the direction of
-     * gravity).
-     */
-    Vector3 gravity = gravityManager_->QueryGravity(moveNode_->GetWorldPosition());
-    Quaternion gravityRotation(Vector3::DOWN, gravity);
-    Matrix3 velocityTransform = gravityRotation.RotationMatrix();
+// ----------------------------------------------------------------------------
+void MovementController::SetCrouching(bool enable)
+{
+    collisionShapeCrouch_->SetEnabled(enable);
+    collisionShapeUpright_->SetEnabled(!enable);
+    UpdateProbeShape();
 
-    /*
-     * Transform the body's current velocity into our local coordinate system.
-     */
-    ExponentialCurve<Vector3> localPlaneVelocity(
-        velocityTransform.Inverse() * body_->GetLinearVelocity(), Vector3::ZERO);
+    state_->isCrouching_ = enable;
+}
 
-    /*
-     * Controls the player's Y velocity. The velocity is reset to 0.0f when
-     * E_NODECOLLISION occurs and the player is on the ground. Allow the player
-     * to jump by pressing space while the velocity is 0.0f.
-     *
-     * NOTE: We can't use GetKeyPress() in FixedUpdate() so we have to track
-     * the key press with a flag ourselves.
-     */
-    if(!jumpKeyPressed_ && input_->GetKeyDown(KEY_SPACE))
+// ----------------------------------------------------------------------------
+MovementSnapshot MovementController::CaptureSnapshot() const
+{
+    const MovementStates& states = movementSystem_->GetStates();
+    unsigned i = movementSystemIndex_;
+
+    MovementSnapshot snapshot;
+    snapshot.position_     = moveNode_->GetWorldPosition();
+    snapshot.velocity_     = body_->GetLinearVelocity();
+    snapshot.acceleration_ = states.accelerations_[i];
+    snapshot.gravity_      = states.gravity_[i];
+    snapshot.rotation_     = states.rotations_[i];
+    snapshot.downVelocity_ = states.downVelocities_[i];
+    snapshot.isOnGround_   = states.isOnGround_[i];
+    snapshot.isCrouching_  = IsCrouching();
+    return snapshot;
+}
+
+// ----------------------------------------------------------------------------
+void MovementController::RestoreSnapshot(const MovementSnapshot& snapshot)
+{
+    MovementStates& states = movementSystem_->GetStates();
+    unsigned i = movementSystemIndex_;
+
+    states.accelerations_[i]  = snapshot.acceleration_;
+    states.gravity_[i]        = snapshot.gravity_;
+    states.rotations_[i]      = snapshot.rotation_;
+    states.downVelocities_[i] = snapshot.downVelocity_;
+    states.isOnGround_[i]     = snapshot.isOnGround_;
+
+    if(snapshot.isCrouching_ != IsCrouching())
+        SetCrouching(snapshot.isCrouching_);
+
+    moveNode_->SetWorldPosition(snapshot.position_);
+    moveNode_->SetRotation(-snapshot.rotation_);
+    body_->SetLinearVelocity(snapshot.velocity_);
+
+    // Only the latest transform is corrected, so the visual node slides
+    // towards the correction instead of snapping
+    if(hasPhysicsTransform_)
     {
-        jumpKeyPressed_ = true;
-        if(isOnGround)
-        {
-            downVelocity_ = playerClass.jump.force;
-            // Give the player a slight speed boost so he moves faster than usual
-            // in the air.
-            localPlaneVelocity.value_ *= playerClass.jump.bunnyHopBoost;
-        }
+        currentPosition_ = body_->GetPosition();
+        currentRotation_ = body_->GetRotation();
     }
-    if(jumpKeyPressed_ && input_->GetKeyDown(KEY_SPACE) == false)
-        jumpKeyPressed_ = false;
 
-    // TODO limit velocity on slopes?
-
-    // TODO Take upwards velocity into account when bunny hopping (e.g. on ramps)
+    // The cached probe results and contacts belong to the old position
+    probe_.timer_.Invalidate();
+    ClearContacts();
+}
 
-    // TODO Add a "lifter" collision sphere to handle steps or other sharp edges.
+// ----------------------------------------------------------------------------
+bool MovementController::Resimulate(MovementSnapshot* snapshot, const InputCommand& command, float timeStep) const
+{
+    const IceWeaselConfig::Data::PlayerClass& playerClass = parameters_->playerClass;
 
     /*
-     * X/Z movement of the player is only possible when on the ground. If the
-     * player is in the air just maintain whatever velocity he currently has,
-     * but also add the target velocity on top of that so the player can
-     * slightly control his movement in the air.
+     * Same as a regular tick, except that everything is done on the snapshot
+     * instead of the node and body. Contacts only exist for the live body, so
+     * the probes stand in for them. Collisions with other bodies can't be
+     * re-simulated without stepping the whole physics world, so the caller
+     * has to give up if we would run into something.
      */
-    localPlaneVelocity.SetTarget(localPlaneAcceleration_.value_);
-    if(downVelocity_ == 0.0f)
-        localPlaneVelocity.Advance(timeStep * playerClass.speed.accelerateSpeed);
-    else
-        localPlaneVelocity.Advance(timeStep);
-
-    NotifyLocalMovementVelocityChange(Vector3(
-        localPlaneVelocity.value_.x_,
-        downVelocity_,
-        localPlaneVelocity.value_.z_
-    ));
-
-    // Integrate downwards velocity if in air and apply velocity back to body.
-    // We don't integrate if on the ground so the player doesn't slide slowly.
-    if(isOnGround == false)
-        downVelocity_ -= gravity.Length() * timeStep;
-    body_->SetLinearVelocity(velocityTransform *
-            Vector3(
-                localPlaneVelocity.value_.x_,
-                downVelocity_,
-                localPlaneVelocity.value_.z_
-            )
-    );
+    CharacterProbe probe = probe_;
+    probe.isCrouching_ = snapshot->isCrouching_;
+    probe.height_ = snapshot->isCrouching_ ? playerClass.body.crouchHeight : playerClass.body.height;
+    probe.radius_ = (snapshot->isCrouching_ ? playerClass.body.crouchWidth : playerClass.body.width) / 2;
+    probeSystem_->ProbeGround(&probe, snapshot->position_, -snapshot->rotation_);
+    probeSystem_->ProbeStandUp(&probe, snapshot->position_, -snapshot->rotation_);
+
+    bool wantsToCrouch = command.IsDown(InputCommand::CROUCH) || command.IsPressed(InputCommand::CROUCH);
+    if(wantsToCrouch)
+        snapshot->isCrouching_ = true;
+    else if(snapshot->isCrouching_ && probe.canStandUp_)
+        snapshot->isCrouching_ = false;
 
-    // Smoothly rotate to target orientation
-    static const float correctCameraAngleSpeed = 5.0f;
-    currentRotation_ = currentRotation_.Nlerp(gravityRotation, timeStep * correctCameraAngleSpeed, true);
-    moveNode_->SetRotation(-currentRotation_);
+    /*
+     * See ResetDownVelocityIfOnGround() and
+     * ResetDownVelocityIfTouchingGround(). With contacts, a regular tick only
+     * snaps to the ground when it falls back to probing, which requires
+     * having been on the ground before.
+     */
+    float& downVelocity = snapshot->downVelocity_;
+    bool snapToGround = (playerClass.ground.useContacts == false || snapshot->isOnGround_);
+    snapshot->isOnGround_ = probe.isOnGround_;
+    if(probe.isOnGround_ && downVelocity <= 0.0f)
+    {
+        downVelocity = 0.0f;
+        if(probe.hasGroundPosition_ && snapToGround)
+            snapshot->position_ = probe.groundPosition_;
+    }
+    if(probe.hitsCeiling_ && downVelocity >= 0.0f)
+        downVelocity = 0.0f;
+
+    // Integrate with the same kernel the movement system uses
+    MovementStates states;
+    states.Push();
+    states.positions_[0]           = snapshot->position_;
+    states.bodyVelocities_[0]      = snapshot->velocity_;
+    states.targetAccelerations_[0] = GetTargetAcceleration(command, snapshot->isCrouching_);
+    states.jounceSpeeds_[0]        = playerClass.speed.jounceSpeed;
+    states.accelerateSpeeds_[0]    = playerClass.speed.accelerateSpeed;
+    states.jumpForces_[0]          = playerClass.jump.force;
+    states.bunnyHopBoosts_[0]      = playerClass.jump.bunnyHopBoost;
+    states.jumps_[0]               = command.IsPressed(InputCommand::JUMP) && snapshot->isOnGround_;
+    states.isOnGround_[0]          = snapshot->isOnGround_;
+    states.accelerations_[0]       = snapshot->acceleration_;
+    // Re-simulated ticks are close to where the character is now, so start
+    // searching the gravity mesh from there. The hint is a copy, because
+    // this mustn't modify the live state.
+    unsigned gravityHint = movementSystem_->GetStates().gravityHints_[movementSystemIndex_];
+    gravityManager_->PrepareConcurrentQuery();
+    states.gravity_[0]             = gravityManager_->QueryGravityConcurrent(snapshot->position_, &gravityHint);
+    states.rotations_[0]           = snapshot->rotation_;
+    states.downVelocities_[0]      = downVelocity;
+    MovementSystem::IntegrateMovement(&states, 0, timeStep);
+
+    Vector3 displacement = states.linearVelocities_[0] * timeStep;
+    if(probeSystem_->ProbeMovement(&probe, snapshot->position_, -snapshot->rotation_, displacement))
+        return false;
+
+    snapshot->velocity_     = states.linearVelocities_[0];
+    snapshot->position_    += displacement;
+    snapshot->acceleration_ = states.accelerations_[0];
+    snapshot->gravity_      = states.gravity_[0];
+    snapshot->rotation_     = states.rotations_[0];
+    snapshot->downVelocity_ = states.downVelocities_[0];
+
+    return true;
 }
 
 // ----------------------------------------------------------------------------
@@ -349,10 +565,11 @@ void MovementController::Update_Water(float timeStep)
 }
 
 // ----------------------------------------------------------------------------
-void MovementController::FixedUpdate_Water(float timeStep)
+void MovementController::PrepareMovement_Water(const InputCommand& command, float timeStep)
 {
-    const IceWeaselConfig::Data& config = GetSubsystem<IceWeaselConfig>()->GetConfig();
-    const IceWeaselConfig::Data::PlayerClass& playerClass = config.playerClass(0);
+    const IceWeaselConfig::Data::PlayerClass& playerClass = parameters_->playerClass;
+    MovementStates& states = movementSystem_->GetStates();
+    unsigned i = movementSystemIndex_;
 
     /*
      * Get input direction vector from WASD on keyboard and store in x and z
@@ -364,165 +581,165 @@ void MovementController::FixedUpdate_Water(float timeStep)
      */
     float speed = playerClass.speed.walk;
     Vector3 jounce(Vector3::ZERO);
-    if(input_->GetKeyDown(KEY_SHIFT))
+    if(command.IsDown(InputCommand::RUN))
         speed = playerClass.speed.run;
-    if(input_->GetKeyDown(KEY_CTRL) || IsCrouching())
+    if(command.IsDown(InputCommand::CROUCH) || IsCrouching())
         speed = playerClass.speed.crouch;
-    if(input_->GetKeyDown(KEY_W))     jounce.z_ += 1;
-    if(input_->GetKeyDown(KEY_S))     jounce.z_ -= 1;
-    if(input_->GetKeyDown(KEY_A))     jounce.x_ += 1;
-    if(input_->GetKeyDown(KEY_D))     jounce.x_ -= 1;
+    if(command.IsDown(InputCommand::FORWARD)) jounce.z_ += 1;
+    if(command.IsDown(InputCommand::BACK))    jounce.z_ -= 1;
+    if(command.IsDown(InputCommand::LEFT))    jounce.x_ += 1;
+    if(command.IsDown(InputCommand::RIGHT))   jounce.x_ -= 1;
     if(jounce.x_ != 0 || jounce.z_ != 0)
         jounce = jounce.Normalized();
 
     // Rotate input direction by camera angle using a 3D rotation matrix
     jounce = Matrix3(
-        -Cos(cameraAngle_.y_), 0, Sin(cameraAngle_.y_),
+        -Cos(command.cameraAngle_.y_), 0, Sin(command.cameraAngle_.y_),
         0, 1, 0,
-        Sin(cameraAngle_.y_), 0, Cos(cameraAngle_.y_)
+        Sin(command.cameraAngle_.y_), 0, Cos(command.cameraAngle_.y_)
     ) * Matrix3(
         1, 0, 0,
-        0, Cos(cameraAngle_.x_), -Sin(cameraAngle_.x_),
-        0, Sin(cameraAngle_.x_), Cos(cameraAngle_.x_)
+        0, Cos(command.cameraAngle_.x_), -Sin(command.cameraAngle_.x_),
+        0, Sin(command.cameraAngle_.x_), Cos(command.cameraAngle_.x_)
     ) * jounce;
 
-    // Approach acceleration smoothly using the input vector.
-    localPlaneAcceleration_.SetTarget(jounce * speed);
-    localPlaneAcceleration_.Advance(timeStep * playerClass.speed.jounceSpeed);
-
-    /*
-     * Query gravity at player's 3D location and calculate the rotation matrix
-     * that would transform our local coordinate system into the gravity's
-     * coordinate system (such that "down" correlates with the direction of
-     * gravity).
-     */
-    Vector3 gravity = gravityManager_->QueryGravity(moveNode_->GetWorldPosition());
-    Quaternion gravityRotation(Vector3::DOWN, gravity);
-    Matrix3 velocityTransform = gravityRotation.RotationMatrix();
-
-    /*
-     * Transform the body's current velocity into our local coordinate system.
-     */
-    ExponentialCurve<Vector3> localPlaneVelocity(
-        velocityTransform.Inverse() * body_->GetLinearVelocity(), Vector3::ZERO);
+    states.targetAccelerations_[i] = jounce * speed;
+    states.jounceSpeeds_[i] = playerClass.speed.jounceSpeed;
+    states.accelerateSpeeds_[i] = playerClass.speed.accelerateSpeed;
+    states.positions_[i] = moveNode_->GetWorldPosition();
+    states.bodyVelocities_[i] = body_->GetLinearVelocity();
+    states.jumps_[i] = false;
+    movementSystem_->QueueGravityQuery(i);
+
+    // Under water, down velocity is always constant. The body floats, so
+    // treat it as being on the ground so gravity doesn't accumulate.
+    states.downVelocities_[i] = -0.04f * timeStep;
+    states.isOnGround_[i] = true;
+}
 
-    // Under water, down velocity is always constant
-    downVelocity_ = -0.04f * timeStep;
-    /*
-     * X/Z movement of the player is only possible when on the ground. If the
-     * player is in the air just maintain whatever velocity he currently has,
-     * but also add the target velocity on top of that so the player can
-     * slightly control his movement in the air.
-     */
-    localPlaneVelocity.SetTarget(localPlaneAcceleration_.value_);
-    localPlaneVelocity.Advance(timeStep * playerClass.speed.accelerateSpeed);
+// ----------------------------------------------------------------------------
+bool MovementController::ResetDownVelocityIfOnGround()
+{
+    float& downVelocity = movementSystem_->GetStates().downVelocities_[movementSystemIndex_];
 
-    NotifyLocalMovementVelocityChange(localPlaneVelocity.value_);
+    // The probe sphere casts down from the top of the capsule and raycasts up
+    // from our feet, see CharacterProbeSystem::RunProbe()
+    if(probe_.isOnGround_)
+    {
+        if(downVelocity <= 0.0f)
+            downVelocity = 0.0f;
+
+        /*
+         * When the player is running down a slope, he will start
+         * oscillating between falling/landing. Since we know we're
+         * touching the ground, just translate the player downwards so he's
+         * actually touching the ground.
+         * Note that this shouldn't be done if the player's velocity is
+         * moving upwards.
+         */
+        if(downVelocity <= 0.0f && probe_.hasGroundPosition_)
+            moveNode_->SetPosition(probe_.groundPosition_);
+        if(probe_.hasGroundPosition_)
+            groundNormal_ = probe_.groundNormal_;
+    }
 
-    // Integrate downwards velocity and apply velocity back to body.
-    downVelocity_ -= gravity.Length() * timeStep;
-    body_->SetLinearVelocity(velocityTransform * localPlaneVelocity.value_);
+    // Check if we're hitting anything with our head
+    if(probe_.hitsCeiling_)
+        if(downVelocity >= 0.0f)
+            downVelocity = 0.0f;
 
-    // Smoothly rotate to target orientation
-    static const float correctCameraAngleSpeed = 5.0f;
-    currentRotation_ = currentRotation_.Nlerp(gravityRotation, timeStep * correctCameraAngleSpeed, true);
-    moveNode_->SetRotation(-currentRotation_);
+    return probe_.isOnGround_;
 }
 
 // ----------------------------------------------------------------------------
-bool MovementController::ResetDownVelocityIfOnGround()
+bool MovementController::ResetDownVelocityIfTouchingGround()
 {
-    using namespace NodeCollision;
-
-    const IceWeaselConfig::Data& config = GetSubsystem<IceWeaselConfig>()->GetConfig();
-    const IceWeaselConfig::Data::PlayerClass& playerClass = config.playerClass(0);
-
-    bool isOnGround = false;
+    MovementStates& states = movementSystem_->GetStates();
+    float& downVelocity = states.downVelocities_[movementSystemIndex_];
 
     /*
-     * Temporarily disable collision checks for the player's rigid body, so
-     * raycasts don't collide with ourselves.
-     * */
-    unsigned int storeCollisionMask = body_->GetCollisionMask();
-    body_->SetCollisionMask(0);
-
-        // Ray length depends on whether player is standing or crouching
-        float bodyHeight = playerClass.body.height;
-        float bodyRadius = playerClass.body.width / 2;
-        if(IsCrouching())
-            bodyHeight = playerClass.body.crouchHeight;
-        if(IsCrouching())
-            bodyRadius = playerClass.body.crouchWidth / 2;
-
-        // Radius slightly less than body width/2
-        float castRadius = bodyRadius / 1.1f;
-
-        // Because we're sphere casting, and the ray length goes to the center
-        // of the sphere and not to the edge, subtract cast width from the
-        // length
-        float rayCastLength = bodyHeight - castRadius;
-
-        // Cast slightly beyond
-        const float extendFactor = 1.1f;
-        rayCastLength *= extendFactor;
-
-        // Cast a ray down and check if we're on the ground
-        PhysicsRaycastResult result;
-        Vector3 downDirection = moveNode_->GetRotation() * Vector3::DOWN;
-        Vector3 rayOrigin(moveNode_->GetWorldPosition() - downDirection * bodyHeight); // cast from top of capsule
-        Ray ray(rayOrigin, downDirection);
-        physicsWorld_->SphereCast(result, ray, castRadius, rayCastLength);
-        if(result.distance_ < rayCastLength)
+     * The contacts are ambiguous if we lost contact with the ground without
+     * moving upwards (e.g. running down a slope or over a bump, where we
+     * briefly separate from the ground), or if the only thing below us is too
+     * steep to stand on. Fall back to probing in those cases.
+     */
+    bool isAmbiguous =
+        groundContactCount_ == 0 && (
+            (states.isOnGround_[movementSystemIndex_] && downVelocity <= 0.0f) ||
+            steepContactCount_ > 0
+        );
+
+    bool isOnGround;
+    if(isAmbiguous)
+    {
+        probeSystem_->ProbeGround(&probe_);
+        isOnGround = ResetDownVelocityIfOnGround();
+    }
+    else
+    {
+        isOnGround = (groundContactCount_ > 0);
+        if(isOnGround)
         {
-            isOnGround = true;
-
-            if(downVelocity_ <= 0.0f)
-                downVelocity_ = 0.0f;
-
-            /*
-             * When the player is running down a slope, he will start
-             * oscillating between falling/landing. Since we know we're
-             * touching the ground, just translate the player downwards so he's
-             * actually touching the ground.
-             * Note that this shouldn't be done if the player's velocity is
-             * moving upwards.
-             */
-            if(downVelocity_ <= 0.0f)
-            {
-                physicsWorld_->RaycastSingle(result, ray, bodyHeight*1.1f);
-                if(result.distance_ < bodyHeight * 1.1f)
-                    moveNode_->SetPosition(result.position_);
-            }
+            if(downVelocity <= 0.0f)
+                downVelocity = 0.0f;
+            groundNormal_ = contactGroundNormal_.Normalized();
         }
 
-        // Cast a ray up and check if we're hitting anything with our head
-        ray = Ray(moveNode_->GetWorldPosition(), -downDirection);
-        physicsWorld_->RaycastSingle(result, ray, rayCastLength);
-        if(result.distance_ < rayCastLength)
-            if(downVelocity_ >= 0.0f)
-                downVelocity_ = 0.0f;
-
-    // Restore collision mask
-    body_->SetCollisionMask(storeCollisionMask);
+        if(hasCeilingContact_)
+            if(downVelocity >= 0.0f)
+                downVelocity = 0.0f;
+    }
 
     return isOnGround;
 }
 
+// ----------------------------------------------------------------------------
+void MovementController::ClearContacts()
+{
+    // Start gathering contacts for the next tick
+    contactGroundNormal_ = Vector3::ZERO;
+    groundContactCount_ = 0;
+    steepContactCount_ = 0;
+    hasCeilingContact_ = false;
+}
+
+// ----------------------------------------------------------------------------
+void MovementController::UpdateProbeShape()
+{
+    const IceWeaselConfig::Data::PlayerClass& playerClass = parameters_->playerClass;
+
+    // Probe length depends on whether player is standing or crouching
+    probe_.isCrouching_ = IsCrouching();
+    if(probe_.isCrouching_)
+    {
+        probe_.height_ = playerClass.body.crouchHeight;
+        probe_.radius_ = playerClass.body.crouchWidth / 2;
+    }
+    else
+    {
+        probe_.height_ = playerClass.body.height;
+        probe_.radius_ = playerClass.body.width / 2;
+    }
+    probe_.standHeight_ = playerClass.body.height;
+}
+
 // ----------------------------------------------------------------------------
 void MovementController::UpdatePhysicsSettings()
 {
-    const IceWeaselConfig::Data& config = GetSubsystem<IceWeaselConfig>()->GetConfig();
+    const IceWeaselConfig::Data::PlayerClass& playerClass = parameters_->playerClass;
 
     // Update collision shapes
-    collisionShapeUpright_->SetCapsule(config.playerClass(0).body.width,
-                                       config.playerClass(0).body.height,
-                                       Vector3(0, config.playerClass(0).body.height / 2, 0));
-    collisionShapeCrouch_->SetCapsule(config.playerClass(0).body.crouchWidth,
-                                      config.playerClass(0).body.crouchHeight,
-                                      Vector3(0, config.playerClass(0).body.crouchHeight / 2, 0));
+    collisionShapeUpright_->SetCapsule(playerClass.body.width,
+                                       playerClass.body.height,
+                                       Vector3(0, playerClass.body.height / 2, 0));
+    collisionShapeCrouch_->SetCapsule(playerClass.body.crouchWidth,
+                                      playerClass.body.crouchHeight,
+                                      Vector3(0, playerClass.body.crouchHeight / 2, 0));
 
     // Update rigid body
-    body_->SetMass(config.playerClass(0).body.mass);
+    body_->SetMass(playerClass.body.mass);
+
+    UpdateProbeShape();
 
     SetInitialPhysicsParameters();
 }
@@ -530,7 +747,25 @@ void MovementController::UpdatePhysicsSettings()
 // ----------------------------------------------------------------------------
 void MovementController::SetInitialPhysicsParameters()
 {
-    downVelocity_ = 0.0f;
+    movementSystem_->GetStates().downVelocities_[movementSystemIndex_] = 0.0f;
+
+    // Cached results are no longer valid
+    gravityTimer_.Invalidate();
+    probe_.timer_.Invalidate();
+    ClearContacts();
+}
+
+// ----------------------------------------------------------------------------
+unsigned MovementController::GetUpdateInterval() const
+{
+    // Any input or being in the air means we're about to move
+    const InputCommand& command = commands_.GetCurrent();
+    if(movementSystem_->GetStates().downVelocities_[movementSystemIndex_] != 0.0f ||
+       ((command.buttons_ | command.pressed_) & ~InputCommand::RUN) != 0)
+        return 1;
+
+    return gravityManager_->GetUpdateRateScheduler().GetInterval(
+        moveNode_->GetWorldPosition(), body_->GetLinearVelocity());
 }
 
 // ----------------------------------------------------------------------------
@@ -543,23 +778,62 @@ void MovementController::HandleCameraAngleChanged(StringHash /*eventType*/, Vari
 // ----------------------------------------------------------------------------
 void MovementController::HandleConfigReloaded(StringHash /*eventType*/, VariantMap& /*eventData*/)
 {
+    // The old parameter block is stale
+    parameters_ = GetSubsystem<IceWeaselConfig>()->GetPlayerClassParameters(0);
     UpdatePhysicsSettings();
 }
 
 // ----------------------------------------------------------------------------
-void MovementController::NotifyLocalMovementVelocityChange(const Urho3D::Vector3& localPlaneVelocity)
+void MovementController::HandleNodeCollision(StringHash eventType, VariantMap& eventData)
 {
-    using namespace LocalMovementVelocityChanged;
-    VariantMap& eventData = GetEventDataMap();
-    eventData[P_LOCALMOVEMENTVELOCITY] = localPlaneVelocity;
-    SendEvent(E_LOCALMOVEMENTVELOCITYCHANGED, eventData);
-}
+    using namespace NodeCollision;
+    (void)eventType;
 
-// ----------------------------------------------------------------------------
-void MovementController::NotifyCrouchStateChange(bool isCrouching)
-{
-    using namespace CrouchStateChanged;
-    VariantMap& eventData = GetEventDataMap();
-    eventData[P_CROUCHING] = isCrouching;
-    SendEvent(E_CROUCHSTATECHANGED, eventData);
+    if(eventData[P_TRIGGER].GetBool())
+        return;
+
+    const IceWeaselConfig::Data::PlayerClass& playerClass = parameters_->playerClass;
+
+    /*
+     * This is sent after every physics substep in which our body touches
+     * something. Contacts near our feet are ground if they aren't too steep,
+     * and contacts near our head are ceiling. The node's origin is at our
+     * feet, and the lower and upper caps of the capsule are probe_.radius_
+     * tall.
+     */
+    Vector3 upDirection = moveNode_->GetRotation() * Vector3::UP;
+    Vector3 feet = moveNode_->GetWorldPosition();
+    float minGroundDot = Cos(playerClass.ground.maxSlope);
+
+    MemoryBuffer contacts(eventData[P_CONTACTS].GetBuffer());
+    while(contacts.IsEof() == false)
+    {
+        Vector3 position = contacts.ReadVector3();
+        Vector3 normal = contacts.ReadVector3();
+        contacts.ReadFloat(); // distance
+        contacts.ReadFloat(); // impulse
+
+        // Make the normal point upwards. Which way it points depends on
+        // whether we are body A or B of the manifold.
+        float dot = normal.DotProduct(upDirection);
+        if(dot < 0.0f)
+        {
+            normal = -normal;
+            dot = -dot;
+        }
+
+        float height = (position - feet).DotProduct(upDirection);
+        if(height < probe_.radius_)
+        {
+            if(dot >= minGroundDot)
+            {
+                contactGroundNormal_ += normal;
+                ++groundContactCount_;
+            }
+            else
+                ++steepContactCount_;
+        }
+        else if(height > probe_.height_ - probe_.radius_ && dot >= minGroundDot)
+            hasCeilingContact_ = true;
+    }
 }
@@ -0,0 +1,308 @@
+#include "iceweasel/MovementPrediction.h"
+#include "iceweasel/IceWeasel.h"
+#include "iceweasel/MovementController.h"
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Network/Connection.h>
+#include <Urho3D/Network/Network.h>
+#include <Urho3D/Network/NetworkEvents.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Scene/Node.h>
+#include <Urho3D/Scene/Scene.h>
+
+using namespace Urho3D;
+
+// Ticks older than this are dropped, even if they were never acknowledged
+static const unsigned MAX_HISTORY_SIZE = 256;
+// Unacknowledged commands are re-sent with every update, up to this many
+static const unsigned MAX_COMMANDS_PER_MESSAGE = 32;
+// A client can't get further ahead of the server than this many ticks.
+// Commands beyond that are ignored and arrive again with the next message.
+static const unsigned MAX_QUEUED_COMMANDS = 32;
+
+// ----------------------------------------------------------------------------
+MovementPrediction::MovementPrediction(Context* context) :
+    Component(context),
+    mode_(PREDICT),
+    correctionTolerance_(0.05f),
+    lastAcknowledged_(0),
+    lastReceived_(0),
+    correctionCount_(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+void MovementPrediction::RegisterObject(Context* context)
+{
+    context->RegisterFactory<MovementPrediction>(ICEWEASEL_CATEGORY);
+}
+
+// ----------------------------------------------------------------------------
+void MovementPrediction::SetMode(Mode mode)
+{
+    mode_ = mode;
+    history_.Clear();
+    lastAcknowledged_ = 0;
+    lastReceived_ = 0;
+
+    MovementController* controller = GetMovementController();
+    if(controller)
+        controller->SetInputSource(mode_ == AUTHORITY ?
+            MovementController::INPUT_REMOTE : MovementController::INPUT_KEYBOARD);
+}
+
+// ----------------------------------------------------------------------------
+void MovementPrediction::SetConnection(Connection* connection)
+{
+    connection_ = connection;
+}
+
+// ----------------------------------------------------------------------------
+MovementController* MovementPrediction::GetMovementController()
+{
+    // The controller may be added after this component
+    if(!movementController_ && node_)
+        movementController_ = node_->GetComponent<MovementController>();
+    return movementController_;
+}
+
+// ----------------------------------------------------------------------------
+Connection* MovementPrediction::GetConnection() const
+{
+    if(mode_ == AUTHORITY)
+        return connection_;
+
+    Network* network = GetSubsystem<Network>();
+    return network ? network->GetServerConnection() : NULL;
+}
+
+// ----------------------------------------------------------------------------
+void MovementPrediction::OnSceneSet(Scene* scene)
+{
+    UnsubscribeFromAllEvents();
+
+    if(scene == NULL)
+        return;
+
+    SubscribeToEvent(scene->GetOrCreateComponent<PhysicsWorld>(), E_PHYSICSPOSTSTEP, URHO3D_HANDLER(MovementPrediction, HandlePhysicsPostStep));
+    SubscribeToEvent(E_NETWORKUPDATE, URHO3D_HANDLER(MovementPrediction, HandleNetworkUpdate));
+    SubscribeToEvent(E_NETWORKMESSAGE, URHO3D_HANDLER(MovementPrediction, HandleNetworkMessage));
+}
+
+// ----------------------------------------------------------------------------
+void MovementPrediction::SendInput()
+{
+    Connection* connection = GetConnection();
+    if(connection == NULL || history_.Empty())
+        return;
+
+    // Packets may be lost, so everything the server hasn't acknowledged yet
+    // is sent again. The server skips commands it has already seen. It
+    // consumes them in order, so if there are too many to fit into one
+    // message, the oldest ones are sent first and the rest follow once these
+    // are acknowledged.
+    unsigned count = Min(history_.Size(), MAX_COMMANDS_PER_MESSAGE);
+
+    VectorBuffer message;
+    message.WriteUInt(count);
+    for(unsigned i = 0; i != count; ++i)
+        history_[i].command_.Write(message);
+
+    connection->SendMessage(MSG_MOVEMENTINPUT, false, false, message);
+}
+
+// ----------------------------------------------------------------------------
+void MovementPrediction::SendState()
+{
+    Connection* connection = GetConnection();
+    MovementController* controller = GetMovementController();
+    if(connection == NULL || controller == NULL)
+        return;
+
+    // Nothing consumed yet
+    const InputCommandBuffer& commands = controller->GetInputCommands();
+    unsigned sequence = commands.GetCurrent().sequence_;
+    if(sequence == 0)
+        return;
+
+    VectorBuffer message;
+    message.WriteUInt(sequence);
+    message.WriteUInt(commands.GetRepeatCount());
+    controller->CaptureSnapshot().Write(message);
+
+    connection->SendMessage(MSG_MOVEMENTSTATE, false, false, message);
+}
+
+// ----------------------------------------------------------------------------
+void MovementPrediction::ReceiveInput(MemoryBuffer& message)
+{
+    MovementController* controller = GetMovementController();
+    if(controller == NULL)
+        return;
+
+    InputCommandBuffer& commands = controller->GetInputCommands();
+    unsigned count = Min(message.ReadUInt(), MAX_COMMANDS_PER_MESSAGE);
+    for(unsigned i = 0; i != count; ++i)
+    {
+        InputCommand command;
+        if(command.Read(message) == false)
+            break;
+
+        // Duplicates and commands that arrived out of order
+        if(command.sequence_ <= lastReceived_)
+            continue;
+
+        // Not marked as received, so they are accepted when sent again
+        if(commands.GetSize() >= MAX_QUEUED_COMMANDS)
+            break;
+
+        lastReceived_ = command.sequence_;
+        commands.Push(command);
+    }
+}
+
+// ----------------------------------------------------------------------------
+void MovementPrediction::ReceiveState(MemoryBuffer& message)
+{
+    MovementController* controller = GetMovementController();
+    if(controller == NULL)
+        return;
+
+    unsigned acknowledged = message.ReadUInt();
+    unsigned repeatedTicks = message.ReadUInt();
+    MovementSnapshot serverState;
+    if(serverState.Read(message) == false)
+        return;
+
+    // States can arrive out of order
+    if(acknowledged <= lastAcknowledged_)
+        return;
+
+    /*
+     * Our input didn't reach the server in time, so it simulated more ticks
+     * with the acknowledged command than we did. This state doesn't belong
+     * to any of our ticks and comparing it would always cause a correction.
+     * Wait for the state of the next command, which the server applies on
+     * top of this one.
+     */
+    if(repeatedTicks != 0)
+        return;
+    lastAcknowledged_ = acknowledged;
+
+    unsigned index = 0;
+    while(index != history_.Size() && history_[index].command_.sequence_ < acknowledged)
+        ++index;
+
+    // We don't know what we predicted for this tick anymore. Take the
+    // server's state as is.
+    if(index == history_.Size() || history_[index].command_.sequence_ != acknowledged)
+    {
+        controller->RestoreSnapshot(serverState);
+        history_.Clear();
+        ++correctionCount_;
+        return;
+    }
+
+    const MovementSnapshot& predicted = history_[index].snapshot_;
+    if((predicted.position_ - serverState.position_).Length() > correctionTolerance_ ||
+       predicted.isCrouching_ != serverState.isCrouching_)
+    {
+        /*
+         * The prediction was wrong. Start from the server's state and apply
+         * the input of all ticks that came after it again. The history is
+         * updated with the new results, so a later state from the server is
+         * compared against the corrected prediction.
+         *
+         * If the character would run into something, we can't know where it
+         * ends up. Stay at the server's state and let the server's states
+         * for the remaining ticks correct us again.
+         */
+        MovementSnapshot snapshot = serverState;
+        unsigned resimulated = 0;
+        for(unsigned i = index + 1; i < history_.Size(); ++i)
+        {
+            MovementSnapshot next = snapshot;
+            if(controller->Resimulate(&next, history_[i].command_, history_[i].timeStep_) == false)
+            {
+                snapshot = serverState;
+                resimulated = 0;
+                break;
+            }
+            snapshot = next;
+            history_[i].snapshot_ = snapshot;
+            ++resimulated;
+        }
+
+        controller->RestoreSnapshot(snapshot);
+        ++correctionCount_;
+        URHO3D_LOGDEBUGF("[MovementPrediction] Corrected tick %d, re-simulated %d of %d ticks",
+                         acknowledged, resimulated, history_.Size() - index - 1);
+    }
+
+    // Acknowledged ticks won't be needed again
+    history_.Erase(0, index + 1);
+}
+
+// ----------------------------------------------------------------------------
+void MovementPrediction::HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData)
+{
+    using namespace PhysicsPostStep;
+    (void)eventType;
+
+    if(mode_ != PREDICT || GetConnection() == NULL)
+        return;
+
+    MovementController* controller = GetMovementController();
+    if(controller == NULL || controller->GetMovementSystemIndex() == M_MAX_UNSIGNED)
+        return;
+
+    // Record the command the controller consumed during this substep and
+    // where it took us
+    HistoryEntry entry;
+    entry.command_ = controller->GetInputCommands().GetCurrent();
+    entry.timeStep_ = eventData[P_TIMESTEP].GetFloat();
+    entry.snapshot_ = controller->CaptureSnapshot();
+    history_.Push(entry);
+
+    if(history_.Size() > MAX_HISTORY_SIZE)
+        history_.Erase(0, history_.Size() - MAX_HISTORY_SIZE);
+}
+
+// ----------------------------------------------------------------------------
+void MovementPrediction::HandleNetworkUpdate(StringHash eventType, VariantMap& eventData)
+{
+    (void)eventType;
+    (void)eventData;
+
+    if(mode_ == PREDICT)
+        SendInput();
+    else
+        SendState();
+}
+
+// ----------------------------------------------------------------------------
+void MovementPrediction::HandleNetworkMessage(StringHash eventType, VariantMap& eventData)
+{
+    using namespace NetworkMessage;
+    (void)eventType;
+
+    Connection* connection = static_cast<Connection*>(eventData[P_CONNECTION].GetPtr());
+    if(connection == NULL || connection != GetConnection())
+        return;
+
+    int messageID = eventData[P_MESSAGEID].GetInt();
+    if(mode_ == AUTHORITY && messageID == MSG_MOVEMENTINPUT)
+    {
+        MemoryBuffer message(eventData[P_DATA].GetBuffer());
+        ReceiveInput(message);
+    }
+    else if(mode_ == PREDICT && messageID == MSG_MOVEMENTSTATE)
+    {
+        MemoryBuffer message(eventData[P_DATA].GetBuffer());
+        ReceiveState(message);
+    }
+}
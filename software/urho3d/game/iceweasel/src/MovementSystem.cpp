@@ -0,0 +1,492 @@
+#include "iceweasel/MovementSystem.h"
+#include "iceweasel/CharacterProbeSystem.h"
+#include "iceweasel/Curves.h"
+#include "iceweasel/GravityManager.h"
+#include "iceweasel/IceWeasel.h"
+#include "iceweasel/MovementController.h"
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/IO/Deserializer.h>
+#include <Urho3D/IO/Serializer.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include <cassert>
+#include <chrono>
+
+using namespace Urho3D;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// Splitting fewer characters than this across threads costs more than it saves
+static const unsigned MIN_CHARACTERS_PER_WORK_ITEM = 16;
+
+// ----------------------------------------------------------------------------
+void MovementStates::Push()
+{
+    positions_.Push(Vector3::ZERO);
+    bodyVelocities_.Push(Vector3::ZERO);
+    targetAccelerations_.Push(Vector3::ZERO);
+    jounceSpeeds_.Push(0.0f);
+    accelerateSpeeds_.Push(0.0f);
+    jumpForces_.Push(0.0f);
+    bunnyHopBoosts_.Push(1.0f);
+    jumps_.Push(false);
+    isOnGround_.Push(false);
+    accelerations_.Push(Vector3::ZERO);
+    gravity_.Push(Vector3::ZERO);
+    rotations_.Push(Quaternion::IDENTITY);
+    downVelocities_.Push(0.0f);
+    gravityHints_.Push(M_MAX_UNSIGNED);
+    linearVelocities_.Push(Vector3::ZERO);
+    localVelocities_.Push(Vector3::ZERO);
+}
+
+// ----------------------------------------------------------------------------
+template <class T>
+static void EraseSwapEntry(PODVector<T>& array, unsigned index)
+{
+    array[index] = array.Back();
+    array.Pop();
+}
+
+void MovementStates::EraseSwap(unsigned index)
+{
+    EraseSwapEntry(positions_, index);
+    EraseSwapEntry(bodyVelocities_, index);
+    EraseSwapEntry(targetAccelerations_, index);
+    EraseSwapEntry(jounceSpeeds_, index);
+    EraseSwapEntry(accelerateSpeeds_, index);
+    EraseSwapEntry(jumpForces_, index);
+    EraseSwapEntry(bunnyHopBoosts_, index);
+    EraseSwapEntry(jumps_, index);
+    EraseSwapEntry(isOnGround_, index);
+    EraseSwapEntry(accelerations_, index);
+    EraseSwapEntry(gravity_, index);
+    EraseSwapEntry(rotations_, index);
+    EraseSwapEntry(downVelocities_, index);
+    EraseSwapEntry(gravityHints_, index);
+    EraseSwapEntry(linearVelocities_, index);
+    EraseSwapEntry(localVelocities_, index);
+}
+
+// ----------------------------------------------------------------------------
+void MovementSnapshot::Write(Serializer& dest) const
+{
+    dest.WriteVector3(position_);
+    dest.WriteVector3(velocity_);
+    dest.WriteVector3(acceleration_);
+    dest.WriteVector3(gravity_);
+    dest.WriteQuaternion(rotation_);
+    dest.WriteFloat(downVelocity_);
+    dest.WriteBool(isOnGround_);
+    dest.WriteBool(isCrouching_);
+}
+
+// ----------------------------------------------------------------------------
+bool MovementSnapshot::Read(Deserializer& source)
+{
+    if(source.IsEof())
+        return false;
+
+    position_     = source.ReadVector3();
+    velocity_     = source.ReadVector3();
+    acceleration_ = source.ReadVector3();
+    gravity_      = source.ReadVector3();
+    rotation_     = source.ReadQuaternion();
+    downVelocity_ = source.ReadFloat();
+    isOnGround_   = source.ReadBool();
+    isCrouching_  = source.ReadBool();
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+MovementSystem::MovementSystem(Context* context) :
+    Component(context),
+    currentStage_(NULL),
+    timeStep_(0.0f),
+    timeSinceTick_(0.0f),
+    isStepping_(false)
+{
+    time_ = GetSubsystem<Time>();
+}
+
+// ----------------------------------------------------------------------------
+MovementSystem::~MovementSystem()
+{
+}
+
+// ----------------------------------------------------------------------------
+void MovementSystem::RegisterObject(Context* context)
+{
+    context->RegisterFactory<MovementSystem>(ICEWEASEL_CATEGORY);
+}
+
+// ----------------------------------------------------------------------------
+void MovementSystem::AddMovementController(MovementController* controller)
+{
+    assert(isStepping_ == false);
+
+    unsigned index = controller->GetMovementSystemIndex();
+    if(index < controllers_.Size() && controllers_[index] == controller)
+        return;
+
+    controller->SetMovementSystemIndex(controllers_.Size());
+    controllers_.Push(controller);
+    states_.Push();
+}
+
+// ----------------------------------------------------------------------------
+void MovementSystem::RemoveMovementController(MovementController* controller)
+{
+    assert(isStepping_ == false);
+
+    unsigned index = controller->GetMovementSystemIndex();
+    if(index >= controllers_.Size() || controllers_[index] != controller)
+        return;
+
+    // Move the last controller into the freed slot
+    MovementController* last = controllers_.Back();
+    last->SetMovementSystemIndex(index);
+    controllers_[index] = last;
+    controllers_.Pop();
+    states_.EraseSwap(index);
+
+    controller->SetMovementSystemIndex(M_MAX_UNSIGNED);
+}
+
+// ----------------------------------------------------------------------------
+template <class T>
+static unsigned HashBytes(unsigned hash, const T& value)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+    for(unsigned i = 0; i != sizeof(T); ++i)
+        hash = SDBMHash(hash, bytes[i]);
+    return hash;
+}
+
+unsigned MovementSystem::GetStateHash() const
+{
+    // Bitwise, so even the smallest difference in floating point results
+    // shows up
+    unsigned hash = 0;
+    for(unsigned i = 0; i != controllers_.Size(); ++i)
+    {
+        MovementSnapshot snapshot = controllers_[i]->CaptureSnapshot();
+        hash = HashBytes(hash, snapshot.position_);
+        hash = HashBytes(hash, snapshot.velocity_);
+        hash = HashBytes(hash, snapshot.acceleration_);
+        hash = HashBytes(hash, snapshot.rotation_);
+        hash = HashBytes(hash, snapshot.downVelocity_);
+        hash = HashBytes(hash, snapshot.isOnGround_);
+        hash = HashBytes(hash, snapshot.isCrouching_);
+    }
+    return hash;
+}
+
+// ----------------------------------------------------------------------------
+void MovementSystem::IntegrateMovement(MovementStates* states, unsigned i, float timeStep)
+{
+    /*
+     * Some notes on the following code.
+     *  + Through experimenting I have found the best method of controlling a
+     *    physics body is to modify its current linear velocity. There are
+     *    other implementations that act on its acceleration instead, but those
+     *    seem to be less stable and harder to control.
+     *
+     *  + The directional input (e.g. WASD) is assumed to be jerk/jounce (i.e.
+     *    the fourth derivative of location). This is integrated once using a
+     *    negative exponential function to get acceleration, which in turn is
+     *    integrated a second time and added to the current linear velocity of
+     *    the physics body. The reasons for this double-integration approach
+     *    are:
+     *      - The X/Z rotation code for tilting the player in the direction of
+     *        acceleration is a lot smoother this way.
+     *      - It's a little more realistic.
+     */
+
+    // Approach acceleration smoothly using the input vector.
+    ExponentialCurve<Vector3> localPlaneAcceleration(states->accelerations_[i], states->targetAccelerations_[i]);
+    localPlaneAcceleration.Advance(timeStep * states->jounceSpeeds_[i]);
+    states->accelerations_[i] = localPlaneAcceleration.value_;
+
+    /*
+     * Calculate the rotation matrix that would transform our local coordinate
+     * system into the gravity's coordinate system (such that "down"
+     * correlates with the direction of gravity).
+     */
+    const Vector3& gravity = states->gravity_[i];
+    Quaternion gravityRotation(Vector3::DOWN, gravity);
+    Matrix3 velocityTransform = gravityRotation.RotationMatrix();
+
+    /*
+     * Transform the body's current velocity into our local coordinate system.
+     */
+    ExponentialCurve<Vector3> localPlaneVelocity(
+        velocityTransform.Inverse() * states->bodyVelocities_[i], Vector3::ZERO);
+
+    float& downVelocity = states->downVelocities_[i];
+    if(states->jumps_[i])
+    {
+        downVelocity = states->jumpForces_[i];
+        // Give the player a slight speed boost so he moves faster than usual
+        // in the air.
+        localPlaneVelocity.value_ *= states->bunnyHopBoosts_[i];
+    }
+
+    /*
+     * X/Z movement of the player is only possible when on the ground. If the
+     * player is in the air just maintain whatever velocity he currently has,
+     * but also add the target velocity on top of that so the player can
+     * slightly control his movement in the air.
+     */
+    localPlaneVelocity.SetTarget(localPlaneAcceleration.value_);
+    if(downVelocity == 0.0f)
+        localPlaneVelocity.Advance(timeStep * states->accelerateSpeeds_[i]);
+    else
+        localPlaneVelocity.Advance(timeStep);
+
+    states->localVelocities_[i] = Vector3(
+        localPlaneVelocity.value_.x_,
+        downVelocity,
+        localPlaneVelocity.value_.z_
+    );
+
+    // Integrate downwards velocity if in air. We don't integrate if on the
+    // ground so the player doesn't slide slowly.
+    if(states->isOnGround_[i] == false)
+        downVelocity -= gravity.Length() * timeStep;
+    states->linearVelocities_[i] = velocityTransform *
+            Vector3(
+                localPlaneVelocity.value_.x_,
+                downVelocity,
+                localPlaneVelocity.value_.z_
+            );
+
+    // Smoothly rotate to target orientation
+    static const float correctCameraAngleSpeed = 5.0f;
+    states->rotations_[i] = states->rotations_[i].Nlerp(gravityRotation, timeStep * correctCameraAngleSpeed, true);
+}
+
+// ----------------------------------------------------------------------------
+void MovementSystem::RunStage(Stage stage, unsigned count)
+{
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    unsigned itemCount = count / MIN_CHARACTERS_PER_WORK_ITEM;
+    if(queue)
+        itemCount = Min(itemCount, queue->GetNumThreads() + 1);
+    if(queue == NULL || itemCount <= 1)
+    {
+        (this->*stage)(0, count);
+        return;
+    }
+
+    // Work items only get pointers, so keep the bounds of each item alive
+    // until the stage completes
+    stageBounds_.Resize(itemCount + 1);
+    for(unsigned i = 0; i <= itemCount; ++i)
+        stageBounds_[i] = count * i / itemCount;
+
+    currentStage_ = stage;
+    for(unsigned i = 0; i != itemCount; ++i)
+    {
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = RunStageWork;
+        item->start_ = &stageBounds_[i];
+        item->end_ = &stageBounds_[i + 1];
+        item->aux_ = this;
+        queue->AddWorkItem(item);
+    }
+
+    // The main thread helps out until all items are done
+    queue->Complete(M_MAX_UNSIGNED);
+}
+
+// ----------------------------------------------------------------------------
+void MovementSystem::RunStageWork(const WorkItem* item, unsigned threadIndex)
+{
+    (void)threadIndex;
+
+    MovementSystem* system = static_cast<MovementSystem*>(item->aux_);
+    unsigned begin = *static_cast<const unsigned*>(item->start_);
+    unsigned end = *static_cast<const unsigned*>(item->end_);
+    (system->*(system->currentStage_))(begin, end);
+}
+
+// ----------------------------------------------------------------------------
+void MovementSystem::QueryGravityStage(unsigned begin, unsigned end)
+{
+    gravityManager_->QueryGravityConcurrent(&queryGravity_, queryPositions_, begin, end, &queryHints_);
+}
+
+// ----------------------------------------------------------------------------
+void MovementSystem::IntegrateMovementStage(unsigned begin, unsigned end)
+{
+    for(unsigned i = begin; i < end; ++i)
+        IntegrateMovement(&states_, i, timeStep_);
+}
+
+// ----------------------------------------------------------------------------
+GravityManager* MovementSystem::GetGravityManager()
+{
+    // The gravity manager may be loaded after this component
+    if(!gravityManager_ && GetScene())
+        gravityManager_ = GetScene()->GetComponent<GravityManager>(true);
+    return gravityManager_;
+}
+
+// ----------------------------------------------------------------------------
+CharacterProbeSystem* MovementSystem::GetProbeSystem()
+{
+    // Created by the first controller that starts
+    if(!probeSystem_ && GetScene())
+        probeSystem_ = GetScene()->GetComponent<CharacterProbeSystem>();
+    return probeSystem_;
+}
+
+// ----------------------------------------------------------------------------
+void MovementSystem::OnSceneSet(Scene* scene)
+{
+    gravityManager_.Reset();
+    probeSystem_.Reset();
+    UnsubscribeFromAllEvents();
+
+    if(scene == NULL)
+        return;
+
+    SubscribeToEvent(scene, E_SCENEUPDATE, URHO3D_HANDLER(MovementSystem, HandleSceneUpdate));
+    SubscribeToEvent(E_PHYSICSPRESTEP, URHO3D_HANDLER(MovementSystem, HandlePhysicsPreStep));
+    SubscribeToEvent(E_PHYSICSPOSTSTEP, URHO3D_HANDLER(MovementSystem, HandlePhysicsPostStep));
+    SubscribeToEvent(scene, E_SCENEPOSTUPDATE, URHO3D_HANDLER(MovementSystem, HandleScenePostUpdate));
+}
+
+// ----------------------------------------------------------------------------
+void MovementSystem::HandleSceneUpdate(StringHash eventType, VariantMap& eventData)
+{
+    using namespace SceneUpdate;
+    (void)eventType;
+
+    // The physics world steps after this event and consumes the time in
+    // fixed substeps, see HandlePhysicsPostStep()
+    timeSinceTick_ += eventData[P_TIMESTEP].GetFloat();
+}
+
+// ----------------------------------------------------------------------------
+void MovementSystem::HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData)
+{
+    using namespace PhysicsPreStep;
+    (void)eventType;
+
+    // Other scenes have their own physics world
+    PhysicsWorld* world = static_cast<PhysicsWorld*>(eventData[P_WORLD].GetPtr());
+    if(world == NULL || world->GetScene() != GetScene())
+        return;
+
+    stageTimes_ = StageTimes();
+    if(controllers_.Empty())
+        return;
+
+    timeStep_ = eventData[P_TIMESTEP].GetFloat();
+
+    // The frame's time was already added to timeSinceTick_, so this substep
+    // ends that long before the current elapsed time plus one step
+    float tickEndTime = time_->GetElapsedTime() - timeSinceTick_ + timeStep_;
+
+    // Gather input, contacts and probes
+    isStepping_ = true;
+    Clock::time_point start = Clock::now();
+    gravityQueries_.Clear();
+    for(unsigned i = 0; i < controllers_.Size(); ++i)
+        controllers_[i]->PrepareProbes(tickEndTime);
+    CharacterProbeSystem* probeSystem = GetProbeSystem();
+    if(probeSystem)
+        probeSystem->UpdateProbes();
+    for(unsigned i = 0; i < controllers_.Size(); ++i)
+        controllers_[i]->PrepareMovement(timeStep_);
+    Clock::time_point prepared = Clock::now();
+
+    // Query gravity of all characters that are due
+    GravityManager* gravityManager = GetGravityManager();
+    if(gravityManager && gravityQueries_.Size())
+    {
+        queryPositions_.Resize(gravityQueries_.Size());
+        queryHints_.Resize(gravityQueries_.Size());
+        for(unsigned i = 0; i != gravityQueries_.Size(); ++i)
+        {
+            queryPositions_[i] = states_.positions_[gravityQueries_[i]];
+            queryHints_[i] = states_.gravityHints_[gravityQueries_[i]];
+        }
+
+        // Recorded queries have to go through the serial path
+        if(gravityManager->IsRecording())
+            gravityManager->QueryGravity(&queryGravity_, queryPositions_, &queryHints_);
+        else
+        {
+            gravityManager->PrepareConcurrentQuery();
+            queryGravity_.Resize(queryPositions_.Size());
+            RunStage(&MovementSystem::QueryGravityStage, queryPositions_.Size());
+        }
+
+        for(unsigned i = 0; i != gravityQueries_.Size(); ++i)
+        {
+            states_.gravity_[gravityQueries_[i]] = queryGravity_[i];
+            states_.gravityHints_[gravityQueries_[i]] = queryHints_[i];
+        }
+    }
+
+    Clock::time_point queried = Clock::now();
+
+    RunStage(&MovementSystem::IntegrateMovementStage, states_.Size());
+    Clock::time_point integrated = Clock::now();
+
+    // Apply in slot order, independent of how the work was split
+    for(unsigned i = 0; i < controllers_.Size(); ++i)
+        controllers_[i]->ApplyMovement();
+    Clock::time_point applied = Clock::now();
+    isStepping_ = false;
+
+    stageTimes_.prepare_   = std::chrono::duration_cast<std::chrono::nanoseconds>(prepared - start).count();
+    stageTimes_.gravity_   = std::chrono::duration_cast<std::chrono::nanoseconds>(queried - prepared).count();
+    stageTimes_.integrate_ = std::chrono::duration_cast<std::chrono::nanoseconds>(integrated - queried).count();
+    stageTimes_.apply_     = std::chrono::duration_cast<std::chrono::nanoseconds>(applied - integrated).count();
+}
+
+// ----------------------------------------------------------------------------
+void MovementSystem::HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData)
+{
+    using namespace PhysicsPostStep;
+    (void)eventType;
+
+    PhysicsWorld* world = static_cast<PhysicsWorld*>(eventData[P_WORLD].GetPtr());
+    if(world == NULL || world->GetScene() != GetScene())
+        return;
+
+    timeStep_ = eventData[P_TIMESTEP].GetFloat();
+    timeSinceTick_ -= timeStep_;
+
+    for(unsigned i = 0; i < controllers_.Size(); ++i)
+        controllers_[i]->RecordPhysicsTransform();
+}
+
+// ----------------------------------------------------------------------------
+void MovementSystem::HandleScenePostUpdate(StringHash eventType, VariantMap& eventData)
+{
+    (void)eventType;
+    (void)eventData;
+
+    if(timeStep_ <= 0.0f)
+        return;
+
+    // Whatever is left over wasn't simulated yet. If the physics world
+    // dropped time because it fell behind, don't let it pile up.
+    timeSinceTick_ = Clamp(timeSinceTick_, 0.0f, timeStep_);
+    float alpha = timeSinceTick_ / timeStep_;
+
+    for(unsigned i = 0; i < controllers_.Size(); ++i)
+        controllers_[i]->InterpolateVisual(alpha);
+}
@@ -22,16 +22,18 @@
 using namespace Urho3D;
 
 // ----------------------------------------------------------------------------
-PlayerAnimationStatesController::PlayerAnimationStatesController(Context* context) :
+PlayerAnimationStatesController::PlayerAnimationStatesController(Context* context, CharacterState* state) :
     LogicComponent(context),
     state_(ON_GROUND),
-    isCrouching_(false)
+    characterState_(state ? state : new CharacterState)
 {
 }
 
 // ----------------------------------------------------------------------------
 void PlayerAnimationStatesController::Start()
 {
+    parameters_ = GetSubsystem<IceWeaselConfig>()->GetPlayerClassParameters(0);
+
     AnimatedModel* aniModel = node_->GetComponent<AnimatedModel>();
     if(!aniModel)
         return;
@@ -56,17 +58,19 @@ void PlayerAnimationStatesController::Start()
     if(animation_[PlayerAnimation::JUMP_LAND])
         animation_[PlayerAnimation::JUMP_LAND]->SetLooped(false);
 
-    // Used to control transitions between idle/walk/run/hop animations
-    SubscribeToEvent(E_LOCALMOVEMENTVELOCITYCHANGED, URHO3D_HANDLER(PlayerAnimationStatesController, HandleLocalMovementVelocityChanged));
-    SubscribeToEvent(E_CROUCHSTATECHANGED, URHO3D_HANDLER(PlayerAnimationStatesController, HandleCrouchStateChanged));
+    SubscribeToEvent(E_CONFIGRELOADED, URHO3D_HANDLER(PlayerAnimationStatesController, HandleConfigReloaded));
 }
 
 // ----------------------------------------------------------------------------
 void PlayerAnimationStatesController::Update(float timeStep)
 {
-    const IceWeaselConfig::Data& config = GetSubsystem<IceWeaselConfig>()->GetConfig();
+    const IceWeaselConfig::Data::PlayerClass& playerClass = parameters_->playerClass;
+
+    // Used to control transitions between idle/walk/run/hop animations
+    const Vector3& currentLocalVelocity = characterState_->localVelocity_;
+    bool isCrouching = characterState_->isCrouching_;
 
-    float velocitySquared = Vector2(currentLocalVelocity_.x_, currentLocalVelocity_.z_).LengthSquared();
+    float velocitySquared = Vector2(currentLocalVelocity.x_, currentLocalVelocity.z_).LengthSquared();
 
     /*
      * Reset all of the animation weights every time we update, so we don't
@@ -80,17 +84,17 @@ void PlayerAnimationStatesController::Update(float timeStep)
         case ON_GROUND:
             HandleGroundWeights(velocitySquared);
 
-            if(currentLocalVelocity_.y_ > 0.0f)
+            if(currentLocalVelocity.y_ > 0.0f)
             {
                 state_ = JUMP_BEGIN;
                 LOG_SCROLL("JUMP_BEGIN");
             }
-            if(currentLocalVelocity_.y_ < 0.0f)
+            if(currentLocalVelocity.y_ < 0.0f)
             {
                 state_ = JUMP_FALL;
                 LOG_SCROLL("JUMP_FALL");
             }
-            if(isCrouching_)
+            if(isCrouching)
             {
                 state_ = CROUCHING;
                 LOG_SCROLL("CROUCHING");
@@ -101,17 +105,17 @@ void PlayerAnimationStatesController::Update(float timeStep)
         case CROUCHING:
             HandleCrouchWeights(velocitySquared);
 
-            if(currentLocalVelocity_.y_ > 0.0f)
+            if(currentLocalVelocity.y_ > 0.0f)
             {
                 state_ = JUMP_BEGIN;
                 LOG_SCROLL("JUMP_BEGIN");
             }
-            if(currentLocalVelocity_.y_ < 0.0f)
+            if(currentLocalVelocity.y_ < 0.0f)
             {
                 state_ = JUMP_FALL;
                 LOG_SCROLL("JUMP_FALL");
             }
-            if(!isCrouching_)
+            if(!isCrouching)
             {
                 state_ = ON_GROUND;
                 LOG_SCROLL("ON_GROUND");
@@ -131,7 +135,7 @@ void PlayerAnimationStatesController::Update(float timeStep)
         case JUMP_OFF:
             animationWeight_[PlayerAnimation::JUMP_OFF].SetTarget(1);
 
-            if(currentLocalVelocity_.y_ <= 0.0f) // now falling
+            if(currentLocalVelocity.y_ <= 0.0f) // now falling
             {
                 state_ = JUMP_FALL;
                 LOG_SCROLL("JUMP_FALL");
@@ -147,7 +151,7 @@ void PlayerAnimationStatesController::Update(float timeStep)
             if(animation_[PlayerAnimation::JUMP_LAND])
                     animation_[PlayerAnimation::JUMP_LAND]->SetTime(0);
 
-            if(currentLocalVelocity_.y_ == 0.0f) // landed
+            if(currentLocalVelocity.y_ == 0.0f) // landed
             {
                 state_ = JUMP_LAND;
                 LOG_SCROLL("JUMP_LAND");
@@ -161,7 +165,7 @@ void PlayerAnimationStatesController::Update(float timeStep)
             if(animation_[PlayerAnimation::JUMP_LAND] == NULL ||
                 animation_[PlayerAnimation::JUMP_LAND]->GetTime() >= animation_[PlayerAnimation::JUMP_LAND]->GetLength())
             {
-                if(isCrouching_)
+                if(isCrouching)
                 {
                     state_ = CROUCHING;
                     LOG_SCROLL("CROUCHING");
@@ -182,19 +186,19 @@ void PlayerAnimationStatesController::Update(float timeStep)
     for(unsigned i = 0; i != PlayerAnimation::NUM_ANIMATIONS; ++i)
         if(animation_[i])
         {
-            animationWeight_[i].Advance(timeStep * config.playerClass(0).animations[i].transitionSpeed);
+            animationWeight_[i].Advance(timeStep * playerClass.animations[i].transitionSpeed);
             animation_[i]->SetWeight(animationWeight_[i].value_);
-            animation_[i]->AddTime(timeStep * config.playerClass(0).animations[i].speed);
+            animation_[i]->AddTime(timeStep * playerClass.animations[i].speed);
         }
 }
 
 // ----------------------------------------------------------------------------
 void PlayerAnimationStatesController::HandleGroundWeights(float velocitySquared)
 {
-    const IceWeaselConfig::Data& config = GetSubsystem<IceWeaselConfig>()->GetConfig();
-    float walkFastSpeedSquared = config.playerClass(0).speed.walk * config.playerClass(0).speed.walk;
-    float walkSlowSpeedSquared = config.playerClass(0).speed.walk / 4; // half the speed of fast
-    float runSpeedSquared = config.playerClass(0).speed.run * config.playerClass(0).speed.run;
+    const IceWeaselConfig::Data::PlayerClass& playerClass = parameters_->playerClass;
+    float walkFastSpeedSquared = playerClass.speed.walk * playerClass.speed.walk;
+    float walkSlowSpeedSquared = playerClass.speed.walk / 4; // half the speed of fast
+    float runSpeedSquared = playerClass.speed.run * playerClass.speed.run;
 
 
     animationWeight_[PlayerAnimation::IDLE].SetTarget(1);
@@ -224,8 +228,8 @@ void PlayerAnimationStatesController::HandleGroundWeights(float velocitySquared)
 // ----------------------------------------------------------------------------
 void PlayerAnimationStatesController::HandleCrouchWeights(float velocitySquared)
 {
-    const IceWeaselConfig::Data& config = GetSubsystem<IceWeaselConfig>()->GetConfig();
-    float crouchSpeedSquared = config.playerClass(0).speed.crouch * config.playerClass(0).speed.crouch;
+    const IceWeaselConfig::Data::PlayerClass& playerClass = parameters_->playerClass;
+    float crouchSpeedSquared = playerClass.speed.crouch * playerClass.speed.crouch;
 
     /*
      * Because crouch-walking is ordered after normal crouching, it has
@@ -237,15 +241,10 @@ void PlayerAnimationStatesController::HandleCrouchWeights(float velocitySquared)
 }
 
 // ----------------------------------------------------------------------------
-void PlayerAnimationStatesController::HandleLocalMovementVelocityChanged(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData)
+void PlayerAnimationStatesController::HandleConfigReloaded(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData)
 {
-    using namespace LocalMovementVelocityChanged;
-    currentLocalVelocity_ = eventData[P_LOCALMOVEMENTVELOCITY].GetVector3();
-}
+    (void)eventType;
+    (void)eventData;
 
-// ----------------------------------------------------------------------------
-void PlayerAnimationStatesController::HandleCrouchStateChanged(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData)
-{
-    using namespace CrouchStateChanged;
-    isCrouching_ = eventData[P_CROUCHING].GetBool();
+    parameters_ = GetSubsystem<IceWeaselConfig>()->GetPlayerClassParameters(0);
 }
@@ -26,6 +26,7 @@ PlayerController::PlayerController(Context* context, Node* moveNode, Node* offse
     moveNode_(moveNode),
     offsetNode_(offsetNode),
     rotateNode_(rotateNode),
+    state_(new CharacterState),
     currentYAngle_(0.0f),
     storeViewMask_(0)
 {
@@ -71,10 +72,21 @@ void PlayerController::SetPlayerVisible(bool visible)
 // ----------------------------------------------------------------------------
 void PlayerController::Start()
 {
+    parameters_ = GetSubsystem<IceWeaselConfig>()->GetPlayerClassParameters(0);
+
+    /*
+     * The move node follows the physics body. Everything that is drawn
+     * (camera included) hangs off a node in between, which smooths out the
+     * movement between physics ticks. See MovementController::InterpolateVisual().
+     */
+    visualNode_ = moveNode_->CreateChild("Player Visual", LOCAL);
+    offsetNode_->SetParent(visualNode_);
+
     CreateComponents();
+    moveNode_->GetComponent<MovementController>()->SetVisualNode(visualNode_);
 
     // Needs to always exist
-    modelNode_ = moveNode_->CreateChild("Player", LOCAL);
+    modelNode_ = visualNode_->CreateChild("Player", LOCAL);
 
     /*
      * The player is created in the editor and saved (with animation states)
@@ -91,9 +103,9 @@ void PlayerController::Start()
 
     // Let the animation controller component set the different animation state
     // weights
-    modelNode_->AddComponent(new PlayerAnimationStatesController(context_), 0, LOCAL);
+    modelNode_->AddComponent(new PlayerAnimationStatesController(context_, state_), 0, LOCAL);
 
-    SubscribeToEvent(E_LOCALMOVEMENTVELOCITYCHANGED, URHO3D_HANDLER(PlayerController, HandleLocalMovementVelocityChanged));
+    SubscribeToEvent(E_CONFIGRELOADED, URHO3D_HANDLER(PlayerController, HandleConfigReloaded));
 }
 
 // ----------------------------------------------------------------------------
@@ -102,13 +114,18 @@ void PlayerController::Stop()
     modelNode_->Remove();
 
     DestroyComponents();
+
+    offsetNode_->SetParent(moveNode_);
+    visualNode_->Remove();
 }
 
 // ----------------------------------------------------------------------------
 void PlayerController::CreateComponents()
 {
     // Add the movement controller to the movement node
-    moveNode_->AddComponent(new MovementController(context_, moveNode_, offsetNode_), 0, LOCAL);
+    MovementController* controller = new MovementController(context_, moveNode_, offsetNode_, state_);
+    controller->SetIsObserver(true);
+    moveNode_->AddComponent(controller, 0, LOCAL);
 
     // The mouse controls the angle of camera node
     offsetNode_->AddComponent(new CameraControllerRotation(context_), 0, LOCAL);
@@ -129,7 +146,7 @@ void PlayerController::DestroyComponents()
 // ----------------------------------------------------------------------------
 void PlayerController::Update(float timeStep)
 {
-    const IceWeaselConfig::Data& config = GetSubsystem<IceWeaselConfig>()->GetConfig();
+    const IceWeaselConfig::PlayerClassParameters& config = *parameters_;
 
     // Control camera offset
     rotateNode_->SetPosition(Vector3(0, 0, cameraOffset_.Advance(timeStep * config.camera.transition.speed)));
@@ -145,29 +162,33 @@ void PlayerController::Update(float timeStep)
         rotateNode_->GetComponent<Finger>()->SetVisible(false);
     }
 
+    const Vector3& currentLocalVelocity = state_->localVelocity_;
+
     // X and Z rotate model depending on acceleration
     acceleration_.SetTarget((
             Vector2(oldLocalVelocity_.x_, oldLocalVelocity_.z_) -
-            Vector2(currentLocalVelocity_.x_, currentLocalVelocity_.z_)
-        ) / Max(M_EPSILON, timeStep) * config.playerClass(0).lean.amount);
-    acceleration_.Advance(timeStep * config.playerClass(0).lean.speed);
+            Vector2(currentLocalVelocity.x_, currentLocalVelocity.z_)
+        ) / Max(M_EPSILON, timeStep) * config.playerClass.lean.amount);
+    acceleration_.Advance(timeStep * config.playerClass.lean.speed);
 
     Quaternion targetRotation = Quaternion(acceleration_.value_.x_, Vector3::FORWARD);
     targetRotation = targetRotation * Quaternion(acceleration_.value_.y_, Vector3::LEFT);
 
     // Y rotate model in local space towards the direction it is moving
-    if(Abs(currentLocalVelocity_.x_) + Abs(currentLocalVelocity_.z_) > M_EPSILON*100)
-        currentYAngle_ = Atan2(currentLocalVelocity_.x_, currentLocalVelocity_.z_);
+    if(Abs(currentLocalVelocity.x_) + Abs(currentLocalVelocity.z_) > M_EPSILON*100)
+        currentYAngle_ = Atan2(currentLocalVelocity.x_, currentLocalVelocity.z_);
     targetRotation = targetRotation * Quaternion(currentYAngle_, Vector3::UP);
 
-    modelNode_->SetRotation(modelNode_->GetRotation().Nlerp(targetRotation, Min(1.0f, config.playerClass(0).turn.speed * timeStep), true));
+    modelNode_->SetRotation(modelNode_->GetRotation().Nlerp(targetRotation, Min(1.0f, config.playerClass.turn.speed * timeStep), true));
 
-    oldLocalVelocity_ = currentLocalVelocity_;
+    oldLocalVelocity_ = currentLocalVelocity;
 }
 
 // ----------------------------------------------------------------------------
-void PlayerController::HandleLocalMovementVelocityChanged(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData)
+void PlayerController::HandleConfigReloaded(Urho3D::StringHash eventType, Urho3D::VariantMap& eventData)
 {
-    using namespace LocalMovementVelocityChanged;
-    currentLocalVelocity_ = eventData[P_LOCALMOVEMENTVELOCITY].GetVector3();
+    (void)eventType;
+    (void)eventData;
+
+    parameters_ = GetSubsystem<IceWeaselConfig>()->GetPlayerClassParameters(0);
 }
@@ -0,0 +1,210 @@
+#include "iceweasel/ProjectileSystem.h"
+#include "iceweasel/ProjectileSystemEvents.h"
+#include "iceweasel/GravityManager.h"
+#include "iceweasel/IceWeasel.h"
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/DebugRenderer.h>
+#include <Urho3D/Math/Ray.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Node.h>
+#include <Urho3D/Scene/Scene.h>
+
+using namespace Urho3D;
+
+// ----------------------------------------------------------------------------
+ProjectileSystem::ProjectileSystem(Context* context) :
+    Component(context),
+    capacity_(4096),
+    collisionMask_(M_MAX_UNSIGNED)
+{
+}
+
+// ----------------------------------------------------------------------------
+ProjectileSystem::~ProjectileSystem()
+{
+}
+
+// ----------------------------------------------------------------------------
+void ProjectileSystem::RegisterObject(Context* context)
+{
+    context->RegisterFactory<ProjectileSystem>(ICEWEASEL_CATEGORY);
+
+    URHO3D_ACCESSOR_ATTRIBUTE("Capacity", GetCapacity, SetCapacity, unsigned, 4096, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Collision Mask", GetCollisionMask, SetCollisionMask, unsigned, M_MAX_UNSIGNED, AM_DEFAULT);
+}
+
+// ----------------------------------------------------------------------------
+bool ProjectileSystem::Fire(const Vector3& position, const Vector3& velocity, float lifetime)
+{
+    if(positions_.Size() >= capacity_ || lifetime <= 0.0f)
+        return false;
+
+    positions_.Push(position);
+    velocities_.Push(velocity);
+    lifetimes_.Push(lifetime);
+    gravityHints_.Push(M_MAX_UNSIGNED);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+void ProjectileSystem::Clear()
+{
+    positions_.Clear();
+    velocities_.Clear();
+    lifetimes_.Clear();
+    gravityHints_.Clear();
+}
+
+// ----------------------------------------------------------------------------
+void ProjectileSystem::SetCapacity(unsigned capacity)
+{
+    capacity_ = capacity;
+    if(positions_.Size() > capacity_)
+    {
+        positions_.Resize(capacity_);
+        velocities_.Resize(capacity_);
+        lifetimes_.Resize(capacity_);
+        gravityHints_.Resize(capacity_);
+    }
+
+    // Allocate the whole pool up front so firing never allocates
+    positions_.Reserve(capacity_);
+    velocities_.Reserve(capacity_);
+    lifetimes_.Reserve(capacity_);
+    gravityHints_.Reserve(capacity_);
+    gravity_.Reserve(capacity_);
+    previousPositions_.Reserve(capacity_);
+}
+
+// ----------------------------------------------------------------------------
+void ProjectileSystem::EraseSwap(unsigned index)
+{
+    positions_[index] = positions_.Back();
+    velocities_[index] = velocities_.Back();
+    lifetimes_[index] = lifetimes_.Back();
+    gravityHints_[index] = gravityHints_.Back();
+    positions_.Pop();
+    velocities_.Pop();
+    lifetimes_.Pop();
+    gravityHints_.Pop();
+}
+
+// ----------------------------------------------------------------------------
+GravityManager* ProjectileSystem::GetGravityManager()
+{
+    // The gravity manager may be loaded after this component
+    if(!gravityManager_ && GetScene())
+        gravityManager_ = GetScene()->GetComponent<GravityManager>(true);
+    return gravityManager_;
+}
+
+// ----------------------------------------------------------------------------
+void ProjectileSystem::DrawDebugGeometry(DebugRenderer* debug, bool depthTest)
+{
+    // Draw the distance each projectile travels in 1/60 of a second
+    for(unsigned i = 0; i != positions_.Size(); ++i)
+        debug->AddLine(positions_[i], positions_[i] - velocities_[i] * (1.0f / 60.0f), Color::YELLOW, depthTest);
+}
+
+// ----------------------------------------------------------------------------
+void ProjectileSystem::OnSceneSet(Scene* scene)
+{
+    Clear();
+    gravityManager_.Reset();
+
+    if(scene == NULL)
+    {
+        UnsubscribeFromEvent(E_PHYSICSPRESTEP);
+        return;
+    }
+
+    SubscribeToEvent(E_PHYSICSPRESTEP, URHO3D_HANDLER(ProjectileSystem, HandlePhysicsPreStep));
+    SetCapacity(capacity_);
+}
+
+// ----------------------------------------------------------------------------
+void ProjectileSystem::HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData)
+{
+    using namespace PhysicsPreStep;
+    (void)eventType;
+
+    // Other scenes have their own physics world
+    PhysicsWorld* world = static_cast<PhysicsWorld*>(eventData[P_WORLD].GetPtr());
+    if(world == NULL || world->GetScene() != GetScene())
+        return;
+
+    if(positions_.Empty())
+        return;
+
+    float timeStep = eventData[P_TIMESTEP].GetFloat();
+
+    // Look up the gravity of all projectiles at once
+    GravityManager* gravityManager = GetGravityManager();
+    if(gravityManager)
+        gravityManager->QueryGravity(&gravity_, positions_, &gravityHints_);
+    else
+    {
+        gravity_.Resize(positions_.Size());
+        for(PODVector<Vector3>::Iterator it = gravity_.Begin(); it != gravity_.End(); ++it)
+            *it = world->GetGravity();
+    }
+
+    // Integrate all projectiles before doing any raycasts, so the loop over
+    // the arrays stays tight
+    previousPositions_ = positions_;
+    for(unsigned i = 0; i != positions_.Size(); ++i)
+    {
+        velocities_[i] += gravity_[i] * timeStep;
+        positions_[i] += velocities_[i] * timeStep;
+        lifetimes_[i] -= timeStep;
+    }
+
+    // Raycast the segment each projectile travelled during this substep.
+    // Hits are collected first and the events are sent afterwards, because
+    // handlers may fire new projectiles.
+    hitPositions_.Clear();
+    hitNormals_.Clear();
+    hitVelocities_.Clear();
+    hitNodes_.Clear();
+    for(unsigned i = 0; i < positions_.Size(); )
+    {
+        Vector3 segment = positions_[i] - previousPositions_[i];
+        float length = segment.Length();
+
+        PhysicsRaycastResult result;
+        if(length > M_EPSILON)
+            world->RaycastSingle(result, Ray(previousPositions_[i], segment / length), length, collisionMask_);
+
+        if(result.body_)
+        {
+            hitPositions_.Push(result.position_);
+            hitNormals_.Push(result.normal_);
+            hitVelocities_.Push(velocities_[i]);
+            hitNodes_.Push(WeakPtr<Node>(result.body_->GetNode()));
+        }
+        else if(lifetimes_[i] > 0.0f)
+        {
+            ++i;
+            continue;
+        }
+
+        // previousPositions_ has to stay in sync with the other arrays
+        previousPositions_[i] = previousPositions_.Back();
+        previousPositions_.Pop();
+        EraseSwap(i);
+    }
+
+    for(unsigned i = 0; i != hitPositions_.Size(); ++i)
+    {
+        using namespace ProjectileHit;
+        VariantMap& hitData = GetEventDataMap();
+        hitData[P_POSITION] = hitPositions_[i];
+        hitData[P_NORMAL] = hitNormals_[i];
+        hitData[P_VELOCITY] = hitVelocities_[i];
+        hitData[P_NODE] = hitNodes_[i].Get();
+        SendEvent(E_PROJECTILEHIT, hitData);
+    }
+}
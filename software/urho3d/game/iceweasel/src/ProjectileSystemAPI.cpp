@@ -0,0 +1,140 @@
+#include "iceweasel/ProjectileSystemAPI.h"
+#include "iceweasel/ProjectileSystem.h"
+
+#include <Urho3D/AngelScript/APITemplates.h>
+#include <Urho3D/AngelScript/Script.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/LuaScript/LuaScript.h>
+
+#include <toluapp/tolua++.h>
+
+using namespace Urho3D;
+
+// ----------------------------------------------------------------------------
+static void RegisterAngelScriptAPI(asIScriptEngine* engine)
+{
+    RegisterComponent<ProjectileSystem>(engine, "ProjectileSystem");
+    engine->RegisterObjectMethod("ProjectileSystem", "bool Fire(const Vector3&in, const Vector3&in, float)", asMETHOD(ProjectileSystem, Fire), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ProjectileSystem", "void Clear()", asMETHOD(ProjectileSystem, Clear), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ProjectileSystem", "void set_capacity(uint)", asMETHOD(ProjectileSystem, SetCapacity), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ProjectileSystem", "uint get_capacity() const", asMETHOD(ProjectileSystem, GetCapacity), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ProjectileSystem", "uint get_count() const", asMETHOD(ProjectileSystem, GetCount), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ProjectileSystem", "void set_collisionMask(uint)", asMETHOD(ProjectileSystem, SetCollisionMask), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ProjectileSystem", "uint get_collisionMask() const", asMETHOD(ProjectileSystem, GetCollisionMask), asCALL_THISCALL);
+}
+
+// ----------------------------------------------------------------------------
+/*
+ * The Lua functions below follow the code tolua++ generates for the engine's
+ * own classes.
+ */
+static int tolua_ProjectileSystem_Fire(lua_State* L)
+{
+    tolua_Error err;
+    if(!tolua_isusertype(L, 1, "ProjectileSystem", 0, &err) ||
+       !tolua_isusertype(L, 2, "const Vector3", 0, &err) ||
+       !tolua_isusertype(L, 3, "const Vector3", 0, &err) ||
+       !tolua_isnumber(L, 4, 0, &err) ||
+       !tolua_isnoobj(L, 5, &err))
+    {
+        tolua_error(L, "#ferror in function 'Fire'.", &err);
+        return 0;
+    }
+
+    ProjectileSystem* self = static_cast<ProjectileSystem*>(tolua_tousertype(L, 1, 0));
+    const Vector3* position = static_cast<const Vector3*>(tolua_tousertype(L, 2, 0));
+    const Vector3* velocity = static_cast<const Vector3*>(tolua_tousertype(L, 3, 0));
+    float lifetime = static_cast<float>(tolua_tonumber(L, 4, 0));
+    tolua_pushboolean(L, self->Fire(*position, *velocity, lifetime));
+    return 1;
+}
+
+// ----------------------------------------------------------------------------
+static int tolua_ProjectileSystem_Clear(lua_State* L)
+{
+    tolua_Error err;
+    if(!tolua_isusertype(L, 1, "ProjectileSystem", 0, &err) || !tolua_isnoobj(L, 2, &err))
+    {
+        tolua_error(L, "#ferror in function 'Clear'.", &err);
+        return 0;
+    }
+
+    static_cast<ProjectileSystem*>(tolua_tousertype(L, 1, 0))->Clear();
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int tolua_ProjectileSystem_GetCount(lua_State* L)
+{
+    tolua_Error err;
+    if(!tolua_isusertype(L, 1, "const ProjectileSystem", 0, &err) || !tolua_isnoobj(L, 2, &err))
+    {
+        tolua_error(L, "#ferror in function 'GetCount'.", &err);
+        return 0;
+    }
+
+    tolua_pushnumber(L, static_cast<lua_Number>(static_cast<const ProjectileSystem*>(tolua_tousertype(L, 1, 0))->GetCount()));
+    return 1;
+}
+
+// ----------------------------------------------------------------------------
+static int tolua_ProjectileSystem_SetCapacity(lua_State* L)
+{
+    tolua_Error err;
+    if(!tolua_isusertype(L, 1, "ProjectileSystem", 0, &err) ||
+       !tolua_isnumber(L, 2, 0, &err) ||
+       !tolua_isnoobj(L, 3, &err))
+    {
+        tolua_error(L, "#ferror in function 'SetCapacity'.", &err);
+        return 0;
+    }
+
+    static_cast<ProjectileSystem*>(tolua_tousertype(L, 1, 0))->SetCapacity(static_cast<unsigned>(tolua_tonumber(L, 2, 0)));
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int tolua_ProjectileSystem_GetCapacity(lua_State* L)
+{
+    tolua_Error err;
+    if(!tolua_isusertype(L, 1, "const ProjectileSystem", 0, &err) || !tolua_isnoobj(L, 2, &err))
+    {
+        tolua_error(L, "#ferror in function 'GetCapacity'.", &err);
+        return 0;
+    }
+
+    tolua_pushnumber(L, static_cast<lua_Number>(static_cast<const ProjectileSystem*>(tolua_tousertype(L, 1, 0))->GetCapacity()));
+    return 1;
+}
+
+// ----------------------------------------------------------------------------
+static void RegisterLuaAPI(lua_State* L)
+{
+    tolua_open(L);
+    tolua_usertype(L, "ProjectileSystem");
+    tolua_usertype(L, "const ProjectileSystem");
+
+    tolua_module(L, NULL, 0);
+    tolua_beginmodule(L, NULL);
+        tolua_cclass(L, "ProjectileSystem", "ProjectileSystem", "Component", NULL);
+        tolua_beginmodule(L, "ProjectileSystem");
+            tolua_function(L, "Fire", tolua_ProjectileSystem_Fire);
+            tolua_function(L, "Clear", tolua_ProjectileSystem_Clear);
+            tolua_function(L, "GetCount", tolua_ProjectileSystem_GetCount);
+            tolua_function(L, "SetCapacity", tolua_ProjectileSystem_SetCapacity);
+            tolua_function(L, "GetCapacity", tolua_ProjectileSystem_GetCapacity);
+        tolua_endmodule(L);
+    tolua_endmodule(L);
+}
+
+// ----------------------------------------------------------------------------
+void RegisterProjectileSystemAPI(Context* context)
+{
+    Script* script = context->GetSubsystem<Script>();
+    if(script)
+        RegisterAngelScriptAPI(script->GetScriptEngine());
+
+    LuaScript* luaScript = context->GetSubsystem<LuaScript>();
+    if(luaScript)
+        RegisterLuaAPI(luaScript->GetState());
+}
@@ -1,10 +1,12 @@
 #include "iceweasel/TetrahedralMeshBuilder.h"
 #include "iceweasel/TetrahedralMesh_Polyhedron.h"
-#include "iceweasel/Math.h"
-#include "iceweasel/GravityVector.h"
+#include "iceweasel/GeometricPredicates.h"
 
+#include <Urho3D/Graphics/DebugRenderer.h>
 #include <Urho3D/Math/BoundingBox.h>
 
+#include <cassert>
+
 using namespace Urho3D;
 using namespace TetrahedralMesh;
 
@@ -14,13 +16,18 @@ CircumscribedTetrahedron::CircumscribedTetrahedron(TetrahedralMesh::Vertex* v1,
                                                    TetrahedralMesh::Vertex* v3, TetrahedralMesh::Vertex* v4)
 {
     v_[0] = v1; v_[1] = v2; v_[2] = v3; v_[3] = v4;
-    circumscibedSphereCenter_ = Math::CircumscribeSphere(v1->position_,
-                                                         v2->position_,
-                                                         v3->position_,
-                                                         v4->position_);
+    neighbours_[0] = neighbours_[1] = neighbours_[2] = neighbours_[3] = NULL;
+
+    double orientation = GeometricPredicates::Orient3D(v1->position_, v2->position_, v3->position_, v4->position_);
+    orientation_ = orientation > 0.0 ? 1 : (orientation < 0.0 ? -1 : 0);
 }
 
 
+// Face i of a tetrahedron is made up of all vertices except vertex i
+static const unsigned faceVertices[4][3] = {
+    {1, 2, 3}, {0, 2, 3}, {0, 1, 3}, {0, 1, 2}
+};
+
 // ============================================================================
 struct Face
 {
@@ -53,42 +60,57 @@ struct Face
 
 // ============================================================================
 static SharedPtr<TetrahedralMeshBuilder::CircumscribedTetrahedron>
-ConstructSuperTetrahedron(const PODVector<GravityVector*>& gravityVectors)
+ConstructSuperTetrahedron(const PODVector<Vector3>& positions)
 {
     // Compute bounding box of all of the gravity vector components
     BoundingBox aabb;
-    for(PODVector<GravityVector*>::ConstIterator it = gravityVectors.Begin();
-        it != gravityVectors.End();
+    for(PODVector<Vector3>::ConstIterator it = positions.Begin();
+        it != positions.End();
         ++it)
     {
-        const Vector3& pos = (*it)->GetPosition();
-        if(aabb.min_.x_ > pos.x_) aabb.min_.x_ = pos.x_;
-        if(aabb.min_.y_ > pos.y_) aabb.min_.y_ = pos.y_;
-        if(aabb.min_.z_ > pos.z_) aabb.min_.z_ = pos.z_;
-        if(aabb.max_.x_ < pos.x_) aabb.max_.x_ = pos.x_;
-        if(aabb.max_.y_ < pos.y_) aabb.max_.y_ = pos.y_;
-        if(aabb.max_.z_ < pos.z_) aabb.max_.z_ = pos.z_;
+        aabb.Merge(*it);
     }
-
-    // Expand bounding box by factor 3 plus a small error margin
-    aabb.min_.x_ -= (aabb.max_.x_ - aabb.min_.x_) * 2.2f;
-    aabb.min_.y_ -= (aabb.max_.y_ - aabb.min_.y_) * 2.2f;
-    aabb.min_.z_ -= (aabb.max_.z_ - aabb.min_.z_) * 2.2f;
-    aabb.max_.x_ += Abs(aabb.max_.x_ * 0.1f);
-    aabb.max_.y_ += Abs(aabb.max_.y_ * 0.1f);
-    aabb.max_.z_ += Abs(aabb.max_.z_ * 0.1f);
-
-    // This tetrahedron should encompass all vertices in the list
+    if(positions.Empty())
+        aabb.Merge(Vector3::ZERO);
+
+    // Enclose the bounding box in a sphere. Flat or co-linear layouts would
+    // otherwise produce a degenerate super tetrahedron, so the sphere is
+    // given a minimum size. The sphere is then made much larger than
+    // required, which keeps the super tetrahedron's vertices from cutting
+    // off tetrahedrons near the hull of the final mesh.
+    Vector3 centre = aabb.Center();
+    float radius = Max(aabb.HalfSize().Length(), 1.0f) * 50.0f;
+
+    // This regular tetrahedron has an inscribed sphere of the above radius,
+    // so it encompasses all vertices in the list
+    float k = radius * 1.7320508f; // sqrt(3)
     return SharedPtr<TetrahedralMeshBuilder::CircumscribedTetrahedron>(new TetrahedralMeshBuilder::CircumscribedTetrahedron(
-        new Vertex(aabb.max_, Vector3::DOWN),
-        new Vertex(Vector3(aabb.min_.x_, aabb.max_.y_, aabb.max_.z_), Vector3::DOWN),
-        new Vertex(Vector3(aabb.max_.x_, aabb.min_.y_, aabb.max_.z_), Vector3::DOWN),
-        new Vertex(Vector3(aabb.max_.x_, aabb.max_.y_, aabb.min_.z_), Vector3::DOWN)
+        new Vertex(centre + Vector3( k,  k,  k), Vector3::DOWN),
+        new Vertex(centre + Vector3(-k, -k,  k), Vector3::DOWN),
+        new Vertex(centre + Vector3(-k,  k, -k), Vector3::DOWN),
+        new Vertex(centre + Vector3( k, -k, -k), Vector3::DOWN)
     ));
 }
 
 // ----------------------------------------------------------------------------
-void TetrahedralMeshBuilder::Build(const PODVector<GravityVector*>& gravityVectors)
+TetrahedralMeshBuilder::TetrahedralMeshBuilder() :
+    nextInsertion_(0),
+    isFinished_(false)
+{
+}
+
+// ----------------------------------------------------------------------------
+void TetrahedralMeshBuilder::Build(const GravityVectorSnapshot& gravityVectors,
+                                   const PODVector<bool>* excluded)
+{
+    Begin(gravityVectors, excluded);
+    Step(M_MAX_UNSIGNED);
+    Step(0);
+}
+
+// ----------------------------------------------------------------------------
+void TetrahedralMeshBuilder::Begin(const GravityVectorSnapshot& gravityVectors,
+                                   const PODVector<bool>* excluded)
 {
     /*
      * The Bowyer-Watson algorithm is used here to convert a set of 3D points
@@ -96,36 +118,95 @@ void TetrahedralMeshBuilder::Build(const PODVector<GravityVector*>& gravityVecto
      * https://en.wikipedia.org/wiki/Bowyer%E2%80%93Watson_algorithm
      */
 
+    gravityVectors_ = gravityVectors;
+    if(excluded)
+        excluded_ = *excluded;
+    else
+        excluded_.Clear();
     triangulationResult_.Clear();
+    vertices_.Clear();
     hull_ = new TetrahedralMesh::Polyhedron;
-
-    CircumscribedTetrahedralMesh badTetrahedrons;
-    TetrahedralMesh::Polyhedron polyhedron;
+    nextInsertion_ = 0;
+    skippedCount_ = 0;
+    isFinished_ = false;
 
     // Add super tetrahedron as the first tetrahedron to the list.
-    SharedPtr<CircumscribedTetrahedron> superTetrahedron = ConstructSuperTetrahedron(gravityVectors);
-    triangulationResult_.Push(superTetrahedron);
+    superTetrahedron_ = ConstructSuperTetrahedron(gravityVectors_.positions_);
+    triangulationResult_.Push(superTetrahedron_);
+}
+
+// ----------------------------------------------------------------------------
+bool TetrahedralMeshBuilder::Step(unsigned maxInsertions)
+{
+    if(isFinished_)
+        return true;
 
-    // Iterate over all gravity vectors, add each as a vertex to the mesh one by one
-    for(PODVector<GravityVector*>::ConstIterator gravityVectorsIt = gravityVectors.Begin();
-        gravityVectorsIt != gravityVectors.End();
-        ++gravityVectorsIt)
+    CircumscribedTetrahedralMesh badTetrahedrons;
+
+    // Add gravity vectors as vertices to the mesh one by one
+    if(nextInsertion_ < gravityVectors_.Size())
     {
-        GravityVector* gravityVector = *gravityVectorsIt;
+        for(; maxInsertions != 0 && nextInsertion_ != gravityVectors_.Size(); --maxInsertions, ++nextInsertion_)
+        {
+            // Create an internal Vertex object from the gravity vector
+            // snapshot. Excluded gravity vectors get one too, so the list
+            // stays in the same order as the snapshot.
+            SharedPtr<Vertex> vertex(new Vertex(
+                gravityVectors_.positions_[nextInsertion_],
+                gravityVectors_.directions_[nextInsertion_],
+                gravityVectors_.forceFactors_[nextInsertion_],
+                nextInsertion_
+            ));
+            vertices_.Push(vertex);
+
+            if(nextInsertion_ < excluded_.Size() && excluded_[nextInsertion_])
+                continue;
+
+            // A point on top of an existing vertex isn't inside of any
+            // circumsphere. Neither it nor a point ExpandCavity() gives up on
+            // can be connected without creating flat tetrahedrons, so they
+            // are left out of the mesh in the same way as excluded ones.
+            FindBadTetrahedrons(&badTetrahedrons, vertex->position_);
+            if(badTetrahedrons.Empty() || ExpandCavity(&badTetrahedrons, vertex->position_) == false)
+            {
+                ++skippedCount_;
+                continue;
+            }
+
+            RemoveTetrahedronsFromTriangulation(badTetrahedrons);
+            ReTriangulateGap(badTetrahedrons, vertex);
+        }
 
-        FindBadTetrahedrons(&badTetrahedrons, gravityVector->GetPosition());
-        CreateHullFromTetrahedrons(&polyhedron, badTetrahedrons);
-        RemoveTetrahedronsFromTriangulation(badTetrahedrons);
-        ReTriangulateGap(polyhedron, *gravityVector);
+        return false;
     }
 
-    CleanUp(superTetrahedron);
+    CleanUp(superTetrahedron_);
 
     // The mesh is built. We can extract the hull by marking all tetrahedrons
     // in the mesh as "bad" and running it through the face-face comparison
     // code. This will return a list of all triangles that don't touch each
     // other, i.e. the hull.
     CreateHullFromTetrahedrons(hull_, triangulationResult_);
+
+    isFinished_ = true;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+void TetrahedralMeshBuilder::DrawDebugGeometry(DebugRenderer* debug, bool depthTest) const
+{
+    for(CircumscribedTetrahedralMesh::ConstIterator it = triangulationResult_.Begin();
+        it != triangulationResult_.End();
+        ++it)
+    {
+        const CircumscribedTetrahedron* t = *it;
+        if(isFinished_ == false && IsConnectedToSuperTetrahedron(t))
+            continue;
+
+        for(unsigned i = 0; i != 4; ++i)
+            for(unsigned j = i + 1; j != 4; ++j)
+                debug->AddLine(t->v_[i]->position_, t->v_[j]->position_, Color::GRAY, depthTest);
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -141,6 +222,12 @@ TetrahedralMesh::Polyhedron* TetrahedralMeshBuilder::GetHullMesh() const
     return hull_;
 }
 
+// ----------------------------------------------------------------------------
+const Vector<SharedPtr<Vertex> >& TetrahedralMeshBuilder::GetVertices() const
+{
+    return vertices_;
+}
+
 // ----------------------------------------------------------------------------
 void TetrahedralMeshBuilder::FindBadTetrahedrons(
     CircumscribedTetrahedralMesh* badTetrahedrons,
@@ -148,28 +235,78 @@ void TetrahedralMeshBuilder::FindBadTetrahedrons(
 {
     badTetrahedrons->Clear();
 
-    // Iterate all tetrahedrons in current triangulation and calculate their
-    // circumsphere. If the vertex location (point) we are adding is within the
-    // sphere, then we add that tetrahedron to the bad list.
+    // Iterate all tetrahedrons in current triangulation and test if the
+    // vertex location (point) we are adding is within the circumsphere. If it
+    // is, then we add that tetrahedron to the bad list. InSphere() expects
+    // positively oriented tetrahedrons, so the result is corrected with the
+    // tetrahedron's orientation. Points exactly on the circumsphere don't
+    // count.
     for(CircumscribedTetrahedralMesh::ConstIterator pTetrahedron = triangulationResult_.Begin();
         pTetrahedron != triangulationResult_.End();
         ++pTetrahedron)
     {
         CircumscribedTetrahedron* tetrahedron = *pTetrahedron;
-        Vector3 circumsphereCenter = Math::CircumscribeSphere(
+        double inSphere = GeometricPredicates::InSphere(
             tetrahedron->v_[0]->position_,
             tetrahedron->v_[1]->position_,
             tetrahedron->v_[2]->position_,
-            tetrahedron->v_[3]->position_
+            tetrahedron->v_[3]->position_,
+            point
         );
 
-        // Test if point is inside circumcircle of tetrahedron. Add to bad list
-        float radiusSquared = (circumsphereCenter - tetrahedron->v_[0]->position_).LengthSquared();
-        if((point - circumsphereCenter).LengthSquared() < radiusSquared)
+        if(inSphere * tetrahedron->orientation_ > 0.0)
             badTetrahedrons->Push(SharedPtr<CircumscribedTetrahedron>(tetrahedron));
     }
 }
 
+// ----------------------------------------------------------------------------
+static bool CavityContains(const TetrahedralMeshBuilder::CircumscribedTetrahedralMesh& cavity,
+                           const TetrahedralMeshBuilder::CircumscribedTetrahedron* tetrahedron)
+{
+    for(unsigned i = 0; i != cavity.Size(); ++i)
+        if(cavity[i] == tetrahedron)
+            return true;
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+bool TetrahedralMeshBuilder::ExpandCavity(CircumscribedTetrahedralMesh* badTetrahedrons, Vector3 point) const
+{
+    // Tetrahedrons added to the cavity are appended and have their faces
+    // checked when the loop gets to them. Faces already checked can only
+    // become shared, never visible, so there is no need to start over.
+    for(unsigned t = 0; t != badTetrahedrons->Size(); ++t)
+    {
+        CircumscribedTetrahedron* tetrahedron = (*badTetrahedrons)[t];
+        for(unsigned f = 0; f != 4; ++f)
+        {
+            // Faces shared by two bad tetrahedrons are inside the cavity
+            CircumscribedTetrahedron* neighbour = tetrahedron->neighbours_[f];
+            if(neighbour != NULL && CavityContains(*badTetrahedrons, neighbour))
+                continue;
+
+            // The point must be strictly on the same side of the face as
+            // the rest of the tetrahedron
+            const Vertex* v0 = tetrahedron->v_[faceVertices[f][0]];
+            const Vertex* v1 = tetrahedron->v_[faceVertices[f][1]];
+            const Vertex* v2 = tetrahedron->v_[faceVertices[f][2]];
+            double opposite = GeometricPredicates::Orient3D(
+                v0->position_, v1->position_, v2->position_, tetrahedron->v_[f]->position_);
+            double side = GeometricPredicates::Orient3D(
+                v0->position_, v1->position_, v2->position_, point);
+            if(opposite * side > 0.0)
+                continue;
+
+            // Add the neighbour on the other side of the face
+            if(neighbour == NULL)
+                return false;
+            badTetrahedrons->Push(SharedPtr<CircumscribedTetrahedron>(neighbour));
+        }
+    }
+
+    return true;
+}
+
 // ----------------------------------------------------------------------------
 void TetrahedralMeshBuilder::CreateHullFromTetrahedrons(
     TetrahedralMesh::Polyhedron* polyhedron,
@@ -227,28 +364,84 @@ void TetrahedralMeshBuilder::RemoveTetrahedronsFromTriangulation(
 }
 
 // ----------------------------------------------------------------------------
-void TetrahedralMeshBuilder::ReTriangulateGap(const TetrahedralMesh::Polyhedron& polyhedron,
-                                          const GravityVector& gravityVector)
+static bool FaceHasEdge(const TetrahedralMeshBuilder::CircumscribedTetrahedron* tetrahedron, unsigned face,
+                        const Vertex* v0, const Vertex* v1)
 {
+    unsigned count = 0;
+    for(unsigned i = 0; i != 3; ++i)
+    {
+        const Vertex* v = tetrahedron->v_[faceVertices[face][i]];
+        if(v == v0 || v == v1)
+            ++count;
+    }
+    return count == 2;
+}
 
-    // Create an internal Vertex object from the gravity vector component.
-    SharedPtr<Vertex> connectToVertex(new Vertex(
-        gravityVector.GetPosition(),
-        gravityVector.GetDirection(),
-        gravityVector.GetForceFactor()
-    ));
+// ----------------------------------------------------------------------------
+void TetrahedralMeshBuilder::ReTriangulateGap(const CircumscribedTetrahedralMesh& cavity,
+                                              Vertex* connectToVertex)
+{
+    // Connect all faces on the boundary of the cavity to the new vertex to
+    // form new tetrahedrons. The new vertex is v_[0], so face 0 of each new
+    // tetrahedron is the boundary face and takes over its outside neighbour.
+    unsigned firstNew = triangulationResult_.Size();
+    for(CircumscribedTetrahedralMesh::ConstIterator it = cavity.Begin(); it != cavity.End(); ++it)
+    {
+        CircumscribedTetrahedron* bad = *it;
+        for(unsigned f = 0; f != 4; ++f)
+        {
+            CircumscribedTetrahedron* outside = bad->neighbours_[f];
+            if(outside != NULL && CavityContains(cavity, outside))
+                continue;
+
+            SharedPtr<CircumscribedTetrahedron> tetrahedron(new CircumscribedTetrahedron(
+                connectToVertex,
+                bad->v_[faceVertices[f][0]],
+                bad->v_[faceVertices[f][1]],
+                bad->v_[faceVertices[f][2]]
+            ));
+
+            // ExpandCavity() makes sure the new vertex can see every face, so
+            // this can't create a flat tetrahedron
+            assert(tetrahedron->orientation_ != 0);
+
+            tetrahedron->neighbours_[0] = outside;
+            if(outside != NULL)
+                for(unsigned i = 0; i != 4; ++i)
+                    if(outside->neighbours_[i] == bad)
+                        outside->neighbours_[i] = tetrahedron;
+
+            triangulationResult_.Push(tetrahedron);
+        }
+    }
 
-    // Connect all faces in the polyhedron to the new vertex to form new
-    // tetrahedrons.
-    TetrahedralMesh::Polyhedron::ConstIterator vertex = polyhedron.Begin();
-    while(vertex != polyhedron.End())
+    // The remaining faces of the new tetrahedrons connect the new vertex with
+    // an edge of the boundary. Each of these edges is shared by exactly two
+    // of the new tetrahedrons.
+    for(unsigned i = firstNew; i != triangulationResult_.Size(); ++i)
     {
-        Vertex* v1 = *vertex++;
-        Vertex* v2 = *vertex++;
-        Vertex* v3 = *vertex++;
-        triangulationResult_.Push(SharedPtr<CircumscribedTetrahedron>(
-            new CircumscribedTetrahedron(connectToVertex, v1, v2, v3)
-        ));
+        CircumscribedTetrahedron* t1 = triangulationResult_[i];
+        for(unsigned f1 = 1; f1 != 4; ++f1)
+        {
+            if(t1->neighbours_[f1] != NULL)
+                continue;
+
+            // Face f1 is made up of the new vertex and the two vertices of
+            // the boundary face other than v_[f1]
+            const Vertex* e0 = t1->v_[faceVertices[f1][1]];
+            const Vertex* e1 = t1->v_[faceVertices[f1][2]];
+            for(unsigned j = i + 1; j != triangulationResult_.Size() && t1->neighbours_[f1] == NULL; ++j)
+            {
+                CircumscribedTetrahedron* t2 = triangulationResult_[j];
+                for(unsigned f2 = 1; f2 != 4; ++f2)
+                    if(t2->neighbours_[f2] == NULL && FaceHasEdge(t2, f2, e0, e1))
+                    {
+                        t1->neighbours_[f1] = t2;
+                        t2->neighbours_[f2] = t1;
+                        break;
+                    }
+            }
+        }
     }
 }
 
@@ -264,6 +457,15 @@ void TetrahedralMeshBuilder::CleanUp(const CircumscribedTetrahedron* superTetrah
             for(int j = 0; j != 4; ++j)
                 if(t->v_[i] == superTetrahedron->v_[j])
                 {
+                    for(int k = 0; k != 4; ++k)
+                    {
+                        CircumscribedTetrahedron* neighbour = t->neighbours_[k];
+                        if(neighbour == NULL)
+                            continue;
+                        for(int l = 0; l != 4; ++l)
+                            if(neighbour->neighbours_[l] == t)
+                                neighbour->neighbours_[l] = NULL;
+                    }
                     tetrahedron = triangulationResult_.Erase(tetrahedron);
                     goto break_dont_increment_iterator;
                 }
@@ -272,3 +474,13 @@ void TetrahedralMeshBuilder::CleanUp(const CircumscribedTetrahedron* superTetrah
         break_dont_increment_iterator: continue;
     }
 }
+
+// ----------------------------------------------------------------------------
+bool TetrahedralMeshBuilder::IsConnectedToSuperTetrahedron(const CircumscribedTetrahedron* tetrahedron) const
+{
+    for(int i = 0; i != 4; ++i)
+        for(int j = 0; j != 4; ++j)
+            if(tetrahedron->v_[i] == superTetrahedron_->v_[j])
+                return true;
+    return false;
+}
@@ -0,0 +1,149 @@
+#include "iceweasel/TetrahedralMeshDecimator.h"
+#include "iceweasel/TetrahedralMeshBuilder.h"
+#include "iceweasel/TetrahedralMesh_Mesh.h"
+#include "iceweasel/TetrahedralMesh_Polyhedron.h"
+
+#include <Urho3D/Math/MathDefs.h>
+
+using namespace Urho3D;
+
+// Each pass rebuilds the full mesh, so keep the number of passes bounded
+static const unsigned MAX_PASSES = 8;
+
+// ----------------------------------------------------------------------------
+TetrahedralMeshDecimator::TetrahedralMeshDecimator() :
+    maxAngularError_(5.0f),
+    maxForceFactorError_(0.05f),
+    removedCount_(0),
+    tetrahedronCountBefore_(0),
+    tetrahedronCountAfter_(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+void TetrahedralMeshDecimator::Decimate(PODVector<bool>* excluded, const GravityVectorSnapshot& gravityVectors)
+{
+    unsigned count = gravityVectors.Size();
+    excluded->Resize(count);
+    PODVector<bool> locked(count);
+    for(unsigned i = 0; i != count; ++i)
+    {
+        (*excluded)[i] = false;
+        locked[i] = false;
+    }
+
+    for(unsigned pass = 0; ; ++pass)
+    {
+        TetrahedralMeshBuilder builder;
+        builder.Build(gravityVectors, excluded);
+        TetrahedralMesh::Mesh mesh(builder.GetTetrahedralMesh());
+
+        // Removing a gravity vector changes the predictions of gravity
+        // vectors removed in earlier passes. Put back any that are no longer
+        // within the error and rebuild.
+        bool restored = false;
+        for(unsigned i = 0; i != count; ++i)
+        {
+            if((*excluded)[i] == false)
+                continue;
+
+            Vector3 predicted;
+            if(mesh.Query(&predicted, gravityVectors.positions_[i]) &&
+               IsWithinError(predicted, gravityVectors.directions_[i], gravityVectors.forceFactors_[i]))
+                continue;
+
+            (*excluded)[i] = false;
+            locked[i] = true;
+            restored = true;
+        }
+        if(restored)
+            continue;
+
+        if(pass == 0)
+            tetrahedronCountBefore_ = mesh.GetTetrahedronCount();
+        tetrahedronCountAfter_ = mesh.GetTetrahedronCount();
+
+        if(pass >= MAX_PASSES)
+            break;
+
+        // Gravity vectors on the hull define the shape of the mesh
+        TetrahedralMesh::Polyhedron* hull = builder.GetHullMesh();
+        for(TetrahedralMesh::Polyhedron::ConstIterator it = hull->Begin(); it != hull->End(); ++it)
+            locked[(*it)->index_] = true;
+
+        // Find the neighbours of each gravity vector
+        Vector<PODVector<unsigned> > neighbours;
+        neighbours.Resize(count);
+        const TetrahedralMeshBuilder::CircumscribedTetrahedralMesh& tetrahedrons = builder.GetTetrahedralMesh();
+        for(TetrahedralMeshBuilder::CircumscribedTetrahedralMesh::ConstIterator it = tetrahedrons.Begin();
+            it != tetrahedrons.End();
+            ++it)
+        {
+            const TetrahedralMeshBuilder::CircumscribedTetrahedron* t = *it;
+            for(unsigned i = 0; i != 4; ++i)
+                for(unsigned j = 0; j != 4; ++j)
+                {
+                    unsigned a = t->v_[i]->index_;
+                    unsigned b = t->v_[j]->index_;
+                    if(a != b && neighbours[a].Contains(b) == false)
+                        neighbours[a].Push(b);
+                }
+        }
+
+        // Try to predict each gravity vector from a mesh built from only its
+        // neighbours. Neighbours of removed gravity vectors are not
+        // considered again in this pass.
+        PODVector<bool> blocked(locked);
+        unsigned removedThisPass = 0;
+        for(unsigned i = 0; i != count; ++i)
+        {
+            if((*excluded)[i] || blocked[i] || neighbours[i].Empty())
+                continue;
+
+            GravityVectorSnapshot link;
+            for(PODVector<unsigned>::ConstIterator n = neighbours[i].Begin(); n != neighbours[i].End(); ++n)
+                link.Push(gravityVectors.positions_[*n], gravityVectors.directions_[*n], gravityVectors.forceFactors_[*n]);
+
+            TetrahedralMeshBuilder linkBuilder;
+            linkBuilder.Build(link);
+            TetrahedralMesh::Mesh linkMesh(linkBuilder.GetTetrahedralMesh());
+
+            Vector3 predicted;
+            if(linkMesh.Query(&predicted, gravityVectors.positions_[i]) == false)
+                continue;
+            if(IsWithinError(predicted, gravityVectors.directions_[i], gravityVectors.forceFactors_[i]) == false)
+                continue;
+
+            (*excluded)[i] = true;
+            ++removedThisPass;
+            for(PODVector<unsigned>::ConstIterator n = neighbours[i].Begin(); n != neighbours[i].End(); ++n)
+                blocked[*n] = true;
+        }
+
+        if(removedThisPass == 0)
+            break;
+    }
+
+    removedCount_ = 0;
+    for(unsigned i = 0; i != count; ++i)
+        if((*excluded)[i])
+            ++removedCount_;
+}
+
+// ----------------------------------------------------------------------------
+bool TetrahedralMeshDecimator::IsWithinError(const Vector3& predicted,
+                                             const Vector3& direction,
+                                             float forceFactor) const
+{
+    float predictedForceFactor = predicted.Length();
+    if(Abs(predictedForceFactor - forceFactor) > maxForceFactorError_)
+        return false;
+
+    // Without any force, the direction doesn't matter
+    float lengths = predictedForceFactor * direction.Length();
+    if(lengths < M_EPSILON)
+        return true;
+
+    float angle = Acos(Clamp(predicted.DotProduct(direction) / lengths, -1.0f, 1.0f));
+    return angle <= maxAngularError_;
+}
@@ -1,5 +1,6 @@
 #include "iceweasel/TetrahedralMesh_Edge.h"
 #include "iceweasel/TetrahedralMesh_Vertex.h"
+#include "iceweasel/DebugLineCache.h"
 
 #include <Urho3D/Graphics/DebugRenderer.h>
 #include <Urho3D/Math/Matrix2.h>
@@ -24,6 +25,13 @@ Edge::Edge(Vertex* v0,
                  ;
 }
 
+// ----------------------------------------------------------------------------
+Vertex* Edge::GetVertex(unsigned char vertexID)
+{
+    assert(vertexID < 2);
+    return vertex_[vertexID];
+}
+
 // ----------------------------------------------------------------------------
 void Edge::FlipBoundaryCheck()
 {
@@ -159,3 +167,14 @@ void Edge::DrawDebugGeometry(DebugRenderer* debug, bool depthTest, const Color&
     debug->AddLine(vertex_[1]->position_, vertex_[1]->position_ + boundaryNormal_[0], Color::CYAN, depthTest);
     debug->AddLine(vertex_[1]->position_, vertex_[1]->position_ + boundaryNormal_[1], Color::CYAN, depthTest);
 }
+
+// ----------------------------------------------------------------------------
+void Edge::AddDebugLines(DebugLineCache* lines, const Color& color) const
+{
+    lines->AddLine(vertex_[0]->position_, vertex_[1]->position_, color);
+
+    lines->AddLine(vertex_[0]->position_, vertex_[0]->position_ + boundaryNormal_[0], Color::CYAN);
+    lines->AddLine(vertex_[0]->position_, vertex_[0]->position_ + boundaryNormal_[1], Color::CYAN);
+    lines->AddLine(vertex_[1]->position_, vertex_[1]->position_ + boundaryNormal_[0], Color::CYAN);
+    lines->AddLine(vertex_[1]->position_, vertex_[1]->position_ + boundaryNormal_[1], Color::CYAN);
+}
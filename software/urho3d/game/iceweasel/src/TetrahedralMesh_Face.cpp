@@ -1,5 +1,6 @@
 #include "iceweasel/TetrahedralMesh_Face.h"
 #include "iceweasel/TetrahedralMesh_Vertex.h"
+#include "iceweasel/DebugLineCache.h"
 
 #include <Urho3D/Graphics/DebugRenderer.h>
 #include <Urho3D/Math/Matrix2.h>
@@ -208,3 +209,17 @@ void Face::DrawDebugGeometry(DebugRenderer* debug, bool depthTest, const Color&
     average /= 3.0f;
     debug->AddLine(average, average + normal_, Color::CYAN, depthTest);
 }
+
+// ----------------------------------------------------------------------------
+void Face::AddDebugLines(DebugLineCache* lines, const Color& color) const
+{
+    Vector3 average(Vector3::ZERO);
+    for(unsigned i = 0; i != 3; ++i)
+    {
+        for(unsigned j = i + 1; j != 3; ++j)
+            lines->AddLine(vertex_[i]->position_, vertex_[j]->position_, color);
+        average += vertex_[i]->position_;
+    }
+    average /= 3.0f;
+    lines->AddLine(average, average + normal_, Color::CYAN);
+}
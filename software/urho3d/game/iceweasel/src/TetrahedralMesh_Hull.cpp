@@ -3,28 +3,54 @@
 #include "iceweasel/TetrahedralMesh_Vertex.h"
 #include "iceweasel/TetrahedralMesh_Edge.h"
 #include "iceweasel/TetrahedralMesh_Face.h"
+#include "iceweasel/DebugLineCache.h"
 
+#include <Urho3D/Container/Sort.h>
 #include <Urho3D/Graphics/DebugRenderer.h>
 #include <Urho3D/Math/Vector3.h>
 
 using namespace TetrahedralMesh;
 
 // ----------------------------------------------------------------------------
-Hull::Hull()
+Hull::Hull() :
+    bandWidth_(1.0f),
+    lastFeature_(FEATURE_NONE)
 {
 }
 
 // ----------------------------------------------------------------------------
-Hull::Hull(Polyhedron* polyhedron)
+Hull::Hull(Polyhedron* polyhedron) :
+    bandWidth_(1.0f),
+    lastFeature_(FEATURE_NONE)
 {
     SetMesh(polyhedron);
 }
 
+// ----------------------------------------------------------------------------
+static void OrientEdgeOutwards(Edge& edge, const Urho3D::Vector3& normal0, const Urho3D::Vector3& normal1)
+{
+    // A point offset from the middle of the edge along both face normals
+    // always lies between them, on the outside of the hull
+    Urho3D::Vector3 middle = edge.TransformToCartesian(Urho3D::Vector2(0.5f, 0.5f));
+    Urho3D::Vector3 outside = middle + normal0 + normal1;
+    if(!edge.ProjectionAngleIsInBounds(middle, outside))
+        edge.FlipBoundaryCheck();
+}
+
 // ----------------------------------------------------------------------------
 void Hull::SetMesh(Polyhedron* polyhedron)
 {
     faces_.Clear();
     edges_.Clear();
+    vertices_.Clear();
+    vertexNeighbours_.Clear();
+    vertexFaces_.Clear();
+    faceEdges_.Clear();
+    edgeFaces_.Clear();
+    hullVertexIndices_.Clear();
+    directionMap_.Clear();
+    directionMapValid_.Clear();
+    sampledCells_.Clear();
     hullMesh_ = polyhedron;
 
     if(hullMesh_->FaceCount() == 0)
@@ -78,6 +104,7 @@ void Hull::SetMesh(Polyhedron* polyhedron)
     // it is more efficient to check for joined edges using the polyhedron data
     // structure than the triangles list. The triangles list is required to get
     // the calculated and adjusted normals.
+    faceEdges_.Resize(faces_.Size());
     vertexIt = hullMesh_->Begin();
     Urho3D::Vector<Face>::ConstIterator triangleIt = faces_.Begin();
     for(; vertexIt != hullMesh_->End(); triangleIt++)
@@ -124,12 +151,170 @@ void Hull::SetMesh(Polyhedron* polyhedron)
                 triangleIt2->GetNormal()
             ));
 
-            // Make sure edge boundary check points outwards from the hull's
-            // centre
-            Urho3D::Vector2 bary = edges_.Back().ProjectAndTransformToBarycentric(centre_);
-            if(edges_.Back().ProjectionAngleIsInBounds(edges_.Back().TransformToCartesian(bary), centre_))
-                edges_.Back().FlipBoundaryCheck();
+            // Make sure edge boundary check points outwards from the hull
+            OrientEdgeOutwards(edges_.Back(), triangleIt->GetNormal(), triangleIt2->GetNormal());
+
+            // Remember which faces the edge depends on for UpdateVertices()
+            unsigned face = triangleIt - faces_.Begin();
+            unsigned face2 = triangleIt2 - faces_.Begin();
+            edgeFaces_.Push(face);
+            edgeFaces_.Push(face2);
+            faceEdges_[face].Push(edges_.Size() - 1);
+            faceEdges_[face2].Push(edges_.Size() - 1);
+        }
+    }
+
+    // The polyhedron lists each vertex once per triangle, collect unique
+    // vertices for the closest vertex search
+    float radius = 0.0f;
+    Urho3D::PODVector<unsigned> faceVertices;
+    for(Polyhedron::ConstIterator it = hullMesh_->Begin(); it != hullMesh_->End(); ++it)
+    {
+        Urho3D::PODVector<Vertex*>::Iterator found = vertices_.Find(*it);
+        faceVertices.Push(found - vertices_.Begin());
+        if(found != vertices_.End())
+            continue;
+        vertices_.Push(*it);
+        radius = Urho3D::Max(radius, ((*it)->position_ - centre_).Length());
+    }
+
+    // Vertices connected by an edge, used to check if a vertex found through
+    // the direction map really is the closest point on the hull
+    vertexNeighbours_.Resize(vertices_.Size());
+    for(unsigned i = 0; i != faceVertices.Size(); ++i)
+    {
+        unsigned firstOfFace = i - i % 3;
+        Urho3D::PODVector<unsigned>& neighbours = vertexNeighbours_[faceVertices[i]];
+        for(unsigned j = firstOfFace; j != firstOfFace + 3; ++j)
+            if(faceVertices[j] != faceVertices[i] && !neighbours.Contains(faceVertices[j]))
+                neighbours.Push(faceVertices[j]);
+    }
+
+    // Faces using each vertex, and where to find the hull vertex of a mesh
+    // vertex, for UpdateVertices()
+    vertexFaces_.Resize(vertices_.Size());
+    for(unsigned i = 0; i != faceVertices.Size(); ++i)
+        vertexFaces_[faceVertices[i]].Push(i / 3);
+    for(unsigned i = 0; i != vertices_.Size(); ++i)
+    {
+        unsigned index = vertices_[i]->index_;
+        if(index == Urho3D::M_MAX_UNSIGNED)
+            continue;
+        while(hullVertexIndices_.Size() <= index)
+            hullVertexIndices_.Push(Urho3D::M_MAX_UNSIGNED);
+        hullVertexIndices_[index] = i;
+    }
+
+    // Candidate lists are sampled lazily, see Query()
+    bandWidth_ = Urho3D::Max(radius * 0.5f, Urho3D::M_EPSILON);
+    unsigned cellCount = DIRECTION_MAP_BANDS * 6 * DIRECTION_MAP_RESOLUTION * DIRECTION_MAP_RESOLUTION;
+    directionMap_.Resize(cellCount);
+    directionMapValid_.Resize(cellCount);
+    for(unsigned i = 0; i != cellCount; ++i)
+        directionMapValid_[i] = false;
+}
+
+// ----------------------------------------------------------------------------
+void Hull::UpdateVertices(const Urho3D::PODVector<Vertex*>& movedVertices)
+{
+    using namespace Urho3D;
+
+    // Feature numbers of everything that changed, same numbering as
+    // FindFeature()
+    PODVector<unsigned> features;
+    PODVector<unsigned> affectedFaces;
+    for(PODVector<Vertex*>::ConstIterator movedIt = movedVertices.Begin();
+        movedIt != movedVertices.End();
+        ++movedIt)
+    {
+        unsigned index = (*movedIt)->index_;
+        if(index >= hullVertexIndices_.Size() || hullVertexIndices_[index] == M_MAX_UNSIGNED)
+            continue;
+
+        unsigned hullVertex = hullVertexIndices_[index];
+        features.Push(faces_.Size() + edges_.Size() + hullVertex);
+
+        const PODVector<unsigned>& connected = vertexFaces_[hullVertex];
+        for(PODVector<unsigned>::ConstIterator it = connected.Begin(); it != connected.End(); ++it)
+            if(!affectedFaces.Contains(*it))
+                affectedFaces.Push(*it);
+    }
+
+    if(affectedFaces.Empty())
+        return;
+
+    // Faces only turn slightly between updates, so the new normal is
+    // oriented the same way as the old one
+    PODVector<unsigned> affectedEdges;
+    for(PODVector<unsigned>::ConstIterator it = affectedFaces.Begin(); it != affectedFaces.End(); ++it)
+    {
+        Face& face = faces_[*it];
+        Face updated(face.GetVertex(0), face.GetVertex(1), face.GetVertex(2));
+        if(updated.GetNormal().DotProduct(face.GetNormal()) < 0)
+            updated.FlipNormal();
+        face = updated;
+        features.Push(*it);
+
+        const PODVector<unsigned>& bordering = faceEdges_[*it];
+        for(PODVector<unsigned>::ConstIterator edgeIt = bordering.Begin(); edgeIt != bordering.End(); ++edgeIt)
+            if(!affectedEdges.Contains(*edgeIt))
+                affectedEdges.Push(*edgeIt);
+    }
+
+    // Edges take their boundary normals from the faces on either side
+    for(PODVector<unsigned>::ConstIterator it = affectedEdges.Begin(); it != affectedEdges.End(); ++it)
+    {
+        Edge& edge = edges_[*it];
+        const Vector3& normal0 = faces_[edgeFaces_[*it * 2 + 0]].GetNormal();
+        const Vector3& normal1 = faces_[edgeFaces_[*it * 2 + 1]].GetNormal();
+        edge = Edge(edge.GetVertex(0), edge.GetVertex(1), normal0, normal1);
+        OrientEdgeOutwards(edge, normal0, normal1);
+        features.Push(faces_.Size() + *it);
+    }
+
+    Sort(features.Begin(), features.End());
+    InvalidateDirectionMap(features);
+}
+
+// ----------------------------------------------------------------------------
+void Hull::InvalidateDirectionMap(const Urho3D::PODVector<unsigned>& features)
+{
+    /*
+     * A cell that doesn't list any of the features may now be missing one of
+     * them, but that only makes it slower: FindCandidateFeature() checks its
+     * result and falls back to searching everything.
+     */
+    for(unsigned i = 0; i < sampledCells_.Size(); )
+    {
+        unsigned cell = sampledCells_[i];
+        const Urho3D::PODVector<unsigned>& candidates = directionMap_[cell];
+
+        // Both lists are sorted
+        bool listsFeature = false;
+        unsigned a = 0, b = 0;
+        while(a != candidates.Size() && b != features.Size())
+        {
+            if(candidates[a] < features[b])
+                ++a;
+            else if(features[b] < candidates[a])
+                ++b;
+            else
+            {
+                listsFeature = true;
+                break;
+            }
+        }
+
+        if(listsFeature == false)
+        {
+            ++i;
+            continue;
         }
+
+        directionMap_[cell].Clear();
+        directionMapValid_[cell] = false;
+        sampledCells_[i] = sampledCells_.Back();
+        sampledCells_.Pop();
     }
 }
 
@@ -163,74 +348,298 @@ bool Hull::Query(Urho3D::Vector3* gravity, const Urho3D::Vector3& position)
         }
     }*/
 
-    Vector3 distanceVec =  position - centre_;
+    SampleDirectionMap(position);
+    return Query(gravity, position, &lastFeature_, &lastIntersection_);
+}
 
-    // Try all faces first
-    for(Vector<Face>::ConstIterator face = faces_.Begin();
-        face != faces_.End();
-        ++face)
-    {
-        Vector3 bary = face->ProjectAndTransformToBarycentric(position);
-        if(face->PointLiesInside(bary))
-        {
-            // It's possible we hit a triangle on the other side
-            if(distanceVec.DotProduct(face->GetNormal()) < 0)
-                continue;
+// ----------------------------------------------------------------------------
+void Hull::SampleDirectionMap(const Urho3D::Vector3& position)
+{
+    if(vertices_.Empty())
+        return;
 
-            // We found the triangle, interpolate gravity vector and return
-            if(gravity != NULL)
-                *gravity = face->InterpolateGravity(bary);
-            lastIntersection_ = face->TransformToCartesian(bary);
-            return true;
-        }
+    unsigned cell = GetDirectionMapCell(position);
+    if(!directionMapValid_[cell])
+    {
+        SampleDirectionMapCell(cell);
+        directionMapValid_[cell] = true;
+        sampledCells_.Push(cell);
     }
+}
 
-    // Try all edges
-    for(Vector<Edge>::ConstIterator edge = edges_.Begin();
-        edge != edges_.End();
-        ++edge)
+// ----------------------------------------------------------------------------
+bool Hull::Query(Urho3D::Vector3* gravity,
+                 const Urho3D::Vector3& position,
+                 Feature* feature,
+                 Urho3D::Vector3* intersection) const
+{
+    *feature = FEATURE_NONE;
+    if(vertices_.Empty())
+        return false;
+
+    // Only check the features that were found around this direction and
+    // distance from the centre. Cells that haven't been sampled yet can't be
+    // sampled here without a lock, so those fall back to checking everything.
+    unsigned cell = GetDirectionMapCell(position);
+    unsigned found = Urho3D::M_MAX_UNSIGNED;
+    if(directionMapValid_[cell])
+        found = FindCandidateFeature(directionMap_[cell], position);
+    if(found == Urho3D::M_MAX_UNSIGNED)
+        found = FindFeature(position);
+
+    return EvaluateFeature(gravity, found, position, feature, intersection);
+}
+
+// ----------------------------------------------------------------------------
+unsigned Hull::FindCandidateFeature(const Urho3D::PODVector<unsigned>& candidates,
+                                    const Urho3D::Vector3& position) const
+{
+    using namespace Urho3D;
+
+    // Faces come first, then edges, then vertices, same as in FindFeature().
+    // On a convex hull, a face or edge that passes its test contains the
+    // closest point, so it's the feature FindFeature() would find.
+    unsigned closestVertex = M_MAX_UNSIGNED;
+    float closestDistanceSquared = M_INFINITY;
+    for(PODVector<unsigned>::ConstIterator it = candidates.Begin(); it != candidates.End(); ++it)
     {
-        Vector2 bary = edge->ProjectAndTransformToBarycentric(position);
-        if(edge->PointLiesInside(bary))
+        if(*it < faces_.Size())
         {
-            // It's possible we're not projecting from the correct angle
-            if(!edge->ProjectionAngleIsInBounds(edge->TransformToCartesian(bary), position))
-                continue;
-
-            // Found the edge, interpolate gravity vector and return
-            if(gravity != NULL)
-                *gravity = edge->InterpolateGravity(bary);
-            lastIntersection_ = edge->TransformToCartesian(bary);
-            return true;
+            if(TestFace(*it, position))
+                return *it;
+        }
+        else if(*it < faces_.Size() + edges_.Size())
+        {
+            if(TestEdge(*it - faces_.Size(), position))
+                return *it;
+        }
+        else
+        {
+            float distanceSquared = (vertices_[*it - faces_.Size() - edges_.Size()]->position_ - position).LengthSquared();
+            if(distanceSquared < closestDistanceSquared)
+            {
+                closestDistanceSquared = distanceSquared;
+                closestVertex = *it;
+            }
         }
     }
 
+    // The cell's list is sampled, so the face or edge the position actually
+    // projects onto may be missing from it. Only accept the vertex if it is
+    // the closest point on the hull.
+    if(closestVertex == M_MAX_UNSIGNED ||
+       TestVertex(closestVertex - faces_.Size() - edges_.Size(), position) == false)
+        return M_MAX_UNSIGNED;
+
+    return closestVertex;
+}
+
+// ----------------------------------------------------------------------------
+bool Hull::TestFace(unsigned index, const Urho3D::Vector3& position) const
+{
+    const Face& face = faces_[index];
+    Urho3D::Vector3 bary = face.ProjectAndTransformToBarycentric(position);
+    if(!face.PointLiesInside(bary))
+        return false;
+
+    // It's possible we hit a triangle on the other side. The position has to
+    // be in front of the face's plane, otherwise another feature is closer.
+    return (position - face.TransformToCartesian(bary)).DotProduct(face.GetNormal()) >= 0;
+}
+
+// ----------------------------------------------------------------------------
+bool Hull::TestEdge(unsigned index, const Urho3D::Vector3& position) const
+{
+    const Edge& edge = edges_[index];
+    Urho3D::Vector2 bary = edge.ProjectAndTransformToBarycentric(position);
+    if(!edge.PointLiesInside(bary))
+        return false;
+
+    // It's possible we're not projecting from the correct angle
+    return edge.ProjectionAngleIsInBounds(edge.TransformToCartesian(bary), position);
+}
+
+// ----------------------------------------------------------------------------
+bool Hull::TestVertex(unsigned index, const Urho3D::Vector3& position) const
+{
+    /*
+     * On a convex hull, a vertex is the closest point to the position if the
+     * position lies behind every plane that goes through the vertex and is
+     * perpendicular to one of the edges leaving it.
+     */
+    const Urho3D::Vector3& vertex = vertices_[index]->position_;
+    Urho3D::Vector3 offset = position - vertex;
+    const Urho3D::PODVector<unsigned>& neighbours = vertexNeighbours_[index];
+    for(Urho3D::PODVector<unsigned>::ConstIterator it = neighbours.Begin(); it != neighbours.End(); ++it)
+        if(offset.DotProduct(vertices_[*it]->position_ - vertex) > 0.0f)
+            return false;
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+unsigned Hull::FindFeature(const Urho3D::Vector3& position) const
+{
+    // Try all faces first
+    for(unsigned i = 0; i != faces_.Size(); ++i)
+        if(TestFace(i, position))
+            return i;
+
+    // Try all edges
+    for(unsigned i = 0; i != edges_.Size(); ++i)
+        if(TestEdge(i, position))
+            return faces_.Size() + i;
+
     // Find closest vertex as a last resort
-    float distanceSquared = M_INFINITY;
-    const Vertex* foundPoint = NULL;
-    for(Polyhedron::ConstIterator pVertex = hullMesh_->Begin();
-        pVertex != hullMesh_->End();
-        ++pVertex)
-    {
-        Vertex* vertex = *pVertex;
-        float newDist = (vertex->position_ - position).LengthSquared();
+    float distanceSquared = Urho3D::M_INFINITY;
+    unsigned found = Urho3D::M_MAX_UNSIGNED;
+    for(unsigned i = 0; i != vertices_.Size(); ++i)
+    {
+        float newDist = (vertices_[i]->position_ - position).LengthSquared();
         if(newDist < distanceSquared)
         {
             distanceSquared = newDist;
-            foundPoint = &(*vertex);
+            found = faces_.Size() + edges_.Size() + i;
         }
     }
-    if(foundPoint != NULL)
+
+    return found;
+}
+
+// ----------------------------------------------------------------------------
+bool Hull::EvaluateFeature(Urho3D::Vector3* gravity,
+                           unsigned feature,
+                           const Urho3D::Vector3& position,
+                           Feature* type,
+                           Urho3D::Vector3* intersection) const
+{
+    if(feature < faces_.Size())
+    {
+        // Interpolate gravity vector on the triangle
+        const Face& face = faces_[feature];
+        Urho3D::Vector3 bary = face.ProjectAndTransformToBarycentric(position);
+        if(gravity != NULL)
+            *gravity = face.InterpolateGravity(bary);
+        *intersection = face.TransformToCartesian(bary);
+        *type = FEATURE_FACE;
+        return true;
+    }
+    feature -= faces_.Size();
+
+    if(feature < edges_.Size())
     {
+        // Interpolate gravity vector on the edge
+        const Edge& edge = edges_[feature];
+        Urho3D::Vector2 bary = edge.ProjectAndTransformToBarycentric(position);
         if(gravity != NULL)
-            *gravity = foundPoint->direction_ * foundPoint->forceFactor_;
-        lastIntersection_ = foundPoint->position_;
+            *gravity = edge.InterpolateGravity(bary);
+        *intersection = edge.TransformToCartesian(bary);
+        *type = FEATURE_EDGE;
+        return true;
+    }
+    feature -= edges_.Size();
+
+    if(feature < vertices_.Size())
+    {
+        const Vertex* vertex = vertices_[feature];
+        if(gravity != NULL)
+            *gravity = vertex->direction_ * vertex->forceFactor_;
+        *intersection = vertex->position_;
+        *type = FEATURE_VERTEX;
         return true;
     }
 
     return false;
 }
 
+// ----------------------------------------------------------------------------
+/*
+ * The direction map divides the space around the hull into cells. A cell is
+ * selected by projecting the direction from the hull's centre onto a cube
+ * map (6 sides with DIRECTION_MAP_RESOLUTION x DIRECTION_MAP_RESOLUTION
+ * cells each), and by the distance from the centre (DIRECTION_MAP_BANDS
+ * bands, the last one extending to infinity).
+ *
+ * Each cell lists the features that points within it project onto. The list
+ * is filled the first time the cell is queried (by the non-const Query()) by
+ * sampling the full search at the corners, edges and centre of the cell, at
+ * the inner, middle and outer distance of the band. Sampling can miss small
+ * features, which is why FindCandidateFeature() checks its result and falls
+ * back to the full search.
+ */
+
+// ----------------------------------------------------------------------------
+static Urho3D::Vector3 CubeMapDirection(unsigned side, float s, float t)
+{
+    switch(side)
+    {
+        case 0  : return Urho3D::Vector3( 1, s, t).Normalized();
+        case 1  : return Urho3D::Vector3(-1, s, t).Normalized();
+        case 2  : return Urho3D::Vector3(s,  1, t).Normalized();
+        case 3  : return Urho3D::Vector3(s, -1, t).Normalized();
+        case 4  : return Urho3D::Vector3(s, t,  1).Normalized();
+        default : return Urho3D::Vector3(s, t, -1).Normalized();
+    }
+}
+
+// ----------------------------------------------------------------------------
+unsigned Hull::GetDirectionMapCell(const Urho3D::Vector3& position) const
+{
+    Urho3D::Vector3 d = position - centre_;
+    unsigned band = (unsigned)(d.Length() / bandWidth_);
+    if(band >= DIRECTION_MAP_BANDS)
+        band = DIRECTION_MAP_BANDS - 1;
+
+    // Select the cube map side by the major axis
+    Urho3D::Vector3 a(Urho3D::Abs(d.x_), Urho3D::Abs(d.y_), Urho3D::Abs(d.z_));
+    unsigned side;
+    float major, s, t;
+    if(a.x_ >= a.y_ && a.x_ >= a.z_) { side = d.x_ >= 0 ? 0 : 1; major = a.x_; s = d.y_; t = d.z_; }
+    else if(a.y_ >= a.z_)            { side = d.y_ >= 0 ? 2 : 3; major = a.y_; s = d.x_; t = d.z_; }
+    else                             { side = d.z_ >= 0 ? 4 : 5; major = a.z_; s = d.x_; t = d.y_; }
+    if(major <= 0.0f)
+        major = 1.0f;
+
+    unsigned u = (unsigned)((s / major + 1.0f) * 0.5f * DIRECTION_MAP_RESOLUTION);
+    unsigned v = (unsigned)((t / major + 1.0f) * 0.5f * DIRECTION_MAP_RESOLUTION);
+    if(u >= DIRECTION_MAP_RESOLUTION) u = DIRECTION_MAP_RESOLUTION - 1;
+    if(v >= DIRECTION_MAP_RESOLUTION) v = DIRECTION_MAP_RESOLUTION - 1;
+
+    return ((band * 6 + side) * DIRECTION_MAP_RESOLUTION + u) * DIRECTION_MAP_RESOLUTION + v;
+}
+
+// ----------------------------------------------------------------------------
+void Hull::SampleDirectionMapCell(unsigned cell)
+{
+    Urho3D::PODVector<unsigned>& candidates = directionMap_[cell];
+    unsigned v = cell % DIRECTION_MAP_RESOLUTION; cell /= DIRECTION_MAP_RESOLUTION;
+    unsigned u = cell % DIRECTION_MAP_RESOLUTION; cell /= DIRECTION_MAP_RESOLUTION;
+    unsigned side = cell % 6;
+    unsigned band = cell / 6;
+
+    float radii[3];
+    radii[0] = Urho3D::Max(band * bandWidth_, bandWidth_ * 0.01f);
+    radii[2] = band == DIRECTION_MAP_BANDS - 1 ? radii[0] * 4.0f : (band + 1) * bandWidth_;
+    radii[1] = (radii[0] + radii[2]) * 0.5f;
+
+    for(unsigned i = 0; i != 3; ++i)
+        for(unsigned j = 0; j != 3; ++j)
+        {
+            float s = (u + i * 0.5f) / DIRECTION_MAP_RESOLUTION * 2.0f - 1.0f;
+            float t = (v + j * 0.5f) / DIRECTION_MAP_RESOLUTION * 2.0f - 1.0f;
+            Urho3D::Vector3 direction = CubeMapDirection(side, s, t);
+
+            for(unsigned r = 0; r != 3; ++r)
+            {
+                unsigned feature = FindFeature(centre_ + direction * radii[r]);
+                if(feature != Urho3D::M_MAX_UNSIGNED && !candidates.Contains(feature))
+                    candidates.Push(feature);
+            }
+        }
+
+    Urho3D::Sort(candidates.Begin(), candidates.End());
+}
+
 // ----------------------------------------------------------------------------
 void Hull::DrawDebugGeometry(Urho3D::DebugRenderer* debug, bool depthTest, Urho3D::Vector3 pos) const
 {
@@ -250,3 +659,19 @@ void Hull::DrawDebugGeometry(Urho3D::DebugRenderer* debug, bool depthTest, Urho3
 
     debug->AddSphere(Urho3D::Sphere(lastIntersection_, 1.0f), Urho3D::Color::RED, depthTest);
 }
+
+// ----------------------------------------------------------------------------
+void Hull::AddDebugLines(DebugLineCache* lines) const
+{
+    for(Urho3D::Vector<Face>::ConstIterator it = faces_.Begin(); it != faces_.End(); ++it)
+        it->AddDebugLines(lines, Urho3D::Color::WHITE);
+
+    for(Urho3D::Vector<Edge>::ConstIterator it = edges_.Begin(); it != edges_.End(); ++it)
+        it->AddDebugLines(lines, Urho3D::Color::WHITE);
+}
+
+// ----------------------------------------------------------------------------
+void Hull::DrawLastIntersection(Urho3D::DebugRenderer* debug, bool depthTest) const
+{
+    debug->AddSphere(Urho3D::Sphere(lastIntersection_, 1.0f), Urho3D::Color::RED, depthTest);
+}
@@ -2,7 +2,9 @@
 #include "iceweasel/TetrahedralMeshBuilder.h"
 #include "iceweasel/Math.h"
 #include "iceweasel/TetrahedralMesh_Vertex.h"
+#include "iceweasel/DebugLineCache.h"
 
+#include <Urho3D/Container/HashSet.h>
 #include <Urho3D/Container/Ptr.h>
 #include <Urho3D/Graphics/DebugRenderer.h>
 #include <Urho3D/Math/BoundingBox.h>
@@ -10,13 +12,18 @@
 using namespace Urho3D;
 using namespace TetrahedralMesh;
 
+// Distance a vertex may lie outside of a hull face, relative to the face's size
+static const float HULL_CONVEXITY_TOLERANCE = 1e-4f;
+
 // ----------------------------------------------------------------------------
-Mesh::Mesh()
+Mesh::Mesh() :
+    isConvex_(true)
 {
 }
 
 // ----------------------------------------------------------------------------
-Mesh::Mesh(const TetrahedralMeshBuilder::CircumscribedTetrahedralMesh& sharedVertexMesh)
+Mesh::Mesh(const TetrahedralMeshBuilder::CircumscribedTetrahedralMesh& sharedVertexMesh) :
+    isConvex_(true)
 {
     SetMesh(sharedVertexMesh);
 }
@@ -25,33 +32,290 @@ Mesh::Mesh(const TetrahedralMeshBuilder::CircumscribedTetrahedralMesh& sharedVer
 void Mesh::SetMesh(const TetrahedralMeshBuilder::CircumscribedTetrahedralMesh& sharedVertexMesh)
 {
     tetrahedrons_.Clear();
+    vertexTetrahedrons_.Clear();
 
     for(TetrahedralMeshBuilder::CircumscribedTetrahedralMesh::ConstIterator it = sharedVertexMesh.Begin();
         it != sharedVertexMesh.End();
         ++it)
     {
         TetrahedralMeshBuilder::CircumscribedTetrahedron* t = *it;
+        for(unsigned i = 0; i != 4; ++i)
+        {
+            unsigned vertexIndex = t->v_[i]->index_;
+            if(vertexIndex == M_MAX_UNSIGNED)
+                continue;
+            if(vertexIndex >= vertexTetrahedrons_.Size())
+                vertexTetrahedrons_.Resize(vertexIndex + 1);
+            vertexTetrahedrons_[vertexIndex].Push(tetrahedrons_.Size());
+        }
         tetrahedrons_.Push(Tetrahedron(t->v_[0], t->v_[1], t->v_[2], t->v_[3]));
     }
+
+    FindNeighbours();
+    FindHull();
+
+    // Removing the super tetrahedron can leave dents in the hull
+    isConvex_ = IsHullConvex();
 }
 
 // ----------------------------------------------------------------------------
-bool Mesh::Query(Vector3* gravity, const Vector3& position) const
+void Mesh::FindNeighbours()
 {
-    // Use a linear search for now. Can optimise later
-    Vector<Tetrahedron>::ConstIterator tetrahedron = tetrahedrons_.Begin();
-    for(; tetrahedron != tetrahedrons_.End(); ++tetrahedron)
+    neighbours_.Resize(tetrahedrons_.Size() * 4);
+    for(unsigned t = 0; t != tetrahedrons_.Size(); ++t)
+        for(unsigned i = 0; i != 4; ++i)
+        {
+            neighbours_[t * 4 + i] = M_MAX_UNSIGNED;
+
+            // The face opposite of vertex i
+            Vertex* face[3];
+            for(unsigned j = 0, k = 0; j != 4; ++j)
+                if(j != i)
+                    face[k++] = tetrahedrons_[t].GetVertex(j);
+
+            // The neighbour is the other tetrahedron connected to all three
+            // face vertices
+            if(face[0]->index_ >= vertexTetrahedrons_.Size())
+                continue;
+            const PODVector<unsigned>& candidates = vertexTetrahedrons_[face[0]->index_];
+            for(PODVector<unsigned>::ConstIterator it = candidates.Begin(); it != candidates.End(); ++it)
+            {
+                if(*it == t)
+                    continue;
+                if(tetrahedrons_[*it].ContainsVertex(face[1]) && tetrahedrons_[*it].ContainsVertex(face[2]))
+                {
+                    neighbours_[t * 4 + i] = *it;
+                    break;
+                }
+            }
+        }
+}
+
+// ----------------------------------------------------------------------------
+void Mesh::FindHull()
+{
+    hullFaces_.Clear();
+    hullVertices_.Clear();
+    isHullVertex_.Resize(vertexTetrahedrons_.Size());
+    for(unsigned i = 0; i != isHullVertex_.Size(); ++i)
+        isHullVertex_[i] = false;
+
+    for(unsigned face = 0; face != neighbours_.Size(); ++face)
     {
-        Vector4 bary = tetrahedron->TransformToBarycentric(position);
-        if(tetrahedron->PointLiesInside(bary))
+        if(neighbours_[face] != M_MAX_UNSIGNED)
+            continue;
+
+        hullFaces_.Push(face);
+        for(unsigned i = 0; i != 4; ++i)
         {
-            if(gravity != NULL)
-                *gravity = tetrahedron->InterpolateGravity(bary);
-            return true;
+            Vertex* vertex = tetrahedrons_[face / 4].GetVertex(i);
+            if(i == face % 4 || vertex->index_ >= isHullVertex_.Size() || isHullVertex_[vertex->index_])
+                continue;
+            isHullVertex_[vertex->index_] = true;
+            hullVertices_.Push(vertex);
         }
     }
+}
+
+// ----------------------------------------------------------------------------
+bool Mesh::IsHullVertex(const Vertex* vertex) const
+{
+    return vertex->index_ < isHullVertex_.Size() && isHullVertex_[vertex->index_];
+}
+
+// ----------------------------------------------------------------------------
+bool Mesh::IsHullConvex() const
+{
+    for(PODVector<unsigned>::ConstIterator face = hullFaces_.Begin(); face != hullFaces_.End(); ++face)
+        for(PODVector<Vertex*>::ConstIterator vertex = hullVertices_.Begin(); vertex != hullVertices_.End(); ++vertex)
+            if(LiesBehindHullFace(*face, (*vertex)->position_) == false)
+                return false;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+bool Mesh::LiesBehindHullFace(unsigned face, const Vector3& position) const
+{
+    const Tetrahedron& tetrahedron = tetrahedrons_[face / 4];
+    unsigned inner = face % 4;
+
+    Vector3 v[3];
+    for(unsigned i = 0, k = 0; i != 4; ++i)
+        if(i != inner)
+            v[k++] = tetrahedron.GetVertexPosition(i);
+
+    // Point the normal away from the vertex opposite of the face
+    Vector3 normal = (v[1] - v[0]).CrossProduct(v[2] - v[0]);
+    if(normal.DotProduct(tetrahedron.GetVertexPosition(inner) - v[0]) > 0.0f)
+        normal = -normal;
+
+    /*
+     * Vertices that were coplanar before being moved together (e.g. probes on
+     * a grid that rotates) are only coplanar up to rounding errors. Points
+     * that close to the hull get the same gravity whether the walk finds
+     * them or not, so allow a small distance relative to the face's size.
+     */
+    float length = normal.Length();
+    float tolerance = Sqrt(length) * HULL_CONVEXITY_TOLERANCE;
+    return normal.DotProduct(position - v[0]) <= length * tolerance;
+}
+
+// ----------------------------------------------------------------------------
+bool Mesh::UpdateVertices(const PODVector<Vertex*>& movedVertices)
+{
+    /*
+     * All vertices have already been moved at this point. Only then is it
+     * possible to check the orientation of the affected tetrahedrons, because
+     * a group of vertices moving together (e.g. a rotating space station)
+     * would otherwise look like they were inverting each other's tetrahedrons.
+     */
+    bool isValid = true;
+    bool hullMoved = false;
+    for(PODVector<Vertex*>::ConstIterator vertex = movedVertices.Begin();
+        vertex != movedVertices.End();
+        ++vertex)
+    {
+        if(IsHullVertex(*vertex))
+            hullMoved = true;
+
+        unsigned vertexIndex = (*vertex)->index_;
+        if(vertexIndex >= vertexTetrahedrons_.Size())
+            continue;
+
+        const PODVector<unsigned>& connected = vertexTetrahedrons_[vertexIndex];
+        for(PODVector<unsigned>::ConstIterator index = connected.Begin();
+            index != connected.End();
+            ++index)
+        {
+            if(tetrahedrons_[*index].UpdateTransform() == false)
+                isValid = false;
+        }
+    }
+
+    // Moving vertices on the hull inwards can make it concave. The walk in
+    // Locate() copes with that, but Hull assumes a convex hull, so a mesh
+    // that was convex has to be rebuilt.
+    bool wasConvex = isConvex_;
+    if(hullMoved)
+        isConvex_ = IsHullConvex();
 
-    return false;
+    return isValid && (isConvex_ || wasConvex == false);
+}
+
+// ----------------------------------------------------------------------------
+bool Mesh::ContainsVertex(const Vertex* vertex) const
+{
+    return vertex->index_ < vertexTetrahedrons_.Size() &&
+           vertexTetrahedrons_[vertex->index_].Empty() == false;
+}
+
+// ----------------------------------------------------------------------------
+bool Mesh::Query(Vector3* gravity, const Vector3& position, unsigned* hint, unsigned* visited) const
+{
+    unsigned index = Locate(position, hint != NULL ? *hint : 0, visited);
+    if(index == M_MAX_UNSIGNED)
+        return false;
+
+    if(hint != NULL)
+        *hint = index;
+
+    if(gravity != NULL)
+    {
+        const Tetrahedron& tetrahedron = tetrahedrons_[index];
+        *gravity = tetrahedron.InterpolateGravity(tetrahedron.TransformToBarycentric(position));
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+unsigned Mesh::Locate(const Vector3& position, unsigned hint, unsigned* visited) const
+{
+    unsigned count = 0;
+    if(hint >= tetrahedrons_.Size())
+        hint = 0;
+
+    /*
+     * Walk towards the point by always stepping through the face whose
+     * barycentric coordinate is the most negative. In a Delaunay
+     * triangulation this walk can't cycle, but rounding errors near
+     * degenerate tetrahedrons might make it, so the number of steps is
+     * bounded.
+     */
+    unsigned current = hint;
+    for(unsigned step = 0; step != tetrahedrons_.Size(); ++step)
+    {
+        ++count;
+        Vector4 bary = tetrahedrons_[current].TransformToBarycentric(position);
+        if(tetrahedrons_[current].PointLiesInside(bary))
+        {
+            if(visited != NULL)
+                *visited = count;
+            return current;
+        }
+
+        unsigned exit = 0;
+        for(unsigned i = 1; i != 4; ++i)
+            if(bary.Data()[i] < bary.Data()[exit])
+                exit = i;
+        current = neighbours_[current * 4 + exit];
+
+        // Walked out through a face on the hull. If the mesh is convex, the
+        // point can't be inside any other tetrahedron either. Otherwise the
+        // walk may have left through a dent, so search all of them.
+        if(current == M_MAX_UNSIGNED)
+        {
+            if(isConvex_)
+            {
+                if(visited != NULL)
+                    *visited = count;
+                return M_MAX_UNSIGNED;
+            }
+            break;
+        }
+    }
+
+    // Gave up walking or left a concave mesh, fall back to a linear search
+    for(unsigned i = 0; i != tetrahedrons_.Size(); ++i)
+    {
+        ++count;
+        if(tetrahedrons_[i].PointLiesInside(tetrahedrons_[i].TransformToBarycentric(position)))
+        {
+            if(visited != NULL)
+                *visited = count;
+            return i;
+        }
+    }
+
+    if(visited != NULL)
+        *visited = count;
+    return M_MAX_UNSIGNED;
+}
+
+// ----------------------------------------------------------------------------
+void Mesh::AddDebugLines(DebugLineCache* lines, const Color& color) const
+{
+    // Neighbouring tetrahedrons share edges, only add each edge once
+    HashSet<Pair<Vertex*, Vertex*> > added;
+    for(ContainerType::ConstIterator it = tetrahedrons_.Begin(); it != tetrahedrons_.End(); ++it)
+        for(unsigned i = 0; i != 4; ++i)
+            for(unsigned j = i + 1; j != 4; ++j)
+            {
+                Vertex* a = it->GetVertex(i);
+                Vertex* b = it->GetVertex(j);
+                if(b < a)
+                    Swap(a, b);
+                if(added.Contains(MakePair(a, b)))
+                    continue;
+                added.Insert(MakePair(a, b));
+                lines->AddLine(a->position_, b->position_, color);
+            }
+}
+
+// ----------------------------------------------------------------------------
+void Mesh::DrawTetrahedron(DebugRenderer* debug, bool depthTest, unsigned index, const Color& color)
+{
+    if(index < tetrahedrons_.Size())
+        tetrahedrons_[index].DrawDebugGeometry(debug, depthTest, color);
 }
 
 // ----------------------------------------------------------------------------
@@ -20,6 +20,7 @@ Tetrahedron::Tetrahedron(TetrahedralMesh::Vertex* v0,
     vertex_[3] = v3;
 
     transform_ = CalculateBarycentricTransformationMatrix();
+    positiveOrientation_ = (CalculateSignedVolume() > 0.0f);
 }
 
 // ----------------------------------------------------------------------------
@@ -71,6 +72,40 @@ Vector3 Tetrahedron::InterpolateGravity(const Vector4& barycentric) const
     );
 }
 
+// ----------------------------------------------------------------------------
+bool Tetrahedron::ContainsVertex(const Vertex* vertex) const
+{
+    return (
+        vertex_[0] == vertex ||
+        vertex_[1] == vertex ||
+        vertex_[2] == vertex ||
+        vertex_[3] == vertex
+    );
+}
+
+// ----------------------------------------------------------------------------
+bool Tetrahedron::UpdateTransform()
+{
+    transform_ = CalculateBarycentricTransformationMatrix();
+
+    // If the sign of the volume changed, then one of the vertices was moved
+    // through the opposing face and the tetrahedron now overlaps with its
+    // neighbours.
+    float volume = CalculateSignedVolume();
+    if(volume == 0.0f)
+        return false;
+    return (volume > 0.0f) == positiveOrientation_;
+}
+
+// ----------------------------------------------------------------------------
+float Tetrahedron::CalculateSignedVolume() const
+{
+    Vector3 a = vertex_[1]->position_ - vertex_[0]->position_;
+    Vector3 b = vertex_[2]->position_ - vertex_[0]->position_;
+    Vector3 c = vertex_[3]->position_ - vertex_[0]->position_;
+    return a.DotProduct(b.CrossProduct(c));
+}
+
 // ----------------------------------------------------------------------------
 Matrix4 Tetrahedron::CalculateBarycentricTransformationMatrix() const
 {
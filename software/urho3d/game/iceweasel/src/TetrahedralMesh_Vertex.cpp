@@ -4,9 +4,10 @@ using namespace Urho3D;
 using namespace TetrahedralMesh;
 
 // ----------------------------------------------------------------------------
-Vertex::Vertex(const Vector3& vertex, const Vector3& direction, float forceFactor) :
+Vertex::Vertex(const Vector3& vertex, const Vector3& direction, float forceFactor, unsigned index) :
     position_(vertex),
     direction_(direction),
-    forceFactor_(forceFactor)
+    forceFactor_(forceFactor),
+    index_(index)
 {
 }
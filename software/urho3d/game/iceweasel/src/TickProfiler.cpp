@@ -0,0 +1,167 @@
+#include "iceweasel/TickProfiler.h"
+#include "iceweasel/CharacterProbeSystem.h"
+#include "iceweasel/MovementSystem.h"
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include <stdio.h>
+
+using namespace Urho3D;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static const char* sampleNames[TickProfiler::NUM_SAMPLES] = {
+    "frame",
+    "logic update",
+    "tick",
+    "other",
+    "probes",
+    "movement prepare",
+    "gravity",
+    "integrate",
+    "apply"
+};
+
+// ----------------------------------------------------------------------------
+TickProfiler::TickProfiler(Context* context) :
+    Object(context),
+    probeTimeAtTickStart_(0),
+    frameTickTime_(0),
+    frameTickCount_(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+void TickProfiler::SetScene(Scene* scene)
+{
+    UnsubscribeFromAllEvents();
+    scene_ = scene;
+    if(scene == NULL)
+        return;
+
+    // Receivers subscribed to the world itself are sent the event before
+    // those subscribed to any sender, like MovementSystem, GravityManager and
+    // ProjectileSystem. The tick therefore starts before their handlers run.
+    // For the same reason it has to end in a handler that isn't specific to
+    // the world. Those are called in the order they subscribed, and the scene
+    // is loaded before calling this, so it comes after MovementSystem's.
+    PhysicsWorld* physicsWorld = scene->GetOrCreateComponent<PhysicsWorld>();
+    SubscribeToEvent(physicsWorld, E_PHYSICSPRESTEP, URHO3D_HANDLER(TickProfiler, HandlePhysicsPreStep));
+    SubscribeToEvent(E_PHYSICSPOSTSTEP, URHO3D_HANDLER(TickProfiler, HandlePhysicsPostStep));
+}
+
+// ----------------------------------------------------------------------------
+void TickProfiler::BeginFrame()
+{
+    frameTickTime_ = 0;
+    frameTickCount_ = 0;
+    frameStart_ = Clock::now();
+}
+
+// ----------------------------------------------------------------------------
+void TickProfiler::EndFrame()
+{
+    long long frameTime = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frameStart_).count();
+    samples_[FRAME].Push(frameTime);
+    samples_[LOGIC].Push(frameTime - frameTickTime_);
+}
+
+// ----------------------------------------------------------------------------
+double TickProfiler::GetMean(Sample sample) const
+{
+    const PODVector<long long>& samples = samples_[sample];
+    if(samples.Empty())
+        return 0.0;
+
+    long long total = 0;
+    for(unsigned i = 0; i != samples.Size(); ++i)
+        total += samples[i];
+    return (double)total / samples.Size();
+}
+
+// ----------------------------------------------------------------------------
+long long TickProfiler::GetPercentile(Sample sample, unsigned percentile) const
+{
+    if(samples_[sample].Empty())
+        return 0;
+
+    PODVector<long long> sorted = samples_[sample];
+    Sort(sorted.Begin(), sorted.End());
+    return sorted[(sorted.Size() - 1) * Min(percentile, 100u) / 100];
+}
+
+// ----------------------------------------------------------------------------
+void TickProfiler::Clear()
+{
+    for(unsigned i = 0; i != NUM_SAMPLES; ++i)
+        samples_[i].Clear();
+}
+
+// ----------------------------------------------------------------------------
+void TickProfiler::PrintReport() const
+{
+    for(unsigned i = 0; i != NUM_SAMPLES; ++i)
+    {
+        if(samples_[i].Empty())
+            continue;
+
+        PODVector<long long> sorted = samples_[i];
+        Sort(sorted.Begin(), sorted.End());
+        unsigned last = sorted.Size() - 1;
+        printf("  %-16s mean %9.1f  p50 %9.1f  p95 %9.1f  p99 %9.1f  max %9.1f\n",
+               sampleNames[i],
+               GetMean((Sample)i) * 1e-3,
+               sorted[last * 50 / 100] * 1e-3,
+               sorted[last * 95 / 100] * 1e-3,
+               sorted[last * 99 / 100] * 1e-3,
+               sorted[last] * 1e-3);
+    }
+}
+
+// ----------------------------------------------------------------------------
+void TickProfiler::HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData)
+{
+    (void)eventType;
+    (void)eventData;
+
+    CharacterProbeSystem* probeSystem = scene_ ? scene_->GetComponent<CharacterProbeSystem>() : NULL;
+    probeTimeAtTickStart_ = probeSystem ? probeSystem->GetTotalProbeTime() : 0;
+    tickStart_ = Clock::now();
+}
+
+// ----------------------------------------------------------------------------
+void TickProfiler::HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData)
+{
+    using namespace PhysicsPostStep;
+    (void)eventType;
+
+    // Other scenes have their own physics world
+    PhysicsWorld* world = static_cast<PhysicsWorld*>(eventData[P_WORLD].GetPtr());
+    if(world == NULL || world->GetScene() != scene_)
+        return;
+
+    long long tickTime = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - tickStart_).count();
+    frameTickTime_ += tickTime;
+    ++frameTickCount_;
+
+    CharacterProbeSystem* probeSystem = scene_ ? scene_->GetComponent<CharacterProbeSystem>() : NULL;
+    MovementSystem* movementSystem = scene_ ? scene_->GetComponent<MovementSystem>() : NULL;
+
+    // Probes run while preparing the movement
+    long long probeTime = probeSystem ? probeSystem->GetTotalProbeTime() - probeTimeAtTickStart_ : 0;
+    MovementSystem::StageTimes stageTimes;
+    if(movementSystem)
+        stageTimes = movementSystem->GetStageTimes();
+    long long movementTime = stageTimes.prepare_ + stageTimes.gravity_ + stageTimes.integrate_ + stageTimes.apply_;
+
+    samples_[TICK].Push(tickTime);
+    samples_[OTHER].Push(tickTime - movementTime);
+    samples_[PROBES].Push(probeTime);
+    samples_[MOVEMENT_PREPARE].Push(stageTimes.prepare_ - probeTime);
+    samples_[GRAVITY].Push(stageTimes.gravity_);
+    samples_[INTEGRATE].Push(stageTimes.integrate_);
+    samples_[APPLY].Push(stageTimes.apply_);
+}
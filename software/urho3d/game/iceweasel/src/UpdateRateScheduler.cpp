@@ -0,0 +1,91 @@
+#include "iceweasel/UpdateRateScheduler.h"
+
+#include <Urho3D/Math/MathDefs.h>
+#include <Urho3D/Scene/Node.h>
+
+using namespace Urho3D;
+
+// ----------------------------------------------------------------------------
+bool UpdateRateTimer::Tick(unsigned interval)
+{
+    if(interval == 0)
+        interval = 1;
+
+    // The interval may have shrunk since the last update
+    if(countdown_ >= interval)
+        countdown_ = phase_ % interval;
+
+    if(isValid_ && countdown_ > 0)
+    {
+        --countdown_;
+        return false;
+    }
+
+    // The first refresh happens immediately. Offsetting the following ones
+    // by the phase is what spreads the entities across ticks.
+    countdown_ = isValid_ ? interval - 1 : phase_ % interval;
+    isValid_ = true;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+UpdateRateScheduler::UpdateRateScheduler() :
+    nearDistance_(20.0f),
+    farDistance_(100.0f),
+    restSpeed_(0.1f),
+    maxInterval_(8),
+    nextPhase_(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+void UpdateRateScheduler::AddObserver(Node* node)
+{
+    for(Vector<WeakPtr<Node> >::ConstIterator it = observers_.Begin(); it != observers_.End(); ++it)
+        if(it->Get() == node)
+            return;
+    observers_.Push(WeakPtr<Node>(node));
+}
+
+// ----------------------------------------------------------------------------
+void UpdateRateScheduler::RemoveObserver(Node* node)
+{
+    for(Vector<WeakPtr<Node> >::Iterator it = observers_.Begin(); it != observers_.End(); ++it)
+        if(it->Get() == node)
+        {
+            observers_.Erase(it);
+            return;
+        }
+}
+
+// ----------------------------------------------------------------------------
+void UpdateRateScheduler::Schedule(UpdateRateTimer* timer)
+{
+    timer->phase_ = nextPhase_++;
+    timer->Invalidate();
+}
+
+// ----------------------------------------------------------------------------
+unsigned UpdateRateScheduler::GetInterval(const Vector3& position, const Vector3& velocity) const
+{
+    if(maxInterval_ <= 1)
+        return 1;
+
+    // Without any observers there is nobody to notice
+    float distanceSquared = M_INFINITY;
+    for(Vector<WeakPtr<Node> >::ConstIterator it = observers_.Begin(); it != observers_.End(); ++it)
+        if(*it)
+            distanceSquared = Min(distanceSquared, ((*it)->GetWorldPosition() - position).LengthSquared());
+
+    // Observers include the player itself, which must never lag behind even
+    // when standing still
+    if(distanceSquared <= nearDistance_ * nearDistance_)
+        return 1;
+    if(velocity.LengthSquared() < restSpeed_ * restSpeed_)
+        return maxInterval_;
+    if(distanceSquared >= farDistance_ * farDistance_)
+        return maxInterval_;
+
+    float t = (Sqrt(distanceSquared) - nearDistance_) / (farDistance_ - nearDistance_);
+    return 1 + (unsigned)(t * (maxInterval_ - 1));
+}
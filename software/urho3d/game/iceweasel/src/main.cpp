@@ -1,7 +1,10 @@
 #include "iceweasel/IceWeasel.h"
 #include "iceweasel/Args.h"
+#include "iceweasel/GravityQueryLog.h"
 #include "iceweasel/InGameEditorApplication.h"
 
+#include <Urho3D/Scene/Scene.h>
+
 #include <stdio.h>
 
 using namespace Urho3D;
@@ -17,8 +20,15 @@ void printHelp(const char* prog_name)
     printf("  -v, --vsync                          = Turn on VSync");
     printf("  -m, --multisample <integer>          = Specify multisample value");
     printf("      --server                         = Run in server mode. Clients can connect.");
+    printf("      --connect                        = Connect to a server right away (see --ip and --port)");
     printf("      --ip                             = Clients can specify which IP address they want to connect to");
     printf("      --port                           = If server: Port to bind to. If client: Port to connect to");
+    printf("      --record-gravity <file>          = Write all gravity queries to a log");
+    printf("      --replay-gravity <file>          = Run the gravity queries of a log and report throughput and differences, then exit");
+    printf("      --record-input <file>            = Write the scene, config and input of all players to a recording");
+    printf("      --replay <file>                  = Run a recording headless as fast as possible, report tick times and state hash differences, then exit");
+    printf("      --load-test <max bots>           = Ramp up the number of bots headless until the tick budget is exceeded, then exit");
+    printf("      --load-test-step <integer>       = Number of bots to add per step of the load test");
 }
 
 int main(int argc, char** argv)
@@ -49,15 +59,45 @@ int main(int argc, char** argv)
                 args->multisample_ = atoi(argv[i + 1]);
         if(strcmp(argv[i], "--server") == 0)
             args->server_ = true;
+        if(strcmp(argv[i], "--connect") == 0)
+            args->connect_ = true;
         if(strcmp(argv[i], "--ip") == 0)
             if(i + 1 < argc)
                 args->networkAddress_ = argv[i + 1];
         if(strcmp(argv[i], "--port") == 0)
             if(i + 1 < argc)
                 args->networkPort_ = atoi(argv[i + 1]);
+        if(strcmp(argv[i], "--record-gravity") == 0)
+            if(i + 1 < argc)
+                args->recordGravityFile_ = argv[i + 1];
+        if(strcmp(argv[i], "--replay-gravity") == 0)
+            if(i + 1 < argc)
+                args->replayGravityFile_ = argv[i + 1];
+        if(strcmp(argv[i], "--record-input") == 0)
+            if(i + 1 < argc)
+                args->recordInputFile_ = argv[i + 1];
+        if(strcmp(argv[i], "--replay") == 0)
+            if(i + 1 < argc)
+                args->replayInputFile_ = argv[i + 1];
+        if(strcmp(argv[i], "--load-test") == 0)
+            if(i + 1 < argc)
+                args->loadTestBots_ = atoi(argv[i + 1]);
+        if(strcmp(argv[i], "--load-test-step") == 0)
+            if(i + 1 < argc)
+                args->loadTestStep_ = atoi(argv[i + 1]);
     }
 
     SharedPtr<Context> context(new Context);
+
+    // The replay doesn't need the engine, only the gravity components
+    if(args->replayGravityFile_.Length() != 0)
+    {
+        RegisterSceneLibrary(context);
+        RegisterIceWeaselMods(context);
+        SharedPtr<GravityQueryReplay> replay(new GravityQueryReplay(context));
+        return replay->Run(args->replayGravityFile_);
+    }
+
     SharedPtr<Application> app;
     if(args->editor_)
         app = new InGameEditorApplication(context, args);
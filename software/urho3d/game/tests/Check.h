@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdio.h>
+
+/*!
+ * @brief Minimal check macros for the headless tests. A failed check prints
+ * its location and lets the test continue, so one run reports every
+ * failure. Return CHECK_RESULT() from main().
+ */
+static int checkFailures = 0;
+
+#define CHECK(condition) do { \
+        if(!(condition)) \
+        { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++checkFailures; \
+        } \
+    } while(0)
+
+#define CHECK_RESULT() (checkFailures == 0 ? 0 : 1)
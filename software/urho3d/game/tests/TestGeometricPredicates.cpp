@@ -0,0 +1,169 @@
+#include "Check.h"
+
+#include "iceweasel/GeometricPredicates.h"
+#include "iceweasel/TetrahedralMeshBuilder.h"
+
+#include <Urho3D/Math/Vector3.h>
+
+#include <cmath>
+
+using namespace Urho3D;
+
+// ----------------------------------------------------------------------------
+static int Sign(double value)
+{
+    return value > 0.0 ? 1 : (value < 0.0 ? -1 : 0);
+}
+
+// ----------------------------------------------------------------------------
+static void TestOrient3D()
+{
+    Vector3 a(0, 0, 0), b(1, 0, 0), c(0, 1, 0);
+
+    // Points on either side of the plane z=0, and swapping two points flips
+    // the sign
+    CHECK(Sign(GeometricPredicates::Orient3D(a, b, c, Vector3(0, 0, -1))) == 1);
+    CHECK(Sign(GeometricPredicates::Orient3D(a, b, c, Vector3(0, 0, 1))) == -1);
+    CHECK(Sign(GeometricPredicates::Orient3D(b, a, c, Vector3(0, 0, -1))) == -1);
+
+    // Exactly coplanar, including points far outside of the triangle
+    CHECK(GeometricPredicates::Orient3D(a, b, c, Vector3(0.25f, 0.75f, 0)) == 0.0);
+    CHECK(GeometricPredicates::Orient3D(a, b, c, Vector3(-1000, 4096, 0)) == 0.0);
+
+    // A tilted plane with large coordinates. Every point is exactly
+    // representable and lies on the plane x+y+z=3072, but the naive
+    // determinant suffers from cancellation.
+    Vector3 p(1024, 1024, 1024), q(2048, 512, 512), r(512, 2048, 512);
+    Vector3 onPlane(512, 512, 2048);
+    CHECK(GeometricPredicates::Orient3D(p, q, r, onPlane) == 0.0);
+
+    // Move the fourth point by one ulp to either side of the plane
+    float z = onPlane.z_;
+    Vector3 above(onPlane.x_, onPlane.y_, std::nextafter(z, 2.0f * z));
+    Vector3 below(onPlane.x_, onPlane.y_, std::nextafter(z, 0.0f));
+    int aboveSign = Sign(GeometricPredicates::Orient3D(p, q, r, above));
+    int belowSign = Sign(GeometricPredicates::Orient3D(p, q, r, below));
+    CHECK(aboveSign != 0);
+    CHECK(belowSign != 0);
+    CHECK(aboveSign == -belowSign);
+
+    // Nearly collinear points close to each other
+    Vector3 s(0.1f, 0.1f, 0.1f), t(0.2f, 0.2f, 0.2f), u(0.3f, 0.3f, 0.3f);
+    CHECK(Sign(GeometricPredicates::Orient3D(s, t, u, Vector3(1, 0, 0))) ==
+         -Sign(GeometricPredicates::Orient3D(t, s, u, Vector3(1, 0, 0))));
+}
+
+// ----------------------------------------------------------------------------
+static void TestInSphere()
+{
+    // Corners of a cube are all cospherical, which is the degenerate case
+    // produced by grid-aligned gravity probes
+    Vector3 a(0, 0, 0), b(1, 0, 0), c(0, 1, 0), d(0, 0, 1);
+    if(GeometricPredicates::Orient3D(a, b, c, d) < 0.0)
+    {
+        b = Vector3(0, 1, 0);
+        c = Vector3(1, 0, 0);
+    }
+    CHECK(GeometricPredicates::Orient3D(a, b, c, d) > 0.0);
+
+    CHECK(GeometricPredicates::InSphere(a, b, c, d, Vector3(1, 1, 0)) == 0.0);
+    CHECK(GeometricPredicates::InSphere(a, b, c, d, Vector3(1, 1, 1)) == 0.0);
+    CHECK(GeometricPredicates::InSphere(a, b, c, d, Vector3(1, 0, 1)) == 0.0);
+
+    CHECK(Sign(GeometricPredicates::InSphere(a, b, c, d, Vector3(0.5f, 0.5f, 0.5f))) == 1);
+    CHECK(Sign(GeometricPredicates::InSphere(a, b, c, d, Vector3(2, 2, 2))) == -1);
+
+    // Reversing the orientation of the tetrahedron reverses the sign
+    CHECK(Sign(GeometricPredicates::InSphere(b, a, c, d, Vector3(0.5f, 0.5f, 0.5f))) == -1);
+
+    // Just inside and just outside of the cube corner (1,1,1)
+    Vector3 inside(1, 1, std::nextafter(1.0f, 0.0f));
+    Vector3 outside(1, 1, std::nextafter(1.0f, 2.0f));
+    CHECK(Sign(GeometricPredicates::InSphere(a, b, c, d, inside)) == 1);
+    CHECK(Sign(GeometricPredicates::InSphere(a, b, c, d, outside)) == -1);
+}
+
+// ----------------------------------------------------------------------------
+static void TestGridTriangulation()
+{
+    // A regular grid is as degenerate as it gets: every cell has eight
+    // cospherical corners. The triangulation must not contain any flat
+    // tetrahedrons and must fill the grid's volume exactly.
+    const int size = 3;
+    GravityVectorSnapshot snapshot;
+    for(int x = 0; x != size; ++x)
+        for(int y = 0; y != size; ++y)
+            for(int z = 0; z != size; ++z)
+                snapshot.Push(Vector3(x, y, z), Vector3::DOWN, 1.0f);
+
+    TetrahedralMeshBuilder builder;
+    builder.Build(snapshot);
+
+    const TetrahedralMeshBuilder::CircumscribedTetrahedralMesh& mesh = builder.GetTetrahedralMesh();
+    CHECK(mesh.Size() > 0);
+
+    double volume = 0.0;
+    for(unsigned i = 0; i != mesh.Size(); ++i)
+    {
+        const TetrahedralMeshBuilder::CircumscribedTetrahedron* t = mesh[i];
+        double orientation = GeometricPredicates::Orient3D(
+            t->v_[0]->position_, t->v_[1]->position_, t->v_[2]->position_, t->v_[3]->position_);
+        CHECK(orientation != 0.0);
+        volume += orientation > 0.0 ? orientation : -orientation;
+    }
+
+    // Orient3D is six times the volume
+    double expected = 6.0 * (size - 1) * (size - 1) * (size - 1);
+    CHECK(volume > expected - 1e-6 && volume < expected + 1e-6);
+    CHECK(builder.GetSkippedCount() == 0);
+
+    // Neighbours must link back, and share the face opposite to the vertex
+    unsigned hullFaceCount = 0;
+    for(unsigned i = 0; i != mesh.Size(); ++i)
+    {
+        const TetrahedralMeshBuilder::CircumscribedTetrahedron* t = mesh[i];
+        for(unsigned f = 0; f != 4; ++f)
+        {
+            const TetrahedralMeshBuilder::CircumscribedTetrahedron* neighbour = t->neighbours_[f];
+            if(neighbour == NULL)
+            {
+                ++hullFaceCount;
+                continue;
+            }
+
+            unsigned backLinks = 0;
+            for(unsigned g = 0; g != 4; ++g)
+                if(neighbour->neighbours_[g] == t)
+                    ++backLinks;
+            CHECK(backLinks == 1);
+
+            unsigned sharedVertices = 0;
+            for(unsigned a = 0; a != 4; ++a)
+                for(unsigned b = 0; b != 4; ++b)
+                    if(a != f && t->v_[a] == neighbour->v_[b])
+                        ++sharedVertices;
+            CHECK(sharedVertices == 3);
+        }
+    }
+
+    // Each face of the grid's cube is split into two triangles per cell
+    CHECK(hullFaceCount == 6 * 2 * (size - 1) * (size - 1));
+
+    // A probe on top of another one can't be connected to the mesh
+    unsigned tetrahedronCount = mesh.Size();
+    snapshot.Push(Vector3(1, 1, 1), Vector3::UP, 1.0f);
+    builder.Build(snapshot);
+    CHECK(builder.GetSkippedCount() == 1);
+    CHECK(builder.GetVertices().Size() == snapshot.Size());
+    CHECK(builder.GetTetrahedralMesh().Size() == tetrahedronCount);
+}
+
+// ----------------------------------------------------------------------------
+int main()
+{
+    TestOrient3D();
+    TestInSphere();
+    TestGridTriangulation();
+
+    return CHECK_RESULT();
+}
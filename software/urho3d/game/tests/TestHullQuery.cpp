@@ -0,0 +1,93 @@
+#include "Check.h"
+
+#include "iceweasel/TetrahedralMeshBuilder.h"
+#include "iceweasel/TetrahedralMesh_Hull.h"
+#include "iceweasel/TetrahedralMesh_Vertex.h"
+
+#include <Urho3D/Math/Quaternion.h>
+#include <Urho3D/Math/Random.h>
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+using namespace TetrahedralMesh;
+
+// ----------------------------------------------------------------------------
+static Vector3 RandomPosition(float range)
+{
+    return Vector3(Random(-range, range), Random(-range, range), Random(-range, range));
+}
+
+// ----------------------------------------------------------------------------
+/*!
+ * @brief Queries random positions around the hull and checks them against a
+ * hull that was built from the same mesh but never sampled. Its const query
+ * always searches every feature.
+ */
+static void CompareWithFullSearch(Hull* sampled, Polyhedron* hullMesh, unsigned* featureCounts)
+{
+    Hull reference(hullMesh);
+
+    for(unsigned i = 0; i != 20000; ++i)
+    {
+        // Points at all distances outside of the hull, including points just
+        // outside of it where the direction map cells are the smallest
+        Vector3 position = RandomPosition(1.0f).Normalized() * Random(6.0f, 60.0f);
+
+        Vector3 gravity, expectedGravity, expectedIntersection;
+        Hull::Feature expectedFeature;
+        bool found = sampled->Query(&gravity, position);
+        bool expectedFound = reference.Query(&expectedGravity, position, &expectedFeature, &expectedIntersection);
+
+        CHECK(found == expectedFound);
+        if(!found || !expectedFound)
+            continue;
+
+        Vector3 intersection;
+        Hull::Feature feature;
+        sampled->Query(NULL, position, &feature, &intersection);
+        CHECK(feature == sampled->GetLastFeature());
+
+        // On the boundary between two features both of them give the same
+        // projection, so compare the results instead of the feature
+        CHECK((intersection - expectedIntersection).Length() < 1e-3f);
+        CHECK((gravity - expectedGravity).Length() < 1e-3f);
+        ++featureCounts[expectedFeature];
+    }
+}
+
+// ----------------------------------------------------------------------------
+int main()
+{
+    // Random probes, so the hull has faces, edges and vertices of all sizes
+    SetRandomSeed(1);
+    GravityVectorSnapshot snapshot;
+    for(unsigned i = 0; i != 60; ++i)
+        snapshot.Push(RandomPosition(10.0f), RandomPosition(1.0f).Normalized(), Random(0.5f, 2.0f));
+
+    TetrahedralMeshBuilder builder;
+    builder.Build(snapshot);
+
+    unsigned featureCounts[4] = {0, 0, 0, 0};
+    Hull sampled(builder.GetHullMesh());
+    CompareWithFullSearch(&sampled, builder.GetHullMesh(), featureCounts);
+
+    // Make sure the test actually covered every kind of feature
+    CHECK(featureCounts[Hull::FEATURE_FACE] > 0);
+    CHECK(featureCounts[Hull::FEATURE_EDGE] > 0);
+    CHECK(featureCounts[Hull::FEATURE_VERTEX] > 0);
+
+    // Rotate the probes a little, like a rotating space station would, and
+    // update the sampled hull in place
+    Quaternion rotation(10.0f, Vector3(1, 2, 3).Normalized());
+    PODVector<Vertex*> movedVertices;
+    const Vector<SharedPtr<Vertex> >& vertices = builder.GetVertices();
+    for(unsigned i = 0; i != vertices.Size(); ++i)
+    {
+        vertices[i]->position_ = rotation * vertices[i]->position_ + Vector3(0.5f, 0.0f, 0.0f);
+        movedVertices.Push(vertices[i]);
+    }
+    sampled.UpdateVertices(movedVertices);
+    CompareWithFullSearch(&sampled, builder.GetHullMesh(), featureCounts);
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,189 @@
+#include "Check.h"
+
+#include "iceweasel/InputCommand.h"
+
+using namespace Urho3D;
+
+// ----------------------------------------------------------------------------
+static InputCommand MakeCommand(unsigned frame, float time, unsigned char buttons, unsigned char pressed)
+{
+    InputCommand command;
+    command.frame_ = frame;
+    command.time_ = time;
+    command.timeStep_ = 0.01f;
+    command.buttons_ = buttons;
+    command.pressed_ = pressed;
+    return command;
+}
+
+// ----------------------------------------------------------------------------
+/*!
+ * @brief Several frames per tick. Each tick consumes the frames sampled
+ * before it ended, in order, and leaves the rest queued.
+ */
+static void ConsumeUpToTickEnd()
+{
+    InputCommandBuffer buffer;
+    buffer.Push(MakeCommand(1, 0.01f, InputCommand::FORWARD, InputCommand::FORWARD));
+    buffer.Push(MakeCommand(2, 0.02f, InputCommand::FORWARD, InputCommand::JUMP));
+    buffer.Push(MakeCommand(3, 0.03f, InputCommand::LEFT, InputCommand::LEFT));
+
+    const InputCommand& first = buffer.Consume(0.025f);
+    CHECK(first.frame_ == 2);
+    CHECK(first.buttons_ == InputCommand::FORWARD);
+    CHECK(first.pressed_ == (InputCommand::FORWARD | InputCommand::JUMP));
+    CHECK(first.sequence_ == 1);
+    CHECK(buffer.GetSize() == 1);
+
+    // Commands sampled exactly at the end of the tick belong to it
+    const InputCommand& second = buffer.Consume(0.03f);
+    CHECK(second.frame_ == 3);
+    CHECK(second.buttons_ == InputCommand::LEFT);
+    CHECK(second.pressed_ == InputCommand::LEFT);
+    CHECK(second.sequence_ == 2);
+    CHECK(buffer.IsEmpty());
+}
+
+// ----------------------------------------------------------------------------
+/*!
+ * @brief Several ticks per frame. Ticks before the next command repeat the
+ * held buttons without presses.
+ */
+static void RepeatUntilNextCommand()
+{
+    InputCommandBuffer buffer;
+    buffer.Push(MakeCommand(1, 0.05f, InputCommand::RUN, InputCommand::JUMP));
+    buffer.Push(MakeCommand(2, 0.1f, InputCommand::BACK, 0));
+
+    const InputCommand& first = buffer.Consume(0.06f);
+    CHECK(first.frame_ == 1);
+    CHECK(first.pressed_ == InputCommand::JUMP);
+
+    const InputCommand& second = buffer.Consume(0.07f);
+    CHECK(second.frame_ == 1);
+    CHECK(second.buttons_ == InputCommand::RUN);
+    CHECK(second.pressed_ == 0);
+    CHECK(second.sequence_ == 2);
+    CHECK(buffer.GetSize() == 1);
+
+    const InputCommand& third = buffer.Consume(0.1f);
+    CHECK(third.frame_ == 2);
+    CHECK(third.buttons_ == InputCommand::BACK);
+    CHECK(third.sequence_ == 3);
+    CHECK(buffer.IsEmpty());
+}
+
+// ----------------------------------------------------------------------------
+/*!
+ * @brief A full buffer drops its oldest command, but not the buttons that
+ * were pressed on it.
+ */
+static void CarryPressesOnOverflow()
+{
+    InputCommandBuffer buffer(2);
+    buffer.Push(MakeCommand(1, 0.01f, 0, InputCommand::JUMP));
+    buffer.Push(MakeCommand(2, 0.02f, 0, 0));
+    buffer.Push(MakeCommand(3, 0.03f, 0, InputCommand::CROUCH));
+    CHECK(buffer.GetSize() == 2);
+
+    InputCommand command;
+    CHECK(buffer.Pop(&command));
+    CHECK(command.frame_ == 2);
+    CHECK(command.pressed_ == InputCommand::JUMP);
+    CHECK(buffer.Pop(&command));
+    CHECK(command.frame_ == 3);
+    CHECK(command.pressed_ == InputCommand::CROUCH);
+    CHECK(buffer.Pop(&command) == false);
+
+    // With a capacity of one, the press moves to the command replacing it
+    InputCommandBuffer single(1);
+    single.Push(MakeCommand(1, 0.01f, 0, InputCommand::JUMP));
+    single.Push(MakeCommand(2, 0.02f, 0, 0));
+    CHECK(single.GetSize() == 1);
+    const InputCommand& consumed = single.Consume(0.02f);
+    CHECK(consumed.frame_ == 2);
+    CHECK(consumed.pressed_ == InputCommand::JUMP);
+}
+
+// ----------------------------------------------------------------------------
+/*!
+ * @brief Remote commands are consumed one per tick. Running dry repeats the
+ * last command without presses, and counts how often it was repeated.
+ */
+static void ConsumeNextInOrder()
+{
+    InputCommandBuffer buffer;
+    for(unsigned i = 1; i != 4; ++i)
+    {
+        InputCommand command = MakeCommand(i, 0.0f, InputCommand::FORWARD, InputCommand::JUMP);
+        command.sequence_ = i;
+        buffer.Push(command);
+    }
+
+    for(unsigned i = 1; i != 4; ++i)
+    {
+        CHECK(buffer.ConsumeNext().sequence_ == i);
+        CHECK(buffer.GetRepeatCount() == 0);
+    }
+
+    const InputCommand& repeated = buffer.ConsumeNext();
+    CHECK(repeated.frame_ == 3);
+    CHECK(repeated.sequence_ == 3);
+    CHECK(repeated.buttons_ == InputCommand::FORWARD);
+    CHECK(repeated.pressed_ == 0);
+    buffer.ConsumeNext();
+    CHECK(buffer.GetRepeatCount() == 2);
+
+    // The next command ends the repetition
+    InputCommand command = MakeCommand(4, 0.0f, 0, 0);
+    command.sequence_ = 4;
+    buffer.Push(command);
+    CHECK(buffer.ConsumeNext().sequence_ == 4);
+    CHECK(buffer.GetRepeatCount() == 0);
+}
+
+// ----------------------------------------------------------------------------
+/*!
+ * @brief Commands are stamped with the start of their frame (see
+ * MovementController::Update()), so the first tick of a frame consumes that
+ * frame's command, whatever is left over from the previous frame.
+ */
+static void ConsumeInFirstTickOfFrame()
+{
+    const float tickStep = 0.02f;
+    const float frameSteps[] = {0.05f, 0.015f, 0.03f, 0.025f, 0.04f};
+
+    InputCommandBuffer buffer;
+    float elapsed = 0.0f;
+    float timeSinceTick = 0.0f;
+    for(unsigned frame = 0; frame != sizeof(frameSteps) / sizeof(*frameSteps); ++frame)
+    {
+        float frameStep = frameSteps[frame];
+        elapsed += frameStep;
+        buffer.Push(MakeCommand(frame + 1, elapsed - frameStep, 0, 0));
+
+        // Same as MovementSystem::HandlePhysicsPreStep()
+        timeSinceTick += frameStep;
+        bool isFirstTick = true;
+        for(; timeSinceTick >= tickStep; timeSinceTick -= tickStep)
+        {
+            float tickEndTime = elapsed - timeSinceTick + tickStep;
+            const InputCommand& command = buffer.Consume(tickEndTime);
+            if(isFirstTick)
+                CHECK(command.frame_ == frame + 1);
+            isFirstTick = false;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+int main()
+{
+    ConsumeUpToTickEnd();
+    RepeatUntilNextCommand();
+    CarryPressesOnOverflow();
+    ConsumeNextInOrder();
+    ConsumeInFirstTickOfFrame();
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,160 @@
+#include "Check.h"
+
+#include "iceweasel/TetrahedralMeshBuilder.h"
+#include "iceweasel/TetrahedralMesh_Mesh.h"
+#include "iceweasel/TetrahedralMesh_Tetrahedron.h"
+#include "iceweasel/TetrahedralMesh_Vertex.h"
+
+#include <Urho3D/Math/Quaternion.h>
+#include <Urho3D/Math/Random.h>
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+using namespace TetrahedralMesh;
+
+// ----------------------------------------------------------------------------
+static Vector3 RandomPosition(float range)
+{
+    return Vector3(Random(-range, range), Random(-range, range), Random(-range, range));
+}
+
+// ----------------------------------------------------------------------------
+/*!
+ * @brief Locates random points, starting the walk from random tetrahedrons,
+ * and checks the result against testing every tetrahedron.
+ */
+static void CompareWithLinearSearch(const Mesh& mesh,
+                                    const TetrahedralMeshBuilder::CircumscribedTetrahedralMesh& sharedVertexMesh,
+                                    float range)
+{
+    CHECK(mesh.GetTetrahedronCount() == sharedVertexMesh.Size());
+
+    // The mesh keeps the order of the builder's tetrahedrons. These are
+    // created from the current vertex positions.
+    Vector<Tetrahedron> tetrahedrons;
+    for(unsigned i = 0; i != sharedVertexMesh.Size(); ++i)
+    {
+        const TetrahedralMeshBuilder::CircumscribedTetrahedron* t = sharedVertexMesh[i];
+        tetrahedrons.Push(Tetrahedron(t->v_[0], t->v_[1], t->v_[2], t->v_[3]));
+    }
+
+    unsigned insideCount = 0, outsideCount = 0;
+    for(unsigned i = 0; i != 20000; ++i)
+    {
+        // Query a larger volume than the mesh covers, so many points are
+        // outside of it
+        Vector3 position = RandomPosition(range * 1.5f);
+
+        bool expectInside = false;
+        for(unsigned j = 0; j != tetrahedrons.Size(); ++j)
+            if(tetrahedrons[j].PointLiesInside(tetrahedrons[j].TransformToBarycentric(position)))
+            {
+                expectInside = true;
+                break;
+            }
+
+        unsigned hint = (unsigned)Random((float)tetrahedrons.Size());
+        unsigned visited;
+        unsigned found = mesh.Locate(position, hint, &visited);
+        CHECK((found != M_MAX_UNSIGNED) == expectInside);
+        if(found != M_MAX_UNSIGNED && found < tetrahedrons.Size())
+            CHECK(tetrahedrons[found].PointLiesInside(tetrahedrons[found].TransformToBarycentric(position)));
+
+        // In a convex mesh, points outside must be rejected by the walk alone
+        if(mesh.IsConvex())
+            CHECK(visited <= tetrahedrons.Size());
+
+        // Starting from the previous result must give the same answer
+        Vector3 gravity;
+        unsigned queryHint = found == M_MAX_UNSIGNED ? hint : found;
+        CHECK(mesh.Query(&gravity, position, &queryHint) == expectInside);
+        if(expectInside)
+            CHECK(queryHint == found);
+
+        if(expectInside)
+            ++insideCount;
+        else
+            ++outsideCount;
+    }
+
+    CHECK(insideCount > 0);
+    CHECK(outsideCount > 0);
+}
+
+// ----------------------------------------------------------------------------
+static void CompareWithLinearSearch(const GravityVectorSnapshot& snapshot, float range)
+{
+    TetrahedralMeshBuilder builder;
+    builder.Build(snapshot);
+    Mesh mesh(builder.GetTetrahedralMesh());
+    CompareWithLinearSearch(mesh, builder.GetTetrahedralMesh(), range);
+}
+
+// ----------------------------------------------------------------------------
+/*!
+ * @brief Moves vertices in place (see Mesh::UpdateVertices()) and checks
+ * that the walk still agrees with the linear search.
+ * @param[in] dent Index of a vertex on a hull face that is pushed inwards,
+ * which makes the hull concave.
+ */
+static void CompareMovedWithLinearSearch(const GravityVectorSnapshot& snapshot,
+                                         float range,
+                                         unsigned dent,
+                                         const Vector3& offset)
+{
+    TetrahedralMeshBuilder builder;
+    builder.Build(snapshot);
+    Mesh mesh(builder.GetTetrahedralMesh());
+    CHECK(mesh.IsConvex());
+
+    const Vector<SharedPtr<Vertex> >& vertices = builder.GetVertices();
+
+    // Rotating everything together keeps the mesh convex
+    Quaternion rotation(30.0f, Vector3(1.0f, 2.0f, 3.0f).Normalized());
+    PODVector<Vertex*> moved;
+    for(unsigned i = 0; i != vertices.Size(); ++i)
+    {
+        vertices[i]->position_ = rotation * vertices[i]->position_;
+        moved.Push(vertices[i]);
+    }
+    CHECK(mesh.UpdateVertices(moved));
+    CHECK(mesh.IsConvex());
+    CompareWithLinearSearch(mesh, builder.GetTetrahedralMesh(), range);
+
+    // Pushing a single vertex on a hull face inwards doesn't invert anything,
+    // but leaves a dent a walk can leave the mesh through. The mesh asks to
+    // be rebuilt, but must remain usable until it is.
+    moved.Clear();
+    vertices[dent]->position_ += rotation * offset;
+    moved.Push(vertices[dent]);
+    CHECK(mesh.UpdateVertices(moved) == false);
+    CHECK(mesh.IsConvex() == false);
+    CompareWithLinearSearch(mesh, builder.GetTetrahedralMesh(), range);
+}
+
+// ----------------------------------------------------------------------------
+int main()
+{
+    SetRandomSeed(1);
+
+    // Random probes
+    GravityVectorSnapshot snapshot;
+    for(unsigned i = 0; i != 100; ++i)
+        snapshot.Push(RandomPosition(10.0f), Vector3::DOWN, 1.0f);
+    CompareWithLinearSearch(snapshot, 10.0f);
+
+    // Grid-aligned probes, where many tetrahedrons have coplanar faces on
+    // the hull
+    snapshot.Clear();
+    for(int x = -2; x <= 2; ++x)
+        for(int y = -2; y <= 2; ++y)
+            for(int z = -2; z <= 2; ++z)
+                snapshot.Push(Vector3(x, y, z) * 5.0f, Vector3::DOWN, 1.0f);
+    CompareWithLinearSearch(snapshot, 10.0f);
+
+    // The probe in the middle of the -Z face of the grid
+    unsigned faceCentre = (2 * 5 + 2) * 5 + 0;
+    CompareMovedWithLinearSearch(snapshot, 10.0f, faceCentre, Vector3(0.0f, 0.0f, 2.0f));
+
+    return CHECK_RESULT();
+}